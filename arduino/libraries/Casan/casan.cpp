@@ -50,8 +50,8 @@ Casan::Casan (l2net *l2, int mtu, long int slaveid)
     l2_ = l2 ;
     slaveid_ = slaveid ;
 
-    curtime = 0 ;			// global variable
-    sync_time (curtime) ;
+    curtime_ = 0 ;
+    sync_time (curtime_) ;
 
     defmtu_ = l2->mtu () ;		// get default L2 MTU
     if (mtu > 0 && mtu < defmtu_)
@@ -517,8 +517,9 @@ void Casan::loop ()
     int mtu ;				// mtu announced by master in assoc msg
 
     oldstatus = status_ ;		// keep old value for debug display
-    sync_time (curtime) ;		// get current time
-    retrans_.loop (*l2_, curtime) ;	// check needed retransmissions
+    sync_time (curtime_) ;		// get current time
+    curtime = curtime_ ;		// global variable, for applications
+    retrans_.loop (*l2_, curtime_) ;	// check needed retransmissions
 
     srcaddr = NULL ;
 
@@ -530,7 +531,7 @@ void Casan::loop ()
     {
 	case SL_COLDSTART :
 	    send_discover (out) ;
-	    twait_.init (curtime) ;
+	    twait_.init (curtime_) ;
 	    status_ = SL_WAITING_UNKNOWN ;
 	    break ;
 
@@ -545,7 +546,7 @@ void Casan::loop ()
 		    {
 			DBGLN1 (F ("Received a CTL HELLO msg")) ;
 			change_master (hlid, -1) ;	// don't change mtu
-			twait_.init (curtime) ;
+			twait_.init (curtime_) ;
 			status_ = SL_WAITING_KNOWN ;
 		    }
 		    else if (is_assoc (in, sttl_, mtu))
@@ -553,14 +554,14 @@ void Casan::loop ()
 			DBGLN1 (F ("Received a CTL ASSOC msg")) ;
 			change_master (-1, mtu) ;	// "unknown" hlid
 			send_assoc_answer (in, out) ;
-			trenew_.init (curtime, sttl_) ;
+			trenew_.init (curtime_, sttl_) ;
 			status_ = SL_RUNNING ;
 		    }
 		    else DBGLN1 (F (RED ("Unkwnon CTL"))) ;
 		}
 	    }
 
-	    if (status_ == SL_WAITING_UNKNOWN && twait_.next (curtime))
+	    if (status_ == SL_WAITING_UNKNOWN && twait_.next (curtime_))
 		send_discover (out) ;
 
 	    break ;
@@ -582,7 +583,7 @@ void Casan::loop ()
 			DBGLN1 (F ("Received a CTL ASSOC msg")) ;
 			change_master (-1, mtu) ;	// unknown hlid
 			send_assoc_answer (in, out) ;
-			trenew_.init (curtime, sttl_) ;
+			trenew_.init (curtime_, sttl_) ;
 			status_ = SL_RUNNING ;
 		    }
 		    else DBGLN1 (F (RED ("Unkwnon CTL"))) ;
@@ -591,14 +592,14 @@ void Casan::loop ()
 
 	    if (status_ == SL_WAITING_KNOWN)
 	    {
-		if (twait_.expired (curtime))
+		if (twait_.expired (curtime_))
 		{
 		    reset_master () ;		// master_ is no longer known
 		    send_discover (out) ;
-		    twait_.init (curtime) ;	// reset timer
+		    twait_.init (curtime_) ;	// reset timer
 		    status_ = SL_WAITING_UNKNOWN ;
 		}
-		else if (twait_.next (curtime))
+		else if (twait_.next (curtime_))
 		{
 		    send_discover (out) ;
 		}
@@ -624,7 +625,7 @@ void Casan::loop ()
 			    change_master (hlid, 0) ;	// reset mtu
 			    if (oldhlid != -1)
 			    {
-				twait_.init (curtime) ;
+				twait_.init (curtime_) ;
 				status_ = SL_WAITING_KNOWN ;
 			    }
 			}
@@ -636,7 +637,7 @@ void Casan::loop ()
 			{
 			    negociate_mtu (mtu) ;
 			    send_assoc_answer (in, out) ;
-			    trenew_.init (curtime, sttl_) ;
+			    trenew_.init (curtime_, sttl_) ;
 			    status_ = SL_RUNNING ;
 			}
 		    }
@@ -663,22 +664,22 @@ void Casan::loop ()
 
 	    check_observed_resources (out) ;
 
-	    if (status_ == SL_RUNNING && trenew_.renew (curtime))
+	    if (status_ == SL_RUNNING && trenew_.renew (curtime_))
 	    {
 		send_discover (out) ;
 		status_ = SL_RENEW ;
 	    }
 
-	    if (status_ == SL_RENEW && trenew_.next (curtime))
+	    if (status_ == SL_RENEW && trenew_.next (curtime_))
 	    {
 		send_discover (out) ;
 	    }
 
-	    if (status_ == SL_RENEW && trenew_.expired (curtime))
+	    if (status_ == SL_RENEW && trenew_.expired (curtime_))
 	    {
 		reset_master () ;	// master_ is no longer known
 		send_discover (out) ;
-		twait_.init (curtime) ;	// reset timer
+		twait_.init (curtime_) ;	// reset timer
 		status_ = SL_WAITING_UNKNOWN ;
 	    }
 
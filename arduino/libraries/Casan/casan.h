@@ -68,6 +68,7 @@ class Casan {
 
 	// private methods which are made public for test programs
 	void process_request (Msg &in, Msg &out) ;
+	bool associated (void)	{ return status_ == SL_RUNNING || status_ == SL_RENEW ; }
 
     private:
 	enum slave_status {
@@ -130,7 +130,7 @@ class Msg {
 
 	l2net   *l2_ ;
 	uint8_t *encoded_ ;	// encoded message to send
-	uint16_t enclen_ ;	// real size of msg (encoded_ may be larger)
+	size_t enclen_ ;	// real size of msg (encoded_ may be larger)
 
 	uint8_t  type_ ;
 	uint8_t  code_ ;
@@ -0,0 +1,80 @@
+/**
+ * @file Arduino.h
+ * @brief Host (Linux) emulation of the Arduino core
+ *
+ * This file replaces the Arduino core when the CASAN slave library
+ * is compiled on a host, such that unmodified slave code can run in
+ * an ordinary process (see ../README.md). Only what the
+ * Casan library and simple sketches use is provided:
+ * - `millis`, which returns the clock of the current slave (see
+ *	host_millis): a process may run many slaves, each on its own
+ *	simulated clock
+ * - `Serial` (print, println), written on the standard output
+ * - the `F` macro, `byte` and `HEX`/`DEC`
+ */
+
+#ifndef	ARDUINO_H
+#define	ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * The Casan library defines its own time_t (64 bit milliseconds, see
+ * time.h in the Casan library), which conflicts with the C library
+ * one. All C headers needed are included above, so that the Casan
+ * type can be renamed without hurting them. C++ headers must be
+ * included before this file.
+ */
+
+#define	time_t		casan_time_t
+
+#define	HEX		16
+#define	DEC		10
+
+#define	F(s)		(s)
+
+typedef uint8_t byte ;
+
+/**
+ * @brief Clock of the current slave (ms)
+ *
+ * This variable is set by the host program before it runs a slave
+ * (i.e. before it calls the `Casan::loop` method of this slave).
+ */
+
+extern unsigned long int host_millis ;
+
+inline unsigned long int millis (void)
+{
+    return host_millis ;
+}
+
+/**
+ * @brief Serial line emulation (on the standard output)
+ */
+
+class HostSerial
+{
+    public:
+	void begin (long int)			{}
+	void print (const char *s)		{ fputs (s, stdout) ; }
+	void print (char c)			{ putchar (c) ; }
+	void print (long int n, int base = DEC) ;
+	void print (unsigned long int n, int base = DEC) ;
+	void print (int n, int base = DEC)	{ print ((long int) n, base) ; }
+	void print (unsigned int n, int base = DEC) { print ((unsigned long int) n, base) ; }
+	void print (uint8_t n, int base = DEC)	{ print ((unsigned long int) n, base) ; }
+	void println (void)			{ putchar ('\n') ; }
+	template <typename T> void println (T x) { print (x) ; println () ; }
+} ;
+
+extern HostSerial Serial ;
+
+#endif
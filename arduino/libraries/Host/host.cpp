@@ -0,0 +1,25 @@
+/**
+ * @file host.cpp
+ * @brief Host (Linux) emulation of the Arduino core
+ */
+
+#include "Arduino.h"
+
+unsigned long int host_millis ;		// global variable
+
+HostSerial Serial ;			// global variable
+
+void HostSerial::print (long int n, int base)
+{
+    if (n < 0)
+    {
+	putchar ('-') ;
+	n = -n ;
+    }
+    print ((unsigned long int) n, base) ;
+}
+
+void HostSerial::print (unsigned long int n, int base)
+{
+    printf (base == HEX ? "%lX" : "%lu", n) ;
+}
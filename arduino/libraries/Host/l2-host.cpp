@@ -0,0 +1,459 @@
+/**
+ * @file l2-host.cpp
+ * @brief L2addr_host, l2host_link and l2net_host class implementations
+ */
+
+#include <sys/socket.h>
+#include <netpacket/packet.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "l2-host.h"
+
+l2addr_host l2addr_host_broadcast ("ff:ff:ff:ff:ff:ff") ;
+
+// Various fields in Ethernet frame (see L2-eth library)
+#define	ETH_OFFSET_DST_ADDR	0
+#define	ETH_OFFSET_SRC_ADDR	6
+#define	ETH_OFFSET_TYPE		12
+#define	ETH_OFFSET_SIZE		14		// specific to CASAN
+#define	ETH_OFFSET_PAYLOAD	16
+
+#define	ETH_SIZE_HEADER		ETH_OFFSET_PAYLOAD
+#define	ETH_SIZE_FCS		4
+
+#define	COAP_TYPE(b)		(((b) >> 4) & 0x3)
+#define	COAP_CON		0
+
+/******************************************************************************
+ * l2addr_host methods
+ */
+
+// constructor
+l2addr_host::l2addr_host ()
+{
+}
+
+/** Constructor with an address given as a string
+ *
+ * This constructor is used to initialize an address with a
+ * string such as "`01:02:03:04:05:06`".
+ *
+ * @param a address to be parsed
+ */
+
+l2addr_host::l2addr_host (const char *a)
+{
+    int i = 0 ;
+    uint8_t b = 0 ;
+
+    while (*a != '\0' && i < ETH_ADDRLEN)
+    {
+	if (*a == ':')
+	{
+	    addr_ [i++] = b ;
+	    b = 0 ;
+	}
+	else if (isxdigit (*a))
+	{
+	    uint8_t x ;
+	    char c ;
+
+	    c = tolower (*a) ;
+	    x = isdigit (c) ? (c - '0') : (c - 'a' + 10) ;
+	    b = (b << 4) + x ;
+	}
+	else
+	{
+	    for (i = 0 ; i < ETH_ADDRLEN ; i++)
+		addr_ [i] = 0 ;
+	    break ;
+	}
+	a++ ;
+    }
+    if (i < ETH_ADDRLEN)
+	addr_ [i] = b ;
+}
+
+// copy constructor
+l2addr_host::l2addr_host (const l2addr_host &x)
+{
+    memcpy (addr_, x.addr_, ETH_ADDRLEN) ;
+}
+
+// assignment operator
+l2addr_host & l2addr_host::operator= (const l2addr_host &x)
+{
+    if (this != &x)
+	memcpy (addr_, x.addr_, ETH_ADDRLEN) ;
+    return *this ;
+}
+
+bool l2addr_host::operator== (const l2addr &other)
+{
+    l2addr_host *oe = (l2addr_host *) &other ;
+    return memcmp (this->addr_, oe->addr_, ETH_ADDRLEN) == 0 ;
+}
+
+bool l2addr_host::operator!= (const l2addr &other)
+{
+    return ! (*this == other) ;
+}
+
+void l2addr_host::print (void)
+{
+    int i ;
+
+    for (i = 0 ; i < ETH_ADDRLEN ; i++)
+    {
+	if (i > 0)
+	    DBG1 (':') ;
+	DBG2 (addr_ [i], HEX) ;
+    }
+}
+
+/******************************************************************************
+ * l2host_link methods
+ */
+
+l2host_link::l2host_link ()
+{
+    fd_ = -1 ;
+    loss_ = 0 ;
+    nrecv_ = nsent_ = nlost_ = ndup_ = 0 ;
+}
+
+l2host_link::~l2host_link ()
+{
+    if (fd_ != -1)
+	close (fd_) ;
+}
+
+/**
+ * @brief Open the Ethernet interface
+ *
+ * The interface is opened with a packet socket (which needs root
+ * privileges, or the CAP_NET_RAW capability) in promiscuous mode.
+ *
+ * @param iface interface name (e.g. `eth0`)
+ * @param ethtype Ethernet type used for sending and receiving frames
+ * @return true if ok, false if error (see errno)
+ */
+
+bool l2host_link::open (const char *iface, int ethtype)
+{
+    struct sockaddr_ll sll ;
+    struct packet_mreq mr ;
+    int ifindex ;
+
+    ethtype_ = ethtype ;
+    ifindex = if_nametoindex (iface) ;
+    if (ifindex == 0)
+	return false ;
+
+    fd_ = socket (AF_PACKET, SOCK_RAW, htons (ethtype)) ;
+    if (fd_ == -1)
+	return false ;
+
+    memset (&sll, 0, sizeof sll) ;
+    sll.sll_family = AF_PACKET ;
+    sll.sll_protocol = htons (ethtype) ;
+    sll.sll_ifindex = ifindex ;
+    memset (&mr, 0, sizeof mr) ;
+    mr.mr_ifindex = ifindex ;
+    mr.mr_type = PACKET_MR_PROMISC ;
+
+    if (bind (fd_, (struct sockaddr *) &sll, sizeof sll) == -1
+	    || setsockopt (fd_, SOL_PACKET, PACKET_ADD_MEMBERSHIP,
+				&mr, sizeof mr) == -1
+	    || fcntl (fd_, F_SETFL, O_NONBLOCK) == -1)
+    {
+	close (fd_) ;
+	fd_ = -1 ;
+	return false ;
+    }
+
+    return true ;
+}
+
+/**
+ * @brief Receive all frames ready on the interface
+ *
+ * Frames are queued in the network of their destination slave, or
+ * in all networks for broadcast frames. Other frames (including
+ * the ones sent by slaves of this process) are ignored.
+ *
+ * @return number of frames read on the interface
+ */
+
+int l2host_link::dispatch (void)
+{
+    int n = 0 ;
+
+    for (;;)
+    {
+	uint8_t frame [ETH_MTU] ;
+	struct sockaddr_ll sll ;
+	socklen_t sllen = sizeof sll ;
+	ssize_t len ;
+
+	len = recvfrom (fd_, frame, sizeof frame, 0, (struct sockaddr *) &sll, &sllen) ;
+	if (len == -1)
+	    break ;
+	n++ ;
+
+	if (sll.sll_pkttype == PACKET_OUTGOING || len < ETH_SIZE_HEADER)
+	    continue ;
+
+	std::string dst ((char *) frame + ETH_OFFSET_DST_ADDR, ETH_ADDRLEN) ;
+
+	if (memcmp (frame + ETH_OFFSET_DST_ADDR, l2addr_host_broadcast.addr_, ETH_ADDRLEN) == 0)
+	{
+	    for (auto net : nets_)
+		if (! lost ())
+		    net->input (frame, len) ;
+	}
+	else
+	{
+	    auto it = addrs_.find (dst) ;
+
+	    if (it != addrs_.end () && ! lost ())
+		it->second->input (frame, len) ;
+	}
+    }
+
+    return n ;
+}
+
+// send a complete Ethernet frame
+bool l2host_link::send (const uint8_t *frame, size_t len)
+{
+    if (lost ())
+	return true ;			// silently lost on the wire
+    nsent_++ ;
+    return ::send (fd_, frame, len, 0) == (ssize_t) len ;
+}
+
+void l2host_link::attach (l2net_host *n)
+{
+    nets_.push_back (n) ;
+    addrs_ [std::string ((char *) n->myaddr_.addr_, ETH_ADDRLEN)] = n ;
+}
+
+void l2host_link::detach (l2net_host *n)
+{
+    for (auto it = nets_.begin () ; it != nets_.end () ; it++)
+    {
+	if (*it == n)
+	{
+	    nets_.erase (it) ;
+	    break ;
+	}
+    }
+    addrs_.erase (std::string ((char *) n->myaddr_.addr_, ETH_ADDRLEN)) ;
+}
+
+// random frame loss
+bool l2host_link::lost (void)
+{
+    if (loss_ > 0 && random () % 100 < loss_)
+    {
+	nlost_++ ;
+	return true ;
+    }
+    return false ;
+}
+
+/******************************************************************************
+ * l2net_host methods
+ */
+
+l2net_host::l2net_host (void)
+{
+    link_ = NULL ;
+    pktlen_ = 0 ;
+    lastcon_ = -1 ;
+}
+
+l2net_host::~l2net_host ()
+{
+    if (link_ != NULL)
+	link_->detach (this) ;
+}
+
+/**
+ * @brief Start a host slave network
+ *
+ * @param a Our Ethernet address
+ * @param link Ethernet interface (already opened)
+ */
+
+void l2net_host::start (l2addr *a, l2host_link *link)
+{
+    myaddr_ = * (l2addr_host *) a ;
+    mtu_ = ETH_MTU ;
+    link_ = link ;
+    link_->attach (this) ;
+}
+
+/**
+ * @brief Get MAC payload length
+ *
+ * This method returns the current MAC payload length, i.e. MTU without
+ * MAC header and trailer.
+ */
+
+size_t l2net_host::maxpayload (void)
+{
+    return mtu_ - (ETH_SIZE_HEADER + ETH_SIZE_FCS) ; // excl. MAC hdr + CASAN len
+}
+
+/**
+ * @brief Send a packet on the Ethernet network
+ *
+ * The frame is built as with the L2-eth library (with a two byte
+ * length in front of the CASAN payload).
+ *
+ * See the l2net::send method for parameters and return value.
+ */
+
+bool l2net_host::send (l2addr &dest, const uint8_t *data, size_t len)
+{
+    l2addr_host *m = (l2addr_host *) &dest ;
+    uint8_t sbuf [ETH_MTU] ;
+    int ethtype = link_->ethtype_ ;
+
+    if (len + ETH_SIZE_HEADER > mtu_ - ETH_SIZE_FCS)
+	return false ;
+
+    // Standard Ethernet MAC header (14 bytes)
+    memcpy (sbuf + ETH_OFFSET_DST_ADDR, m->addr_, ETH_ADDRLEN) ;
+    memcpy (sbuf + ETH_OFFSET_SRC_ADDR, myaddr_.addr_, ETH_ADDRLEN) ;
+    sbuf [ETH_OFFSET_TYPE   ] = BYTE_HIGH (ethtype) ;
+    sbuf [ETH_OFFSET_TYPE +1] = BYTE_LOW (ethtype) ;
+
+    // CASAN message size (2 bytes)
+    sbuf [ETH_OFFSET_SIZE    ] = BYTE_HIGH (len + 2) ;
+    sbuf [ETH_OFFSET_SIZE + 1] = BYTE_LOW  (len + 2) ;
+
+    // Payload
+    memcpy (sbuf + ETH_OFFSET_PAYLOAD, data, len) ;
+
+    return link_->send (sbuf, len + ETH_SIZE_HEADER) ;
+}
+
+// queue a received frame (called by l2host_link::dispatch)
+void l2net_host::input (const uint8_t *frame, size_t len)
+{
+    link_->nrecv_++ ;
+
+    // a CON request with the same id as the previous one
+    if (len > ETH_OFFSET_PAYLOAD + 4 && COAP_TYPE (frame [ETH_OFFSET_PAYLOAD]) == COAP_CON)
+    {
+	long int id = INT16 (frame [ETH_OFFSET_PAYLOAD + 2], frame [ETH_OFFSET_PAYLOAD + 3]) ;
+
+	if (id == lastcon_)
+	    link_->ndup_++ ;
+	lastcon_ = id ;
+    }
+
+    rxq_.push_back (std::string ((const char *) frame, len)) ;
+}
+
+/**
+ * @brief Receive a packet from the Ethernet network
+ *
+ * This method gets the next frame queued by the shared interface.
+ *
+ * See the `l2net::l2_recv_t` enumeration for return values.
+ */
+
+l2net::l2_recv_t l2net_host::recv (void)
+{
+    l2_recv_t r ;
+
+    if (rxq_.empty ())
+	return RECV_EMPTY ;
+
+    rbuf_.swap (rxq_.front ()) ;
+    rxq_.pop_front () ;
+
+    r = RECV_OK ;
+
+    // Get true packet length (specific length for Ethernet CASAN payload)
+    pktlen_ = INT16 (rbuf_ [ETH_OFFSET_SIZE], rbuf_ [ETH_OFFSET_SIZE+1]) ;
+    pktlen_ -= 2 ;
+    if (pktlen_ + ETH_SIZE_HEADER > rbuf_.size ())
+	r = RECV_TRUNCATED ;
+    else if (rbuf_.size () > mtu_ - ETH_SIZE_FCS)
+	r = RECV_TRUNCATED ;
+
+    // Check Ethernet type
+    if (r == RECV_OK
+	    && ((uint8_t) rbuf_ [ETH_OFFSET_TYPE] != BYTE_HIGH (link_->ethtype_)
+	     || (uint8_t) rbuf_ [ETH_OFFSET_TYPE + 1] != BYTE_LOW (link_->ethtype_)))
+	r = RECV_WRONG_TYPE ;
+
+    return r ;
+}
+
+/**
+ * @brief Returns the broadcast Ethernet address
+ *
+ * @return address of an existing l2addr_host object (do not free it)
+ */
+
+l2addr *l2net_host::bcastaddr (void)
+{
+    return &l2addr_host_broadcast ;
+}
+
+/**
+ * @brief Returns the source address of the received frame
+ *
+ * @return address of a new l2addr_host object (to delete after use)
+ */
+
+l2addr *l2net_host::get_src (void)
+{
+    l2addr_host *a = new l2addr_host ;
+    memcpy (a->addr_, rbuf_.data () + ETH_OFFSET_SRC_ADDR, ETH_ADDRLEN) ;
+    return a ;
+}
+
+/**
+ * @brief Returns the destination address of the received frame
+ *
+ * @return address of a new l2addr_host object (to delete after use)
+ */
+
+l2addr *l2net_host::get_dst (void)
+{
+    l2addr_host *a = new l2addr_host ;
+    memcpy (a->addr_, rbuf_.data () + ETH_OFFSET_DST_ADDR, ETH_ADDRLEN) ;
+    return a ;
+}
+
+/**
+ * @brief Returns the address of the received payload
+ *
+ * @return address inside an existing buffer (do not free it)
+ */
+
+uint8_t *l2net_host::get_payload (int offset)
+{
+    return (uint8_t *) &rbuf_ [0] + ETH_OFFSET_PAYLOAD + offset ;
+}
+
+/**
+ * @brief Returns the payload length
+ *
+ * @return original length
+ */
+
+size_t l2net_host::get_paylen (void)
+{
+    return pktlen_ ;
+}
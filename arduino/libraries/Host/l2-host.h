@@ -0,0 +1,147 @@
+/**
+ * @file l2-host.h
+ * @brief l2addr and l2net specializations for slaves running on a host
+ */
+
+#ifndef L2_HOST_H
+#define	L2_HOST_H
+
+/*
+ * These classes are used to run slaves on a host (Linux), with
+ * Ethernet frames exchanged through a packet socket
+ */
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <map>
+#include <Arduino.h>			// after C++ headers (see time_t)
+#include "l2.h"
+
+/** Ethernet frame type used for CASAN frames */
+#define	ETH_TYPE	0x88b5
+
+/** Ethernet address length */
+#define	ETH_ADDRLEN	6
+
+/** Ethernet MTU (complete MAC frame length, including MAC header and footer) */
+#define	ETH_MTU		1518
+
+class l2net_host ;
+
+/**
+ * @brief Specialization of the l2addr abstract class for host slaves
+ *
+ * Addresses are Ethernet addresses.
+ */
+
+class l2addr_host : public l2addr
+{
+    public:
+	l2addr_host () ;				// constructor
+	l2addr_host (const char *) ;			// constructor
+	l2addr_host (const l2addr_host &) ;		// copy constructor
+	l2addr_host &operator= (const l2addr_host &) ;	// copy assignment
+
+	bool operator== (const l2addr &) ;
+	bool operator!= (const l2addr &) ;
+	void print (void) ;
+
+    protected:
+	uint8_t addr_ [ETH_ADDRLEN] ;
+
+	friend class l2net_host ;
+	friend class l2host_link ;
+} ;
+
+extern l2addr_host l2addr_host_broadcast ;
+
+/**
+ * @brief Ethernet interface shared by all slaves of a process
+ *
+ * Each process running slaves opens the Ethernet interface (a real
+ * one, a TAP or an end of a veth pair) once: received frames are
+ * dispatched to the slave networks (see l2net_host) according to
+ * their destination address, and broadcast frames are given to
+ * all slaves. The interface is in promiscuous mode, since slaves
+ * use their own Ethernet address.
+ *
+ * Frames may be randomly lost (in both directions), in order to
+ * test retransmissions.
+ */
+
+class l2host_link
+{
+    public:
+	l2host_link () ;
+	~l2host_link () ;
+	bool open (const char *iface, int ethtype) ;
+	int fd (void)			{ return fd_ ; }
+	void loss (int percent)		{ loss_ = percent ; }
+	int dispatch (void) ;		// dispatch all received frames
+
+	// statistics
+	unsigned long int nrecv_ ;	// frames given to slaves
+	unsigned long int nsent_ ;	// frames sent by slaves
+	unsigned long int nlost_ ;	// frames lost (both directions)
+	unsigned long int ndup_ ;	// retransmitted CON requests received
+
+    private:
+	friend class l2net_host ;
+
+	bool send (const uint8_t *frame, size_t len) ;
+	void attach (l2net_host *n) ;
+	void detach (l2net_host *n) ;
+	bool lost (void) ;
+
+	int fd_ ;
+	int ethtype_ ;
+	int loss_ ;			// loss probability (%)
+	std::vector <l2net_host *> nets_ ;
+	std::map <std::string, l2net_host *> addrs_ ;
+} ;
+
+/**
+ * @brief Specialization of the l2net abstract class for host slaves
+ *
+ * This class provides real methods (specified in l2net virtual
+ * class) for a slave running on a host. Frames have the format of
+ * the L2-eth library, such that slaves can be associated to a real
+ * CASAN master on an Ethernet network. Received frames are queued
+ * by the shared interface (see l2host_link).
+ */
+
+class l2net_host : public l2net
+{
+    public:
+	l2net_host (void) ;
+	~l2net_host () ;
+	void start (l2addr *myaddr, l2host_link *link) ;
+	size_t maxpayload (void) ;
+	bool send (l2addr &dest, const uint8_t *data, size_t len) ;
+	l2_recv_t recv (void) ;
+
+	l2addr *bcastaddr (void) ;	// return a static variable
+	l2addr *get_src (void) ;	// get a new l2addr_host
+	l2addr *get_dst (void) ;	// get a new l2addr_host
+
+	// Ethernet payload (not including MAC header, of course)
+	uint8_t *get_payload (int offset) ;
+	size_t get_paylen (void) ;	// if truncated pkt: truncated payload
+
+	bool pending (void)		{ return ! rxq_.empty () ; }
+
+    private:
+	friend class l2host_link ;
+
+	void input (const uint8_t *frame, size_t len) ;
+
+	l2addr_host myaddr_ ;		// my MAC address
+	l2host_link *link_ ;
+	std::deque <std::string> rxq_ ;	// received frames
+	std::string rbuf_ ;		// current received frame
+	size_t pktlen_ ;		// real length of received packet
+	long int lastcon_ ;		// id of the last CON request
+} ;
+
+#endif
@@ -0,0 +1,221 @@
+/**
+ * @file swarm.cpp
+ * @brief Swarm of CASAN slaves running on a host
+ *
+ * This program runs many instances of the CASAN slave library (the
+ * same code as the Arduino firmware, compiled for the host with the
+ * Host library), in order to test a real CASAN master (`casand`)
+ * with hundreds of slaves, without any hardware.
+ *
+ * All slaves share an Ethernet interface (see l2host_link). The
+ * master should use the other end of a veth pair:
+ *	ip link add veth0 type veth peer name veth1
+ *	ip link set veth0 up
+ *	ip link set veth1 up
+ * with `veth0` in the master configuration file, and slaves with
+ * ids from the first slave id (1000 by default):
+ *	for i in `seq 1000 1499` ; do echo "slave id $i ttl 600" ; done
+ * and then:
+ *	./swarm veth1 500
+ *
+ * Each slave runs on its own simulated clock (see host_millis):
+ * slaves boot at a random date in the boot window (-b), and their
+ * clock may drift (-d, in ppm, randomly chosen for each slave in
+ * [-drift, +drift]). Frames may be lost (-p, in both directions).
+ * Each slave has a `temp` resource.
+ *
+ * Statistics are displayed each second: number of associated
+ * slaves, frames received and sent, frames lost, and retransmitted
+ * requests received (i.e. retransmissions by the master). At the
+ * end, association times are summarized.
+ *
+ * Usage: swarm [-b <boot window ms>] [-d <drift ppm>] [-f <first slave id>]
+ *		[-m <mtu>] [-p <loss %>] [-t <duration s>] <iface> <nslaves>
+ */
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "casan.h"
+#include "l2-host.h"
+
+#define	DEFAULT_FIRST	1000		// first slave id
+#define	DEFAULT_BOOT	1000		// boot window (ms)
+#define	DEFAULT_TIME	30		// duration (s)
+#define	MAXLOOP		10		// max calls to Casan::loop per round
+
+/*
+ * A slave and its simulated clock
+ */
+
+struct slave
+{
+    l2addr *addr ;
+    l2net_host l2 ;
+    Casan *casan ;
+    long int boot ;			// boot date (ms)
+    double rate ;			// clock rate (drift)
+    long int assoc ;			// first association date (ms), or -1
+    int temp ;
+} ;
+
+std::vector <slave *> slaves ;
+slave *cur ;				// slave currently running
+
+uint8_t process_temp (Msg *in, Msg *out)
+{
+    char payload [10] ;
+
+    (void) in ;
+    snprintf (payload, sizeof payload, "%d", cur->temp) ;
+    out->set_payload ((uint8_t *) payload, strlen (payload)) ;
+
+    return COAP_RETURN_CODE (2, 5) ;
+}
+
+// boot a slave
+void boot (slave *s, long int id, int mtu)
+{
+    Resource *r ;
+
+    host_millis = 0 ;
+    s->casan = new Casan (&s->l2, mtu, id) ;
+    r = new Resource ("temp", "Temperature", "celsius") ;
+    r->handler (COAP_CODE_GET, process_temp) ;
+    s->casan->register_resource (r) ;
+}
+
+void usage (const char *prog)
+{
+    fprintf (stderr, "usage: %s [-b <boot window ms>] [-d <drift ppm>] [-f <first slave id>]\n"
+		"\t\t[-m <mtu>] [-p <loss %%>] [-t <duration s>] <iface> <nslaves>\n",
+		prog) ;
+    exit (1) ;
+}
+
+int main (int argc, char *argv [])
+{
+    l2host_link link ;
+    long int first = DEFAULT_FIRST ;
+    long int bootwin = DEFAULT_BOOT ;
+    long int duration = DEFAULT_TIME ;
+    int drift = 0 ;
+    int mtu = 0 ;
+    int loss = 0 ;
+    int nslaves, nassoc, opt ;
+    long int lastsec ;
+
+    while ((opt = getopt (argc, argv, "b:d:f:m:p:t:")) != -1)
+    {
+	switch (opt)
+	{
+	    case 'b' : bootwin = atol (optarg) ; break ;
+	    case 'd' : drift = atoi (optarg) ; break ;
+	    case 'f' : first = atol (optarg) ; break ;
+	    case 'm' : mtu = atoi (optarg) ; break ;
+	    case 'p' : loss = atoi (optarg) ; break ;
+	    case 't' : duration = atol (optarg) ; break ;
+	    default : usage (argv [0]) ;
+	}
+    }
+    if (optind != argc - 2 || bootwin <= 0)
+	usage (argv [0]) ;
+    nslaves = atoi (argv [optind + 1]) ;
+    if (nslaves <= 0 || nslaves > 65535)
+	usage (argv [0]) ;
+
+    if (! link.open (argv [optind], ETH_TYPE))
+    {
+	perror (argv [optind]) ;
+	exit (1) ;
+    }
+    link.loss (loss) ;
+
+    for (int i = 0 ; i < nslaves ; i++)
+    {
+	slave *s = new slave ;
+	char a [sizeof "02:ca:5a:00:00:00"] ;
+
+	snprintf (a, sizeof a, "02:ca:5a:00:%02x:%02x", BYTE_HIGH (i), BYTE_LOW (i)) ;
+	s->addr = new l2addr_host (a) ;
+	s->l2.start (s->addr, &link) ;
+	s->casan = NULL ;
+	s->boot = random () % bootwin ;
+	s->rate = 1 + (drift > 0 ? (random () % (2 * drift + 1) - drift) / 1e6 : 0) ;
+	s->assoc = -1 ;
+	s->temp = 15 + random () % 10 ;
+	slaves.push_back (s) ;
+    }
+
+    printf ("%d slaves (ids %ld-%ld) on %s, boot window %ld ms, drift %d ppm, loss %d %%\n",
+		nslaves, first, first + nslaves - 1, argv [optind], bootwin, drift, loss) ;
+    printf ("%6s %8s %10s %10s %8s %8s\n", "time", "assoc", "recv", "sent", "lost", "dup") ;
+
+    auto start = std::chrono::steady_clock::now () ;
+    lastsec = 0 ;
+    nassoc = 0 ;
+    for (;;)
+    {
+	struct pollfd pfd ;
+	long int now ;
+
+	pfd.fd = link.fd () ;
+	pfd.events = POLLIN ;
+	(void) poll (&pfd, 1, 1) ;
+	link.dispatch () ;
+
+	now = std::chrono::duration_cast <std::chrono::milliseconds>
+		    (std::chrono::steady_clock::now () - start).count () ;
+
+	for (int i = 0 ; i < nslaves ; i++)
+	{
+	    slave *s = slaves [i] ;
+
+	    if (now < s->boot)
+		continue ;
+	    if (s->casan == NULL)
+		boot (s, first + i, mtu) ;
+
+	    cur = s ;
+	    host_millis = (now - s->boot) * s->rate ;
+	    for (int n = 0 ; n == 0 || (n < MAXLOOP && s->l2.pending ()) ; n++)
+		s->casan->loop () ;
+
+	    if (s->assoc == -1 && s->casan->associated ())
+	    {
+		s->assoc = now - s->boot ;
+		nassoc++ ;
+	    }
+	}
+
+	if (now / 1000 > lastsec)
+	{
+	    lastsec = now / 1000 ;
+	    printf ("%6ld %8d %10lu %10lu %8lu %8lu\n", lastsec, nassoc,
+			link.nrecv_, link.nsent_, link.nlost_, link.ndup_) ;
+	    fflush (stdout) ;
+	    if (lastsec >= duration)
+		break ;
+	}
+    }
+
+    std::vector <long int> t ;
+    for (auto s : slaves)
+	if (s->assoc != -1)
+	    t.push_back (s->assoc) ;
+    std::sort (t.begin (), t.end ()) ;
+
+    printf ("%d/%d slaves associated", (int) t.size (), nslaves) ;
+    if (! t.empty ())
+	printf (", association time (ms): min %ld, p50 %ld, p99 %ld, max %ld",
+		    t [0], t [(t.size () - 1) / 2], t [(t.size () - 1) * 99 / 100],
+		    t [t.size () - 1]) ;
+    printf ("\n") ;
+
+    exit (0) ;
+}
@@ -0,0 +1,243 @@
+/**
+ * @file benchhit.cc
+ * @brief Benchmark of HTTP cache hits
+ *
+ * This program measures the number of cache hits per second that a
+ * single core can serve, from the HTTP request (once parsed) to the
+ * write of the HTTP response, in two ways:
+ * - copy: the CASAN reply is found in the cache, and the HTTP
+ *	response is built from it (option scans, payload copy and
+ *	header formatting) for each request
+ * - rendered: the HTTP response, serialized on the first hit and
+ *	kept in the cache entry, is sent as is (master::http_casan)
+ * In both cases, the response is written with a single writev
+ * (as the asio::async_write call would do) to /dev/null.
+ *
+ * Usage: benchhit [<number of requests>]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <asio.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "global.h"
+
+#include "msg.h"
+#include "option.h"
+#include "resource.h"
+#include "slave.h"
+#include "cache.h"
+
+#include "http/reply.hpp"
+
+#define	DEFAULT_NREQ	1000000
+#define	PAYLOAD		"{\"temp\":21.5,\"unit\":\"C\"}"
+
+int debug_levels = 0 ;
+
+const char *debug_title (int)
+{
+    return "" ;
+}
+
+casan::slave sl ;
+casan::cache ca ;
+int devnull ;
+
+/*
+ * Build a GET request, as master::http_casan does
+ */
+
+casan::msgptr_t mkrequest (void)
+{
+    const char path [] = "temp" ;
+    casan::msgptr_t m (new casan::msg) ;
+
+    m->peer (&sl) ;
+    m->type (casan::msg::MT_CON) ;
+    m->code (casan::msg::MC_GET) ;
+    casan::option o (casan::option::MO_Uri_Path, path, sizeof path - 1) ;
+    m->pushoption (o) ;
+    return m ;
+}
+
+/*
+ * Write the response with a single writev
+ */
+
+void send (http::server2::reply &rep)
+{
+    std::vector <asio::const_buffer> b = rep.to_buffers () ;
+    struct iovec iov [64] ;
+    int n = 0 ;
+
+    for (auto &x : b)
+    {
+	iov [n].iov_base = (void *) asio::buffer_cast <const char *> (x) ;
+	iov [n].iov_len = asio::buffer_size (x) ;
+	n++ ;
+    }
+    if (writev (devnull, iov, n) == -1)
+    {
+	perror ("writev") ;
+	std::exit (1) ;
+    }
+}
+
+void connection_header (http::server2::reply &rep)
+{
+    http::server2::header h ;
+
+    h.name = "Connection" ;
+    h.value = "keep-alive" ;
+    rep.headers.push_back (h) ;
+}
+
+/*
+ * Cache hit, HTTP response built from the CASAN reply
+ */
+
+bool hit_copy (void)
+{
+    casan::msgptr_t m = mkrequest () ;
+    casan::msgptr_t r ;
+    http::server2::reply rep ;
+    int contentformat = 0 ;
+    casan::option *o ;
+    int paylen ;
+    char *payld ;
+
+    r = ca.get (m) ;
+    if (r == nullptr)
+	return false ;
+
+    payld = (char *) r->payload (&paylen) ;
+    o = r->getoption (casan::option::MO_Content_Format) ;
+    if (o != nullptr)
+	contentformat = o->optval () ;
+    o = r->getoption (casan::option::MO_Size1) ;
+    if (o != nullptr)
+	sl.curmtu (o->optval ()) ;
+
+    rep.status = http::server2::reply::ok ;
+    rep.headers.resize (2) ;
+    rep.headers [0].name = "Content-Length" ;
+    rep.headers [1].name = "Content-Type" ;
+    for (int i = 0 ; i < paylen ; i++)
+	rep.content.push_back (payld [i]) ;
+    rep.headers [1].value = contentformat == 50 ? "application/json" : "text/plain" ;
+    rep.headers [0].value = boost::lexical_cast <std::string> (rep.content.size ()) ;
+    connection_header (rep) ;
+    send (rep) ;
+    return true ;
+}
+
+/*
+ * Cache hit, pre-rendered HTTP response
+ */
+
+bool hit_rendered (void)
+{
+    casan::msgptr_t m = mkrequest () ;
+    casan::cache::rendered_t rendered ;
+    http::server2::reply rep ;
+
+    rendered = ca.get_rendered (m,
+	[] (casan::msgptr_t r)
+	{
+	    http::server2::reply tmp ;
+	    const char ct [] = "Content-Type: application/json\r\n" ;
+	    int paylen ;
+	    void *payld = r->payload (&paylen) ;
+
+	    tmp.status = http::server2::reply::ok ;
+	    tmp.header_block = asio::buffer (ct, sizeof ct - 1) ;
+	    tmp.set_content (r, payld, paylen) ;
+	    return tmp.render () ;
+	}) ;
+    if (rendered == nullptr)
+	return false ;
+
+    rep.set_rendered (rendered) ;
+    connection_header (rep) ;
+    send (rep) ;
+    return true ;
+}
+
+void bench (const char *name, std::function <bool (void)> hit, long int nreq)
+{
+    std::chrono::duration <double> dur ;
+
+    auto start = std::chrono::steady_clock::now () ;
+    for (long int i = 0 ; i < nreq ; i++)
+    {
+	if (! hit ())
+	{
+	    std::cerr << name << ": cache miss\n" ;
+	    std::exit (1) ;
+	}
+    }
+    dur = std::chrono::steady_clock::now () - start ;
+
+    std::cout << std::left << std::setw (10) << name << std::right
+		<< std::fixed << std::setprecision (0)
+		<< std::setw (10) << nreq / dur.count () << " hits/s"
+		<< std::setprecision (1)
+		<< std::setw (8) << dur.count () * 1e9 / nreq << " ns/hit\n" ;
+}
+
+int main (int argc, char *argv [])
+{
+    long int nreq = DEFAULT_NREQ ;
+    casan::msgptr_t m, r ;
+
+    if (argc > 2)
+    {
+	std::cerr << "usage: " << argv [0] << " [<number of requests>]\n" ;
+	std::exit (1) ;
+    }
+    if (argc == 2)
+	nreq = std::atol (argv [1]) ;
+
+    devnull = open ("/dev/null", O_WRONLY) ;
+    if (devnull == -1)
+    {
+	perror ("/dev/null") ;
+	std::exit (1) ;
+    }
+
+    /*
+     * Populate the cache with a JSON reply valid for 1 hour
+     */
+
+    m = mkrequest () ;
+    r = casan::msgptr_t (new casan::msg) ;
+    r->type (casan::msg::MT_ACK) ;
+    r->code (COAP_MKCODE (2, 5)) ;
+    casan::option cf (casan::option::MO_Content_Format, 50) ;
+    r->pushoption (cf) ;
+    casan::option ma (casan::option::MO_Max_Age, 3600) ;
+    r->pushoption (ma) ;
+    r->payload ((void *) PAYLOAD, sizeof PAYLOAD - 1) ;
+    casan::msg::link_reqrep (m, r) ;
+    ca.add (m) ;
+    casan::msg::link_reqrep (m, nullptr) ;
+
+    bench ("copy", hit_copy, nreq) ;
+    bench ("rendered", hit_rendered, nreq) ;
+
+    std::cout << ca.html_debug () ;
+    std::exit (0) ;
+}
@@ -0,0 +1,336 @@
+/**
+ * @file benchhttp.cc
+ * @brief HTTP load generator for the CASAN master
+ *
+ * This program measures the number of HTTP requests per second
+ * served by a running `casand`. Each of the `nconn` threads sends
+ * GET requests for the same URL:
+ * - without keep-alive (default): one TCP connection per request,
+ *	with a "Connection: close" header
+ * - with keep-alive (-k): one persistent connection per thread, on
+ *	which requests are sent by batches of `depth` pipelined requests
+ * With -H, every other request is a HEAD request: the reply to a HEAD
+ * has no content, whatever its Content-Length header says, and the
+ * next pipelined reply must follow its headers.
+ *
+ * In order to measure the cached-reply path, use a CASAN resource
+ * with a Max-Age (such as /casan/169/temp): the first request fills
+ * the cache, and all other ones are answered without any CoAP
+ * exchange. Admin pages (such as /admin/cache) can be used to
+ * measure the HTTP server alone.
+ *
+ * Usage: benchhttp [-h][-k][-H][-c nconn][-n nreq][-p depth] host port path
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <atomic>
+
+#include <unistd.h>
+#include <strings.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define	DEFAULT_NCONN	4		// concurrent connections
+#define	DEFAULT_NREQ	10000		// total number of requests
+#define	DEFAULT_DEPTH	1		// pipelined requests
+
+struct params
+{
+    const char *host ;
+    const char *port ;
+    const char *path ;
+    bool keepalive ;
+    bool head ;				// HEAD and GET requests in turn
+    int depth ;
+} ;
+
+std::atomic <long int> nok (0) ;	// successful replies
+std::atomic <long int> nerr (0) ;	// errors
+
+/******************************************************************************
+ * Client
+ */
+
+/*
+ * Open a TCP connection to the server
+ */
+
+int connect_server (const params &p)
+{
+    struct addrinfo hints, *res, *r ;
+    int fd = -1 ;
+
+    std::memset (&hints, 0, sizeof hints) ;
+    hints.ai_family = AF_UNSPEC ;
+    hints.ai_socktype = SOCK_STREAM ;
+    if (getaddrinfo (p.host, p.port, &hints, &res) != 0)
+	return -1 ;
+
+    for (r = res ; r != nullptr ; r = r->ai_next)
+    {
+	fd = socket (r->ai_family, r->ai_socktype, r->ai_protocol) ;
+	if (fd == -1)
+	    continue ;
+	if (connect (fd, r->ai_addr, r->ai_addrlen) == 0)
+	{
+	    int one = 1 ;
+	    (void) setsockopt (fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one) ;
+	    break ;
+	}
+	close (fd) ;
+	fd = -1 ;
+    }
+    freeaddrinfo (res) ;
+    return fd ;
+}
+
+bool send_all (int fd, const std::string &s)
+{
+    std::size_t off = 0 ;
+
+    while (off < s.size ())
+    {
+	ssize_t n = write (fd, s.data () + off, s.size () - off) ;
+	if (n <= 0)
+	    return false ;
+	off += n ;
+    }
+    return true ;
+}
+
+/*
+ * Read one reply from the connection, using `buf` to keep data
+ * received after the reply (next pipelined replies).
+ * The reply must have a Content-Length header, unless the server
+ * closes the connection after it. A reply to HEAD has no content.
+ */
+
+bool read_reply (int fd, std::string &buf, bool head)
+{
+    std::size_t hdrend, clen ;
+    bool haslen = false ;
+    char tmp [8192] ;
+    ssize_t n ;
+
+    while ((hdrend = buf.find ("\r\n\r\n")) == std::string::npos)
+    {
+	n = read (fd, tmp, sizeof tmp) ;
+	if (n <= 0)
+	    return false ;
+	buf.append (tmp, n) ;
+    }
+
+    if (buf.compare (0, 9, "HTTP/1.1 ") != 0 && buf.compare (0, 9, "HTTP/1.0 ") != 0)
+	return false ;
+    if (buf [9] != '2')
+	return false ;
+
+    clen = 0 ;
+    for (std::size_t pos = buf.find ("\r\n") ; pos < hdrend ; )
+    {
+	std::size_t eol = buf.find ("\r\n", pos + 2) ;
+	std::string line = buf.substr (pos + 2, eol - pos - 2) ;
+
+	if (strncasecmp (line.c_str (), "Content-Length:", 15) == 0)
+	{
+	    clen = std::strtoul (line.c_str () + 15, nullptr, 10) ;
+	    haslen = true ;
+	}
+	pos = eol ;
+    }
+    hdrend += 4 ;
+
+    if (head && haslen)
+	buf.erase (0, hdrend) ;
+    else if (haslen)
+    {
+	while (buf.size () < hdrend + clen)
+	{
+	    n = read (fd, tmp, sizeof tmp) ;
+	    if (n <= 0)
+		return false ;
+	    buf.append (tmp, n) ;
+	}
+	buf.erase (0, hdrend + clen) ;
+    }
+    else
+    {
+	while ((n = read (fd, tmp, sizeof tmp)) > 0)
+	    ;
+	buf.clear () ;
+    }
+    return true ;
+}
+
+/*
+ * Client thread: send `nreq` requests
+ */
+
+void client (const params &p, long int nreq)
+{
+    std::string req, hreq, batch, buf ;
+    long int sent = 0 ;			// requests sent, for HEAD/GET turns
+    int fd = -1 ;
+
+    req = std::string (" ") + p.path + " HTTP/1.1\r\n"
+		+ "Host: " + p.host + "\r\n"
+		+ "Connection: " + (p.keepalive ? "keep-alive" : "close")
+		+ "\r\n\r\n" ;
+    hreq = "HEAD" + req ;
+    req = "GET" + req ;
+
+    while (nreq > 0)
+    {
+	int depth = p.keepalive ? p.depth : 1 ;
+
+	if (depth > nreq)
+	    depth = nreq ;
+
+	if (fd == -1)
+	{
+	    fd = connect_server (p) ;
+	    if (fd == -1)
+	    {
+		nerr += nreq ;
+		return ;
+	    }
+	    buf.clear () ;
+	}
+
+	batch.clear () ;
+	for (int i = 0 ; i < depth ; i++)
+	    batch += (p.head && (sent + i) % 2 == 0) ? hreq : req ;
+
+	if (! send_all (fd, batch))
+	{
+	    nerr += depth ;
+	    close (fd) ;
+	    fd = -1 ;
+	    nreq -= depth ;
+	    continue ;
+	}
+
+	for (int i = 0 ; i < depth ; i++)
+	{
+	    if (read_reply (fd, buf, p.head && (sent + i) % 2 == 0))
+		nok++ ;
+	    else
+	    {
+		nerr += depth - i ;
+		close (fd) ;
+		fd = -1 ;
+		break ;
+	    }
+	}
+	nreq -= depth ;
+	sent += depth ;
+
+	if (! p.keepalive && fd != -1)
+	{
+	    close (fd) ;
+	    fd = -1 ;
+	}
+    }
+
+    if (fd != -1)
+	close (fd) ;
+}
+
+/******************************************************************************
+ * Main
+ */
+
+void usage (const char *prog)
+{
+    std::cerr << "usage: " << prog << " [-h][-k][-H][-c nconn][-n nreq][-p depth] host port path\n" ;
+    std::cerr << "\t-k: use persistent connections\n" ;
+    std::cerr << "\t-H: send HEAD and GET requests in turn\n" ;
+    std::cerr << "\t-c: number of concurrent connections (default "
+			<< DEFAULT_NCONN << ")\n" ;
+    std::cerr << "\t-n: total number of requests (default "
+			<< DEFAULT_NREQ << ")\n" ;
+    std::cerr << "\t-p: pipelined requests with -k (default "
+			<< DEFAULT_DEPTH << ")\n" ;
+    std::cerr << "Example: " << prog << " -k -c 8 -p 4 localhost 8004 /casan/169/temp\n" ;
+}
+
+int main (int argc, char *argv [])
+{
+    params p ;
+    int nconn = DEFAULT_NCONN ;
+    long int nreq = DEFAULT_NREQ ;
+    std::vector <std::thread> thr ;
+    std::chrono::duration <double> dur ;
+    int opt ;
+
+    p.keepalive = false ;
+    p.head = false ;
+    p.depth = DEFAULT_DEPTH ;
+
+    while ((opt = getopt (argc, argv, "hkHc:n:p:")) != -1)
+    {
+	switch (opt)
+	{
+	    case 'h' :
+		usage (argv [0]) ;
+		exit (0) ;
+		break ;
+	    case 'k' :
+		p.keepalive = true ;
+		break ;
+	    case 'H' :
+		p.head = true ;
+		break ;
+	    case 'c' :
+		nconn = std::atoi (optarg) ;
+		break ;
+	    case 'n' :
+		nreq = std::atol (optarg) ;
+		break ;
+	    case 'p' :
+		p.depth = std::atoi (optarg) ;
+		break ;
+	    default :
+		usage (argv [0]) ;
+		exit (1) ;
+	}
+    }
+    if (argc - optind != 3 || nconn <= 0 || nreq <= 0 || p.depth <= 0)
+    {
+	usage (argv [0]) ;
+	exit (1) ;
+    }
+    p.host = argv [optind] ;
+    p.port = argv [optind + 1] ;
+    p.path = argv [optind + 2] ;
+
+    auto start = std::chrono::steady_clock::now () ;
+    for (int i = 0 ; i < nconn ; i++)
+    {
+	long int n = nreq / nconn + (i < nreq % nconn ? 1 : 0) ;
+	thr.push_back (std::thread (client, std::cref (p), n)) ;
+    }
+    for (auto &t : thr)
+	t.join () ;
+    dur = std::chrono::steady_clock::now () - start ;
+
+    std::cout << (p.keepalive ? "keep-alive" : "close")
+		<< ", " << nconn << " connection(s)"
+		<< ", depth " << (p.keepalive ? p.depth : 1)
+		<< (p.head ? ", HEAD/GET" : "")
+		<< ": " << nok << " ok, " << nerr << " errors in "
+		<< std::fixed << std::setprecision (3) << dur.count () << " s = "
+		<< std::setprecision (0) << nok / dur.count () << " req/s\n" ;
+
+    exit (nerr == 0 ? 0 : 1) ;
+}
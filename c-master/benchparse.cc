@@ -0,0 +1,247 @@
+/**
+ * @file benchparse.cc
+ * @brief Microbenchmark of the HTTP request parser
+ *
+ * This program measures the time needed by the HTTP request parser
+ * (http::server2::request_parser) to parse typical requests received
+ * by the CASAN master:
+ * - a GET request sent by curl
+ * - a GET request sent by a web browser (more and longer headers)
+ * - a POST request with an url-encoded form (body decoding)
+ * - a batch of pipelined GET requests
+ * Each request is parsed from a single buffer, and then again by
+ * chunks of CHUNK bytes, as if it were received in several reads
+ * (the incomplete request is kept at the beginning of the buffer,
+ * as http::server2::connection does).
+ *
+ * Before measuring, requests parsed by chunks of any size (such that
+ * the request line, headers or body are split between reads) are
+ * checked against requests parsed from a single buffer.
+ *
+ * Usage: benchparse [<iterations>]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include "http/request.hpp"
+#include "http/request_parser.hpp"
+
+#define	DEFAULT_ITER	200000
+#define	CHUNK		64		// bytes per simulated read
+
+struct mix
+{
+    const char *name ;
+    std::string data ;
+    int nreq ;				// requests in data
+} ;
+
+std::vector <mix> mixes = {
+    {
+	"curl GET",
+	"GET /casan/169/temp HTTP/1.1\r\n"
+	"Host: localhost:8004\r\n"
+	"User-Agent: curl/7.88.1\r\n"
+	"Accept: */*\r\n"
+	"\r\n",
+	1
+    },
+    {
+	"browser GET",
+	"GET /casan/169/light%20sensor?unit=lux HTTP/1.1\r\n"
+	"Host: casan.example.org:8004\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+	"Accept-Language: fr,fr-FR;q=0.8,en-US;q=0.5,en;q=0.3\r\n"
+	"Accept-Encoding: gzip, deflate\r\n"
+	"Referer: http://casan.example.org:8004/admin/slave\r\n"
+	"Connection: keep-alive\r\n"
+	"Cookie: session=0123456789abcdef0123456789abcdef\r\n"
+	"Upgrade-Insecure-Requests: 1\r\n"
+	"Cache-Control: max-age=0\r\n"
+	"\r\n",
+	1
+    },
+    {
+	"form POST",
+	"POST /admin/slave HTTP/1.1\r\n"
+	"Host: localhost:8004\r\n"
+	"User-Agent: curl/7.88.1\r\n"
+	"Accept: */*\r\n"
+	"Content-Type: application/x-www-form-urlencoded\r\n"
+	"Content-Length: 57\r\n"
+	"\r\n"
+	"slaveid=169&status=inactive&comment=moved+to+room%20B%2F2",
+	1
+    },
+} ;
+
+/*
+ * Textual form of a parsed request, in order to compare them
+ */
+
+std::string dump (const http::server2::request &req)
+{
+    std::string s ;
+
+    s = req.method.to_string () + " " + req.uri.to_string () + "\n" ;
+    for (auto &h : req.headers)
+	s += h.name.to_string () + ": " + h.value.to_string () + "\n" ;
+    for (auto &a : req.postargs)
+	s += a.name + "=" + a.value + "\n" ;
+    return s ;
+}
+
+/*
+ * Parse all requests in data, by chunks of at most `chunk` bytes.
+ * Returns the number of parsed requests, and their textual form
+ * if `reqs` is not null.
+ */
+
+int parse_all (std::vector <char> &buf, const std::string &data, std::size_t chunk,
+			std::vector <std::string> *reqs = nullptr)
+{
+    http::server2::request_parser parser ;
+    http::server2::request req ;
+    std::size_t in = 0, begin = 0, end = 0 ;
+    int n = 0 ;
+
+    bool more = true ;
+    while (true)
+    {
+	boost::tribool result ;
+	char *next ;
+
+	if (more)
+	{
+	    // read new data after unparsed data (see connection::read_more)
+	    std::size_t len = std::min (chunk, data.size () - in) ;
+
+	    if (len == 0)
+		break ;
+	    std::memmove (buf.data (), buf.data () + begin, end - begin) ;
+	    end -= begin ;
+	    begin = 0 ;
+	    std::memcpy (buf.data () + end, data.data () + in, len) ;
+	    end += len ;
+	    in += len ;
+	}
+
+	boost::tie (result, next) = parser.parse (req, buf.data () + begin, buf.data () + end) ;
+	begin = next - buf.data () ;
+	if (result)
+	{
+	    n++ ;
+	    if (reqs != nullptr)
+		reqs->push_back (dump (req)) ;
+	    req = http::server2::request () ;
+	    parser.reset () ;
+	    more = (begin == end) ;
+	}
+	else if (! result)
+	{
+	    std::cerr << "parse error\n" ;
+	    std::exit (1) ;
+	}
+	else
+	    more = true ;
+    }
+    return n ;
+}
+
+/*
+ * Check that requests are the same when parsed by chunks of any size
+ */
+
+void verify (const mix &m)
+{
+    std::vector <char> buf (m.data.size ()) ;
+    std::vector <std::string> ref ;
+
+    if (parse_all (buf, m.data, m.data.size (), &ref) != m.nreq)
+    {
+	std::cerr << m.name << ": wrong number of requests\n" ;
+	std::exit (1) ;
+    }
+    for (std::size_t chunk = 1 ; chunk < m.data.size () ; chunk++)
+    {
+	std::vector <std::string> reqs ;
+
+	(void) parse_all (buf, m.data, chunk, &reqs) ;
+	if (reqs != ref)
+	{
+	    std::cerr << m.name << ": wrong request when read by "
+			<< chunk << " bytes\n" ;
+	    std::exit (1) ;
+	}
+    }
+}
+
+void bench (const mix &m, std::size_t chunk, long int niter)
+{
+    std::vector <char> buf (m.data.size ()) ;
+    std::chrono::duration <double> dur ;
+    long int nreq = 0 ;
+    double ns ;
+
+    auto start = std::chrono::steady_clock::now () ;
+    for (long int i = 0 ; i < niter ; i++)
+	nreq += parse_all (buf, m.data, chunk) ;
+    dur = std::chrono::steady_clock::now () - start ;
+
+    if (nreq != niter * m.nreq)
+    {
+	std::cerr << m.name << ": " << nreq << " requests parsed instead of "
+			<< niter * m.nreq << "\n" ;
+	std::exit (1) ;
+    }
+
+    ns = dur.count () * 1e9 / nreq ;
+    std::cout << std::left << std::setw (16) << m.name
+		<< std::right << std::setw (6) << m.data.size () << " bytes "
+		<< std::setw (8)
+		<< (chunk >= m.data.size () ? std::string ("1 read")
+				: "by " + std::to_string (chunk))
+		<< std::fixed << std::setprecision (1)
+		<< std::setw (10) << ns << " ns/req"
+		<< std::setw (10) << m.data.size () * niter / dur.count () / 1e6
+		<< " MB/s\n" ;
+}
+
+int main (int argc, char *argv [])
+{
+    long int niter = DEFAULT_ITER ;
+    mix pipelined ;
+
+    if (argc > 2)
+    {
+	std::cerr << "usage: " << argv [0] << " [<iterations>]\n" ;
+	std::exit (1) ;
+    }
+    if (argc == 2)
+	niter = std::atol (argv [1]) ;
+
+    pipelined.name = "8 pipelined" ;
+    pipelined.nreq = 8 ;
+    for (int i = 0 ; i < pipelined.nreq ; i++)
+	pipelined.data += mixes [0].data ;
+    mixes.push_back (pipelined) ;
+
+    for (auto &m : mixes)
+	verify (m) ;
+
+    for (auto &m : mixes)
+    {
+	bench (m, m.data.size (), niter) ;
+	bench (m, CHUNK, niter) ;
+    }
+
+    std::exit (0) ;
+}
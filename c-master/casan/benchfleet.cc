@@ -0,0 +1,377 @@
+/**
+ * @file benchfleet.cc
+ * @brief Benchmark of the CASAN engine with a fleet of simulated slaves
+ *
+ * This program measures how the CASAN engine scales with the number
+ * of slaves, without any hardware: slaves are simulated (see
+ * slavesim.h) on an in-memory network (see l2-loop.h). For each
+ * number of slaves, a new engine is started and:
+ * - the association time is the time needed for all slaves to be
+ *	associated (Discover, Associate request and answer)
+ * - requests are then sent as the HTTP server does when it proxies
+ *	requests to slaves (see master::http_casan), to random slaves,
+ *	with a fixed number of outstanding requests. The number of
+ *	requests per second and the latency percentiles are reported.
+ *	The HTTP server and the cache are not used (see benchhttp for
+ *	them), only the engine path.
+ *
+ * Slaves may reply with a latency (plus a random jitter), and frames
+ * may be lost (in both directions): lost requests are retransmitted
+ * by the engine, which shows up in the latency percentiles. Requests
+ * which never get a reply are counted as lost. Messages dropped by
+ * the engine itself, since the receive ring (between the receiver
+ * and worker threads) was full, are reported as well.
+ *
+ * Slaves may be spread over many networks, each one with its own
+ * fleet, and the engine may be split in many shards (see shards.h):
+ * requests are then sent through the shard owning the slave, as the
+ * HTTP server does.
+ *
+ * At most NSTART requests are outstanding for each slave (see
+ * casan::limit_nstart), other requests wait in the engine.
+ *
+ * Usage: benchfleet [-e] [-l <latency ms>] [-j <jitter ms>] [-p <loss %>]
+ *		[-s <payload length>] [-c <outstanding requests>]
+ *		[-n <number of requests>] [-w <networks>] [-k <shards>]
+ *		[-N <nstart>] [<number of slaves>...]
+ *	-e: use the event loop (see casan::event_loop) instead of threads
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdlib>
+
+#include <unistd.h>
+
+#include "global.h"
+#include "byte.h"
+
+#include "l2.h"
+#include "l2-loop.h"
+#include "msg.h"
+#include "resource.h"
+#include "slave.h"
+#include "casan.h"
+#include "shards.h"
+#include "slavesim.h"
+
+#define	FIRSTSID	1000		// slave id of the first slave
+#define	TTL		3600		// slave ttl (s)
+#define	ASSOC_TIMEOUT	60		// max time (s) to associate all slaves
+#define	DEFAULT_CONC	100		// outstanding requests
+#define	DEFAULT_NREQ	20000		// requests for each number of slaves
+#define	DEFAULT_NSTART	4		// outstanding requests per slave
+
+int debug_levels = 0 ;
+
+const char *debug_title (int)
+{
+    return "" ;
+}
+
+typedef std::chrono::steady_clock bclock ;
+
+/*
+ * Request load: each completed request issues the next one, until
+ * the requested number of requests has been issued
+ */
+
+struct load
+{
+    std::vector <casan::slave *> slaves ;
+    std::vector <casan::casan *> engines ;	// shard owning each slave
+    long int nreq ;			// requests to issue
+
+    std::mutex mtx ;
+    std::condition_variable cv ;
+    std::mt19937 rng ;			// protected by mtx
+    long int issued = 0 ;		// protected by mtx
+    long int done = 0 ;			// protected by mtx
+    long int lost = 0 ;			// protected by mtx
+    std::vector <double> lat ;		// latencies (ms), protected by mtx
+} ;
+
+void issue (load *ld)
+{
+    casan::slave *s ;
+    casan::casan *e ;
+    casan::resource *res ;
+    std::vector <std::string> path = { "temp" } ;
+    int i ;
+
+    {
+	std::lock_guard <std::mutex> lk (ld->mtx) ;
+
+	if (ld->issued >= ld->nreq)
+	    return ;
+	ld->issued++ ;
+	i = std::uniform_int_distribution <int>
+			    (0, ld->slaves.size () - 1) (ld->rng) ;
+	s = ld->slaves [i] ;
+	e = ld->engines [i] ;
+    }
+
+    casan::msgptr_t m (new casan::msg) ;
+    m->peer (s) ;
+    m->type (casan::msg::MT_CON) ;
+    m->code (casan::msg::MC_GET) ;
+    res = s->find_resource (path) ;
+    if (res != nullptr)
+	res->add_to_message (*m) ;
+
+    bclock::time_point t0 = bclock::now () ;
+    e->add_request (m,
+	[ld, t0] (casan::msgptr_t req)
+	{
+	    std::chrono::duration <double, std::milli> d = bclock::now () - t0 ;
+	    bool ok = req->reqrep () != nullptr ;
+
+	    casan::msg::link_reqrep (req, nullptr) ;
+	    {
+		std::lock_guard <std::mutex> lk (ld->mtx) ;
+
+		ld->done++ ;
+		if (ok)
+		    ld->lat.push_back (d.count ()) ;
+		else
+		    ld->lost++ ;
+		ld->cv.notify_one () ;
+	    }
+	    issue (ld) ;
+	}) ;
+}
+
+double percentile (std::vector <double> &v, int p)
+{
+    if (v.empty ())
+	return 0 ;
+    return v [(v.size () - 1) * p / 100] ;
+}
+
+void bench (int nslaves, int nnets, int nshards, int nstart, bool evloop, const slavesim::params &p, int conc, long int nreq)
+{
+    casan::shards e ;
+    std::vector <casan::l2net_loop *> l2 ;
+    std::vector <slavesim *> fleet ;
+    load ld ;
+    int nrunning ;
+    long int rpeak, rovf, flost ;
+
+    e.count (nshards) ;
+    for (int i = 0 ; i < e.count () ; i++)
+    {
+	casan::casan &x = e.shard (i) ;
+
+	x.timer_first_hello (1) ;
+	x.timer_interval_hello (10) ;
+	x.timer_slave_ttl (TTL) ;
+	x.event_loop (evloop) ;
+	x.limit_nstart (nstart) ;
+    }
+    e.init () ;
+
+    for (int i = 0 ; i < nslaves ; i++)
+    {
+	casan::slave s ;
+
+	s.slaveid (FIRSTSID + i) ;
+	s.init_ttl (TTL) ;
+	e.add_slave (&s) ;
+    }
+
+    // network k gets slaves [k * nslaves / nnets, (k+1) * nslaves / nnets)
+    for (int k = 0 ; k < nnets ; k++)
+    {
+	int first = k * nslaves / nnets ;
+	int last = (k + 1) * nslaves / nnets ;
+	casan::l2net_loop *l = new casan::l2net_loop ;
+
+	if (l->init (casan::l2addr_loop (SLAVESIM_MASTER)) == -1)
+	{
+	    perror ("eventfd") ;
+	    std::exit (1) ;
+	}
+	l2.push_back (l) ;
+	fleet.push_back (new slavesim (l, FIRSTSID + first, last - first, p)) ;
+    }
+
+    /*
+     * Association of all slaves
+     */
+
+    bclock::time_point t0 = bclock::now () ;
+    for (int k = 0 ; k < nnets ; k++)
+    {
+	e.start_net (l2 [k]) ;
+	fleet [k]->start () ;
+    }
+
+    nrunning = 0 ;
+    while (nrunning < nslaves && bclock::now () - t0 < std::chrono::seconds (ASSOC_TIMEOUT))
+    {
+	casan::slave *s ;
+	casan::casan *x ;
+
+	// slaves are associated in no particular order
+	x = e.owner (FIRSTSID + nrunning, &s) ;
+	if (s->status () == casan::slave::SL_RUNNING)
+	{
+	    ld.slaves.push_back (s) ;
+	    ld.engines.push_back (x) ;
+	    nrunning++ ;
+	}
+	else std::this_thread::sleep_for (std::chrono::milliseconds (1)) ;
+    }
+    std::chrono::duration <double, std::milli> tassoc = bclock::now () - t0 ;
+
+    /*
+     * Requests
+     */
+
+    ld.nreq = nrunning == nslaves ? nreq : 0 ;
+    ld.lat.reserve (nreq) ;
+
+    bclock::time_point t1 = bclock::now () ;
+    for (int i = 0 ; i < conc ; i++)
+	issue (&ld) ;
+    {
+	std::unique_lock <std::mutex> lk (ld.mtx) ;
+
+	while (ld.done < ld.issued)
+	    ld.cv.wait (lk) ;
+    }
+    std::chrono::duration <double> treq = bclock::now () - t1 ;
+
+    std::sort (ld.lat.begin (), ld.lat.end ()) ;
+    rovf = flost = 0 ;
+    for (int k = 0 ; k < nnets ; k++)
+    {
+	long int o ;
+
+	if (e.engine (l2 [k])->ring_stats (l2 [k], rpeak, o))
+	    rovf += o ;
+	flost += fleet [k]->nlost_ ;
+    }
+
+    std::cout << std::setw (8) << nslaves
+		<< std::setw (8) << nrunning
+		<< std::fixed << std::setprecision (1)
+		<< std::setw (12) << tassoc.count ()
+		<< std::setprecision (0)
+		<< std::setw (12) << (ld.done > 0 ? ld.done / treq.count () : 0)
+		<< std::setprecision (3)
+		<< std::setw (10) << percentile (ld.lat, 50)
+		<< std::setw (10) << percentile (ld.lat, 99)
+		<< std::setw (8) << ld.lost
+		<< std::setw (10) << flost
+		<< std::setw (10) << rovf
+		<< "\n" << std::flush ;
+
+    e.stop () ;
+    for (int k = 0 ; k < nnets ; k++)
+    {
+	delete fleet [k] ;
+	l2 [k]->term () ;
+	delete l2 [k] ;
+    }
+}
+
+void usage (const char *prog)
+{
+    std::cerr << "usage: " << prog
+		<< " [-e] [-l <latency ms>] [-j <jitter ms>] [-p <loss %>]\n"
+		<< "\t\t[-s <payload length>] [-c <outstanding requests>]\n"
+		<< "\t\t[-n <number of requests>] [-w <networks>] [-k <shards>]\n"
+		<< "\t\t[-N <nstart>] [<number of slaves>...]\n" ;
+    std::exit (1) ;
+}
+
+int main (int argc, char *argv [])
+{
+    slavesim::params p ;
+    std::vector <int> nslaves ;
+    bool evloop = false ;
+    int conc = DEFAULT_CONC ;
+    long int nreq = DEFAULT_NREQ ;
+    int nnets = 1 ;
+    int nshards = 1 ;
+    int nstart = DEFAULT_NSTART ;
+    int opt ;
+
+    while ((opt = getopt (argc, argv, "el:j:p:s:c:n:w:k:N:")) != -1)
+    {
+	switch (opt)
+	{
+	    case 'e' :
+		evloop = true ;
+		break ;
+	    case 'l' :
+		p.latency = std::atoi (optarg) ;
+		break ;
+	    case 'j' :
+		p.jitter = std::atoi (optarg) ;
+		break ;
+	    case 'p' :
+		p.loss = std::atof (optarg) / 100 ;
+		break ;
+	    case 's' :
+		p.paylen = std::atoi (optarg) ;
+		break ;
+	    case 'c' :
+		conc = std::atoi (optarg) ;
+		break ;
+	    case 'n' :
+		nreq = std::atol (optarg) ;
+		break ;
+	    case 'w' :
+		nnets = std::atoi (optarg) ;
+		break ;
+	    case 'k' :
+		nshards = std::atoi (optarg) ;
+		break ;
+	    case 'N' :
+		nstart = std::atoi (optarg) ;
+		break ;
+	    default :
+		usage (argv [0]) ;
+	}
+    }
+    for (int i = optind ; i < argc ; i++)
+	nslaves.push_back (std::atoi (argv [i])) ;
+    if (nslaves.empty ())
+	nslaves = { 100, 1000, 5000 } ;
+    if (conc <= 0 || nreq < 0 || nnets <= 0 || nshards <= 0 || nstart <= 0 || p.latency < 0 || p.jitter < 0)
+	usage (argv [0]) ;
+
+    std::cout << (evloop ? "event loop" : "threads")
+		<< ", latency " << p.latency << "+" << p.jitter << " ms"
+		<< ", loss " << p.loss * 100 << " %"
+		<< ", payload " << p.paylen << " bytes"
+		<< ", " << conc << " outstanding requests"
+		<< ", " << nnets << " networks, " << nshards << " shards"
+		<< ", nstart " << nstart << "\n" ;
+    std::cout << std::setw (8) << "slaves"
+		<< std::setw (8) << "assoc"
+		<< std::setw (12) << "assoc(ms)"
+		<< std::setw (12) << "req/s"
+		<< std::setw (10) << "p50(ms)"
+		<< std::setw (10) << "p99(ms)"
+		<< std::setw (8) << "lost"
+		<< std::setw (10) << "frm lost"
+		<< std::setw (10) << "ring ovf"
+		<< "\n" ;
+
+    for (int n : nslaves)
+	if (n >= nnets)
+	    bench (n, nnets, nshards, nstart, evloop, p, conc, nreq) ;
+
+    std::exit (0) ;
+}
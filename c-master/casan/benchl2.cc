@@ -0,0 +1,238 @@
+/**
+ * @file benchl2.cc
+ * @brief Benchmark of Ethernet frame I/O
+ *
+ * This program measures the number of frames per second which can be
+ * sent and received (and decoded) on a real Ethernet interface, one
+ * frame at a time (l2net::send and msg::recv, as receiver threads
+ * did), in batches (l2net::send_batch and msg::recv_batch, as the
+ * CASAN engine does), or in batches received through a PACKET_MMAP
+ * ring (`ring` option of Ethernet networks).
+ *
+ * Small CASAN messages (a GET request, as sent to many slaves) are
+ * sent in bursts on the first interface, and each burst is received
+ * on the second interface before the next one is sent, in order to
+ * measure each side alone. Both interfaces should be the two ends
+ * of a veth pair:
+ *	ip link add veth0 type veth peer name veth1
+ *	ip link set veth0 up
+ *	ip link set veth1 up
+ *
+ * The receive buffer is enlarged in order to hold a whole burst
+ * (this needs root privileges): the number of lost frames, if any,
+ * is reported.
+ *
+ * Usage: benchl2 <sending iface> <receiving iface> [<number of frames>]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "global.h"
+#include "byte.h"
+
+#include "l2.h"
+#include "l2-eth.h"
+#include "msg.h"
+#include "option.h"
+#include "resource.h"
+#include "slave.h"
+
+#define	DEFAULT_NFRAMES	1000000
+#define	ETHERTYPE	0x88b5
+#define	BURST		10000		// frames sent before receiving them
+#define	RCVBUF		(64*1024*1024)	// in order to not lose a burst
+#define	IDLE		200		// ms to wait for the first frame
+#define	RING		64		// blocks in the receive ring
+
+int debug_levels = 0 ;
+
+const char *debug_title (int)
+{
+    return "" ;
+}
+
+/*
+ * A GET request for "/temp", with a 2 bytes token
+ */
+
+int mkframe (byte *b, int id)
+{
+    const char path [] = "temp" ;
+    int i ;
+
+    i = 0 ;
+    b [i++] = (CASAN_VERSION << 6) | (casan::msg::MT_CON << 4) | 2 ;
+    b [i++] = casan::msg::MC_GET ;
+    b [i++] = BYTE_HIGH (id) ;
+    b [i++] = BYTE_LOW (id) ;
+    b [i++] = BYTE_HIGH (id) ;		// token
+    b [i++] = BYTE_LOW (id) ;
+    b [i++] = (casan::option::MO_Uri_Path << 4) | (sizeof path - 1) ;
+    std::memcpy (b + i, path, sizeof path - 1) ;
+    i += sizeof path - 1 ;
+    return i ;
+}
+
+/*
+ * Send a burst of frames, one at a time or in batches
+ */
+
+void send_burst (casan::l2net *l2, casan::l2frame *f, long int nframes, bool batch)
+{
+    long int i ;
+
+    for (i = 0 ; i < nframes ; )
+    {
+	int n = nframes - i < L2_BATCH ? nframes - i : L2_BATCH ;
+
+	if (batch)
+	{
+	    int r = l2->send_batch (f, n) ;
+	    if (r > 0)
+		i += r ;
+	}
+	else
+	{
+	    for (int j = 0 ; j < n ; j++)
+		if (l2->send (f [j].addr, f [j].data, f [j].len) != -1)
+		    i++ ;
+	}
+    }
+}
+
+/*
+ * Receive (and decode) all queued frames
+ */
+
+long int recv_burst (casan::l2net *l2, casan::msgptr_t *m, bool batch)
+{
+    casan::l2addr *a [L2_BATCH] ;
+    long int nrecv = 0 ;
+    int n ;
+
+    do
+    {
+	if (batch)
+	    n = casan::msg::recv_batch (l2, m, a, L2_BATCH) ;
+	else
+	{
+	    a [0] = m [0]->recv (l2, false) ;
+	    n = m [0]->pktype () == casan::PK_AGAIN ? 0 : 1 ;
+	}
+
+	for (int i = 0 ; i < n ; i++)
+	{
+	    if (a [i] != nullptr)
+	    {
+		nrecv++ ;
+		delete a [i] ;
+	    }
+	}
+    } while (n > 0) ;
+
+    return nrecv ;
+}
+
+/*
+ * Alternate bursts of sent frames and reception of these frames,
+ * in order to measure each side alone (even on a single core)
+ */
+
+void bench (const char *name, casan::l2net *l2s, casan::l2net *l2r,
+				long int nframes, bool batch)
+{
+    byte frames [L2_BATCH][MAXBUF] ;
+    casan::l2frame f [L2_BATCH] ;
+    casan::msgptr_t m [L2_BATCH] ;
+    std::chrono::duration <double> sdur (0), rdur (0) ;
+    long int nsent, nrecv ;
+    struct pollfd pfd ;
+
+    for (int j = 0 ; j < L2_BATCH ; j++)
+    {
+	f [j].addr = l2s->bcastaddr () ;
+	f [j].data = frames [j] ;
+	f [j].len = mkframe (frames [j], j) ;
+	m [j] = std::make_shared <casan::msg> () ;
+    }
+
+    pfd.fd = l2r->pollfd () ;
+    pfd.events = POLLIN ;
+
+    nrecv = 0 ;
+    for (nsent = 0 ; nsent < nframes ; nsent += BURST)
+    {
+	auto t0 = std::chrono::steady_clock::now () ;
+	send_burst (l2s, f, BURST, batch) ;
+	auto t1 = std::chrono::steady_clock::now () ;
+	(void) poll (&pfd, 1, IDLE) ;	// wait for delivery
+	auto t2 = std::chrono::steady_clock::now () ;
+	nrecv += recv_burst (l2r, m, batch) ;
+	auto t3 = std::chrono::steady_clock::now () ;
+
+	sdur += t1 - t0 ;
+	rdur += t3 - t2 ;
+    }
+
+    std::cout << std::left << std::setw (8) << name << std::right
+		<< std::fixed << std::setprecision (0)
+		<< std::setw (12) << nsent / sdur.count () << " sent/s"
+		<< std::setw (12) << nrecv / rdur.count () << " recv/s"
+		<< std::setw (10) << nsent - nrecv << " lost\n" ;
+}
+
+int main (int argc, char *argv [])
+{
+    casan::l2net_eth l2s, l2r ;
+    long int nframes = DEFAULT_NFRAMES ;
+    int rcvbuf ;
+
+    if (argc < 3 || argc > 4)
+    {
+	std::cerr << "usage: " << argv [0]
+		<< " <sending iface> <receiving iface> [<number of frames>]\n" ;
+	std::exit (1) ;
+    }
+    if (argc == 4)
+	nframes = std::atol (argv [3]) ;
+
+    if (l2s.init (argv [1], 0, ETHERTYPE) == -1)
+    {
+	perror (argv [1]) ;
+	std::exit (1) ;
+    }
+    if (l2r.init (argv [2], 0, ETHERTYPE) == -1)
+    {
+	perror (argv [2]) ;
+	std::exit (1) ;
+    }
+    rcvbuf = RCVBUF ;
+    if (setsockopt (l2r.pollfd (), SOL_SOCKET, SO_RCVBUFFORCE,
+				&rcvbuf, sizeof rcvbuf) == -1)
+	perror ("SO_RCVBUFFORCE") ;
+
+    bench ("single", &l2s, &l2r, nframes, false) ;
+    bench ("batch", &l2s, &l2r, nframes, true) ;
+
+    l2r.term () ;
+    if (l2r.init (argv [2], 0, ETHERTYPE, RING) == -1)
+    {
+	perror ("ring") ;
+	std::exit (1) ;
+    }
+    bench ("ring", &l2s, &l2r, nframes, true) ;
+
+    l2s.term () ;
+    l2r.term () ;
+    std::exit (0) ;
+}
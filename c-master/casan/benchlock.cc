@@ -0,0 +1,233 @@
+/**
+ * @file benchlock.cc
+ * @brief Lock contention benchmark of the CASAN engine
+ *
+ * This program measures the request throughput of the CASAN engine
+ * with N "HTTP" threads (each one sending requests and waiting for
+ * the answer, as master::http_casan does) and M receiver threads
+ * (one for each L2 network).
+ *
+ * Networks are loopback networks (see casan::l2net_loop and
+ * loopslave): each confirmable message sent by the engine is
+ * immediately answered by a piggy-backed ACK, so that the measured
+ * cost is the engine cost (locks, correlation, thread wake-ups).
+ *
+ * Usage: benchlock [<nhttp> [<nrecv> [<duration in s>]]]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "global.h"
+#include "byte.h"
+
+#include "l2.h"
+#include "l2-loop.h"
+#include "msg.h"
+#include "waiter.h"
+#include "resource.h"
+#include "casan.h"
+#include "loopslave.h"
+
+#define	NSLAVES		16		// slaves by network
+#define	FIRST_SID	1000		// first slave id
+#define	MASTER		1		// engine address on the network
+
+int debug_levels = 0 ;
+
+const char *debug_title (int)
+{
+    return "" ;
+}
+
+/*
+ * Simulated slaves: each confirmable message sent to a slave is
+ * immediately answered with a piggy-backed ACK
+ */
+
+void slave (loopslave *ls, casan::l2addr_loop &daddr, const byte *b, int len)
+{
+    if (daddr != casan::l2addr_loop_broadcast && len >= 4
+				&& ((b [0] >> 4) & 0x3) == casan::msg::MT_CON)
+    {
+	byte ack [4 + COAP_MAX_TOKLEN] ;
+	int tkl = b [0] & 0xf ;
+
+	ack [0] = (CASAN_VERSION << 6) | (casan::msg::MT_ACK << 4) | tkl ;
+	ack [1] = COAP_MKCODE (2, 5) ;
+	ack [2] = b [2] ;
+	ack [3] = b [3] ;
+	std::memcpy (ack + 4, b + 4, tkl) ;
+	ls->send (daddr, ack, 4 + tkl) ;
+    }
+}
+
+/*
+ * Address of a simulated slave
+ */
+
+casan::l2addr_loop slave_addr (slaveid_t sid)
+{
+    return casan::l2addr_loop (sid) ;
+}
+
+/*
+ * HTTP thread: send requests to slaves until the end date
+ */
+
+std::atomic <long int> nreq (0) ;
+std::atomic <long int> ntimeout (0) ;
+std::atomic <long long int> totlat (0) ;	// in us
+
+void http_thread (casan::casan *e, std::vector <casan::slave *> *sl,
+				int start, timepoint_t end)
+{
+    const char path [] = "bench" ;
+    int i = start ;
+
+    while (std::chrono::system_clock::now () < end)
+    {
+	casan::msgptr_t m (new casan::msg) ;
+	casan::waiter w ;
+	timepoint_t t0 ;
+
+	m->peer ((*sl) [i++ % sl->size ()]) ;
+	m->type (casan::msg::MT_CON) ;
+	m->code (casan::msg::MC_GET) ;
+	casan::option o (casan::option::MO_Uri_Path, path, sizeof path - 1) ;
+	m->pushoption (o) ;
+
+	t0 = std::chrono::system_clock::now () ;
+	m->wt (&w) ;
+	auto a = [e, m] () { e->add_request (m) ; } ;
+	w.do_and_wait (a, DATE_TIMEOUT_MS (1000)) ;
+	m->wt (nullptr) ;
+
+	if (m->reqrep () == nullptr)
+	    ntimeout++ ;
+	else
+	{
+	    auto d = std::chrono::system_clock::now () - t0 ;
+	    totlat += std::chrono::duration_cast <std::chrono::microseconds> (d).count () ;
+	    nreq++ ;
+	}
+	casan::msg::link_reqrep (m, nullptr) ;	// break the reference cycle
+    }
+}
+
+int main (int argc, char *argv [])
+{
+    int nhttp = 4 ;
+    int nrecv = 2 ;
+    int duration = 2 ;
+    casan::casan e ;
+    std::vector <casan::l2net_loop *> nets ;
+    std::vector <loopslave *> ls ;
+    std::vector <casan::slave *> sl ;
+    std::vector <std::thread *> thr ;
+    timepoint_t end ;
+
+    if (argc > 1)
+	nhttp = std::atoi (argv [1]) ;
+    if (argc > 2)
+	nrecv = std::atoi (argv [2]) ;
+    if (argc > 3)
+	duration = std::atoi (argv [3]) ;
+
+    e.timer_first_hello (1) ;
+    e.timer_interval_hello (10) ;
+    e.timer_slave_ttl (3600) ;
+    e.init () ;
+
+    /*
+     * Register slaves and networks, and bring slaves up
+     */
+
+    for (int r = 0 ; r < nrecv ; r++)
+    {
+	casan::l2net_loop *l2 = new casan::l2net_loop ;
+	loopslave *l ;
+
+	if (l2->init (casan::l2addr_loop (MASTER)) == -1)
+	{
+	    perror ("loopback") ;
+	    std::exit (1) ;
+	}
+	l = new loopslave (l2) ;
+	l->handler (
+	    [l] (casan::l2addr_loop &daddr, const byte *data, int len)
+	    {
+		slave (l, daddr, data, len) ;
+	    }) ;
+
+	for (int i = 0 ; i < NSLAVES ; i++)
+	{
+	    casan::slave s ;
+
+	    s.slaveid (FIRST_SID + r * NSLAVES + i) ;
+	    s.init_ttl (3600) ;
+	    e.add_slave (&s) ;
+	}
+	e.start_net (l2) ;
+	nets.push_back (l2) ;
+	ls.push_back (l) ;
+    }
+
+    for (int r = 0 ; r < nrecv ; r++)
+    {
+	for (int i = 0 ; i < NSLAVES ; i++)
+	{
+	    int sid = FIRST_SID + r * NSLAVES + i ;
+	    casan::slave *s = e.find_slave (sid) ;
+
+	    ls [r]->discover (slave_addr (sid), sid) ;
+	    while (s->addr () == nullptr)
+		std::this_thread::sleep_for (std::chrono::milliseconds (1)) ;
+	    sl.push_back (s) ;
+	}
+    }
+
+    /*
+     * Run HTTP threads
+     */
+
+    end = DATE_TIMEOUT_S (duration) ;
+    for (int i = 0 ; i < nhttp ; i++)
+	thr.push_back (new std::thread (http_thread, &e, &sl, i, end)) ;
+    for (auto t : thr)
+	t->join () ;
+
+    std::cout << std::setw (6) << "http"
+	    << std::setw (6) << "recv"
+	    << std::setw (12) << "req/s"
+	    << std::setw (14) << "latency (us)"
+	    << std::setw (10) << "timeouts"
+	    << "\n" ;
+    std::cout << std::setw (6) << nhttp
+	    << std::setw (6) << nrecv
+	    << std::setw (12) << nreq / duration
+	    << std::setw (14) << (nreq ? totlat / nreq : 0)
+	    << std::setw (10) << ntimeout
+	    << "\n" ;
+
+    e.stop () ;
+    for (auto l : ls)
+	delete l ;
+    for (auto l2 : nets)
+    {
+	l2->term () ;
+	delete l2 ;
+    }
+    return 0 ;
+}
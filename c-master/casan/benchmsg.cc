@@ -0,0 +1,237 @@
+/**
+ * @file benchmsg.cc
+ * @brief Benchmark of message encoding and decoding
+ *
+ * This program measures the cost of encoding (and sending), of
+ * receiving (and decoding) and of matching (as the cache does) typical
+ * CASAN messages with 3 to 8 options, in time and in number of heap
+ * allocations per message. The global operator new is replaced in
+ * order to count heap allocations.
+ *
+ * Networks are simulated: sent frames are discarded, and the
+ * same frame is received again and again.
+ *
+ * Usage: benchmsg [<number of messages>]
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <atomic>
+
+#include "global.h"
+
+#include "l2.h"
+#include "l2-eth.h"
+#include "msg.h"
+#include "pool.h"
+#include "resource.h"
+#include "slave.h"
+
+int debug_levels = 0 ;
+
+const char *debug_title (int)
+{
+    return "" ;
+}
+
+/*
+ * Count heap allocations
+ */
+
+static std::atomic <long int> nallocs (0) ;
+
+void *operator new (std::size_t sz)
+{
+    void *p ;
+
+    nallocs++ ;
+    p = std::malloc (sz ? sz : 1) ;
+    if (p == nullptr)
+	throw std::bad_alloc () ;
+    return p ;
+}
+
+void operator delete (void *p) noexcept
+{
+    std::free (p) ;
+}
+
+void operator delete (void *p, std::size_t) noexcept
+{
+    std::free (p) ;
+}
+
+/*
+ * Simulated L2 network: keeps the last sent frame, and receives it
+ */
+
+class l2net_null: public casan::l2net
+{
+    public:
+	l2net_null ()
+	{
+	    mtu_ = 1024 ;
+	    maxlatency_ = DEFAULT_MAX_LATENCY ;
+	}
+	void term (void) {}
+	int send (casan::l2addr *, void *data, int len)
+	{
+	    frame_.assign ((const char *) data, len) ;
+	    return len ;
+	}
+	int bsend (void *data, int len)	{ return send (nullptr, data, len) ; }
+	casan::pktype_t recv (casan::l2addr **saddr, void *data, int *len)
+	{
+	    *len = frame_.size () ;
+	    std::memcpy (data, frame_.data (), *len) ;
+	    *saddr = new casan::l2addr_eth (src_) ;
+	    return casan::PK_ME ;
+	}
+	casan::l2addr *bcastaddr (void)	{ return &casan::l2addr_eth_broadcast ; }
+
+    private:
+	std::string frame_ ;
+	casan::l2addr_eth src_ = casan::l2addr_eth ("02:00:00:00:00:01") ;
+} ;
+
+/*
+ * Build a typical message from a slave: a few options (Uri-Path
+ * elements, Content-Format, Max-Age, etc.) and a small payload.
+ * Options are not pushed in ascending order, as the master does
+ * when it builds a request from an URL.
+ */
+
+static struct
+{
+    casan::option::optcode_t code ;
+    const char *str ;			// string value, or nullptr
+    casan::option::uint val ;		// integer value
+}
+benchopt [] =
+{
+    { casan::option::MO_Uri_Path,	"sensors",	0 },
+    { casan::option::MO_Uri_Path,	"temp",		0 },
+    { casan::option::MO_Content_Format,	nullptr,	50 },
+    { casan::option::MO_Uri_Query,	"unit=C",	0 },
+    { casan::option::MO_Max_Age,	nullptr,	60 },
+    { casan::option::MO_Etag,		"e1f2",		0 },
+    { casan::option::MO_Uri_Host,	"slave169",	0 },
+    { casan::option::MO_Accept,		nullptr,	50 },
+} ;
+
+#define	MINOPT		3
+#define	MAXOPT		((int) (sizeof benchopt / sizeof benchopt [0]))
+
+casan::msgptr_t mkmsg (casan::slave *s, int nopt)
+{
+    static const char payload [] = "{ \"temp\": 21.5, \"unit\": \"C\" }" ;
+    casan::msgptr_t m ;
+    byte tok [2] = { 0x12, 0x34 } ;
+
+    m = std::allocate_shared <casan::msg> (casan::pool_allocator <casan::msg> ()) ;
+    m->peer (s) ;
+    m->type (casan::msg::MT_CON) ;
+    m->code (COAP_MKCODE (2, 5)) ;
+    m->id (1234) ;
+    m->token (tok, sizeof tok) ;
+    for (int i = 0 ; i < nopt ; i++)
+    {
+	if (benchopt [i].str != nullptr)
+	{
+	    casan::option o (benchopt [i].code, benchopt [i].str,
+	    				std::strlen (benchopt [i].str)) ;
+	    m->pushoption (o) ;
+	}
+	else
+	{
+	    casan::option o (benchopt [i].code, benchopt [i].val) ;
+	    m->pushoption (o) ;
+	}
+    }
+    m->payload ((void *) payload, sizeof payload - 1) ;
+    return m ;
+}
+
+void encode (casan::slave *s, int nopt)
+{
+    casan::msgptr_t m = mkmsg (s, nopt) ;
+
+    (void) m->send () ;
+}
+
+void decode (l2net_null *l2)
+{
+    casan::msgptr_t m ;
+    casan::l2addr *a ;
+
+    m = std::allocate_shared <casan::msg> (casan::pool_allocator <casan::msg> ()) ;
+    a = m->recv (l2) ;
+    delete a ;
+}
+
+// compare two identical requests, as the cache does
+bool match (casan::msgptr_t m1, casan::msgptr_t m2)
+{
+    return m1->cache_match (m2) && m1->max_age () >= 0 ;
+}
+
+template <class F>
+void bench (const char *name, int nopt, int n, F f)
+{
+    long int a0 ;
+    timepoint_t t0 ;
+
+    for (int i = 0 ; i < 1000 ; i++)	// warm up (fill the pool)
+	f () ;
+
+    a0 = nallocs ;
+    t0 = std::chrono::system_clock::now () ;
+    for (int i = 0 ; i < n ; i++)
+	f () ;
+    auto ns = std::chrono::duration_cast <std::chrono::nanoseconds> (
+			std::chrono::system_clock::now () - t0).count () ;
+
+    std::cout << std::setw (10) << name
+	    << std::setw (8) << nopt
+	    << std::setw (14) << ns / n
+	    << std::setw (16) << std::fixed << std::setprecision (2)
+			<< double (nallocs - a0) / n
+	    << "\n" ;
+}
+
+int main (int argc, char *argv [])
+{
+    int n = 1000000 ;
+    l2net_null l2 ;
+    casan::slave s ;
+
+    if (argc > 1)
+	n = std::atoi (argv [1]) ;
+
+    s.l2 (&l2) ;
+    s.addr (new casan::l2addr_eth ("02:00:00:00:00:02")) ;
+
+    std::cout << std::setw (10) << "op"
+	    << std::setw (8) << "options"
+	    << std::setw (14) << "ns/msg"
+	    << std::setw (16) << "allocs/msg"
+	    << "\n" ;
+    for (int nopt = MINOPT ; nopt <= MAXOPT ; nopt++)
+    {
+	casan::msgptr_t m1 = mkmsg (&s, nopt) ;
+	casan::msgptr_t m2 = mkmsg (&s, nopt) ;
+
+	bench ("encode", nopt, n, [&s, nopt] () { encode (&s, nopt) ; }) ;
+	encode (&s, nopt) ;		// prepare a frame to receive
+	bench ("decode", nopt, n, [&l2] () { decode (&l2) ; }) ;
+	bench ("match", nopt, n, [m1, m2] () { (void) match (m1, m2) ; }) ;
+    }
+
+    return 0 ;
+}
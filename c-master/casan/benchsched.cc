@@ -0,0 +1,128 @@
+/**
+ * @file benchsched.cc
+ * @brief Benchmark of the sender thread tick cost
+ *
+ * This program compares the cost of one wake-up of the sender thread
+ * with N outstanding messages:
+ * - "scan": the whole message list is traversed, once to act on due
+ *	messages and once to compute the next deadline
+ * - "sched": only due entries are extracted from the scheduler
+ *
+ * In both cases, exactly one message is due at each tick and is
+ * rescheduled (as a retransmission would be).
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <list>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include "global.h"
+
+#include "coap.h"
+#include "scheduler.h"
+
+#define	NTICKS		10000
+
+struct fakemsg
+{
+    timepoint_t next_timeout ;
+} ;
+
+// one tick with the linear scan algorithm
+timepoint_t tick_scan (std::list <fakemsg> &l, timepoint_t now)
+{
+    timepoint_t next = std::chrono::system_clock::time_point::max () ;
+
+    for (auto &m : l)
+	if (now >= m.next_timeout)
+	    m.next_timeout = now + duration_t (MAX_TRANSMIT_SPAN) ;
+    for (auto &m : l)
+	if (next > m.next_timeout)
+	    next = m.next_timeout ;
+    return next ;
+}
+
+// one tick with the scheduler
+timepoint_t tick_sched (casan::scheduler &s, timepoint_t now)
+{
+    void *key ;
+    int type ;
+
+    while (s.pop (now, &key, &type))
+    {
+	fakemsg *m = (fakemsg *) key ;
+
+	m->next_timeout = now + duration_t (MAX_TRANSMIT_SPAN) ;
+	s.add (m, type, m->next_timeout) ;
+    }
+    return s.next () ;
+}
+
+int main (int argc, char *argv [])
+{
+    int nmax = 100000 ;
+
+    if (argc > 1)
+	nmax = std::atoi (argv [1]) ;
+
+    std::cout << std::setw (10) << "msgs"
+	    << std::setw (16) << "scan (ns/tick)"
+	    << std::setw (16) << "sched (ns/tick)"
+	    << "\n" ;
+
+    for (int n = 10 ; n <= nmax ; n *= 10)
+    {
+	std::list <fakemsg> l ;
+	std::vector <fakemsg> v (n) ;
+	casan::scheduler s ;
+	timepoint_t start, now ;
+	double tscan, tsched ;
+	int nscan ;
+
+	start = std::chrono::system_clock::now () ;
+
+	// one message due every ms, deadlines spread over n ms
+	for (int i = 0 ; i < n ; i++)
+	{
+	    fakemsg m ;
+
+	    m.next_timeout = start + duration_t (i) ;
+	    l.push_back (m) ;
+	    v [i] = m ;
+	    s.add (&v [i], 0, v [i].next_timeout) ;
+	}
+
+	// full scans are too slow for big lists: do less ticks
+	nscan = (n > 10000) ? NTICKS / 100 : NTICKS ;
+
+	auto t0 = std::chrono::steady_clock::now () ;
+	now = start ;
+	for (int i = 0 ; i < nscan ; i++)
+	{
+	    (void) tick_scan (l, now) ;
+	    now += duration_t (1) ;
+	}
+	auto t1 = std::chrono::steady_clock::now () ;
+	tscan = std::chrono::duration_cast <std::chrono::nanoseconds> (t1 - t0).count () / double (nscan) ;
+
+	t0 = std::chrono::steady_clock::now () ;
+	now = start ;
+	for (int i = 0 ; i < NTICKS ; i++)
+	{
+	    (void) tick_sched (s, now) ;
+	    now += duration_t (1) ;
+	}
+	t1 = std::chrono::steady_clock::now () ;
+	tsched = std::chrono::duration_cast <std::chrono::nanoseconds> (t1 - t0).count () / double (NTICKS) ;
+
+	std::cout << std::setw (10) << n
+		<< std::setw (16) << std::fixed << std::setprecision (0) << tscan
+		<< std::setw (16) << tsched
+		<< "\n" ;
+    }
+
+    exit (0) ;
+}
@@ -4,17 +4,130 @@
  */
 
 #include <iostream>
+#include <sstream>
 
 #include "cache.h"
 
 namespace casan {
 
+/******************************************************************************
+ * Constructor and destructor
+ */
+
+cache::cache ()
+    : maxsize_ (DEFAULT_MAXSIZE), hits_ (0), misses_ (0),
+      evictions_ (0), expirations_ (0), coalesced_ (0)
+{
+}
+
+cache::~cache ()
+{
+    for (auto &s : shards_)
+	for (auto e : s.lru)
+	    delete e ;
+}
+
+/******************************************************************************
+ * Utilities (shard lock must be held)
+ */
+
+/*
+ * Remove an entry from the index, the expiry heap and the LRU list
+ */
+
+void cache::remove (shard &s, entry *e)
+{
+    auto range = s.index.equal_range (e->hash) ;
+    for (auto it = range.first ; it != range.second ; it++)
+    {
+	if (it->second == e)
+	{
+	    s.index.erase (it) ;
+	    break ;
+	}
+    }
+    s.expiry.remove (e) ;
+    s.lru.erase (e->lru) ;
+    s.size -= e->size ;
+    delete e ;
+}
+
+/*
+ * Remove expired entries, starting from the first one in the heap
+ */
+
+void cache::expire (shard &s, timepoint_t now)
+{
+    void *key ;
+    int type ;
+
+    while (s.expiry.pop (now, &key, &type))
+    {
+	entry *e = (entry *) key ;
+
+	D (D_CACHE, "Cache: expiring " << *(e->request)) ;
+	remove (s, e) ;
+	expirations_++ ;
+    }
+}
+
+/*
+ * Evict least recently used entries until the shard fits in its
+ * share of the byte budget
+ */
+
+void cache::shrink (shard &s)
+{
+    while (s.size > maxsize_ / NSHARDS && ! s.lru.empty ())
+    {
+	D (D_CACHE, "Cache: evicting " << *(s.lru.back ()->request)) ;
+	remove (s, s.lru.back ()) ;
+	evictions_++ ;
+    }
+}
+
+/*
+ * Look for a valid entry matching a request (after removing expired
+ * entries), and update hit/miss counters
+ */
+
+cache::entry *cache::lookup (shard &s, msgptr_t req, std::uint64_t h)
+{
+    entry *r = nullptr ;
+
+    expire (s, std::chrono::system_clock::now ()) ;
+
+    auto range = s.index.equal_range (h) ;
+    for (auto it = range.first ; it != range.second ; it++)
+    {
+	entry *e = it->second ;
+
+	if (req->cache_match (e->request))
+	{
+	    D (D_CACHE, "Cache: found " << *(e->request)) ;
+	    s.lru.splice (s.lru.begin (), s.lru, e->lru) ;
+	    r = e ;
+	    break ;
+	}
+    }
+
+    if (r == nullptr)
+	misses_++ ;
+    else
+	hits_++ ;
+
+    return r ;
+}
+
+/******************************************************************************
+ * Cache operations
+ */
+
 /**
  * @brief Ask the cache for the reply to a request
  *
  * This method looks the cache for a reply to a given request.
- * The request must have been linked with the reply.
- * Cache cleanup (removing obsolete entries) is performed if needed.
+ * Expired entries of the shard are removed first.
  *
  * @param req a request
  * @result reply found or nullptr
@@ -22,55 +135,64 @@ namespace casan {
 
 msgptr_t cache::get (msgptr_t req)
 {
-    std::unique_lock <std::mutex> lk (mtx_) ;
-    msgptr_t r = nullptr ;
-    timepoint_t now ;
-    bool need_to_remove = false ;
+    entry *e ;
+    std::uint64_t h ;
 
-    now = std::chrono::system_clock::now () ;
+    h = req->cache_hash () ;
+    shard &s = shards_ [h % NSHARDS] ;
 
-    /*
-     * Look for the request in cache and check if a cache cleanup
-     * must be performed.
-     */
+    std::lock_guard <std::mutex> lk (s.mtx) ;
 
-    for (auto &e : cache_)
+    e = lookup (s, req, h) ;
+    return e == nullptr ? nullptr : e->reply ;
+}
+
+/**
+ * @brief Ask the cache for the serialized reply to a request
+ *
+ * This method is similar to `get`, but it returns the serialized
+ * form of the reply. This form is built by the `render` function
+ * on the first call for a given entry, and kept with the entry
+ * (and accounted in its size) until it expires or is evicted.
+ *
+ * The `render` function is called with the shard lock held: it
+ * must not call cache methods.
+ *
+ * @param req a request
+ * @param render function building the serialized form of a reply
+ * @result serialized reply found or nullptr
+ */
+
+cache::rendered_t cache::get_rendered (msgptr_t req, render_t render)
+{
+    rendered_t r = nullptr ;
+    entry *e ;
+    std::uint64_t h ;
+
+    h = req->cache_hash () ;
+    shard &s = shards_ [h % NSHARDS] ;
+
+    std::lock_guard <std::mutex> lk (s.mtx) ;
+
+    e = lookup (s, req, h) ;
+    if (e != nullptr)
     {
-	if (now > e.expire)
-	{
-	    need_to_remove = true ;
-	    D (D_CACHE, "Cache: expiring " << *(e.request)) ;
-	}
-	else
+	if (e->rendered == nullptr)
 	{
-	    if (req->cache_match (e.request))
+	    e->rendered = render (e->reply) ;
+	    if (e->rendered != nullptr)
 	    {
-		D (D_CACHE, "Cache: found " << *(e.request)) ;
-		r = e.request ;
-		break ;
+		e->size += e->rendered->size () ;
+		s.size += e->rendered->size () ;
 	    }
 	}
-    }
-
-    /*
-     * Perform cache cleanup
-     */
-
-    if (need_to_remove)
-    {
-	cache_.remove_if (
-		[now]
-		(const entry &e)
-		{
-		    return now > e.expire ;
-		}
-	    ) ;
+	r = e->rendered ;
+	shrink (s) ;
     }
 
     return r ;
 }
 
-
 /**
  * @brief Add a request to the cache
  *
@@ -79,6 +201,10 @@ msgptr_t cache::get (msgptr_t req)
  * together. If the reply does not indicate a cacheable status,
  * the pair of messages is not inserted in the cache.
  *
+ * An entry for the same request (added by another thread in
+ * the meantime) is replaced. If the shard exceeds its share of
+ * the byte budget, least recently used entries are evicted.
+ *
  * @param req a request
  */
 
@@ -86,25 +212,187 @@ void cache::add (msgptr_t req)
 {
     msgptr_t rep ;
     long int maxage ;
+    std::size_t size, shardmax ;
+    timepoint_t now ;
+    std::uint64_t h ;
+    entry *e ;
 
     rep = req->reqrep () ;
-    if (rep != nullptr)
+    if (rep == nullptr)
+	return ;
+
+    maxage = rep->max_age () ;
+    if (maxage == -1)
+	return ;
+
+    size = sizeof (entry) + 2 * sizeof (msg)
+		+ req->msglen () + req->paylen ()
+		+ rep->msglen () + rep->paylen () ;
+    shardmax = maxsize_ / NSHARDS ;
+    if (size > shardmax)
     {
-	maxage = rep->max_age () ;
-	if (maxage != -1)
+	D (D_CACHE, "Cache: too large " << *req) ;
+	return ;
+    }
+
+    h = req->cache_hash () ;
+    shard &s = shards_ [h % NSHARDS] ;
+
+    std::lock_guard <std::mutex> lk (s.mtx) ;
+
+    D (D_CACHE, "Cache: adding " << *req << " for " << maxage << " sec") ;
+
+    now = std::chrono::system_clock::now () ;
+    expire (s, now) ;
+
+    auto range = s.index.equal_range (h) ;
+    for (auto it = range.first ; it != range.second ; it++)
+    {
+	if (req->cache_match (it->second->request))
 	{
-	    std::unique_lock <std::mutex> lk (mtx_) ;
-	    timepoint_t now ;
-	    entry e ;
+	    remove (s, it->second) ;
+	    break ;
+	}
+    }
 
-	    D (D_CACHE, "Cache: adding " << *req << " for " << maxage << " sec") ;
+    e = new entry ;
+    e->hash = h ;
+    e->expire = now + duration_t (maxage * 1000) ;
+    e->request = req ;
+    e->reply = rep ;
+    e->size = size ;
+    e->lru = s.lru.insert (s.lru.begin (), e) ;
+    s.index.insert (std::make_pair (h, e)) ;
+    s.expiry.add (e, 0, e->expire) ;
+    s.size += size ;
 
-	    now = std::chrono::system_clock::now () ;
-	    e.expire = now + duration_t (maxage * 1000) ;
-	    e.request = req ;
-	    cache_.push_back (e) ;
+    shrink (s) ;
+}
+
+/**
+ * @brief Send a request, unless an identical one is already in progress
+ *
+ * This method is called after a cache miss. If a matching GET request
+ * is already being sent, just register the `done` function, which will
+ * be called with the reply of this request. Otherwise, call the `fetch`
+ * function to send the request: upon completion, the request and the
+ * reply are added to the cache, and all registered functions are
+ * called with the reply.
+ *
+ * Other requests (non GET) are always sent.
+ *
+ * @param req a request
+ * @param fetch function sending `req`, which must call its argument
+ *	with the reply (still linked to `req`) or nullptr
+ * @param done function to call with the reply or nullptr
+ */
+
+void cache::coalesce (msgptr_t req, fetch_t fetch, done_t done)
+{
+    flightptr_t f ;
+    std::uint64_t h ;
+    shard *sp ;
+
+    if (req->code () != msg::MC_GET)
+    {
+	fetch (done) ;
+	return ;
+    }
+
+    h = req->cache_hash () ;
+    sp = &shards_ [h % NSHARDS] ;
+
+    {
+	std::lock_guard <std::mutex> lk (sp->mtx) ;
+
+	auto range = sp->inflight.equal_range (h) ;
+	for (auto it = range.first ; it != range.second ; it++)
+	{
+	    if (req->cache_match (it->second->request))
+	    {
+		D (D_CACHE, "Cache: joining in-flight " << *req) ;
+		it->second->waiters.push_back (done) ;
+		coalesced_++ ;
+		return ;
+	    }
 	}
+
+	f = std::make_shared <flight> () ;
+	f->hash = h ;
+	f->request = req ;
+	f->waiters.push_back (done) ;
+	sp->inflight.insert (std::make_pair (h, f)) ;
     }
+
+    /*
+     * We are the first one: send the request without any lock held
+     */
+
+    fetch ([this, sp, f] (msgptr_t rep) { land (*sp, f, rep) ; }) ;
+}
+
+/*
+ * Completion of an in-flight request: cache the reply, and give it
+ * to all waiting functions
+ */
+
+void cache::land (shard &s, flightptr_t f, msgptr_t rep)
+{
+    std::vector <done_t> waiters ;
+
+    if (rep != nullptr)
+	add (f->request) ;
+
+    {
+	std::lock_guard <std::mutex> lk (s.mtx) ;
+
+	auto range = s.inflight.equal_range (f->hash) ;
+	for (auto it = range.first ; it != range.second ; it++)
+	{
+	    if (it->second == f)
+	    {
+		s.inflight.erase (it) ;
+		break ;
+	    }
+	}
+	waiters.swap (f->waiters) ;
+	f->request = nullptr ;
+    }
+
+    for (auto &w : waiters)
+	w (rep) ;
+}
+
+/******************************************************************************
+ * Debug
+ */
+
+/**
+ * @brief Returns cache counters
+ */
+
+std::string cache::html_debug (void)
+{
+    std::ostringstream oss ;
+    std::size_t nentries = 0, size = 0 ;
+
+    for (auto &s : shards_)
+    {
+	std::lock_guard <std::mutex> lk (s.mtx) ;
+
+	nentries += s.lru.size () ;
+	size += s.size ;
+    }
+
+    oss << "Entries = " << nentries << "\n" ;
+    oss << "Size = " << size << " bytes (max " << maxsize_ << ")\n" ;
+    oss << "Hits = " << hits_ << "\n" ;
+    oss << "Misses = " << misses_ << "\n" ;
+    oss << "Evictions = " << evictions_ << "\n" ;
+    oss << "Expirations = " << expirations_ << "\n" ;
+    oss << "Coalesced = " << coalesced_ << "\n" ;
+
+    return oss.str () ;
 }
 
 }					// end of namespace casan
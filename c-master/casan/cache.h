@@ -9,9 +9,16 @@
 #include <list>
 #include <memory>
 #include <mutex>
+#include <functional>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
 
 #include "global.h"
 #include "msg.h"
+#include "scheduler.h"
 
 namespace casan {
 
@@ -19,22 +26,110 @@ namespace casan {
  * @brief CASAN cache interface
  *
  * The CASAN cache interface provides two basic operations: `add` and `get`.
- * The cache is 
+ * The cache stores requests and their replies, until the reply Max-Age
+ * expires. Since the cache keeps its own reference to the reply, the
+ * caller may unlink request and reply after `add`.
+ *
+ * Entries are indexed by a hash of the cache key (see msg::cache_hash):
+ * slave, request code and options which are part of the cache key.
+ * Since different requests may have the same hash, a candidate is
+ * only returned if msg::cache_match confirms it.
+ *
+ * The cache is split in `NSHARDS` shards (selected by the hash), each
+ * one with its own lock, index, expiry heap and LRU list. The
+ * approximate memory used by entries is limited by a byte budget
+ * (see `maxsize`), evenly divided among shards: when a shard exceeds
+ * its share, least recently used entries are evicted.
+ *
+ * On a cache miss, `coalesce` avoids sending identical requests in
+ * parallel: the first GET request for a given key is sent, and
+ * concurrent matching GET requests get its reply instead of
+ * being sent (single-flight). No thread waits: the reply is given
+ * to each requester through its own completion function.
+ *
+ * Since a cached reply does not change until it expires, each entry
+ * may also keep a serialized form of the reply (such as the complete
+ * HTTP response), built on the first `get_rendered` and returned by
+ * subsequent ones.
  */
 
 class cache
 {
     public:
+	cache () ;
+	~cache () ;
+
+	// called with the reply (or nullptr)
+	typedef std::function <void (msgptr_t rep)> done_t ;
+	// sends the request and calls the done_t function upon completion
+	typedef std::function <void (done_t)> fetch_t ;
+
+	// serialized reply, and function building it
+	typedef std::shared_ptr <const std::string> rendered_t ;
+	typedef std::function <rendered_t (msgptr_t rep)> render_t ;
+
 	msgptr_t get (msgptr_t req) ;
+	rendered_t get_rendered (msgptr_t req, render_t render) ;
 	void add (msgptr_t req) ;
+	void coalesce (msgptr_t req, fetch_t fetch, done_t done) ;
+
+	// byte budget
+	std::size_t maxsize (void)		{ return maxsize_ ; }
+	void maxsize (std::size_t m)		{ maxsize_ = m ; }
+
+	std::string html_debug (void) ;		// counters
+
+	static const int NSHARDS = 16 ;
+	static const std::size_t DEFAULT_MAXSIZE = 4 * 1024 * 1024 ;
+
     private:
 	struct entry
 	{
+	    std::uint64_t hash ;
 	    timepoint_t expire ;
-	    msgptr_t request ;		// reply is linked with the request
+	    msgptr_t request ;
+	    msgptr_t reply ;
+	    rendered_t rendered ;	// built on first get_rendered
+	    std::size_t size ;		// approximate memory footprint
+	    std::list <entry *>::iterator lru ;
 	} ;
-	std::list <entry> cache_ ;
-	std::mutex mtx_ ;		// protect list access
+
+	// request in progress, and functions waiting for its reply
+	struct flight
+	{
+	    std::uint64_t hash ;
+	    msgptr_t request ;
+	    std::vector <done_t> waiters ;
+	} ;
+	typedef std::shared_ptr <flight> flightptr_t ;
+
+	struct shard
+	{
+	    std::unordered_multimap <std::uint64_t, entry *> index ;
+	    std::unordered_multimap <std::uint64_t, flightptr_t> inflight ;
+	    scheduler expiry ;		// expiry heap
+	    std::list <entry *> lru ;	// most recently used first
+	    std::size_t size = 0 ;	// sum of entry sizes
+	    std::mutex mtx ;		// protect shard access
+	} ;
+	shard shards_ [NSHARDS] ;
+
+	std::atomic <std::size_t> maxsize_ ;
+
+	// counters
+	std::atomic <long int> hits_ ;
+	std::atomic <long int> misses_ ;
+	std::atomic <long int> evictions_ ;
+	std::atomic <long int> expirations_ ;
+	std::atomic <long int> coalesced_ ;
+
+	// the following methods must be called with shard lock held
+	void expire (shard &s, timepoint_t now) ;
+	void remove (shard &s, entry *e) ;
+	void shrink (shard &s) ;
+	entry *lookup (shard &s, msgptr_t req, std::uint64_t h) ;
+
+	void land (shard &s, flightptr_t f, msgptr_t rep) ;
 } ;
 
 }					// end of namespace casan
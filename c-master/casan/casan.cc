@@ -13,21 +13,35 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <future>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 // don't define NDEBUG
 #include <cassert>
 
 #include "global.h"
 #include "utils.h"
+#include "byte.h"
 
 #include "l2.h"
 #include "waiter.h"
 #include "msg.h"
 #include "resource.h"
+#include "spsc.h"
 #include "casan.h"
 
 namespace casan {
 
+/** maximum number of epoll events handled in a row */
+#define	EPOLL_EVENTS	16
+
 /**
  * @brief Private data for each receiver thread
  */
@@ -37,10 +51,38 @@ struct casan::receiver
     l2net *l2 ;
     long int hid ; 			// hello id, initialized at start time
     slave broadcast ;
-    std::list <msgptr_t> deduplist ;	// received messages
+    dedup dedupset ;			// received messages
     msgptr_t hellomsg ;
     timepoint_t next_hello ;
-    std::thread *thr ;
+    std::thread *thr ;			// or NULL if polled by the sender
+    bool polled ;			// in the sender epoll set
+    int stopfd ;			// eventfd to stop the receiver thread
+    std::atomic <bool> stop ;		// for threads which cannot be polled
+    std::promise <void> *stopped ;	// see casan::stop_net
+    msgptr_t batch [L2_BATCH] ;	// preallocated messages (see receive_all)
+
+    /*
+     * Handoff to the worker thread (see casan::worker_thread): the
+     * receiver thread only reads and decodes messages
+     */
+
+    struct frame
+    {
+	msgptr_t m ;
+	l2addr *a = nullptr ;
+    } ;
+    spsc <frame> ring ;			// decoded messages
+    std::thread *worker ;		// or NULL if polled by the sender
+    int ringfd ;			// eventfd to wake the worker up
+    std::atomic <bool> idle ;		// worker waiting on ringfd
+
+    ~receiver ()
+    {
+	frame f ;
+
+	while (ring.pop (f))		// not processed by the worker
+	    delete f.a ;
+    }
 } ;
 
 
@@ -54,21 +96,25 @@ struct casan::receiver
 casan::casan ()
 {
     tsender_ = NULL ;
+    tokcount_ = 0 ;
 }
 
 /**
  * @brief CASAN engine destructor
  *
- * This destructor removes all internal lists used by the CASAN engine.
- *
- * @bug Threads should be cleanly removed.
+ * This destructor stops all threads and removes all internal lists
+ * used by the CASAN engine.
  */
 
 casan::~casan ()
 {
+    stop () ;
     rlist_.clear () ;
-    slist_.clear () ;
+    slaves_.clear () ;
     mlist_.clear () ;
+    corrlist_.clear () ;
+    subs_.clear () ;
+    obslist_.clear () ;
 }
 
 /**
@@ -83,11 +129,78 @@ casan::~casan ()
 void casan::init (void)
 {
     std::srand (std::time (0)) ;
+    tokcount_ = std::rand () ;
 
     if (tsender_ == NULL)
     {
-	tsender_ = new std::thread (&casan::sender_thread, this) ;
+	if (evloop_)
+	{
+	    struct epoll_event ev ;
+
+	    epfd_ = epoll_create1 (EPOLL_CLOEXEC) ;
+	    wakefd_ = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+
+	    ev.events = EPOLLIN ;
+	    ev.data.ptr = nullptr ;		// see event_loop_thread
+	    if (epfd_ == -1 || wakefd_ == -1
+		    || epoll_ctl (epfd_, EPOLL_CTL_ADD, wakefd_, &ev) == -1)
+	    {
+		perror ("event loop") ;
+		evloop_ = false ;
+	    }
+	}
+
+	if (evloop_)
+	    tsender_ = new std::thread (&casan::event_loop_thread, this) ;
+	else
+	    tsender_ = new std::thread (&casan::sender_thread, this) ;
+    }
+}
+
+/**
+ * @brief Stop the CASAN engine
+ *
+ * This function removes all L2 networks (see casan::stop_net), and
+ * then stops the sender thread. Messages which are still pending
+ * are not sent, and their completion function is not called.
+ * It must not be called by a thread of the CASAN engine (i.e. in
+ * a completion function).
+ */
+
+void casan::stop (void)
+{
+    std::vector <l2net *> nets ;
+
+    {
+	std::unique_lock <std::mutex> lk (rmtx_) ;
+
+	for (auto r : rlist_)
+	    nets.push_back (r->l2) ;
+    }
+    for (auto l2 : nets)
+	stop_net (l2) ;
+
+    if (tsender_ != NULL)
+    {
+	{
+	    std::unique_lock <std::mutex> lk (mtx_) ;
+
+	    stop_ = true ;
+	    condvar_.notify_one () ;
+	}
+	if (evloop_)
+	    wakeup () ;
+
+	tsender_->join () ;
+	delete tsender_ ;
+	tsender_ = NULL ;
     }
+
+    if (epfd_ != -1)
+	close (epfd_) ;
+    if (wakefd_ != -1)
+	close (wakefd_) ;
+    epfd_ = wakefd_ = -1 ;
 }
 
 /**
@@ -101,28 +214,64 @@ void casan::init (void)
 
 std::ostream& operator<< (std::ostream &os, const casan &se)
 {
+    casan &e = (casan &) se ;		// needed to lock mutexes
+
     os << "Receivers: " ;
+    std::unique_lock <std::mutex> rlk (e.rmtx_) ;
     for (auto &r : se.rlist_)
     {
 	os << "Recv hid=" << r->hid
-	    << ", Deduplist (NON/CON received):"
+	    << ", Dedup set (NON/CON received): "
+	    << r->dedupset.size () << "/" << r->dedupset.maxsize ()
+	    << ", Ring (depth/peak/size): "
+	    << r->ring.depth () << "/" << r->ring.peak ()
+	    << "/" << r->ring.capacity ()
+	    << ", overflows: " << r->ring.overflow ()
 	    << "\n" ;
-	for (auto &m : r->deduplist)
-	    os << *m ;
     }
     os << "\n" ;
+    rlk.unlock () ;
 
     os << "Slaves:\n" ;
-    for (auto &s : se.slist_)
-	os << s ;
+    e.slaves_.foreach ([&os] (slave &s) { os << s ; }) ;
 
     os << "Messages (sent):\n" ;
+    std::unique_lock <std::mutex> mlk (e.reqmtx_) ;
     for (auto &m : se.mlist_)
-	os << *m ;
+	os << *m.second ;
 
     return os ;
 }
 
+/**
+ * @brief Get the statistics of the receive ring of a network
+ *
+ * These statistics are meant to size the ring (see casan::limit_ring):
+ * the highest number of messages waiting for the worker thread, and
+ * the number of messages dropped because the ring was full.
+ *
+ * @param l2 network
+ * @param peak highest depth of the ring
+ * @param overflow number of messages dropped
+ * @return false if the network is not found
+ */
+
+bool casan::ring_stats (l2net *l2, long int &peak, long int &overflow)
+{
+    std::unique_lock <std::mutex> lk (rmtx_) ;
+
+    for (auto r : rlist_)
+    {
+	if (r->l2 == l2)
+	{
+	    peak = r->ring.peak () ;
+	    overflow = r->ring.overflow () ;
+	    return true ;
+	}
+    }
+    return false ;
+}
+
 /**
  * @brief Dumps CASAN engine configuration
  *
@@ -136,13 +285,36 @@ std::ostream& operator<< (std::ostream &os, const casan &se)
 std::string casan::html_debug (void)
 {
     std::ostringstream oss ;
+    std::vector <slave *> sl ;
 
     oss << "Delay for first HELLO message = " << first_hello_ << " s\n" ;
     oss << "HELLO interval = " << interval_hello_ << " s\n" ;
     oss << "Default TTL = " << slave_ttl_ << " s\n" ;
+    oss << "Receive rings (depth/peak/size, overflows):\n" ;
+    {
+	std::unique_lock <std::mutex> lk (rmtx_) ;
+
+	for (auto r : rlist_)
+	    oss << "\thid=" << r->hid << ": "
+		<< r->ring.depth () << "/" << r->ring.peak ()
+		<< "/" << r->ring.capacity ()
+		<< ", " << r->ring.overflow () << "\n" ;
+    }
     oss << "Slaves:\n" ;
-    for (auto &s : slist_)
-	oss << s ;
+    slaves_.foreach ([&oss, &sl] (slave &s) { oss << s ; sl.push_back (&s) ; }) ;
+
+    // windows and estimators belong to the outstanding request table
+    oss << "Slave windows (outstanding/queued, RTT):\n" ;
+    {
+	std::unique_lock <std::mutex> lk (reqmtx_) ;
+
+	for (auto s : sl)
+	    if (s->rtonet_ != nullptr)
+		oss << "\tslave " << s->slaveid () << ": "
+		    << s->outstanding_ << "/" << s->pending_.size ()
+		    << ", " << s->rto_ << "\n" ;
+    }
+    oss << "Observed resources:\n" << html_observe () ;
 
     return oss.str () ;
 }
@@ -160,18 +332,20 @@ std::string casan::resource_list (void)
 {
     std::string str = "" ;
 
-    for (auto &s : slist_)
-    {
-	if (s.status_ == slave::SL_RUNNING)
+    slaves_.foreach (
+	[&str]
+	(slave &s)
 	{
-	    for (auto &r : s.resource_list ())
+	    if (s.status_ == slave::SL_RUNNING)
 	    {
-		std::ostringstream oss ;
-		oss << r ;
-		str += oss.str () ;
+		for (auto &r : s.resource_list ())
+		{
+		    std::ostringstream oss ;
+		    oss << r ;
+		    str += oss.str () ;
+		}
 	    }
-	}
-    }
+	}) ;
     return str ;
 }
 
@@ -194,8 +368,6 @@ std::string casan::resource_list (void)
 
 void casan::start_net (l2net *l2)
 {
-    std::unique_lock <std::mutex> lk (mtx_) ;
-
     if (tsender_ != NULL)
     {
 	receiver *r ;
@@ -205,9 +377,19 @@ void casan::start_net (l2net *l2)
 
 	r->l2 = l2 ;
 	r->thr = NULL ;
+	r->polled = false ;
+	r->stopfd = eventfd (0, EFD_CLOEXEC) ;
+	r->worker = NULL ;
+	r->ringfd = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC) ;
+	r->idle = false ;
+	r->ring.capacity (ring_max_) ;
+	r->stop = false ;
+	r->stopped = nullptr ;
+	r->dedupset.maxsize (dedup_max_) ;
 	// define a pseudo-slave for broadcast address
 	r->broadcast.l2 (l2) ;
-	r->broadcast.addr (l2->bcastaddr ()) ;
+	// the broadcast address belongs to the network
+	r->broadcast.addr (std::shared_ptr <l2addr> (l2->bcastaddr (), [] (l2addr *) {})) ;
 
 	now = std::chrono::system_clock::now () ;
 	r->hid = std::chrono::system_clock::to_time_t (now) % 1000 ;
@@ -220,21 +402,80 @@ void casan::start_net (l2net *l2)
 
 	r->next_hello = now + random_timeout (first_hello_ * 1000)  ;
 
-	rlist_.push_front (r) ;
-	condvar_.notify_one () ;
+	// retransmit early requests not delivered by the link layer
+	l2->txfail (
+	    [this, l2]
+	    (l2addr *a, const byte *data, int len)
+	    {
+		tx_failure (l2, a, data, len) ;
+	    }) ;
+
+	{
+	    std::unique_lock <std::mutex> lk (rmtx_) ;
+	    rlist_.push_front (r) ;
+	}
+	schedule (r, EV_START, now) ;
     }
 }
 
 /**
  * @brief Remove an L2 network
  *
- * @bug This method should remove the associated thread and close
- *	the interface
+ * This method removes an L2 network from the list of networks
+ * managed by the CASAN engine, and waits until the sender thread
+ * has stopped using it and receiving from it (see casan::sender_stop).
+ * Slaves associated through this network are reset. The network
+ * is not closed: this is the caller's job, after this method returns.
+ *
+ * @param l2 pointer to an l2net object given to casan::start_net
  */
 
 void casan::stop_net (l2net *l2)
 {
-    std::cout << sizeof *l2 << "\n" ;	// calm down -Wall
+    std::promise <void> stopped ;
+    std::vector <slave *> bound ;
+    receiver *r = nullptr ;
+
+    {
+	std::unique_lock <std::mutex> lk (rmtx_) ;
+
+	for (auto it = rlist_.begin () ; it != rlist_.end () ; it++)
+	{
+	    if ((*it)->l2 == l2)
+	    {
+		r = *it ;
+		rlist_.erase (it) ;
+		break ;
+	    }
+	}
+    }
+
+    if (r == nullptr)
+	return ;
+
+    // the stop event replaces any pending event for this receiver
+    {
+	std::unique_lock <std::mutex> lk (mtx_) ;
+
+	r->stopped = &stopped ;
+	if (tsender_ == NULL)		// engine not started
+	    sched_.remove (r) ;
+    }
+    if (tsender_ == NULL)
+	sender_stop (r) ;
+    else
+	schedule (r, EV_STOP, std::chrono::system_clock::now ()) ;
+    stopped.get_future ().wait () ;
+
+    slaves_.foreach (
+	[&bound, l2]
+	(slave &s)
+	{
+	    if (s.l2 () == l2)
+		bound.push_back (&s) ;
+	}) ;
+    for (auto s : bound)
+	slaves_.reset (s) ;
 }
 
 /**
@@ -250,16 +491,14 @@ void casan::stop_net (l2net *l2)
 
 void casan::add_slave (slave *s)
 {
-    std::unique_lock <std::mutex> lk (mtx_) ;
-
     s->reset () ;
-    slist_.push_front (*s) ;
+    (void) slaves_.add (*s) ;
 }
 
 /**
  * @brief Locate a slave by its slave id
  *
- * This method searches through the slave list to find a slave
+ * This method searches the slave registry to find a slave
  * with its slave-id (as given by the slave in its Discover message).
  *
  * @param sid slave id
@@ -268,18 +507,7 @@ void casan::add_slave (slave *s)
 
 slave *casan::find_slave (slaveid_t sid)
 {
-    slave *r ;
-
-    r = nullptr ;
-    for (auto &s : slist_)
-    {
-	if (s.slaveid () == sid)
-	{
-	    r = &s ;
-	    break ;
-	}
-    }
-    return r ;
+    return slaves_.find (sid) ;
 }
 
 /**
@@ -293,10 +521,112 @@ slave *casan::find_slave (slaveid_t sid)
 
 void casan::add_request (msgptr_t m)
 {
-    std::unique_lock <std::mutex> lk (mtx_) ;
+    /*
+     * Message id and token (for requests) are allocated now,
+     * since the message must be registered in the correlation
+     * index before the sender thread transmits it.
+     */
+
+    if (m->id () == 0)
+	m->id (msg::new_id ()) ;
+
+    if (m->code () != msg::MC_EMPTY && (m->code () >> 5) == 0
+			&& m->toklen_ == 0)
+    {
+	unsigned int t = tokcount_++ ;
+	byte tok [2] ;
+
+	tok [0] = BYTE_HIGH (t) ;
+	tok [1] = BYTE_LOW (t) ;
+	m->token (tok, sizeof tok) ;
+    }
+
+    /*
+     * The message is sent now if the window of the slave is open.
+     * Else, it is queued until an outstanding exchange completes.
+     */
+
+    timepoint_t now = std::chrono::system_clock::now () ;
+    slave *s = m->peer () ;
+    int maxlat = DEFAULT_MAX_LATENCY ;
+    bool open ;
+
+    if (s != nullptr && s->l2 () != nullptr)
+	maxlat = s->l2 ()->maxlatency () ;
+    m->expire_ = now + duration_t (EXCHANGE_LIFETIME (maxlat)) ;
+
+    {
+	std::unique_lock <std::mutex> lk (reqmtx_) ;
+
+	mlist_ [m.get ()] = m ;
+	corr_add (m) ;
+	open = window_add (m, now) ;
+    }
+
+    if (open)
+	schedule (m.get (), EV_MSG, now) ;
+}
+
+/**
+ * @brief Add a request, with a function to call upon completion
+ *
+ * The request is sent as with the other form of add_request. Then,
+ * the completion function is called once (by a worker thread or
+ * by the sender thread), with the request as argument:
+ * - when an answer is received (answer is linked to the request)
+ * - or when the request expires without any answer
+ *
+ * The completion function must not block.
+ *
+ * @param m the request
+ * @param c completion function
+ */
+
+void casan::add_request (msgptr_t m, msg::completion_t c)
+{
+    m->completion (c) ;
+    add_request (m) ;
+}
+
+/**
+ * @brief Register an event for the sender thread
+ *
+ * The event replaces the previous event registered for this key,
+ * if any, and the sender thread is notified.
+ *
+ * @param key object (receiver, slave or message)
+ * @param type event type (see casan::evtype)
+ * @param date date of the event
+ */
+
+void casan::schedule (void *key, int type, timepoint_t date)
+{
+    bool wake ;
+
+    {
+	std::unique_lock <std::mutex> lk (mtx_) ;
+
+	// the event loop only needs to be woken up for an earlier deadline
+	wake = evloop_ && date < sched_.next ()
+			&& std::this_thread::get_id () != sender_id_ ;
+	sched_.add (key, type, date) ;
+	condvar_.notify_one () ;
+    }
+
+    if (wake)
+	wakeup () ;
+}
 
-    mlist_.push_front (m) ;
-    condvar_.notify_one () ;
+/**
+ * @brief Wake the sender thread up in event loop mode
+ */
+
+void casan::wakeup (void)
+{
+    std::uint64_t one = 1 ;
+
+    if (write (wakefd_, &one, sizeof one) == -1)
+	perror ("eventfd") ;
 }
 
 /******************************************************************************
@@ -315,7 +645,7 @@ void casan::add_request (msgptr_t m)
  *
  * The sender thread manages:
  * - the list of l2 networks (the thread must start a new receiver
- *     thread for each new l2 network)
+ *     thread for each new l2 network, and send periodic hello messages)
  * - the list of all slaves in order to expire the "active" status
  *     if needed
  * - the list of all outgoing messages in order to:
@@ -324,272 +654,1015 @@ void casan::add_request (msgptr_t m)
  *    - expire an old message without any received answer. In this
  *     case, the message will only be deleted if there is no
  *     thread waiting for this message.
+ * - observed resources, in order to renew a registration when no
+ *     notification has been received in time (see observe.cc)
+ *
+ * All these objects are not scanned: each one registers its next
+ * deadline in the scheduler (see the scheduler class), and each wake-up
+ * only processes the objects whose deadline is reached.
  */
 
 void casan::sender_thread (void)
 {
     for (;;)
     {
-	timepoint_t now ;
-	timepoint_t next_timeout ;
-
-	std::unique_lock <std::mutex> lk (mtx_) ;
-
 	/*
-	 * Sender thread is woken up (see last instructions in this loop
-	 * body) for one or more multiple reasons:
-	 * - a new l2 network has been registered
+	 * Sender thread is woken up for one or more multiple reasons:
+	 * - a new l2 network has been registered (or removed)
 	 * - a new message is to be sent
 	 * - timeout expired: there is an action to do (message to
 	 *	retransmit or to remove from a queue)
-	 * At each iteration, we need to check all reasons.
-	 */
-
-	now = std::chrono::system_clock::now () ;
-
-	/*
-	 * Traverse the receiver list to check new entries, and
-	 * start receiver threads.
+	 * All these reasons are registered in the scheduler.
 	 */
 
-	for (auto &r : rlist_)
 	{
-	    // should the receiver thread be started?
-	    if (r->thr == NULL)
-	    {
-		D (D_MESSAGE, "Found a receiver to start") ;
-		r->thr = new std::thread (&casan::receiver_thread, this, r) ;
-	    }
+	    std::unique_lock <std::mutex> lk (mtx_) ;
+	    timepoint_t now, next_timeout ;
 
-	    // is it time to send a new hello ?
-	    if (now >= r->next_hello)
+	    for (;;)
 	    {
-		// send the pre-prepared hello message
-		r->hellomsg->id (0) ;		// don't reuse the same msg id
-		r->hellomsg->send () ;
-		// schedule next hello packet
-		r->next_hello = now + duration_t (interval_hello_ * 1000) ;
-	    }
-	}
+		if (stop_)
+		    return ;
 
-	/*
-	 * Traverse slave list to check ttl
-	 */
+		now = std::chrono::system_clock::now () ;
+		next_timeout = sched_.next () ;
+		if (next_timeout <= now)
+		    break ;
 
-	for (auto &s : slist_)
-	    if (s.status () == slave::SL_RUNNING && now >= s.next_timeout_)
-		s.reset () ;
-
-	/*
-	 * Traverse message list to check new messages to send or older
-	 * messages to retransmit
-	 */
+		/*
+		 * Wait for next action (or indefinitely)
+		 */
 
-	for (auto &m : mlist_)
-	{
-	    if (m->ntrans_ == 0 ||
-		    (m->ntrans_ < MAX_RETRANSMIT && now >= m->next_timeout_)
-		    )
-	    {
-		if (m->send () == -1)
+		if (next_timeout == std::chrono::system_clock::time_point::max ())
 		{
-		    std::cout << "ERROR DURING TRANSMISSION\n" ;
+		    D (D_MESSAGE, "WAIT") ;
+		    condvar_.wait (lk) ;
 		}
-	    }
+		else
+		{
+		    auto delay = next_timeout - now ;	// needed precision for delay
 
+		    D (D_MESSAGE, "WAIT " << std::chrono::duration_cast<duration_t> (delay).count() << "ms") ;
+		    condvar_.wait_for (lk, delay) ;
+		}
+	    }
 	}
 
-	/*
-	 * Remove expired messages (using a C++ lambda)
-	 */
+	sender_events () ;
+    }
+}
 
-	mlist_.remove_if (
-	    [now]
-	    (const msgptr_t &m)
-	    {
-		return now > m->expire_ ;
-	    }) ;
+/**
+ * @brief Sender thread in event loop mode
+ *
+ * The sender thread waits (with epoll) for frames on all networks
+ * which can be polled, for a wake-up (see casan::wakeup) or for the
+ * deadline of the next event in the scheduler. Frames are processed
+ * (see casan::receive_all) as a receiver thread would do, and then
+ * due events are processed as in casan::sender_thread.
+ */
 
-	/*
-	 * Determine date of next action
-	 */
+void casan::event_loop_thread (void)
+{
+    {
+	std::unique_lock <std::mutex> lk (mtx_) ;
 
-	next_timeout = std::chrono::system_clock::time_point::max () ;
+	sender_id_ = std::this_thread::get_id () ;
+    }
 
-	for (auto &r : rlist_)
-	{
-	    // must current timeout be the next hello?
-	    if (next_timeout > r->next_hello)
-		next_timeout = r->next_hello ;
-	}
+    for (;;)
+    {
+	struct epoll_event ev [EPOLL_EVENTS] ;
+	timepoint_t next_timeout ;
+	int timeout, n ;
 
-	for (auto &s : slist_)
 	{
-	    // must current timeout be the next hello?
-	    if (s.status () == slave::SL_RUNNING && next_timeout > s.next_timeout_)
-	    if (next_timeout > s.next_timeout_)
-		next_timeout = s.next_timeout_ ;
-	}
+	    std::unique_lock <std::mutex> lk (mtx_) ;
 
-	for (auto &m : mlist_)
-	{
-	    // must current timeout be the next retransmission of this message?
-	    if (m->ntrans_ < MAX_RETRANSMIT && next_timeout > m->next_timeout_)
-		next_timeout = m->next_timeout_ ;
+	    if (stop_)
+		return ;
+	    next_timeout = sched_.next () ;
 	}
 
-
-	/*
-	 * Wait for next action (or indefinitely)
-	 */
-
 	if (next_timeout == std::chrono::system_clock::time_point::max ())
-	{
-	    D (D_MESSAGE, "WAIT") ;
-	    condvar_.wait (lk) ;
-	}
+	    timeout = -1 ;
 	else
 	{
-	    now = std::chrono::system_clock::now () ;
-	    auto delay = next_timeout - now ;	// needed precision for delay
+	    auto delay = next_timeout - std::chrono::system_clock::now () ;
+	    auto ms = std::chrono::duration_cast <duration_t> (delay) ;
+
+	    // round up, in order to not wake up just before the deadline
+	    if (ms < delay)
+		ms += duration_t (1) ;
+	    timeout = ms.count () < 0 ? 0 : ms.count () ;
+	}
+
+	D (D_MESSAGE, "WAIT " << timeout << "ms") ;
+	n = epoll_wait (epfd_, ev, EPOLL_EVENTS, timeout) ;
+	if (n == -1 && errno != EINTR)
+	    perror ("epoll_wait") ;
 
-	    assert (std::chrono::duration_cast<duration_t> (delay).count() >= 0) ;
+	for (int i = 0 ; i < n ; i++)
+	{
+	    if (ev [i].data.ptr == nullptr)
+	    {
+		std::uint64_t v ;
 
-	    D (D_MESSAGE, "WAIT " << std::chrono::duration_cast<duration_t> (delay).count() << "ms") ;
-	    condvar_.wait_for (lk, delay) ;
+		if (read (wakefd_, &v, sizeof v) == -1 && errno != EAGAIN)
+		    perror ("eventfd") ;
+	    }
+	    else
+		receive_all ((receiver *) ev [i].data.ptr) ;
 	}
+
+	sender_events () ;
     }
 }
 
-/******************************************************************************
- * Receiver threads
- *****************************************************************************/
-
 /**
- * @brief Receiver thread
- *
- * Each receiver thread spends its life waiting for a message to be
- * received on the associated interface (in fact, the l2net::recv
- * method).
- *
- * A receiver thread manages a de-duplication list (as specified
- * in the CoAP specification) to eliminate received answers which
- * are duplicated (i.e. already received).
+ * @brief Process all due events
  *
- * @param r receiver private data
+ * Due events are extracted from the scheduler, and they are
+ * processed after the scheduler lock is released.
  */
 
-void casan::receiver_thread (receiver *r)
+void casan::sender_events (void)
 {
-    for (;;)
+    timepoint_t now ;
+
     {
-	msgptr_t m (new msg) ;	// received message
-	l2addr *a ;			// source address of received message
-	msgptr_t orgreq ;	// message correlation result
-	msgptr_t dupmsg ;	// original message in case of duplicate
+	std::unique_lock <std::mutex> lk (mtx_) ;
+	void *key ;
+	int type ;
 
-	/*
-	 * Wait for a new message
-	 */
+	now = std::chrono::system_clock::now () ;
+	while (sched_.pop (now, &key, &type))
+	    due_.push_back (std::make_pair (key, type)) ;
+    }
 
-	a = m->recv (r->l2) ;
+    for (auto &e : due_)
+    {
+	switch (e.second)
+	{
+	    case EV_START :
+		{
+		    receiver *r = (receiver *) e.first ;
+		    struct epoll_event ev ;
+		    int fd = r->l2->pollfd () ;
+
+		    /*
+		     * In event loop mode, the network is polled by
+		     * this thread if possible. Else, a receiver thread
+		     * (and its worker thread) must be started.
+		     */
+
+		    ev.events = EPOLLIN ;
+		    ev.data.ptr = r ;
+		    if (evloop_ && fd != -1
+			    && epoll_ctl (epfd_, EPOLL_CTL_ADD, fd, &ev) == 0)
+		    {
+			D (D_MESSAGE, "Found a receiver to poll") ;
+			r->polled = true ;
+		    }
+		    else
+		    {
+			D (D_MESSAGE, "Found a receiver to start") ;
+			// the worker must exist before the receiver hands off
+			r->worker = new std::thread (&casan::worker_thread, this, r) ;
+			r->thr = new std::thread (&casan::receiver_thread, this, r) ;
+		    }
+		    sender_filter (r->l2) ;
+		    schedule_hello (r) ;
+		}
+		break ;
 
-	/*
-	 * Invalid message received
-	 */
+	    case EV_HELLO :
+		{
+		    receiver *r = (receiver *) e.first ;
+
+		    // send the pre-prepared hello message
+		    r->hellomsg->id (0) ;	// don't reuse the same msg id
+		    r->hellomsg->send () ;
+		    // schedule next hello packet
+		    r->next_hello = now + duration_t (interval_hello_ * 1000) ;
+		    schedule_hello (r) ;
+		}
+		break ;
 
-	if (a == nullptr)
-	    continue ;
+	    case EV_STOP :
+		sender_stop ((receiver *) e.first) ;
+		break ;
 
-	D (D_MESSAGE, "Received a message from " << *a) ;
-	m->expire_ = DATE_TIMEOUT_MS (EXCHANGE_LIFETIME (r->l2->maxlatency ())) ;
+	    case EV_SLAVE_TTL :
+		{
+		    slave *s = (slave *) e.first ;
 
-	/*
-	 * House cleaning: remove obsolete messages from deduplication list
-	 */
+		    // ttl may have been extended since it was scheduled
+		    if (s->status () == slave::SL_RUNNING)
+		    {
+			if (now >= s->next_timeout_)
+			{
+			    l2net *l2 = s->l2 () ;
+
+			    slaves_.reset (s) ;
+			    schedule (l2, EV_FILTER, now) ;
+			}
+			else
+			    schedule (s, EV_SLAVE_TTL, s->next_timeout_) ;
+		    }
+		}
+		break ;
 
-	clean_deduplist (*r) ;
+	    case EV_MSG :
+		sender_msg ((msg *) e.first, now) ;
+		break ;
 
-	/*************************************************************
-	 * CoAP message pre-processing (deduplication, correlation, etc.)
-	 */
+	    case EV_RETRANSMIT :
+		sender_msg ((msg *) e.first, now, true) ;
+		break ;
+
+	    case EV_OBSERVE :
+		// observation not refreshed by a notification
+		observe_refresh (e.first) ;
+		break ;
+
+	    case EV_FILTER :
+		sender_filter ((l2net *) e.first) ;
+		break ;
+	}
+    }
+    due_.clear () ;
+
+    sender_flush (now) ;
+}
+
+/**
+ * @brief Schedule the next hello message of a network
+ *
+ * The hello event must not replace the stop event of a network
+ * being removed (see casan::stop_net).
+ *
+ * @param r receiver private data
+ */
+
+void casan::schedule_hello (receiver *r)
+{
+    std::unique_lock <std::mutex> lk (mtx_) ;
+
+    if (r->stopped == nullptr)
+	sched_.add (r, EV_HELLO, r->next_hello) ;
+}
+
+/**
+ * @brief Stop receiving from a removed network
+ *
+ * This method is called by the sender thread, when no other event
+ * can be scheduled for this network. The receiver and worker threads
+ * (if any) are stopped, or the network is removed from the epoll set,
+ * and the receiver private data are removed. Then, casan::stop_net is
+ * notified. Messages received but not yet processed are dropped.
+ *
+ * A receiver thread blocked in l2net::recv (for networks which
+ * cannot be polled) is woken up with l2net::interrupt, so that the
+ * network is no longer used when casan::stop_net returns.
+ *
+ * @param r receiver private data
+ */
+
+void casan::sender_stop (receiver *r)
+{
+    std::promise <void> *stopped = r->stopped ;
+    int fd = r->l2->pollfd () ;
+
+    if (r->thr != NULL)
+    {
+	std::uint64_t one = 1 ;
+
+	// stop the worker thread and the receiver thread (if polled)
+	if (write (r->stopfd, &one, sizeof one) == -1)
+	    perror ("eventfd") ;
+	r->worker->join () ;
+	delete r->worker ;
+	r->worker = NULL ;
+    }
+
+    if (r->thr != NULL && fd == -1)
+    {
+	r->stop = true ;
+	r->l2->interrupt () ;
+    }
+
+    if (r->thr != NULL)
+    {
+	r->thr->join () ;
+	delete r->thr ;
+    }
+
+    if (r->polled)
+	(void) epoll_ctl (epfd_, EPOLL_CTL_DEL, fd, NULL) ;
+
+    if (r->stopfd != -1)
+	close (r->stopfd) ;
+    if (r->ringfd != -1)
+	close (r->ringfd) ;
+    delete r ;
+    stopped->set_value () ;
+}
+
+/**
+ * @brief Update the in-kernel filter of a network
+ *
+ * This method is called by the sender thread, when a slave has been
+ * bound to this network or reset (see l2net::filter). Events for a
+ * network which has been removed are ignored.
+ *
+ * @param l2 network
+ */
+
+void casan::sender_filter (l2net *l2)
+{
+    std::vector <byte> peers ;
+    bool found = false ;
+    int n = 0 ;
+
+    {
+	std::unique_lock <std::mutex> lk (rmtx_) ;
+
+	for (auto r : rlist_)
+	    if (r->l2 == l2)
+		found = true ;
+    }
+    if (! found)
+	return ;
+
+    slaves_.foreach (
+	[&peers, &n, l2]
+	(slave &s)
+	{
+	    if (s.l2 () == l2 && s.addr () != nullptr)
+	    {
+		const byte *b ;
+		int len ;
+
+		b = s.addr ()->bytes (&len) ;
+		peers.insert (peers.end (), b, b + len) ;
+		n++ ;
+	    }
+	}) ;
+
+    D (D_MESSAGE, "Filter " << n << " slave(s) on a network") ;
+    if (l2->filter (peers.data (), n) == -1)
+	perror ("filter") ;
+}
+
+/**
+ * @brief Process a message whose deadline is reached
+ *
+ * This method is called by the sender thread (without any lock
+ * held) in order to:
+ * - send a new message
+ * - retransmit a message if no answer has been received yet
+ * - remove an expired message (and call its completion function
+ *	if no answer has been received)
+ * - retransmit a message before its timeout, if the link layer
+ *	has reported that it has not been delivered
+ *
+ * Messages to send are queued, in order to be sent in batches
+ * (see casan::sender_flush) once all due events are processed.
+ *
+ * @param k message (key in the message list)
+ * @param now current date
+ * @param failed true if the last transmission has not been delivered
+ */
+
+void casan::sender_msg (msg *k, timepoint_t now, bool failed)
+{
+    msgptr_t m ;
+
+    {
+	std::unique_lock <std::mutex> lk (reqmtx_) ;
+
+	auto it = mlist_.find (k) ;
+	if (it == mlist_.end ())
+	    return ;
+	m = it->second ;
+    }
+
+    if ((m->ntrans_ == 0 && now < m->expire_) ||
+	    (m->ntrans_ < MAX_RETRANSMIT && (failed || now >= m->next_timeout_))
+	    )
+	out_.push_back (m) ;
+    else
+    {
+	// last retransmission without any answer: no longer outstanding
+	if (m->ntrans_ >= MAX_RETRANSMIT && now >= m->next_timeout_)
+	    window_release (m, now, false) ;
+	sender_done (m, now) ;
+    }
+}
+
+/**
+ * @brief Send queued messages
+ *
+ * Messages queued by casan::sender_msg are grouped by L2 network,
+ * and each group is sent with msg::send_batch. Then, the next
+ * deadline of each message is registered (see casan::sender_done).
+ *
+ * @param now current date
+ */
+
+void casan::sender_flush (timepoint_t now)
+{
+    std::size_t first = 0 ;
+
+    while (first < out_.size ())
+    {
+	msgptr_t batch [L2_BATCH] ;
+	l2net *l2 ;
+	std::size_t i, next ;
+	int n, r ;
 
 	/*
-	 * Find slave. If not found, the message is ignored
-	 * If found, a is either
+	 * Pick messages for the same network as the first one, and
+	 * move the other ones after them
 	 */
 
-	if (! find_peer (m, a, *r))
+	l2 = out_ [first]->peer ()->l2 () ;
+	n = 0 ;
+	next = first ;
+	for (i = first ; i < out_.size () && n < L2_BATCH ; i++)
 	{
-	    D (D_MESSAGE, "Sender not found in authorized peers") ;
-	    continue ;
+	    if (out_ [i]->peer ()->l2 () == l2)
+	    {
+		batch [n++] = out_ [i] ;
+		if (i != next)
+		    std::swap (out_ [i], out_ [next]) ;
+		next++ ;
+	    }
 	}
 
-	/*
-	 * Is the received message a reply to a pending request?
-	 */
+	// messages which have not been sent are moved after the other ones
+	r = l2 == nullptr ? -1 : msg::send_batch (l2, batch, n) ;
+	if (r < n)
+	    std::cout << "ERROR DURING TRANSMISSION\n" ;
+
+	for (i = 0 ; (int) i < n ; i++)
+	    sender_done (batch [i], now) ;
+	first = next ;
+    }
+    out_.clear () ;
+}
+
+/**
+ * @brief Register the next deadline of a message
+ *
+ * The message is removed if it has expired, and its completion
+ * function is called if no answer has been received. Else, its
+ * next deadline (retransmission or expiration) is registered in
+ * the scheduler.
+ *
+ * @param m message
+ * @param now current date
+ */
+
+void casan::sender_done (msgptr_t m, timepoint_t now)
+{
+    msg *k = m.get () ;
+
+    if (now >= m->expire_)
+    {
+	msg::completion_t done ;
 
-	orgreq = correlate (m) ;
-	if (orgreq != nullptr)
 	{
-	    /*
-	     * Ignore the message if an answer has already been received
-	     */
+	    std::unique_lock <std::mutex> lk (reqmtx_) ;
 
-	    if (orgreq->reqrep () != nullptr)
-		continue ;
+	    corr_remove (k) ;
+	    mlist_.erase (k) ;
+	    done.swap (m->completion_) ;
+	}
+	window_release (m, now, false) ;
 
-	    /*
-	     * This is the first reply we get.
-	     * Stop further retransmissions, link the received answer to
-	     * the original request we sent, and wake the emitter up.
-	     */
+	// no answer has been received (else completion would be null)
+	if (done)
+	    done (m) ;
+    }
+    else if (m->ntrans_ == 0)			// transmission failed
+	schedule (k, EV_MSG, now + duration_t (ACK_TIMEOUT)) ;
+    else if (m->ntrans_ < MAX_RETRANSMIT && m->next_timeout_ < m->expire_)
+	schedule (k, EV_MSG, m->next_timeout_) ;
+    else
+	schedule (k, EV_MSG, m->expire_) ;
+}
 
-	    msg::link_reqrep (orgreq, m) ;
-	    orgreq->stop_retransmit () ;
+/**
+ * @brief Account for a new CON message in the window of its slave
+ *
+ * This method is called with reqmtx_ held. Other messages (and
+ * messages to a slave not yet bound to a network) are not paced.
+ *
+ * @param m message to send
+ * @param now current date
+ * @return true if the message may be sent now, false if it is queued
+ */
+
+bool casan::window_add (msgptr_t m, timepoint_t now)
+{
+    slave *s = m->peer () ;
+
+    if (m->type () != msg::MT_CON || s == nullptr || s->l2 () == nullptr)
+	return true ;
+
+    if (s->outstanding_ < nstart_)
+    {
+	window_grant (m, s, now) ;
+	return true ;
+    }
+
+    D (D_MESSAGE, "Slave " << s->slaveid () << " window full, queueing id=" << m->id ()) ;
+    s->pending_.push_back (m) ;
+    return false ;
+}
+
+/**
+ * @brief Give a slot of the window of a slave to a message
+ *
+ * The initial timeout of the message is given by the RTO estimator
+ * of the slave, which is reset when the slave is on a new network.
+ * This method is called with reqmtx_ held.
+ *
+ * @param m message to send
+ * @param s slave (peer of the message)
+ * @param now current date
+ */
+
+void casan::window_grant (msgptr_t m, slave *s, timepoint_t now)
+{
+    if (s->l2 () != nullptr && s->rtonet_ != s->l2 ())
+    {
+	s->rto_.init (s->l2 ()->maxlatency ()) ;
+	s->rtonet_ = s->l2 () ;
+    }
+
+    s->outstanding_++ ;
+    m->inflight_ = true ;
+    m->rto_ = s->rtonet_ != nullptr ? s->rto_.timeout (now) : duration_t (0) ;
+}
+
+/**
+ * @brief Release the slot of a message which is no longer outstanding
+ *
+ * The message is no longer outstanding when it is acknowledged (by
+ * an empty ACK or a piggy-backed reply), when it is not retransmitted
+ * anymore, or when it expires. If acknowledged, the RTT is given to
+ * the estimator of the slave. The first queued message, if any, gets
+ * the slot and is scheduled.
+ *
+ * This method may be called many times for the same message: only
+ * the first call is accounted.
+ *
+ * @param m message
+ * @param now current date
+ * @param acked true if the message has been acknowledged
+ */
+
+void casan::window_release (msgptr_t m, timepoint_t now, bool acked)
+{
+    slave *s = m->peer () ;
+    msgptr_t next ;
+
+    {
+	std::unique_lock <std::mutex> lk (reqmtx_) ;
+
+	if (! m->inflight_)
+	    return ;
+	m->inflight_ = false ;
+	s->outstanding_-- ;
+
+	if (acked && s->rtonet_ != nullptr)
+	    s->rto_.sample (std::chrono::duration_cast <std::chrono::microseconds>
+					(now - m->sent_), m->ntrans_) ;
+
+	if (! s->pending_.empty () && s->outstanding_ < nstart_)
+	{
+	    next = s->pending_.front () ;
+	    s->pending_.pop_front () ;
+	    window_grant (next, s, now) ;
+	}
+    }
+
+    // a message which expired while queued is removed by sender_msg
+    if (next != nullptr)
+	schedule (next.get (), EV_MSG, now) ;
+}
 
-	    if (orgreq->wt () != nullptr)
+/******************************************************************************
+ * Receiver threads
+ *****************************************************************************/
+
+/**
+ * @brief Receiver thread
+ *
+ * Each receiver thread spends its life waiting for a message to be
+ * received on the associated interface: with poll (on the network
+ * and on an eventfd used to stop the thread) if the network can be
+ * polled, else in the l2net::recv method. Received messages are
+ * decoded, and handed off to the worker thread of the network
+ * (see casan::worker_thread).
+ *
+ * @param r receiver private data
+ */
+
+void casan::receiver_thread (receiver *r)
+{
+    struct pollfd pfd [2] ;
+
+    pfd [0].fd = r->l2->pollfd () ;
+    pfd [0].events = POLLIN ;
+    pfd [1].fd = r->stopfd ;
+    pfd [1].events = POLLIN ;
+
+    for (;;)
+    {
+	msgptr_t m ;			// received message
+	l2addr *a ;			// source address of received message
+
+	if (pfd [0].fd != -1)
+	{
+	    if (poll (pfd, 2, -1) == -1)
 	    {
-		orgreq->wt ()->wakeup () ;
+		if (errno != EINTR)
+		    perror ("poll") ;
 		continue ;
 	    }
+	    if (pfd [1].revents != 0)
+		return ;
+	    receive_all (r) ;
+	    continue ;
 	}
 
 	/*
-	 * Is this the same request as already seen?
-	 * Ignore it if an answer has already been sent (in which
-	 * case the deduplicate function send it back again).
+	 * Wait for a new message. The message (and its shared_ptr
+	 * control block) is allocated from the memory pool.
 	 */
 
-	dupmsg = deduplicate (*r, m) ;
-	if (dupmsg && dupmsg->reqrep ())
+	m = std::allocate_shared <msg> (pool_allocator <msg> ()) ;
+	a = m->recv (r->l2) ;
+
+	if (r->stop)
+	{
+	    // network removed while we were waiting (see casan::sender_stop)
+	    delete a ;
+	    return ;
+	}
+
+	if (a != nullptr && handoff (*r, m, a))
+	    handoff_notify (*r) ;
+    }
+}
+
+/**
+ * @brief Receive frames available on a network
+ *
+ * Frames are read without blocking, in a batch of at most L2_BATCH
+ * frames (see msg::recv_batch) in order to not starve other networks.
+ * Messages are preallocated for each network, and a message is only
+ * replaced if it has been used to receive a valid message.
+ *
+ * Decoded messages are handed off to the worker thread of the
+ * network if there is one (see casan::worker_thread), else they
+ * are processed in place (event loop mode).
+ *
+ * @param r receiver private data
+ */
+
+void casan::receive_all (receiver *r)
+{
+    l2addr *a [L2_BATCH] ;
+    bool queued = false ;
+    int n ;
+
+    for (auto &m : r->batch)
+	if (m == nullptr)
+	    m = std::allocate_shared <msg> (pool_allocator <msg> ()) ;
+
+    n = msg::recv_batch (r->l2, r->batch, a, L2_BATCH) ;
+
+    for (int i = 0 ; i < n ; i++)
+    {
+	if (a [i] != nullptr)
+	{
+	    msgptr_t m ;
+
+	    m.swap (r->batch [i]) ;
+	    if (r->worker == NULL)
+		receive (*r, m, a [i]) ;
+	    else if (handoff (*r, m, a [i]))
+		queued = true ;
+	    else
+		r->batch [i].swap (m) ;		// ring full: reuse message
+	}
+    }
+
+    if (queued)
+	handoff_notify (*r) ;
+}
+
+/**
+ * @brief Hand a received message off to the worker thread
+ *
+ * The message is dropped (and the overflow counter of the ring is
+ * incremented) if the worker thread is late: the message will be
+ * retransmitted by the slave if needed, as if it were lost.
+ *
+ * @param r receiver private data
+ * @param m received message (moved if queued)
+ * @param a source address of received message (freed if dropped)
+ * @return true if the message has been queued
+ */
+
+bool casan::handoff (receiver &r, msgptr_t &m, l2addr *a)
+{
+    receiver::frame f ;
+
+    f.m.swap (m) ;
+    f.a = a ;
+    if (r.ring.push (f))
+	return true ;
+
+    D (D_MESSAGE, "Receive ring full, message dropped") ;
+    m.swap (f.m) ;
+    delete a ;
+    return false ;
+}
+
+/**
+ * @brief Wake the worker thread up if it is waiting
+ *
+ * The eventfd is only written if the worker thread has announced
+ * that it is about to wait (see casan::worker_thread), in order to
+ * not make a system call for each message under load.
+ *
+ * @param r receiver private data
+ */
+
+void casan::handoff_notify (receiver &r)
+{
+    std::atomic_thread_fence (std::memory_order_seq_cst) ;
+    if (r.idle.exchange (false))
+    {
+	std::uint64_t one = 1 ;
+
+	if (write (r.ringfd, &one, sizeof one) == -1)
+	    perror ("eventfd") ;
+    }
+}
+
+/**
+ * @brief Worker thread
+ *
+ * Each network handled by a receiver thread has a worker thread,
+ * which processes messages decoded by the receiver thread: peer
+ * matching, deduplication, correlation and slave protocol handling
+ * (see casan::receive). Thus, a slow processing step does not
+ * delay reads from the network, which could drop frames in the
+ * kernel or in the device.
+ *
+ * Messages are handed off through a lock-free ring. When the ring
+ * is empty, the worker thread waits on an eventfd, as well as on
+ * the eventfd used to stop the receiver thread.
+ *
+ * @param r receiver private data
+ */
+
+void casan::worker_thread (receiver *r)
+{
+    struct pollfd pfd [2] ;
+
+    pfd [0].fd = r->ringfd ;
+    pfd [0].events = POLLIN ;
+    pfd [1].fd = r->stopfd ;
+    pfd [1].events = POLLIN ;
+
+    for (;;)
+    {
+	receiver::frame f ;
+
+	while (r->ring.pop (f))
+	{
+	    receive (*r, f.m, f.a) ;
+	    f.m = nullptr ;
+	}
+
+	/*
+	 * Announce that we are about to wait, and check again: a
+	 * message may have been queued before the announcement.
+	 */
+
+	r->idle = true ;
+	std::atomic_thread_fence (std::memory_order_seq_cst) ;
+	if (! r->ring.empty ())
+	{
+	    r->idle = false ;
 	    continue ;
+	}
+
+	if (poll (pfd, 2, -1) == -1)
+	{
+	    if (errno != EINTR)
+		perror ("poll") ;
+	    continue ;
+	}
+	if (pfd [1].revents != 0)
+	    return ;
+	if (pfd [0].revents != 0)
+	{
+	    std::uint64_t v ;
+
+	    if (read (r->ringfd, &v, sizeof v) == -1 && errno != EAGAIN)
+		perror ("eventfd") ;
+	}
+    }
+}
+
+/**
+ * @brief Process a received message
+ *
+ * This method is called by a worker thread, or by the sender thread
+ * in event loop mode.
+ *
+ * A de-duplication list is managed for each network (as specified
+ * in the CoAP specification) to eliminate received answers which
+ * are duplicated (i.e. already received).
+ *
+ * @param r receiver private data
+ * @param m received message
+ * @param a source address of received message
+ */
+
+void casan::receive (receiver &r, msgptr_t m, l2addr *a)
+{
+    msgptr_t orgreq ;		// message correlation result
+
+    D (D_MESSAGE, "Received a message from " << *a) ;
+    m->expire_ = DATE_TIMEOUT_MS (EXCHANGE_LIFETIME (r.l2->maxlatency ())) ;
+
+    /*
+     * House cleaning: remove obsolete messages from deduplication set
+     */
 
-	/*************************************************************
-	 * Message processing
+    r.dedupset.expire (std::chrono::system_clock::now ()) ;
+
+    /*************************************************************
+     * CoAP message pre-processing (deduplication, correlation, etc.)
+     */
+
+    /*
+     * Find slave. If not found, the message is ignored
+     * If found, a is either
+     */
+
+    if (! find_peer (m, a, r))
+    {
+	D (D_MESSAGE, "Sender not found in authorized peers") ;
+	return ;
+    }
+
+    /*
+     * Is the received message a reply to a pending request?
+     */
+
+    orgreq = correlate (m) ;
+
+    /*
+     * Is it a notification for an observed resource? The first
+     * one is the reply to the registration request, and it is
+     * handled as such.
+     */
+
+    if ((orgreq == nullptr || orgreq->reqrep () != nullptr) && notify (m))
+	return ;
+
+    if (orgreq != nullptr)
+    {
+	/*
+	 * A separate response sent as a CON message must be
+	 * acknowledged (even if it is a duplicate)
+	 */
+
+	if (m->type () == msg::MT_CON)
+	{
+	    msg ack ;
+
+	    ack.peer (m->peer ()) ;
+	    ack.type (msg::MT_ACK) ;
+	    ack.id (m->id ()) ;
+	    (void) ack.send () ;
+	}
+
+	/*
+	 * Ignore the message if an answer has already been received
 	 */
 
+	if (orgreq->reqrep () != nullptr)
+	    return ;
+
 	/*
-	 * Check CASAN control messages first
+	 * An empty ACK means that the answer will be sent later
+	 * in a separate response: just stop retransmissions.
 	 */
 
-	if (m->casan_type () != msg::CASAN_NONE)
+	if (m->type () == msg::MT_ACK && m->code () == msg::MC_EMPTY)
 	{
-	    m->peer ()->process_casan (this, m) ;
-	    continue ;
+	    window_release (orgreq, std::chrono::system_clock::now (), true) ;
+	    orgreq->stop_retransmit () ;
+	    return ;
 	}
 
 	/*
-	 * If we get here, message is an orphaned message
+	 * This is the first reply we get.
+	 * Stop further retransmissions, link the received answer to
+	 * the original request we sent, and call the completion
+	 * function or wake the emitter up.
 	 */
 
-	if (m->peer ()->status () == slave::SL_RUNNING)
+	msg::link_reqrep (orgreq, m) ;
+	window_release (orgreq, std::chrono::system_clock::now (), true) ;
+	orgreq->stop_retransmit () ;
+
+	msg::completion_t done ;
+	{
+	    std::unique_lock <std::mutex> lk (reqmtx_) ;
+
+	    done.swap (orgreq->completion_) ;
+	}
+
+	if (done)
 	{
-	    D (D_MESSAGE, "Orphaned message from " << *(m->peer ()->addr ()) << ", id=" << m->id ()) ;
+	    done (orgreq) ;
+	    return ;
+	}
+
+	if (orgreq->wt () != nullptr)
+	{
+	    orgreq->wt ()->wakeup () ;
+	    return ;
 	}
     }
+
+    /*
+     * Is this the same request as already seen?
+     * Ignore it if an answer has already been sent (in which
+     * case the deduplicate function send it back again).
+     */
+
+    if (deduplicate (r, m))
+	return ;
+
+    /*************************************************************
+     * Message processing
+     */
+
+    /*
+     * Check CASAN control messages first
+     */
+
+    if (m->casan_type () != msg::CASAN_NONE)
+    {
+	m->peer ()->process_casan (this, m) ;
+
+	/*
+	 * Slave may have been associated: (re)schedule its ttl
+	 */
+
+	if (m->peer ()->status () == slave::SL_RUNNING)
+	    schedule (m->peer (), EV_SLAVE_TTL, m->peer ()->next_timeout_) ;
+	return ;
+    }
+
+    /*
+     * If we get here, message is an orphaned message
+     */
+
+    if (m->peer ()->status () == slave::SL_RUNNING)
+    {
+	D (D_MESSAGE, "Orphaned message from " << *(m->peer ()->addr ()) << ", id=" << m->id ()) ;
+    }
 }
 
+/**
+ * @brief Find the slave which sent a message
+ *
+ * The slave is looked up with the source address of the message.
+ * If it is not found, the message may be a Discover message from
+ * a registered slave coming up: in this case, the slave is bound
+ * to this network and address.
+ *
+ * @param m received message (its peer is set if found)
+ * @param a source address (freed or kept by the slave registry)
+ * @param r receiver private data
+ * @return true if the peer is found
+ */
+
 bool casan::find_peer (msgptr_t m, l2addr *a, receiver &r)
 {
     bool found ;
@@ -598,19 +1671,17 @@ bool casan::find_peer (msgptr_t m, l2addr *a, receiver &r)
     if (a != nullptr)
     {
 	bool free_a = true ;
+	slave *s ;
 
 	/*
 	 * Is the peer already known?
 	 */
 
-	for (auto &s : slist_)
+	s = slaves_.find (r.l2, a) ;
+	if (s != nullptr)
 	{
-	    if (s.addr () != 0 && *a == *(s.addr ()))
-	    {
-		m->peer (&s) ;
-		found = true ;
-		break ;
-	    }
+	    m->peer (s) ;
+	    found = true ;
 	}
 
 	/*
@@ -625,28 +1696,32 @@ bool casan::find_peer (msgptr_t m, l2addr *a, receiver &r)
 
 	    if (m->is_casan_discover (sid, mtu))
 	    {
-		for (auto &s : slist_)
+		s = slaves_.find (sid) ;
+		if (s != nullptr)
 		{
-		    if (sid == s.slaveid ())
-		    {
-			int l2mtu, defmtu ;
-
-			s.l2 (r.l2) ;
-			s.addr (a) ; free_a = false ;
-			m->peer (&s) ;
-
-			// MTU negociation
-			l2mtu = r.l2->mtu () ;	// MTU of network
-			defmtu = s.defmtu () ;	// user configured network MTU
-			if (defmtu <= 0 || defmtu > l2mtu)
-			    defmtu = l2mtu ;
-			if (mtu <= 0 || mtu > defmtu)
-			    mtu = defmtu ;
-			s.curmtu (mtu) ;
-
-			found = true ;
-			break ;
-		    }
+		    int l2mtu, defmtu ;
+
+		    l2net *prev = s->l2 () ;
+		    timepoint_t now = std::chrono::system_clock::now () ;
+
+		    slaves_.bind (s, r.l2, a) ; free_a = false ;
+		    m->peer (s) ;
+
+		    // accept frames from this slave in the kernel
+		    schedule (r.l2, EV_FILTER, now) ;
+		    if (prev != nullptr && prev != r.l2)
+			schedule (prev, EV_FILTER, now) ;
+
+		    // MTU negociation
+		    l2mtu = r.l2->mtu () ;	// MTU of network
+		    defmtu = s->defmtu () ;	// user configured network MTU
+		    if (defmtu <= 0 || defmtu > l2mtu)
+			defmtu = l2mtu ;
+		    if (mtu <= 0 || mtu > defmtu)
+			mtu = defmtu ;
+		    s->curmtu (mtu) ;
+
+		    found = true ;
 		}
 	    }
 	}
@@ -658,13 +1733,149 @@ bool casan::find_peer (msgptr_t m, l2addr *a, receiver &r)
     return found ;
 }
 
+/**
+ * @brief Retransmit a request which has not been delivered
+ *
+ * This method is called by the receiving thread of a network, when
+ * the link layer reports that a frame has not been delivered (see
+ * l2net::txfail). If the frame is a confirmable request still
+ * waiting for its acknowledgement, it is retransmitted at once
+ * instead of waiting for its timeout.
+ *
+ * @param l2 network
+ * @param a destination address
+ * @param data encoded message (CoAP header: type in the first byte,
+ *	message id in the third and fourth bytes)
+ * @param len message length
+ */
+
+void casan::tx_failure (l2net *l2, l2addr *a, const byte *data, int len)
+{
+    corrkey k ;
+    msg *m = nullptr ;
+
+    if (len < 4 || ((data [0] >> 4) & 0x3) != msg::MT_CON)
+	return ;
+
+    k.peer = slaves_.find (l2, a) ;
+    if (k.peer == nullptr)
+	return ;
+    k.len = 0 ;
+    k.val = INT16 (data [2], data [3]) ;
+
+    {
+	std::unique_lock <std::mutex> lk (reqmtx_) ;
+
+	auto it = corrlist_.find (k) ;
+	if (it != corrlist_.end ())
+	    m = it->second.get () ;
+    }
+
+    if (m != nullptr)
+    {
+	D (D_MESSAGE, "Early retransmit id=" << k.val) ;
+	schedule (m, EV_RETRANSMIT, std::chrono::system_clock::now ()) ;
+    }
+}
+
+/******************************************************************************
+ * Correlation index
+ *****************************************************************************/
+
+std::size_t casan::corrhash::operator() (const corrkey &k) const
+{
+    std::size_t h ;
+
+    h = std::hash <void *> () (k.peer) ;
+    h ^= std::hash <std::uint64_t> () (k.val) + 0x9e3779b9 + (h << 6) + (h >> 2) ;
+    return h ^ k.len ;
+}
+
+/**
+ * @brief Build the correlation key for the message id of a message
+ *
+ * @param m message
+ * @return correlation key
+ */
+
+casan::corrkey casan::corrkey_id (msg *m)
+{
+    corrkey k ;
+
+    k.peer = m->peer_ ;
+    k.len = 0 ;
+    k.val = m->id_ ;
+    return k ;
+}
+
+/**
+ * @brief Build the correlation key for the token of a message
+ *
+ * @param m message
+ * @return correlation key
+ */
+
+casan::corrkey casan::corrkey_token (msg *m)
+{
+    corrkey k ;
+
+    k.peer = m->peer_ ;
+    k.len = m->toklen_ ;
+    k.val = 0 ;
+    for (int i = 0 ; i < m->toklen_ ; i++)
+	k.val = (k.val << 8) | m->token_ [i] ;
+    return k ;
+}
+
+/**
+ * @brief Register a message in the correlation index
+ *
+ * Only messages which may be answered are registered: confirmable
+ * messages by their message id (for ACK or RST), and requests by
+ * their token (for separate responses).
+ * The request table must be locked.
+ *
+ * @param m message to be sent
+ */
+
+void casan::corr_add (msgptr_t m)
+{
+    if (m->type_ == msg::MT_CON)
+	corrlist_ [corrkey_id (m.get ())] = m ;
+    if (m->toklen_ > 0 && m->type_ != msg::MT_ACK)
+	corrlist_ [corrkey_token (m.get ())] = m ;
+}
+
+/**
+ * @brief Remove a message from the correlation index
+ *
+ * Entries are only removed if they still reference this message
+ * (the message id or token may have been reused since).
+ * The request table must be locked.
+ *
+ * @param m expired message
+ */
+
+void casan::corr_remove (msg *m)
+{
+    corrkey keys [2] = { corrkey_id (m), corrkey_token (m) } ;
+
+    for (auto &k : keys)
+    {
+	auto it = corrlist_.find (k) ;
+	if (it != corrlist_.end () && it->second.get () == m)
+	    corrlist_.erase (it) ;
+    }
+}
+
 /**
  * @brief Message correlation
  *
- * Message correlation: see CoAP spec, section 4.4
+ * Message correlation: see CoAP spec, section 4.4 and 5.3.2
  * Is the received message a reply to an already sent request?
- * For this, we need to perform a search in the message list
- * for a request message with this id.
+ * An ACK or a RST is matched with the message id, and a separate
+ * response (CON or NON) is matched with the token, both from
+ * the same peer. Lookups use the correlation index.
  *
  * @param m received message
  * @return pointer to our original request if the message is
@@ -676,102 +1887,64 @@ msgptr_t casan::correlate (msgptr_t m)
 {
     msg::msgtype mt ;
     msgptr_t orgmsg ;
+    corrkey k ;
 
-    orgmsg = 0 ;
     mt = m->type () ;
     if (mt == msg::MT_ACK || mt == msg::MT_RST)
-    {
-	std::unique_lock <std::mutex> lk (mtx_) ;
-	int id ;
+	k = corrkey_id (m.get ()) ;
+    else if (m->toklen_ > 0 && (m->code () >> 5) != 0)
+	k = corrkey_token (m.get ()) ;
+    else
+	return nullptr ;
 
-	id = m->id () ;
-	for (auto &mr : mlist_)
-	{
-	    if (mr->id () == id)
-	    {
-		/* Got it! Original request found */
-		D (D_MESSAGE, "Found original request for id=" << id) ;
-		orgmsg = mr ;
-		break ;
-	    }
-	}
+    std::unique_lock <std::mutex> lk (reqmtx_) ;
+
+    auto it = corrlist_.find (k) ;
+    if (it != corrlist_.end ())
+    {
+	/* Got it! Original request found */
+	D (D_MESSAGE, "Found original request for id=" << m->id ()) ;
+	orgmsg = it->second ;
     }
 
     return orgmsg ;
 }
 
-/**
- * @brief Remove obsolete items from deduplication list
- *
- * @param r receiver private data
- */
-
-void casan::clean_deduplist (receiver &r)
-{
-    timepoint_t now = std::chrono::system_clock::now () ;
-
-    /*
-     * Remove expired messages (using a C++ lambda)
-     */
-
-    r.deduplist.remove_if (
-	[now]
-	(const msgptr_t &m)
-	{
-	    return now > m->expire_ ;
-	}) ;
-
-}
-
 /**
  * @brief Check if a message is a duplicated one
  *
- * This method checks if a message has already been received.
- * If this is the case, returns the original message.
- * If an answer has already been sent (the message is marked as such with
- * the reqrep method), send it back again
+ * This method checks if a CON/NON message has already been received
+ * (see the dedup class). If this is the case and if an answer has
+ * already been sent, send it back again.
  *
  * @param r receiver private data
  * @param m message to check
- * @return original message if m is a duplicate, or NULL if not found
+ * @return true if m is a duplicate which has already been answered
  */
 
-msgptr_t casan::deduplicate (receiver &r, msgptr_t m)
+bool casan::deduplicate (receiver &r, msgptr_t m)
 {
     msg::msgtype mt ;
-    msgptr_t orgmsg ;
+    msgptr_t rep ;
+    bool dup ;
 
-    orgmsg = 0 ;			// no duplicate
+    dup = false ;
     mt = m->type () ;
     if (mt == msg::MT_CON || mt == msg::MT_NON)
     {
-	for (auto &d : r.deduplist)
-	{
-	    if (*m == *d)
-	    {
-		orgmsg = *(&d) ;
-		break ;
-	    }
-	}
-
-	if (orgmsg && orgmsg->reqrep ())
+	dup = r.dedupset.check (m, m->expire_, rep) ;
+	if (dup && rep != nullptr)
 	{
 	    /*
 	     * Found a duplicated message (and an answer). Just send
 	     * back the already sent answer.
 	     */
-	    D (D_MESSAGE, "DUPLICATE MESSAGE id=" << orgmsg->id ()) ;
-	    (void) orgmsg->reqrep ()->send () ;
-	}
-	else
-	{
-	    // store the new message on deduplist with a timeout
-	    m->expire_ = DATE_TIMEOUT_MS (EXCHANGE_LIFETIME (r.l2->maxlatency ())) ;
+	    D (D_MESSAGE, "DUPLICATE MESSAGE id=" << m->id ()) ;
+	    (void) rep->send () ;
 	}
     }
-    r.deduplist.push_back (m) ;
 
-    return orgmsg ;
+    return dup && rep != nullptr ;
 }
 
 }					// end of namespace casan
@@ -7,19 +7,29 @@
 #define	CASAN_CASAN_H
 
 #include <list>
+#include <vector>
+#include <utility>
 #include <string>
 #include <memory>
+#include <unordered_map>
+#include <atomic>
+#include <cstdint>
 
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <functional>
 
 #include "msg.h"
 #include "slave.h"
+#include "scheduler.h"
+#include "dedup.h"
+#include "registry.h"
 
 namespace casan {
 
 class l2net ;
+class resource ;
 
 /**
  * @brief CASAN engine class
@@ -35,12 +45,49 @@ class l2net ;
  * - setting the sender condition variable and signalling this thread
  *
  * There is a receiver thread by L2 network. These receiver threads
- * are used to receive events from slaves:
+ * only read and decode messages, and hand them off (through a
+ * lock-free ring, see casan::limit_ring) to a worker thread by L2
+ * network, which processes events from slaves:
  * - events which can be matched with a request are handled through
- *   a wake up of the emitting thread
+ *   the request completion function, or a wake up of the emitting
+ *   thread
  * - events which can not be paired with a request are handled through
  *   the slave handler
  * - events which are not issued by a recognized slave are ignored.
+ *
+ * In event loop mode (see casan::event_loop), there is no receiver
+ * thread for networks which can be polled: the sender thread waits
+ * for incoming frames on all of them (with epoll) as well as for
+ * its next timer, and processes them as receiver threads would do.
+ * Networks can be added and removed at any time, and the engine
+ * can be stopped (casan::stop) in both modes.
+ *
+ * Engine state is split into separately synchronized domains, in
+ * order to keep HTTP threads, receiver threads and the sender thread
+ * from serializing on a single lock:
+ * - the outstanding request table (messages sent, correlation
+ *   index and completion functions), protected by reqmtx_
+ * - the slave registry, with shared access for lookups (see the
+ *   registry class). Slave addresses are shared (see slave::addr):
+ *   a slave may be bound to a new address or reset while a message
+ *   is sent to its previous address, which is freed afterwards.
+ * - the receiver list, protected by rmtx_
+ * - the messages received on each network, handed off from the
+ *   receiver thread to the worker thread without any lock
+ * - the scheduler, protected by mtx_ (associated with the
+ *   condition variable used to wake the sender thread up)
+ * - the observed resources and their subscribers, protected
+ *   by obsmtx_
+ * No thread holds two of these locks at the same time, and the
+ * sender thread does not hold any lock while it sends messages.
+ * Completion functions are called without any lock held.
+ *
+ * CON messages to a slave are paced (see casan::limit_nstart): at
+ * most NSTART of them are outstanding, the other ones are queued in
+ * the slave until an exchange completes. The initial timeout of each
+ * CON message is estimated from the RTTs measured with this slave
+ * (see the rto class). Windows and estimators are part of the
+ * outstanding request table.
  */
 
 class casan
@@ -51,8 +98,9 @@ class casan
 
 	friend std::ostream& operator<< (std::ostream &os, const casan &se) ;
 
-	// start sender thread
+	// start sender thread, and stop all threads
 	void init (void) ;
+	void stop (void) ;
 
 	// accessors and mutators
 	casantimer_t timer_slave_ttl (void)	{ return slave_ttl_ ; }
@@ -61,6 +109,14 @@ class casan
 	void timer_slave_ttl (casantimer_t t) 	{ slave_ttl_ = t ; }
 	void timer_first_hello (casantimer_t t) { first_hello_ = t ; }
 	void timer_interval_hello (casantimer_t t) { interval_hello_ = t ; }
+	long int limit_dedup (void)		{ return dedup_max_ ; }
+	void limit_dedup (long int n)		{ dedup_max_ = n ; }
+	long int limit_ring (void)		{ return ring_max_ ; }
+	void limit_ring (long int n)		{ ring_max_ = n ; } // before start_net
+	int limit_nstart (void)			{ return nstart_ ; }
+	void limit_nstart (int n)		{ nstart_ = n < 1 ? 1 : n ; }
+	bool event_loop (void)			{ return evloop_ ; }
+	void event_loop (bool on)		{ evloop_ = on ; } // before init
 
 	// start and stop receiver thread
 	void start_net (l2net *l2) ;
@@ -71,10 +127,19 @@ class casan
 
 	// add a request
 	void add_request (msgptr_t m) ;
+	void add_request (msgptr_t m, msg::completion_t c) ;
 
 	// find a slave by it's slave id
 	slave *find_slave (slaveid_t sid) ;
 
+	// observe a resource (see observe.cc)
+	typedef std::function <void (msgptr_t notif)> notify_t ;
+	int observe (slave *s, resource *res, notify_t n) ;
+	void unobserve (int id) ;
+
+	// receive ring statistics of a network (see limit_ring)
+	bool ring_stats (l2net *l2, long int &peak, long int &overflow) ;
+
 	// dump data structures
 	std::string html_debug (void) ;
 	std::string resource_list (void) ;	// aggregated .well-known/casan
@@ -83,24 +148,117 @@ class casan
 	struct receiver ;		// receiver private data
 
 	std::list <receiver *> rlist_ ;	// connected networks
-	std::list <slave> slist_ ;	// registered slaves
-	std::list <msgptr_t> mlist_ ;	// messages sent by CASAN
+	std::mutex rmtx_ ;		// protects rlist_
 
-	std::thread *tsender_ ;
+	registry slaves_ ;		// registered slaves
 
-	std::mutex mtx_ ;
+	// events handled by the sender thread
+	enum evtype { EV_START, EV_HELLO, EV_SLAVE_TTL, EV_MSG, EV_RETRANSMIT,
+			EV_OBSERVE, EV_FILTER, EV_STOP } ;
+	scheduler sched_ ;		// next event for each object
+	std::mutex mtx_ ;		// protects sched_
 	std::condition_variable condvar_ ;
 
+	/*
+	 * Outstanding request table (protected by reqmtx_)
+	 */
+
+	std::unordered_map <msg *, msgptr_t> mlist_ ; // messages sent by CASAN
+	std::mutex reqmtx_ ;
+
+	/*
+	 * Correlation index: pending requests, indexed by peer and
+	 * message id (for ACK/RST) or by peer and token (for separate
+	 * responses). Since a peer is a (l2net, address) pair, replies
+	 * from different slaves using the same message id or token
+	 * are not mixed up.
+	 */
+
+	struct corrkey
+	{
+	    slave *peer ;
+	    int len ;			// 0 for a message id, or token length
+	    std::uint64_t val ;		// message id or token value
+	    bool operator== (const corrkey &k) const
+	    {
+		return peer == k.peer && len == k.len && val == k.val ;
+	    }
+	} ;
+	struct corrhash
+	{
+	    std::size_t operator() (const corrkey &k) const ;
+	} ;
+	std::unordered_map <corrkey, msgptr_t, corrhash> corrlist_ ;
+	std::atomic <unsigned int> tokcount_ ;	// token generator
+
+	/*
+	 * Observed resources (protected by obsmtx_): one observation
+	 * for each (slave, resource), shared by all its subscribers,
+	 * and indexed by the token used for the registration.
+	 */
+
+	struct observation ;
+	typedef std::shared_ptr <observation> obsptr_t ;
+	std::unordered_map <corrkey, obsptr_t, corrhash> obslist_ ;
+	std::unordered_map <int, obsptr_t> subs_ ; // subscriber id -> obs.
+	int obsid_ = 0 ;		// last subscriber id
+	std::mutex obsmtx_ ;
+
+	std::thread *tsender_ ;
+	bool stop_ = false ;		// sender must exit (protected by mtx_)
+	std::vector <std::pair <void *, int>> due_ ; // see sender_events
+	std::vector <msgptr_t> out_ ;	// see sender_flush
+
+	/*
+	 * In event loop mode, the sender thread also receives frames
+	 * from all networks which can be polled (see l2net::pollfd).
+	 */
+
+	bool evloop_ = false ;
+	int epfd_ = -1 ;		// epoll descriptor
+	int wakefd_ = -1 ;		// eventfd to wake the sender thread up
+	std::thread::id sender_id_ ;	// protected by mtx_
+
 	casantimer_t first_hello_ ;	// delay before first hello message
 	casantimer_t interval_hello_ ;	// hello message interval
 	casantimer_t slave_ttl_ ;	// default slave ttl (in sec)
+	long int dedup_max_ = dedup::DEFAULT_MAXSIZE ; // dedup set size
+	long int ring_max_ = 8192 ;	// receive ring size (see spsc)
+	int nstart_ = NSTART ;		// outstanding CON messages per slave
 
+	void schedule (void *key, int type, timepoint_t date) ;
+	void wakeup (void) ;
 	void sender_thread (void) ;
+	void event_loop_thread (void) ;
+	void sender_events (void) ;
+	void sender_msg (msg *k, timepoint_t now, bool failed = false) ;
+	void sender_flush (timepoint_t now) ;
+	void sender_done (msgptr_t m, timepoint_t now) ;
+	bool window_add (msgptr_t m, timepoint_t now) ;
+	void window_grant (msgptr_t m, slave *s, timepoint_t now) ;
+	void window_release (msgptr_t m, timepoint_t now, bool acked) ;
+	void sender_stop (receiver *r) ;
+	void sender_filter (l2net *l2) ;
+	void schedule_hello (receiver *r) ;
 	void receiver_thread (receiver *r) ;
-	void clean_deduplist (receiver &r) ;
-	msgptr_t deduplicate (receiver &r, msgptr_t m) ;
+	void receive_all (receiver *r) ;
+	bool handoff (receiver &r, msgptr_t &m, l2addr *a) ;
+	void handoff_notify (receiver &r) ;
+	void worker_thread (receiver *r) ;
+	void receive (receiver &r, msgptr_t m, l2addr *a) ;
+	bool deduplicate (receiver &r, msgptr_t m) ;
 	bool find_peer (msgptr_t m, l2addr *a, receiver &r) ;
+	void tx_failure (l2net *l2, l2addr *a, const byte *data, int len) ;
+	static corrkey corrkey_id (msg *m) ;
+	static corrkey corrkey_token (msg *m) ;
+	void corr_add (msgptr_t m) ;
+	void corr_remove (msg *m) ;
 	msgptr_t correlate (msgptr_t m) ;
+	void observe_register (obsptr_t o, int obsval) ;
+	void observe_deliver (obsptr_t o, msgptr_t r) ;
+	void observe_refresh (void *key) ;
+	bool notify (msgptr_t m) ;
+	std::string html_observe (void) ;
 } ;
 
 }					// end of namespace casan
@@ -53,6 +53,17 @@ namespace casan {
 #define	EXCHANGE_LIFETIME(maxlat)	(MAX_TRANSMIT_SPAN+(2*(maxlat))+PROCESSING_DELAY)
 /** time from sending a Non-confirmable message to the time its Message ID can be safely reused */
 #define	NON_LIFETIME(maxlat)	(MAX_TRANSMIT_SPAN+(maxlat))
+/** default Max-Age option value (in seconds) */
+#define	DEFAULT_MAX_AGE	60
+
+/*
+ * Observe constants (see RFC 7641)
+ */
+
+/** an older notification is accepted after this delay (ms, see 3.4) */
+#define	OBSERVE_FRESHNESS	128000
+/** notification sequence numbers are 24 bits wide */
+#define	OBSERVE_SERIAL_WINDOW	(1<<23)
 
 }					// end of namespace casan
 #endif
@@ -0,0 +1,103 @@
+/**
+ * @file dedup.cc
+ * @brief Deduplication set implementation
+ */
+
+#include <deque>
+#include <unordered_map>
+
+#include "global.h"
+
+#include "msg.h"
+#include "dedup.h"
+
+namespace casan {
+
+std::size_t dedup::keyhash::operator() (const key &k) const
+{
+    return std::hash <void *> () (k.peer) ^ (std::size_t (k.id) << 1) ;
+}
+
+/**
+ * @brief Check if a received message is a duplicate
+ *
+ * If the message (i.e. same peer, same message id and same contents)
+ * is already present in the set, returns the reply already sent.
+ * Else, the message is added to the set (replacing a previous message
+ * with the same id but different contents, if any).
+ *
+ * @param m received message (peer must be known)
+ * @param expire expiration date of the entry
+ * @param reply reply already sent, if the message is a duplicate
+ * @return true if the message is a duplicate
+ */
+
+bool dedup::check (msgptr_t m, timepoint_t expire, msgptr_t &reply)
+{
+    key k ;
+    std::uint64_t fp ;
+
+    k.peer = m->peer () ;
+    k.id = m->id () ;
+    fp = m->fingerprint () ;
+
+    auto it = set_.find (k) ;
+    if (it != set_.end () && it->second.fp == fp)
+    {
+	reply = it->second.reply ;
+	return true ;
+    }
+
+    /*
+     * New message: enforce the size limit, and add it. The
+     * FIFO (which may contain obsolete entries) is bounded as well.
+     */
+
+    while (! fifo_.empty () && fifo_.size () >= max_)
+	pop () ;
+
+    entry &e = set_ [k] ;
+    e.fp = fp ;
+    e.seq = seq_ ;
+    e.reply = m->reqrep () ;
+
+    fifoentry f ;
+    f.k = k ;
+    f.seq = seq_++ ;
+    f.expire = expire ;
+    fifo_.push_back (f) ;
+
+    reply = nullptr ;
+    return false ;
+}
+
+/**
+ * @brief Remove expired entries
+ *
+ * @param now current date
+ */
+
+void dedup::expire (timepoint_t now)
+{
+    while (! fifo_.empty () && now > fifo_.front ().expire)
+	pop () ;
+}
+
+/**
+ * @brief Remove the oldest entry
+ *
+ * The hash table entry is only removed if it has not been replaced
+ * by a more recent message with the same key.
+ */
+
+void dedup::pop (void)
+{
+    fifoentry &f = fifo_.front () ;
+
+    auto it = set_.find (f.k) ;
+    if (it != set_.end () && it->second.seq == f.seq)
+	set_.erase (it) ;
+    fifo_.pop_front () ;
+}
+
+}					// end of namespace casan
@@ -0,0 +1,87 @@
+/**
+ * @file dedup.h
+ * @brief Deduplication set interface
+ */
+
+#ifndef CASAN_DEDUP_H
+#define	CASAN_DEDUP_H
+
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+
+#include "msg.h"
+
+namespace casan {
+
+class slave ;
+
+/**
+ * @brief Set of recently received messages
+ *
+ * This class records CON/NON messages received on a L2 network in
+ * order to detect duplicates (see CoAP spec, section 4.5). Messages
+ * are identified by their source (the peer slave, i.e. a L2 network
+ * and an address) and their message id. Only a fingerprint of the
+ * message is kept, with the reply already linked to the message
+ * (if any).
+ *
+ * All messages received on a network have the same lifetime, thus
+ * entries expire in insertion order: they are kept in a FIFO queue
+ * besides the hash table, and cleaning is amortized O(1).
+ *
+ * The number of entries is bounded: when the limit is reached, the
+ * oldest entry is removed before the new one is added.
+ *
+ * This class is not thread-safe: each receiver thread owns its set.
+ */
+
+class dedup
+{
+    public:
+	void maxsize (std::size_t max)	{ max_ = max ; }
+	std::size_t maxsize (void)	{ return max_ ; }
+	std::size_t size (void)		{ return set_.size () ; }
+
+	bool check (msgptr_t m, timepoint_t expire, msgptr_t &reply) ;
+	void expire (timepoint_t now) ;
+
+	static const std::size_t DEFAULT_MAXSIZE = 10000 ;
+
+    private:
+	struct key
+	{
+	    slave *peer ;
+	    int id ;
+	    bool operator== (const key &k) const
+	    {
+		return peer == k.peer && id == k.id ;
+	    }
+	} ;
+	struct keyhash
+	{
+	    std::size_t operator() (const key &k) const ;
+	} ;
+	struct entry
+	{
+	    std::uint64_t fp ;		// fingerprint of received message
+	    unsigned long seq ;		// sequence number in fifo_
+	    msgptr_t reply ;		// reply sent, or nullptr
+	} ;
+	struct fifoentry
+	{
+	    key k ;
+	    unsigned long seq ;
+	    timepoint_t expire ;
+	} ;
+
+	std::unordered_map <key, entry, keyhash> set_ ;
+	std::deque <fifoentry> fifo_ ;	// in expiration order
+	unsigned long seq_ = 0 ;
+	std::size_t max_ = DEFAULT_MAXSIZE ;
+
+	void pop (void) ;
+} ;
+
+}					// end of namespace casan
+#endif
@@ -5,12 +5,18 @@
 
 #include <iostream>
 #include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <chrono>
 
 // #define	_BSD_SOURCE			// for termios on Linux
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
 #include <unistd.h>
 
 #include <termios.h>
@@ -28,6 +34,11 @@
 
 #define	XBEE_START		0x7e		// XBee API start delimiter
 #define	XBEE_TX_SHORT		0x01		// XBee API command id
+#define	XBEE_TX_SUCCESS		0		// TX_STATUS: frame acknowledged
+
+/* Delays (ms) to wait for the answer to AT commands */
+#define	XBEE_CMDMODE_TIMEOUT	1500		// "+++": guard time + margin
+#define	XBEE_AT_TIMEOUT		500
 
 /*
  * MTU is expressed as the maximum MAC frame size, i.e. L2154_MTU bytes
@@ -135,7 +146,7 @@ l2addr_154::l2addr_154 (const l2addr_154 &l)
 l2addr_154 &l2addr_154::operator= (const l2addr_154 &l)
 {
     if (this != &l)
-	*this = l ;
+	std::memcpy (addr_, l.addr_, L2154ADDRLEN) ;
     return *this ;
 }
 
@@ -173,25 +184,71 @@ bool l2addr_154::operator!= (const l2addr &other)
     return ! (*this == other) ;
 }
 
+/**
+ * @brief Returns raw address bytes (used to index addresses)
+ */
+
+const byte *l2addr_154::bytes (int *len) const
+{
+    *len = L2154ADDRLEN ;
+    return addr_ ;
+}
+
 /******************************************************************************
  * l2net_154 methods
  */
 
+/*
+ * Serial line speeds supported by the XBee, with the value of the
+ * BD parameter
+ */
+
+static struct
+{
+    int baud ;
+    speed_t speed ;
+    int bd ;
+} xbee_speeds [] =
+{
+    { 1200,	B1200,		0 },
+    { 2400,	B2400,		1 },
+    { 4800,	B4800,		2 },
+    { 9600,	B9600,		3 },
+    { 19200,	B19200,		4 },
+    { 38400,	B38400,		5 },
+    { 57600,	B57600,		6 },
+    { 115200,	B115200,	7 },
+} ;
+
+static int find_speed (int baud)
+{
+    for (int i = 0 ; i < NTAB (xbee_speeds) ; i++)
+	if (xbee_speeds [i].baud == baud)
+	    return i ;
+    return -1 ;
+}
+
 /**
  * @brief Initialize an IEEE 802.15.4 network access
  *
  * Initialize the IEEE 802.15.4 network access with needed constants.
  *
+ * The XBee is configured with AT commands, each one waiting for the
+ * `OK` answer. It is first reached at the requested speed (it may
+ * have been configured by a previous run), then at the factory
+ * speed.
+ *
  * @param iface entry in /dev (with or without /dev) for XBee USB stick
  * @param type `xbee`
  * @param mtu user configured MTU or 0 for default network MTU
  * @param myaddr Our IEEE 802.15.4 address
  * @param panid PAN-id
  * @param channel channel number
+ * @param baud serial line speed, or 0 for the XBee factory speed
  * @return -1 if initialization fails (`errno` is set)
  */
 
-int l2net_154::init (const std::string iface, const char *type, const int mtu, const std::string myaddr, const std::string panid, const int channel)
+int l2net_154::init (const std::string iface, const char *type, const int mtu, const std::string myaddr, const std::string panid, const int channel, const int baud)
 {
     std::string dev ;
     int n = -1 ;			// default: init fails
@@ -200,6 +257,7 @@ int l2net_154::init (const std::string iface, const char *type, const int mtu, c
 
     /* Various initializations */
     maxlatency_ = L2154MAXLATENCY ;
+    epfd_ = -1 ;
 
     /* Prepend /dev if needed */
     if (iface [0] == '/')
@@ -209,71 +267,49 @@ int l2net_154::init (const std::string iface, const char *type, const int mtu, c
 
     if (strcmp (type, "xbee") == 0)
     {
-	struct termios tm ;
+	int speed = baud > 0 ? baud : XBEE_DEFAULT_BAUD ;
+	struct epoll_event ev ;
 
 	mtu_ = (mtu > 0 && mtu <= XBEE_MTU) ? mtu : XBEE_MTU ;
-	if (channel < 11 || channel > 26)
+	if (channel < 11 || channel > 26 || find_speed (speed) == -1)
+	{
+	    errno = EINVAL ;
 	    return -1 ;
+	}
 
 	/* Open device */
-	fd_ = open (dev.c_str (), O_RDWR) ;
+	fd_ = open (dev.c_str (), O_RDWR | O_NOCTTY | O_NONBLOCK) ;
 	if (fd_ == -1)
 	    return -1 ;
 
-	/* Initialize RS-232 driver */
-	if (tcgetattr (fd_, &tm) == -1)
+	pbuffer_ = buffer_ ;
+	txlen_ = 0 ;
+	lastid_ = 0 ;
+	ntxreq_ = 0 ;
+	for (auto &t : txreq_)
+	    t.busy = false ;
+
+	/* Initialize device to API (non-escaped) mode */
+	if (config (a, pan, channel, speed) == -1)
 	{
 	    close (fd_) ;
 	    return -1 ;
 	}
-	tm.c_iflag = IGNBRK | IGNPAR ;
-	tm.c_oflag = 0 ;
-	tm.c_cflag = CS8 | CREAD | B9600 ;
-	tm.c_lflag = 0 ;
-	for (int i = 0 ; i < NTAB (tm.c_cc) ; i++)
-	    tm.c_cc [i] = _POSIX_VDISABLE ;
-	tm.c_cc [VMIN] = 1 ;		// read() waits for 1 char (at least)
-	if (tcsetattr (fd_, TCSANOW, &tm) == -1)
+
+	/* Poll set: output is added while a frame is not written */
+	ev.events = EPOLLIN ;
+	ev.data.fd = fd_ ;
+	epfd_ = epoll_create1 (EPOLL_CLOEXEC) ;
+	if (epfd_ == -1 || epoll_ctl (epfd_, EPOLL_CTL_ADD, fd_, &ev) == -1)
 	{
+	    if (epfd_ != -1)
+		close (epfd_) ;
+	    epfd_ = -1 ;
 	    close (fd_) ;
 	    return -1 ;
 	}
 
-	/* Initialize device to API (non-escaped) mode */
-	sleep (2) ;
-	write (fd_, "+++", 3) ;
-	sleep (2) ;
-	write (fd_, "ATRE\r", 5) ;		// restore factory defaults
-	// write (fd_, "ATFR\r", 5) ;		// software reset
-	// initialize short addresses, my address, panid
-	{
-	    char buf [MAXBUF] ;
-
-	    // my short address : lowest significant byte first
-	    std::sprintf (buf, "ATMY%02x%02x\r",
-			a.addr_ [L2154ADDRLEN-1],
-			a.addr_ [L2154ADDRLEN-2]) ;
-	    write (fd_, buf, strlen (buf)) ;
-
-	    // pan id : lowest significant byte first
-	    std::sprintf (buf, "ATID%02x%02x\r",
-			pan.addr_ [L2154ADDRLEN-1],
-			pan.addr_ [L2154ADDRLEN-2]) ;
-	    write (fd_, buf, strlen (buf)) ;
-
-	    // channel
-	    std::sprintf (buf, "ATCH%02x\r", channel) ;
-	    write (fd_, buf, strlen (buf)) ;
-
-	    // 802.15.4 with ACKs
-	    write (fd_, "ATMM2\r", 6) ;
-	}
-	write (fd_, "ATAP1\r", 6) ;		// enter API mode
-	write (fd_, "ATCN\r", 5) ;		// quit AT command mode
-	
 	n = 0 ;
-
-	pbuffer_ = buffer_ ;
     }
     else
     {
@@ -289,58 +325,95 @@ int l2net_154::init (const std::string iface, const char *type, const int mtu, c
 
 void l2net_154::term (void)
 {
+    if (epfd_ != -1)
+	close (epfd_) ;
     close (fd_) ;
 }
 
 /**
  * @brief Send a frame to the given destination address
  *
+ * The frame is written without waiting: if the serial line cannot
+ * accept it (the previous frame is still not completely written),
+ * or if XBEE_TXWINDOW requests are still waiting for their status,
+ * the frame is refused with `errno` set to EAGAIN. The delivery
+ * status of frames sent to a single destination is checked later
+ * (see l2net::txfail).
+ *
  * @return number of bytes sent
  */
 
 int l2net_154::send (l2addr *daddr, void *data, int len)
 {
+    std::unique_lock <std::mutex> lk (txmtx_) ;
     l2addr_154 *da = (l2addr_154 *) daddr ;
-    int n ;
     byte cmd [MAXBUF] ;
+    int cmdlen, id, r ;
 
-    n = -1 ;
-    if (len <= L2154MTU)
+    if (len > L2154MTU)
     {
-	int cmdlen ;
+	errno = EMSGSIZE ;
+	return -1 ;
+    }
 
-	cmdlen = sizeof cmd ;
-	if (encode_transmit (cmd, cmdlen, da, (byte *) data, len))
-	{
-	    byte *pcmd ;
+    /*
+     * Complete the previous frame: a frame must not be written
+     * in the middle of another one
+     */
 
-	    /*
-	     * Send encoded command, may be in multiple chunks
-	     * since write() may return a value < cmdlen
-	     */
+    if (flush () == -1)
+	return -1 ;
+    if (txlen_ > 0)
+    {
+	errno = EAGAIN ;
+	return -1 ;
+    }
 
-	    n = 0 ;
-	    pcmd = cmd ;
-	    while (cmdlen > 0)
-	    {
-		int r ;
-
-		r = write (fd_, pcmd, cmdlen) ;
-		if (r == -1)
-		{
-		    n = -1 ;
-		    break ;
-		}
-		else
-		{
-		    cmdlen -= r ;
-		    pcmd += r ;
-		    n += r ;
-		}
-	    }
+    // broadcast frames are not acknowledged: no need for a status
+    id = 0 ;
+    if (*da != l2addr_154_broadcast)
+    {
+	id = alloc_frame_id () ;
+	if (id == 0)			// too many outstanding requests
+	{
+	    errno = EAGAIN ;
+	    return -1 ;
 	}
     }
-    return n ;
+
+    cmdlen = sizeof cmd ;
+    encode_transmit (cmd, cmdlen, da, (byte *) data, len, id) ;
+
+    r = write (fd_, cmd, cmdlen) ;
+    if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+	return -1 ;
+    if (r <= 0)
+    {
+	errno = EAGAIN ;
+	return -1 ;
+    }
+
+    // keep the remaining bytes until the line is writable again
+    if (r < cmdlen)
+    {
+	txlen_ = cmdlen - r ;
+	std::memcpy (txbuf_, cmd + r, txlen_) ;
+	pollout (true) ;
+    }
+
+    if (id != 0)
+    {
+	txreq &t = txreq_ [id] ;
+
+	t.busy = true ;
+	t.date = std::chrono::system_clock::now () ;
+	t.daddr = *da ;
+	t.len = len ;
+	std::memcpy (t.data, data, len) ;
+	ntxreq_++ ;
+    }
+
+    return cmdlen ;
 }
 
 /**
@@ -355,7 +428,7 @@ int l2net_154::bsend (void *data, int len)
 }
 
 // private method
-bool l2net_154::encode_transmit (byte *cmd, int &cmdlen, l2addr_154 *daddr, byte *data, int len)
+bool l2net_154::encode_transmit (byte *cmd, int &cmdlen, l2addr_154 *daddr, byte *data, int len, int id)
 {
     byte *b ;
     int fdlen ;
@@ -371,8 +444,7 @@ bool l2net_154::encode_transmit (byte *cmd, int &cmdlen, l2addr_154 *daddr, byte
     *b++ = BYTE_LOW (fdlen) ;
 
     *b++ = XBEE_TX_SHORT ;
-    // *b++ = 0 ;				// frame id
-    *b++ = 0x41 ;				// frame id
+    *b++ = id ;				// frame id (0: no TX_STATUS)
     *b++ = daddr->addr_ [L2154ADDRLEN-1] ;	// lowest significant byte first
     *b++ = daddr->addr_ [L2154ADDRLEN-2] ;
     *b++ = 0 ;				// options
@@ -429,18 +501,20 @@ pktype_t l2net_154::recv (l2addr **saddr, void *data, int *len)
 {
     pktype_t r ;
 
-    r = PK_NONE ;			// no packet received
-    while (r == PK_NONE)
+    // try to find an already received packet (in the list)
+    while ((r = extract_received_packet (saddr, data, len)) == PK_NONE)
     {
-	// try to find an already received packet (in the list)
-	r = extract_received_packet (saddr, data, len) ;
-
-	if (r == PK_NONE)
+	struct pollfd pfd ;
+
+	// No packet received: waits for bytes (or for the line to
+	// complete the last frame) and store complete frames in the list
+	pfd.fd = epfd_ ;
+	pfd.events = POLLIN ;
+	if ((poll (&pfd, 1, -1) == -1 && errno != EINTR)
+			|| read_available () == -1)
 	{
-	    // No packet received: waits for a complete frame in the buffer
-	    // and store it (them) in the list
-	    if (read_complete_frame () == -1)
-		break ;				// error
+	    *saddr = nullptr ;
+	    break ;				// error
 	}
     }
 
@@ -449,68 +523,88 @@ pktype_t l2net_154::recv (l2addr **saddr, void *data, int *len)
     return r ;
 }
 
-// Explore frame list to find (and remove) a received packet
+/**
+ * @brief Receive frame if one is ready (non-blocking)
+ *
+ * @param saddr address of an existing l2addr_154 object
+ * @return See the pktype_t type (PK_AGAIN if no frame is ready)
+ */
+
+pktype_t l2net_154::try_recv (l2addr **saddr, void *data, int *len)
+{
+    pktype_t r ;
+
+    r = extract_received_packet (saddr, data, len) ;
+    if (r == PK_NONE && read_available () > 0)
+	r = extract_received_packet (saddr, data, len) ;
+
+    if (r == PK_NONE)
+    {
+	*saddr = nullptr ;
+	r = PK_AGAIN ;
+    }
+
+    return r ;
+}
+
+// Remove the first received packet from the frame list
 pktype_t l2net_154::extract_received_packet (l2addr **saddr, void *data, int *len)
 {
     pktype_t r = PK_NONE ;
-    std::list <casan::l2net_154::frame>::iterator f ;
 
-    f = framelist_.begin () ;
-    while (r == PK_NONE && f != framelist_.end ())
+    if (! framelist_.empty ())
     {
-	if (f->type == casan::l2net_154::RX_SHORT)
-	{
-	    // get source address and convert it to a l2addr_154 object
-	    char txtaddr [6] ;
-	    std::snprintf (txtaddr, sizeof txtaddr, "%2x:%2x", 
-		BYTE_LOW (f->rx_short_.saddr), BYTE_HIGH (f->rx_short_.saddr)) ;
-	    *saddr = new l2addr_154 (txtaddr) ;
-
-	    // transfer data
-	    if (*len >= f->rx_short_.len)
-		*len = f->rx_short_.len ;
-	    std::memcpy (data, f->rx_short_.data, *len) ;
-
-	    // packet addressed to us?
-	    if (f->rx_short_.options & casan::l2net_154::RX_SHORT_OPT_BROADCAST)
-		r = PK_BCAST ;
-	    else r = PK_ME ;
-
-	    // remove frame from list
-	    // std::list <casan::l2net_154::frame>::iterator tmp ;
-	    // tmp = f ;
-	    // tmp++ ;
-	    framelist_.erase (f) ;
-	    // f = tmp ;
-	}
-	else f++ ;
+	frame &f = framelist_.front () ;
+	l2addr_154 *a ;
+
+	// get source address (lowest significant byte first)
+	a = new l2addr_154 ;
+	std::memset (a->addr_, 0, L2154ADDRLEN) ;
+	a->addr_ [L2154ADDRLEN-2] = BYTE_LOW (f.rx_short_.saddr) ;
+	a->addr_ [L2154ADDRLEN-1] = BYTE_HIGH (f.rx_short_.saddr) ;
+	*saddr = a ;
+
+	// transfer data
+	if (*len >= f.rx_short_.len)
+	    *len = f.rx_short_.len ;
+	std::memcpy (data, f.rx_short_.data, *len) ;
+
+	// packet addressed to us?
+	if (f.rx_short_.options & casan::l2net_154::RX_SHORT_OPT_BROADCAST)
+	    r = PK_BCAST ;
+	else r = PK_ME ;
+
+	framelist_.pop_front () ;
     }
     return r ;
 }
 
-// Buffer does not contain a complete valid frame. Read a complete frame
-int l2net_154::read_complete_frame (void)
+// Read bytes already received (if any) without waiting, and store
+// complete frames in the list. Complete the last frame sent if needed.
+int l2net_154::read_available (void)
 {
-    int n = -1 ;
-    bool found_at_least_one = false ;
+    int n ;
 
-    /*
-     * We should never reach the end of this buffer
-     */
+    {
+	std::unique_lock <std::mutex> lk (txmtx_) ;
+
+	(void) flush () ;
+    }
 
-    while (! found_at_least_one &&
-	(n = read (fd_, pbuffer_, BUFLEN - (pbuffer_ - buffer_))) > 0)
+    n = read (fd_, pbuffer_, BUFLEN - (pbuffer_ - buffer_)) ;
+    if (n > 0)
     {
 	pbuffer_ += n ;
-
-	// we may have read more than one frame:
-	// extract them all from the buffer to the list
 	while (l2net_154::is_frame_complete ())
-	{
-	    found_at_least_one = true ;
 	    l2net_154::extract_frame_to_list () ;
-	}
     }
+    else if (n == 0)			// device has been removed
+    {
+	errno = EIO ;
+	n = -1 ;
+    }
+    else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	n = 0 ;
 
     return n ;				// -1 <=> error
 }
@@ -610,8 +704,7 @@ void l2net_154::extract_frame_to_list (void)
     switch (buffer_ [3])
     {
 	case l2net_154::TX_STATUS :
-	    f.tx_status_.frame_id = buffer_ [4] ;
-	    f.tx_status_.status = buffer_ [5] ;
+	    tx_done (buffer_ [4], buffer_ [5]) ;
 	    break ;
 	case l2net_154::RX_SHORT :
 	    f.rx_short_.saddr = (buffer_ [4] << 8) | buffer_ [5] ;
@@ -619,17 +712,243 @@ void l2net_154::extract_frame_to_list (void)
 	    std::memcpy (f.rx_short_.data, buffer_ + 8, f.rx_short_.len) ;
 	    f.rx_short_.rssi = buffer_ [6] ;
 	    f.rx_short_.options = buffer_ [7] ;
+	    framelist_.push_back (f) ;
 	    break ;
 	default :
 	    std::cerr << "PKT API " << (int) buffer_ [3] << " unrecognized\n" ;
 	    break ;
     }
-    framelist_.push_back (f) ;
 
     // remove extracted packet from buffer
     pbuffer_ -=  pktlen ;
     if (pbuffer_ - buffer_ > 0)		// buffer still contains more bytes
-	std::memcpy (buffer_, buffer_ + pktlen, pbuffer_ - buffer_) ;
+	std::memmove (buffer_, buffer_ + pktlen, pbuffer_ - buffer_) ;
+}
+
+/*
+ * XBee configuration
+ */
+
+// Set the speed of the serial line (and raw mode)
+int l2net_154::setspeed (int baud)
+{
+    struct termios tm ;
+    speed_t speed = xbee_speeds [find_speed (baud)].speed ;
+
+    if (tcgetattr (fd_, &tm) == -1)
+	return -1 ;
+    tm.c_iflag = IGNBRK | IGNPAR ;
+    tm.c_oflag = 0 ;
+    tm.c_cflag = CS8 | CREAD | CLOCAL ;
+    tm.c_lflag = 0 ;
+    for (int i = 0 ; i < NTAB (tm.c_cc) ; i++)
+	tm.c_cc [i] = _POSIX_VDISABLE ;
+    tm.c_cc [VMIN] = 1 ;
+    tm.c_cc [VTIME] = 0 ;
+    cfsetispeed (&tm, speed) ;
+    cfsetospeed (&tm, speed) ;
+    if (tcsetattr (fd_, TCSANOW, &tm) == -1)
+	return -1 ;
+    (void) tcflush (fd_, TCIOFLUSH) ;
+    return 0 ;
+}
+
+// Send an AT command (or "+++") and wait for the OK answer
+int l2net_154::at_command (const char *cmd, int timeout)
+{
+    timepoint_t end = std::chrono::system_clock::now () + duration_t (timeout) ;
+    char ans [MAXBUF] ;
+    int len = 0 ;
+
+    D (D_MESSAGE, "XBee command " << cmd) ;
+
+    for (int n = strlen (cmd) ; n > 0 ; )
+    {
+	struct pollfd pfd ;
+	int r ;
+
+	r = write (fd_, cmd, n) ;
+	if (r > 0)
+	{
+	    cmd += r ;
+	    n -= r ;
+	}
+	else if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+	    return -1 ;
+
+	pfd.fd = fd_ ;
+	pfd.events = POLLOUT ;
+	if (n > 0)
+	    (void) poll (&pfd, 1, timeout) ;
+    }
+
+    for (;;)
+    {
+	struct pollfd pfd ;
+	int ms, r ;
+
+	ms = std::chrono::duration_cast <duration_t>
+		    (end - std::chrono::system_clock::now ()).count () ;
+	if (ms <= 0)
+	    break ;
+
+	pfd.fd = fd_ ;
+	pfd.events = POLLIN ;
+	if (poll (&pfd, 1, ms) <= 0)
+	    continue ;
+
+	r = read (fd_, ans + len, sizeof ans - 1 - len) ;
+	if (r <= 0)
+	    continue ;
+	len += r ;
+	ans [len] = '\0' ;
+
+	if (strstr (ans, "OK\r") != NULL)
+	    return 0 ;
+	if (strstr (ans, "ERROR\r") != NULL || len == sizeof ans - 1)
+	    break ;
+    }
+
+    errno = ETIMEDOUT ;
+    return -1 ;
+}
+
+// Configure the XBee in API mode with the requested speed
+int l2net_154::config (l2addr_154 &a, l2addr_154 &pan, int channel, int baud)
+{
+    char buf [MAXBUF] ;
+    int r = -1 ;
+
+    // enter command mode (the answer comes after the guard time)
+    if (setspeed (baud) == 0)
+	r = at_command ("+++", XBEE_CMDMODE_TIMEOUT) ;
+    if (r == -1 && baud != XBEE_DEFAULT_BAUD)
+    {
+	if (setspeed (XBEE_DEFAULT_BAUD) == 0)
+	    r = at_command ("+++", XBEE_CMDMODE_TIMEOUT) ;
+    }
+    if (r == -1)
+	return -1 ;
+
+    std::vector <std::string> cmds ;
+
+    cmds.push_back ("ATRE\r") ;		// restore factory defaults
+    // my short address : lowest significant byte first
+    std::sprintf (buf, "ATMY%02x%02x\r",
+		a.addr_ [L2154ADDRLEN-1],
+		a.addr_ [L2154ADDRLEN-2]) ;
+    cmds.push_back (buf) ;
+    // pan id : lowest significant byte first
+    std::sprintf (buf, "ATID%02x%02x\r",
+		pan.addr_ [L2154ADDRLEN-1],
+		pan.addr_ [L2154ADDRLEN-2]) ;
+    cmds.push_back (buf) ;
+    // channel
+    std::sprintf (buf, "ATCH%02x\r", channel) ;
+    cmds.push_back (buf) ;
+    cmds.push_back ("ATMM2\r") ;		// 802.15.4 with ACKs
+    cmds.push_back ("ATAP1\r") ;		// enter API mode
+    // serial line speed (effective when leaving command mode)
+    std::sprintf (buf, "ATBD%x\r", xbee_speeds [find_speed (baud)].bd) ;
+    cmds.push_back (buf) ;
+    cmds.push_back ("ATCN\r") ;		// quit AT command mode
+
+    for (auto &c : cmds)
+	if (at_command (c.c_str (), XBEE_AT_TIMEOUT) == -1)
+	    return -1 ;
+
+    return setspeed (baud) ;
+}
+
+/*
+ * Transmit requests
+ */
+
+// Find a free frame id, or 0 if too many requests are outstanding.
+// Requests without TX_STATUS for too long are forgotten.
+int l2net_154::alloc_frame_id (void)
+{
+    if (ntxreq_ >= XBEE_TXWINDOW)
+    {
+	timepoint_t old ;
+
+	old = std::chrono::system_clock::now () - duration_t (XBEE_TXTIMEOUT) ;
+	for (int i = 1 ; i < XBEE_NFRAMEID ; i++)
+	{
+	    if (txreq_ [i].busy && txreq_ [i].date < old)
+	    {
+		txreq_ [i].busy = false ;
+		ntxreq_-- ;
+	    }
+	}
+	if (ntxreq_ >= XBEE_TXWINDOW)
+	    return 0 ;
+    }
+
+    for (int i = 1 ; i < XBEE_NFRAMEID ; i++)
+    {
+	lastid_ = lastid_ % (XBEE_NFRAMEID - 1) + 1 ;	// never 0
+	if (! txreq_ [lastid_].busy)
+	    return lastid_ ;
+    }
+    return 0 ;
+}
+
+// Write the remaining bytes of the last frame (txmtx_ locked)
+int l2net_154::flush (void)
+{
+    int r ;
+
+    if (txlen_ > 0)
+    {
+	r = write (fd_, txbuf_, txlen_) ;
+	if (r == -1)
+	    return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1 ;
+	txlen_ -= r ;
+	std::memmove (txbuf_, txbuf_ + r, txlen_) ;
+	if (txlen_ == 0)
+	    pollout (false) ;
+    }
+    return 0 ;
+}
+
+// Poll the serial line for output (in addition to input) or not
+void l2net_154::pollout (bool on)
+{
+    struct epoll_event ev ;
+
+    ev.events = on ? EPOLLIN | EPOLLOUT : EPOLLIN ;
+    ev.data.fd = fd_ ;
+    (void) epoll_ctl (epfd_, EPOLL_CTL_MOD, fd_, &ev) ;
+}
+
+// A TX_STATUS has been received: report a delivery failure
+void l2net_154::tx_done (int id, int status)
+{
+    l2addr_154 daddr ;
+    byte data [L2154MTU] ;
+    int len = 0 ;
+
+    {
+	std::unique_lock <std::mutex> lk (txmtx_) ;
+	txreq &t = txreq_ [id] ;
+
+	if (id == 0 || ! t.busy)
+	    return ;
+	t.busy = false ;
+	ntxreq_-- ;
+	if (status == XBEE_TX_SUCCESS)
+	    return ;
+
+	daddr = t.daddr ;
+	len = t.len ;
+	std::memcpy (data, t.data, len) ;
+    }
+
+    D (D_MESSAGE, "Frame " << id << " to " << daddr
+			<< " not delivered (status " << status << ")") ;
+    if (txfail_)
+	txfail_ (&daddr, data, len) ;
 }
 
 }					// end of namespace casan
@@ -8,6 +8,7 @@
 
 #include "l2.h"
 #include <list>
+#include <mutex>
 
 // IEEE 802.15.4 address length
 #define	L2154ADDRLEN	8
@@ -17,6 +18,14 @@
 // more realistic than the default CoAP value (100 s)
 // In our case, 128 Bytes takes ~4 ms with a 230 kb/s network
 #define	L2154MAXLATENCY	5
+// XBee factory serial line speed
+#define	XBEE_DEFAULT_BAUD	9600
+// XBee frame ids (0 means: no TX_STATUS wanted)
+#define	XBEE_NFRAMEID	256
+// Maximum number of outstanding transmit requests
+#define	XBEE_TXWINDOW	16
+// Delay (ms) after which a TX_STATUS is not expected anymore
+#define	XBEE_TXTIMEOUT	2000
 
 
 namespace casan {
@@ -40,6 +49,7 @@ class l2addr_154: public l2addr
 
 	bool operator== (const l2addr &) ;
 	bool operator!= (const l2addr &) ;
+	const byte *bytes (int *len) const ;
 
     protected:
 	void print (std::ostream &os) const ;
@@ -56,6 +66,21 @@ extern l2addr_154 l2addr_154_broadcast ;
  * This class provides real methods (specified in l2net virtual
  * class) for IEEE 802.15.4 networks. It handles the lowest layer,
  * which is assumed to be the XBee USB stick.
+ *
+ * The serial line is never waited for: bytes received are
+ * accumulated until a complete API frame is found, and a frame
+ * which cannot be written at once is completed before the next
+ * one (or the frame is refused if the line is still busy).
+ * The descriptor returned by `pollfd` (an epoll set) is readable
+ * when bytes are received, or when the serial line can accept the
+ * rest of such a frame: `try_recv` then writes it.
+ *
+ * Each transmit request gets a frame id, so that several requests
+ * can be outstanding (at most XBEE_TXWINDOW, further ones are refused
+ * until a status is received) while the XBee sends them. The
+ * TX_STATUS frames returned by the XBee are matched with these
+ * requests, and delivery failures (no ACK from the destination
+ * after the XBee retries) are reported with l2net::txfail.
  */
 
 class l2net_154: public l2net
@@ -63,15 +88,18 @@ class l2net_154: public l2net
     public:
 	~l2net_154 () {} ;
 	// type = xbee
-	int init (const std::string iface, const char *type, const int mtu, const std::string myaddr, const std::string panid, const int channel) ;
+	int init (const std::string iface, const char *type, const int mtu, const std::string myaddr, const std::string panid, const int channel, const int baud = 0) ;
 	void term (void) ;
 	int send (l2addr *daddr, void *data, int len) ;
 	int bsend (void *data, int len) ;
 	pktype_t recv (l2addr **saddr, void *data, int *len) ;
 	l2addr *bcastaddr (void) ;
+	int pollfd (void)		{ return epfd_ ; }
+	pktype_t try_recv (l2addr **saddr, void *data, int *len) ;
 
     private:
 	int fd_ ;			// interface index
+	int epfd_ ;			// fd_ input, and output if txlen_ > 0
 
 	/*
 	 * Buffer to accumulate bytes received from the XBee chip
@@ -113,14 +141,42 @@ class l2net_154: public l2net
 		rx_short  rx_short_ ;
 	    } ;
 	} ;
-	std::list <frame> framelist_ ;
+	std::list <frame> framelist_ ;	// received packets only
+
+	/*
+	 * Outstanding transmit requests, indexed by frame id, and
+	 * unwritten bytes of the last frame (protected by txmtx_)
+	 */
 
-	bool encode_transmit (byte *cmd, int &cmdlen, l2addr_154 *daddr, byte *data, int len) ;
+	struct txreq
+	{
+	    bool busy ;			// waiting for TX_STATUS
+	    timepoint_t date ;		// date of request
+	    l2addr_154 daddr ;
+	    int len ;
+	    byte data [L2154MTU] ;
+	} ;
+	txreq txreq_ [XBEE_NFRAMEID] ;
+	int lastid_ ;			// last frame id allocated
+	int ntxreq_ ;			// outstanding requests
+	byte txbuf_ [MAXBUF] ;
+	int txlen_ ;			// bytes left in txbuf_
+	std::mutex txmtx_ ;
+
+	bool encode_transmit (byte *cmd, int &cmdlen, l2addr_154 *daddr, byte *data, int len, int id) ;
 	int compute_checksum (const byte *buf) ;
 	pktype_t extract_received_packet (l2addr **saddr, void *data, int *len) ;
-	int read_complete_frame (void) ;
+	int read_available (void) ;
 	bool is_frame_complete (void) ;
 	void extract_frame_to_list (void) ;
+
+	int setspeed (int baud) ;
+	int at_command (const char *cmd, int timeout) ;
+	int config (l2addr_154 &a, l2addr_154 &pan, int channel, int baud) ;
+	int alloc_frame_id (void) ;
+	int flush (void) ;
+	void pollout (bool on) ;
+	void tx_done (int id, int status) ;
 } ;
 
 }					// end of namespace casan
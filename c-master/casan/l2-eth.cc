@@ -5,13 +5,19 @@
 
 #include <iostream>
 #include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <vector>
 
 #include <sys/types.h>
 #include <unistd.h>
 
 #ifdef USE_PF_PACKET
 #include <sys/socket.h>
-#include <netpacket/packet.h>
+#include <sys/mman.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#include <poll.h>
 #endif
 #ifdef USE_PCAP
 #include <pcap/pcap.h>
@@ -31,6 +37,9 @@
 #include "l2-eth.h"
 #include "byte.h"
 
+// CoAP POST code (see msg::MC_POST), used by the in-kernel filter
+#define	COAP_POST	2
+
 namespace casan {
 
 /******************************************************************************
@@ -93,7 +102,7 @@ l2addr_eth::l2addr_eth (const l2addr_eth &l)
 l2addr_eth &l2addr_eth::operator= (const l2addr_eth &l)
 {
     if (this != &l)
-	*this = l ;
+	std::memcpy (addr_, l.addr_, ETHADDRLEN) ;
     return *this ;
 }
 
@@ -131,10 +140,45 @@ bool l2addr_eth::operator!= (const l2addr &other)
     return ! (*this == other) ;
 }
 
+/**
+ * @brief Returns raw address bytes (used to index addresses)
+ */
+
+const byte *l2addr_eth::bytes (int *len) const
+{
+    *len = ETHADDRLEN ;
+    return addr_ ;
+}
+
 /******************************************************************************
  * l2net_eth methods
  */
 
+#if defined (USE_PF_PACKET)
+
+/*
+ * Ethernet specific: the payload is preceded by its length (2 bytes),
+ * since short frames are padded. Frames are sent and received with
+ * scatter/gather I/O, in order to avoid copying the payload.
+ */
+
+static void mkhdr (struct msghdr *h, struct iovec *iov,
+			struct sockaddr_ll *sll, byte *lenbuf, l2frame &f)
+{
+    iov [0].iov_base = lenbuf ;
+    iov [0].iov_len = 2 ;
+    iov [1].iov_base = f.data ;
+    iov [1].iov_len = f.len ;
+
+    std::memset (h, 0, sizeof *h) ;
+    h->msg_name = sll ;
+    h->msg_namelen = sizeof *sll ;
+    h->msg_iov = iov ;
+    h->msg_iovlen = 2 ;
+}
+
+#endif
+
 /**
  * @brief Initialize an Ethernet network access
  *
@@ -143,10 +187,12 @@ bool l2addr_eth::operator!= (const l2addr &other)
  * @param iface Ethernet interface name (eth0, etc.)
  * @param mtu user configured MTU or 0 for default network MTU
  * @param ethertype Ethernet frame type
+ * @param ring number of blocks in the PACKET_MMAP receive ring, or 0
+ *	to receive frames with system calls
  * @return -1 if initialization fails (`errno` is set)
  */
 
-int l2net_eth::init (const std::string iface, const int mtu, int ethertype)
+int l2net_eth::init (const std::string iface, const int mtu, int ethertype, int ring)
 {
 #if defined (USE_PF_PACKET)
     struct sockaddr_ll sll ;
@@ -179,11 +225,22 @@ int l2net_eth::init (const std::string iface, const int mtu, int ethertype)
 	return -1 ;
     }
 
+    /* Map the receive ring, if requested */
+
+    ring_ = nullptr ;
+    if (ring > 0 && init_ring (ring) == -1)
+    {
+	close (fd_) ;
+	return -1 ;
+    }
+
     return 0 ;
 #elif defined (USE_PCAP)
     struct bpf_program *bpfp ;
     char buf [MAXBUF] ;
 
+    (void) ring ;			// no ring with pcap
+
     fd_ = pcap_create (iface.c_str (), errbuf_) ;
     if (fd_ == NULL)
 	return -1 ;
@@ -210,7 +267,7 @@ int l2net_eth::init (const std::string iface, const int mtu, int ethertype)
 
     return 0 ;
 #else
-    if (iface == "" && ethertype == 0)
+    if (iface == "" && ethertype == 0 && ring == 0)
 	return -1 ;
     return 0 ;
 #endif
@@ -223,6 +280,9 @@ int l2net_eth::init (const std::string iface, const int mtu, int ethertype)
 void l2net_eth::term (void)
 {
 #if defined (USE_PF_PACKET)
+    if (ring_ != nullptr)
+	munmap (ring_, nblocks_ * ETHRINGBLOCK) ;
+    ring_ = nullptr ;
     close (fd_) ;
 #elif defined (USE_PCAP)
     pcap_close (fd_) ;
@@ -240,32 +300,23 @@ int l2net_eth::send (l2addr *daddr, void *data, int len)
     int r ;
 
 #if defined (USE_PF_PACKET)
+    struct msghdr h ;
+    struct iovec iov [2] ;
     struct sockaddr_ll sll ;
-    l2addr_eth *a = (l2addr_eth *) daddr ;
-    byte *buf ;
-
-    /*
-     * Ethernet specific: add message length at the beginnin of the payload
-     */
-
-    len += 2 ;
-    buf = new byte [len] ;
-    buf [0] = BYTE_HIGH (len) ;
-    buf [1] = BYTE_LOW (len) ;
-    std::memcpy (buf + 2, data, len - 2) ;
+    byte lenbuf [2] ;
+    l2frame f ;
 
     /*
      * Send Ethernet raw packet
      */
 
-    std::memset (&sll, 0, sizeof sll) ;
-    sll.sll_family = AF_PACKET ;
-    sll.sll_protocol = htons (ethertype_) ;
-    sll.sll_halen = ETHADDRLEN ;
-    sll.sll_ifindex = ifidx_ ;
-    std::memcpy (sll.sll_addr, a->addr_, ETHADDRLEN) ;
+    f.addr = daddr ;
+    f.data = data ;
+    f.len = len ;
+    mkdest (&sll, lenbuf, f) ;
+    mkhdr (&h, iov, &sll, lenbuf, f) ;
 
-    r = sendto (fd_, buf, len, 0, (struct sockaddr *) &sll, sizeof sll) ;
+    r = sendmsg (fd_, &h, 0) ;
 #elif defined (USE_PCAP)
     r = 0 ;
 #else
@@ -292,6 +343,47 @@ int l2net_eth::bsend (void *data, int len)
     return send (&l2addr_eth_broadcast, data, len) ;
 }
 
+/**
+ * @brief Send frames with a single system call
+ *
+ * @return number of sent frames, or -1 if the first one failed
+ */
+
+int l2net_eth::send_batch (l2frame *f, int n)
+{
+#if defined (USE_PF_PACKET)
+    // descriptors are on the stack since several threads may send
+    struct mmsghdr h [L2_BATCH] ;
+    struct iovec iov [L2_BATCH][2] ;
+    struct sockaddr_ll sll [L2_BATCH] ;
+    byte lenbuf [L2_BATCH][2] ;
+    int i, r ;
+
+    if (n > L2_BATCH)
+	n = L2_BATCH ;
+
+    for (i = 0 ; i < n ; i++)
+    {
+	mkdest (&sll [i], lenbuf [i], f [i]) ;
+	mkhdr (&h [i].msg_hdr, iov [i], &sll [i], lenbuf [i], f [i]) ;
+    }
+
+    /*
+     * sendmmsg may send only the beginning of the batch
+     */
+
+    for (i = 0 ; i < n ; i += r)
+    {
+	r = sendmmsg (fd_, h + i, n - i, 0) ;
+	if (r <= 0)
+	    break ;
+    }
+    return (i == 0 && n > 0) ? -1 : i ;
+#else
+    return l2net::send_batch (f, n) ;
+#endif
+}
+
 /**
  * @brief Return the broadcast address for this network
  */
@@ -301,80 +393,78 @@ l2addr *l2net_eth::bcastaddr (void)
     return &l2addr_eth_broadcast ;
 }
 
+/**
+ * @brief Return a descriptor to poll for incoming frames
+ */
+
+int l2net_eth::pollfd (void)
+{
+#if defined (USE_PF_PACKET)
+    return fd_ ;
+#elif defined (USE_PCAP)
+    return pcap_get_selectable_fd (fd_) ;
+#else
+    return -1 ;
+#endif
+}
+
+/**
+ * @brief Receive a frame (blocking)
+ */
+
 pktype_t l2net_eth::recv (l2addr **saddr, void *data, int *len)
+{
+    return recv (saddr, data, len, true) ;
+}
+
+/**
+ * @brief Receive a frame if one is ready (non-blocking)
+ *
+ * @return PK_AGAIN if no frame is ready
+ */
+
+pktype_t l2net_eth::try_recv (l2addr **saddr, void *data, int *len)
+{
+    return recv (saddr, data, len, false) ;
+}
+
+pktype_t l2net_eth::recv (l2addr **saddr, void *data, int *len, bool block)
 {
     pktype_t pktype ;
 
 #if defined (USE_PF_PACKET)
+    struct msghdr h ;
+    struct iovec iov [2] ;
     struct sockaddr_ll sll ;
-    socklen_t ssll ;
-    l2addr_eth **a = (l2addr_eth **) saddr ;
+    byte lenbuf [2] ;
+    l2frame f ;
     int r ;
-    byte *buf ;
-    int lenlen = *len + 2 ;
-
-    /*
-     * Ethernet specific : use additional 2 bytes for length in
-     * front of the payload
-     */
 
+    if (ring_ != nullptr)
+	return ring_recv (saddr, data, len, block) ;
 
-    buf = new byte [lenlen] ;
+    f.data = data ;
+    f.len = *len ;
+    mkhdr (&h, iov, &sll, lenbuf, f) ;
 
-    std::memset (&sll, 0, sizeof sll) ;
-    sll.sll_family = AF_PACKET ;
-    sll.sll_ifindex = ifidx_ ;
-    sll.sll_protocol = htons (ETHTYPE_CASAN) ;
-    sll.sll_halen = ETHADDRLEN ;
-
-    ssll = sizeof sll ;
-
-    r = recvfrom (fd_, buf, lenlen, 0, (struct sockaddr *) &sll, &ssll) ;
+    r = recvmsg (fd_, &h, block ? 0 : MSG_DONTWAIT) ;
     if (r == -1)
     {
-	*a = nullptr ;
-	pktype = PK_NONE ;
+	*saddr = nullptr ;
+	pktype = (errno == EAGAIN || errno == EWOULDBLOCK) ? PK_AGAIN : PK_NONE ;
     }
     else
-    {
-	*a = new l2addr_eth ;
-
-	/*
-	 * Remove Ethernet specific length
-	 */
-
-	*len = INT16 (buf [0], buf [1]) - 2 ;	// true length
-	std::memcpy (data, buf + 2, r - 2) ;
-	delete buf ;
-
-	// *len = r ;
-	switch (sll.sll_pkttype)
-	{
-	    case PACKET_HOST :
-		pktype = PK_ME ;
-		break ;
-	    case PACKET_BROADCAST :
-	    case PACKET_MULTICAST :
-		pktype = PK_BCAST ;
-		break ;
-	    case PACKET_OTHERHOST :
-	    case PACKET_OUTGOING :
-	    default :
-		pktype = PK_NONE ;
-		break ;
-	}
-
-	std::memcpy ((*a)->addr_, sll.sll_addr, ETHADDRLEN) ;
-    }
+	pktype = frame (&sll, lenbuf, r, saddr, len) ;
 
 #elif defined (USE_PCAP)
     struct pcap_pkthdr pkthdr ;
     const u_char *d ;
 
+    (void) pcap_setnonblock (fd_, ! block, errbuf_) ;
     d = pcap_next (fd_, &pkthdr) ;
     if (d == NULL)
     {
-	pktype = PK_NONE ;
+	pktype = block ? PK_NONE : PK_AGAIN ;
     }
     else
     {
@@ -391,7 +481,7 @@ pktype_t l2net_eth::recv (l2addr **saddr, void *data, int *len)
      * a big non-sense
      */
 
-    if (saddr == NULL && data == NULL && len == NULL)
+    if (saddr == NULL && data == NULL && len == NULL && block)
 	pktype = PK_NONE ;
     pktype = PK_NONE ;
 
@@ -399,4 +489,334 @@ pktype_t l2net_eth::recv (l2addr **saddr, void *data, int *len)
     return pktype ;
 }
 
+/**
+ * @brief Receive ready frames with a single system call
+ *
+ * @return number of received frames (0 if none is ready), or -1
+ */
+
+int l2net_eth::recv_batch (l2frame *f, int n)
+{
+#if defined (USE_PF_PACKET)
+    int i, r ;
+
+    if (ring_ != nullptr)
+	return l2net::recv_batch (f, n) ;	// copy from the ring
+
+    if (n > L2_BATCH)
+	n = L2_BATCH ;
+
+    for (i = 0 ; i < n ; i++)
+	mkhdr (&rhdr_ [i].msg_hdr, riov_ [i], &rsll_ [i], rlen_ [i], f [i]) ;
+
+    r = recvmmsg (fd_, rhdr_, n, MSG_DONTWAIT, NULL) ;
+    if (r == -1)
+	return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1 ;
+
+    for (i = 0 ; i < r ; i++)
+	f [i].pktype = frame (&rsll_ [i], rlen_ [i], rhdr_ [i].msg_len,
+					&f [i].addr, &f [i].len) ;
+    return r ;
+#else
+    return l2net::recv_batch (f, n) ;
+#endif
+}
+
+/**
+ * @brief Get views on frames received in the PACKET_MMAP ring
+ *
+ * Frames are not copied: the data of each frame is in the ring,
+ * and it must not be used after l2net_eth::release_view. Frames
+ * are taken from one block at a time.
+ *
+ * @param f frames (data, length, type and source address are set)
+ * @param n maximum number of frames
+ * @return number of frames (0 if none is ready), or -1 if the
+ *	network does not have a receive ring
+ */
+
+int l2net_eth::recv_view (l2frame *f, int n)
+{
+#if defined (USE_PF_PACKET)
+    struct tpacket_block_desc *bd ;
+    int i ;
+
+    if (ring_ == nullptr)
+	return -1 ;
+
+    /*
+     * Start reading the current block if the kernel has delivered it
+     * (empty blocks are given back at once)
+     */
+
+    while (nextpkt_ == nullptr)
+    {
+	bd = (struct tpacket_block_desc *) ringblock (curblock_) ;
+	if ((bd->hdr.bh1.block_status & TP_STATUS_USER) == 0)
+	    return 0 ;
+	std::atomic_thread_fence (std::memory_order_acquire) ;
+
+	npkts_ = bd->hdr.bh1.num_pkts ;
+	nextpkt_ = (byte *) bd + bd->hdr.bh1.offset_to_first_pkt ;
+	if (npkts_ == 0)
+	    release_view () ;
+    }
+
+    if (n > npkts_)
+	n = npkts_ ;
+
+    for (i = 0 ; i < n ; i++)
+    {
+	struct tpacket3_hdr *h = (struct tpacket3_hdr *) nextpkt_ ;
+	struct sockaddr_ll *sll ;
+	byte *d ;
+
+	sll = (struct sockaddr_ll *) (nextpkt_ + TPACKET_ALIGN (sizeof *h)) ;
+	d = nextpkt_ + h->tp_mac ;
+
+	f [i].len = 0 ;
+	f [i].pktype = frame (sll, d, h->tp_snaplen, &f [i].addr, &f [i].len) ;
+	f [i].data = d + 2 ;			// Ethernet specific length
+
+	nextpkt_ += h->tp_next_offset ;
+    }
+    npkts_ -= n ;
+
+    return n ;
+#else
+    (void) f ; (void) n ;
+    return -1 ;
+#endif
+}
+
+/**
+ * @brief Give the current block back to the kernel if it has been read
+ *
+ * This method must be called after each call to l2net_eth::recv_view,
+ * when the frames are not used anymore.
+ */
+
+void l2net_eth::release_view (void)
+{
+#if defined (USE_PF_PACKET)
+    if (ring_ != nullptr && nextpkt_ != nullptr && npkts_ == 0)
+    {
+	struct tpacket_block_desc *bd ;
+
+	bd = (struct tpacket_block_desc *) ringblock (curblock_) ;
+	std::atomic_thread_fence (std::memory_order_release) ;
+	bd->hdr.bh1.block_status = TP_STATUS_KERNEL ;
+
+	curblock_ = (curblock_ + 1) % nblocks_ ;
+	nextpkt_ = nullptr ;
+    }
+#endif
+}
+
+/**
+ * @brief Filter received frames in the kernel
+ *
+ * A classic BPF program is attached to the socket (replacing the
+ * previous one, if any). It accepts:
+ * - broadcast and multicast frames
+ * - frames sent to us which contain a CoAP POST request: they may
+ *   be Discover messages from slaves not associated yet
+ * - other frames sent to us only if they come from one of the
+ *   given addresses
+ * Frames sent to other hosts, as well as our own frames, are dropped.
+ *
+ * If there are more than ETHFILTERMAX addresses, frames sent to us
+ * are not filtered by source address.
+ *
+ * @param peers addresses of bound slaves (ETHADDRLEN bytes each)
+ * @param n number of addresses
+ * @return -1 if the filter cannot be attached (`errno` is set)
+ */
+
+int l2net_eth::filter (const byte *peers, int n)
+{
+#if defined (USE_PF_PACKET)
+    std::vector <struct sock_filter> prog ;
+    struct sock_fprog fprog ;
+    const unsigned int accept = 0x40000 ;	// maximum frame length
+    const unsigned int pkttype = SKF_AD_OFF + SKF_AD_PKTTYPE ;
+    const unsigned int src = SKF_LL_OFF + ETHADDRLEN ;	// source address
+
+    // frame type
+    prog.push_back (BPF_STMT (BPF_LD | BPF_W | BPF_ABS, pkttype)) ;
+    prog.push_back (BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, PACKET_HOST, 4, 0)) ;
+    prog.push_back (BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, PACKET_BROADCAST, 1, 0)) ;
+    prog.push_back (BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, PACKET_MULTICAST, 0, 1)) ;
+    prog.push_back (BPF_STMT (BPF_RET | BPF_K, accept)) ;
+    prog.push_back (BPF_STMT (BPF_RET | BPF_K, 0)) ;
+
+    // sent to us: CoAP code (after the Ethernet specific length)
+    prog.push_back (BPF_STMT (BPF_LD | BPF_B | BPF_ABS, 3)) ;
+    prog.push_back (BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, COAP_POST, 0, 1)) ;
+    prog.push_back (BPF_STMT (BPF_RET | BPF_K, accept)) ;
+
+    // source address: 4 high bytes, then 2 low bytes
+    if (n <= ETHFILTERMAX)
+    {
+	for (int i = 0 ; i < n ; i++)
+	{
+	    const byte *a = peers + i * ETHADDRLEN ;
+	    unsigned int hi, lo ;
+
+	    hi = (a [0] << 24) | (a [1] << 16) | (a [2] << 8) | a [3] ;
+	    lo = (a [4] << 8) | a [5] ;
+	    prog.push_back (BPF_STMT (BPF_LD | BPF_W | BPF_ABS, src)) ;
+	    prog.push_back (BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, hi, 0, 3)) ;
+	    prog.push_back (BPF_STMT (BPF_LD | BPF_H | BPF_ABS, src + 4)) ;
+	    prog.push_back (BPF_JUMP (BPF_JMP | BPF_JEQ | BPF_K, lo, 0, 1)) ;
+	    prog.push_back (BPF_STMT (BPF_RET | BPF_K, accept)) ;
+	}
+	prog.push_back (BPF_STMT (BPF_RET | BPF_K, 0)) ;
+    }
+    else
+	prog.push_back (BPF_STMT (BPF_RET | BPF_K, accept)) ;
+
+    fprog.len = prog.size () ;
+    fprog.filter = prog.data () ;
+    return setsockopt (fd_, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof fprog) ;
+#else
+    (void) peers ; (void) n ;
+    return 0 ;
+#endif
+}
+
+#if defined (USE_PF_PACKET)
+
+/*
+ * PACKET_MMAP receive ring (TPACKET_V3): the kernel fills blocks of
+ * frames in memory shared with the process, and delivers a block when
+ * it is full or after ETHRINGTIMEOUT ms. The block is given back to
+ * the kernel once all its frames have been read (see recv_view).
+ */
+
+int l2net_eth::init_ring (int nblocks)
+{
+    struct tpacket_req3 req ;
+    int v = TPACKET_V3 ;
+
+    if (setsockopt (fd_, SOL_PACKET, PACKET_VERSION, &v, sizeof v) == -1)
+	return -1 ;
+
+    std::memset (&req, 0, sizeof req) ;
+    req.tp_block_size = ETHRINGBLOCK ;
+    req.tp_block_nr = nblocks ;
+    req.tp_frame_size = ETHRINGFRAME ;
+    req.tp_frame_nr = (ETHRINGBLOCK / ETHRINGFRAME) * nblocks ;
+    req.tp_retire_blk_tov = ETHRINGTIMEOUT ;
+    if (setsockopt (fd_, SOL_PACKET, PACKET_RX_RING, &req, sizeof req) == -1)
+	return -1 ;
+
+    ring_ = (byte *) mmap (NULL, nblocks * ETHRINGBLOCK,
+			    PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0) ;
+    if (ring_ == MAP_FAILED)
+    {
+	ring_ = nullptr ;
+	return -1 ;
+    }
+
+    nblocks_ = nblocks ;
+    curblock_ = 0 ;
+    npkts_ = 0 ;
+    nextpkt_ = nullptr ;
+
+    return 0 ;
+}
+
+// Receive one frame from the ring (copied in the given buffer)
+pktype_t l2net_eth::ring_recv (l2addr **saddr, void *data, int *len, bool block)
+{
+    l2frame f ;
+
+    while (recv_view (&f, 1) == 0)
+    {
+	struct pollfd pfd ;
+
+	if (! block)
+	{
+	    *saddr = nullptr ;
+	    return PK_AGAIN ;
+	}
+
+	pfd.fd = fd_ ;
+	pfd.events = POLLIN ;
+	(void) poll (&pfd, 1, -1) ;
+    }
+
+    if (f.len > *len)
+	f.len = *len ;
+    std::memcpy (data, f.data, f.len) ;
+    *len = f.len ;
+    *saddr = f.addr ;
+    release_view () ;
+
+    return f.pktype ;
+}
+
+// Destination address and length of a frame to send
+void l2net_eth::mkdest (struct sockaddr_ll *sll, byte *lenbuf, l2frame &f)
+{
+    l2addr_eth *a = (l2addr_eth *) f.addr ;
+    int len = f.len + 2 ;
+
+    lenbuf [0] = BYTE_HIGH (len) ;
+    lenbuf [1] = BYTE_LOW (len) ;
+
+    std::memset (sll, 0, sizeof *sll) ;
+    sll->sll_family = AF_PACKET ;
+    sll->sll_protocol = htons (ethertype_) ;
+    sll->sll_halen = ETHADDRLEN ;
+    sll->sll_ifindex = ifidx_ ;
+    std::memcpy (sll->sll_addr, a->addr_, ETHADDRLEN) ;
+}
+
+// Source address, length and type of a received frame of r bytes
+pktype_t l2net_eth::frame (struct sockaddr_ll *sll, byte *lenbuf, int r,
+				l2addr **saddr, int *len)
+{
+    l2addr_eth *a ;
+    pktype_t pktype ;
+    int l ;
+
+    /*
+     * Remove Ethernet specific length
+     */
+
+    l = INT16 (lenbuf [0], lenbuf [1]) - 2 ;	// true length
+    if (r < 2 || l < 0)
+    {
+	*saddr = nullptr ;
+	return PK_NONE ;
+    }
+    *len = l < r - 2 ? l : r - 2 ;
+
+    switch (sll->sll_pkttype)
+    {
+	case PACKET_HOST :
+	    pktype = PK_ME ;
+	    break ;
+	case PACKET_BROADCAST :
+	case PACKET_MULTICAST :
+	    pktype = PK_BCAST ;
+	    break ;
+	case PACKET_OTHERHOST :
+	case PACKET_OUTGOING :
+	default :
+	    pktype = PK_NONE ;
+	    break ;
+    }
+
+    a = new l2addr_eth ;
+    std::memcpy (a->addr_, sll->sll_addr, ETHADDRLEN) ;
+    *saddr = a ;
+
+    return pktype ;
+}
+
+#endif
+
 }					// end of namespace casan
@@ -13,6 +13,10 @@
 
 #include "l2.h"
 
+#ifdef USE_PF_PACKET
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#endif
 #ifdef USE_PCAP
 #include <pcap/pcap.h>
 #endif
@@ -25,6 +29,15 @@
 // more realistic than the default CoAP value (100 s)
 // #define	ETHMAXLATENCY	10
 #define	ETHMAXLATENCY	50
+// PACKET_MMAP receive ring: block size, frame size (for the kernel)
+// and maximum delay (ms) before a partially filled block is delivered
+#define	ETHRINGBLOCK	(1 << 16)
+#define	ETHRINGFRAME	2048
+#define	ETHRINGTIMEOUT	1
+// Maximum number of slave addresses in the in-kernel filter (each one
+// needs 5 BPF instructions). Beyond, unicast frames are not filtered
+// by source address.
+#define	ETHFILTERMAX	512
 
 
 namespace casan {
@@ -46,6 +59,7 @@ class l2addr_eth: public l2addr
 
 	bool operator== (const l2addr &) ;
 	bool operator!= (const l2addr &) ;
+	const byte *bytes (int *len) const ;
 
 	friend class l2net_eth ;
 
@@ -69,18 +83,48 @@ class l2net_eth: public l2net
 {
     public:
 	~l2net_eth () {} ;
-	int init (const std::string iface, int mtu, int ethertype) ;
+	int init (const std::string iface, int mtu, int ethertype, int ring = 0) ;
 	void term (void) ;
 	int send (l2addr *daddr, void *data, int len) ;
 	int bsend (void *data, int len) ;
 	pktype_t recv (l2addr **saddr, void *data, int *len) ;
 	l2addr *bcastaddr (void) ;
+	int pollfd (void) ;
+	pktype_t try_recv (l2addr **saddr, void *data, int *len) ;
+	int recv_batch (l2frame *f, int n) ;
+	int send_batch (l2frame *f, int n) ;
+	int recv_view (l2frame *f, int n) ;
+	void release_view (void) ;
+	int filter (const byte *peers, int n) ;
 
     private:
+	pktype_t recv (l2addr **saddr, void *data, int *len, bool block) ;
+
 #ifdef USE_PF_PACKET
 	int ifidx_ ;			// interface index
 	int fd_ ;			// socket descriptor
 	int ethertype_  ;		// ethernet type
+
+	// receive ring (see recv_batch), used by the receiving thread only
+	struct mmsghdr rhdr_ [L2_BATCH] ;
+	struct iovec riov_ [L2_BATCH][2] ;	// length, payload
+	struct sockaddr_ll rsll_ [L2_BATCH] ;	// source addresses
+	byte rlen_ [L2_BATCH][2] ;		// Ethernet specific length
+
+	// PACKET_MMAP receive ring (see init), or nullptr
+	byte *ring_ = nullptr ;
+	int nblocks_ ;				// number of blocks in ring
+	int curblock_ ;				// block being read
+	int npkts_ ;				// frames left in this block
+	byte *nextpkt_ ;			// next frame, or nullptr
+
+	int init_ring (int nblocks) ;
+	byte *ringblock (int i)	{ return ring_ + i * ETHRINGBLOCK ; }
+	pktype_t ring_recv (l2addr **saddr, void *data, int *len, bool block) ;
+
+	void mkdest (struct sockaddr_ll *sll, byte *lenbuf, l2frame &f) ;
+	pktype_t frame (struct sockaddr_ll *sll, byte *lenbuf, int r,
+			l2addr **saddr, int *len) ;
 #endif
 #ifdef USE_PCAP
 	pcap_t *fd_ ;			// pcap descriptor
@@ -0,0 +1,315 @@
+/**
+ * @file l2-loop.cc
+ * @brief L2addr_loop and l2net_loop class implementations
+ */
+
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <stdio.h>
+
+#include "global.h"
+
+#include "l2.h"
+#include "l2-loop.h"
+#include "byte.h"
+
+namespace casan {
+
+/******************************************************************************
+ * l2addr_loop methods
+ */
+
+// default constructor
+l2addr_loop::l2addr_loop ()
+{
+    std::memset (addr_, 0, LOOPADDRLEN) ;
+}
+
+/**
+ * @brief Constructor with an address given as a number
+ *
+ * @param n address (only the LOOPADDRLEN lower bytes are used)
+ */
+
+l2addr_loop::l2addr_loop (unsigned long int n)
+{
+    for (int i = LOOPADDRLEN - 1 ; i >= 0 ; i--)
+    {
+	addr_ [i] = n & 0xff ;
+	n >>= 8 ;
+    }
+}
+
+// copy constructor
+l2addr_loop::l2addr_loop (const l2addr_loop &l)
+{
+    *this = l ;
+}
+
+// copy assignment constructor
+l2addr_loop &l2addr_loop::operator= (const l2addr_loop &l)
+{
+    if (this != &l)
+	std::memcpy (addr_, l.addr_, LOOPADDRLEN) ;
+    return *this ;
+}
+
+/**
+ * @brief Loopback broadcast address
+ */
+
+l2addr_loop l2addr_loop_broadcast (0xffffffff) ;
+
+/**
+ * @brief Print address
+ *
+ * This function is a hack needed for l2::operator<< overloading
+ */
+
+void l2addr_loop::print (std::ostream &os) const
+{
+    for (int i = 0  ; i < LOOPADDRLEN ; i++)
+    {
+	if (i > 0)
+	    os << ":" ;
+	PRINT_HEX_DIGIT (os, addr_ [i] >> 4) ;
+	PRINT_HEX_DIGIT (os, addr_ [i]     ) ;
+    }
+}
+
+bool l2addr_loop::operator== (const l2addr &other)
+{
+    l2addr_loop *oe = (l2addr_loop *) &other ;
+    return std::memcmp (this->addr_, oe->addr_, LOOPADDRLEN) == 0 ;
+}
+
+bool l2addr_loop::operator!= (const l2addr &other)
+{
+    return ! (*this == other) ;
+}
+
+/**
+ * @brief Returns raw address bytes (used to index addresses)
+ */
+
+const byte *l2addr_loop::bytes (int *len) const
+{
+    *len = LOOPADDRLEN ;
+    return addr_ ;
+}
+
+/**
+ * @brief Returns address as a number
+ */
+
+unsigned long int l2addr_loop::number (void) const
+{
+    unsigned long int n = 0 ;
+
+    for (int i = 0 ; i < LOOPADDRLEN ; i++)
+	n = (n << 8) | addr_ [i] ;
+    return n ;
+}
+
+/******************************************************************************
+ * l2net_loop methods
+ */
+
+/**
+ * @brief Initialize the loopback network
+ *
+ * @param myaddr address of the CASAN engine on this network
+ * @param mtu MTU (or 0 for the default MTU)
+ * @param maxlatency maximum latency announced to the engine (ms),
+ *	or 0 for the default value. The network itself does not add
+ *	any latency: the other end may delay frames.
+ * @return 0 if ok, -1 if error (see errno)
+ */
+
+int l2net_loop::init (const l2addr_loop &myaddr, int mtu, int maxlatency)
+{
+    myaddr_ = myaddr ;
+    mtu_ = (mtu > 0 && mtu <= MAXBUF) ? mtu : LOOPMTU ;
+    maxlatency_ = maxlatency > 0 ? maxlatency : LOOPMAXLATENCY ;
+
+    fd_ = eventfd (0, EFD_NONBLOCK) ;
+    return fd_ == -1 ? -1 : 0 ;
+}
+
+/**
+ * @brief Terminate the loopback network
+ *
+ * Frames which have not been received are lost.
+ */
+
+void l2net_loop::term (void)
+{
+    std::lock_guard <std::mutex> lk (mtx_) ;
+
+    frames_.clear () ;
+    if (fd_ != -1)
+	close (fd_) ;
+    fd_ = -1 ;
+}
+
+/**
+ * @brief Send a frame to the other end
+ *
+ * The frame is given to the output function (see l2net_loop::output),
+ * or silently dropped if no output function has been registered.
+ *
+ * @param daddr destination address
+ * @param data data to send
+ * @param len length of data
+ * @return number of bytes sent, or -1 if error (frame too large)
+ */
+
+int l2net_loop::send (l2addr *daddr, void *data, int len)
+{
+    if (len > mtu_)
+    {
+	errno = EMSGSIZE ;
+	return -1 ;
+    }
+    if (output_)
+	output_ (* (l2addr_loop *) daddr, (const byte *) data, len) ;
+    return len ;
+}
+
+/**
+ * @brief Broadcast a frame to the other end
+ *
+ * @param data data to send
+ * @param len length of data
+ * @return number of bytes sent, or -1 if error
+ */
+
+int l2net_loop::bsend (void *data, int len)
+{
+    return send (&l2addr_loop_broadcast, data, len) ;
+}
+
+/**
+ * @brief Send a frame to the CASAN engine
+ *
+ * This method is called by the other end of the network, from any
+ * thread. The frame is queued if it is addressed to the engine or
+ * broadcasted, else it is dropped.
+ *
+ * @param saddr source address
+ * @param daddr destination address
+ * @param data frame contents
+ * @param len length of data
+ */
+
+void l2net_loop::input (const l2addr_loop &saddr, const l2addr_loop &daddr,
+					const void *data, int len)
+{
+    l2addr_loop d (daddr) ;
+    frame f ;
+
+    if (d == myaddr_)
+	f.pktype = PK_ME ;
+    else if (d == l2addr_loop_broadcast)
+	f.pktype = PK_BCAST ;
+    else
+	return ;
+
+    f.saddr = saddr ;
+    f.data.assign ((const char *) data, len) ;
+
+    std::lock_guard <std::mutex> lk (mtx_) ;
+    if (fd_ == -1)
+	return ;
+    frames_.push_back (std::move (f)) ;
+    if (frames_.size () == 1)
+    {
+	std::uint64_t one = 1 ;
+
+	if (write (fd_, &one, sizeof one) == -1)
+	    perror ("eventfd") ;
+    }
+}
+
+/**
+ * @brief Receive a frame without blocking
+ *
+ * @param saddr address of the sender (allocated by this method)
+ * @param data buffer to store the frame (truncated if too small)
+ * @param len size of buffer on input, length of frame on output
+ * @return PK_ME, PK_BCAST, or PK_AGAIN if no frame is ready
+ */
+
+pktype_t l2net_loop::try_recv (l2addr **saddr, void *data, int *len)
+{
+    std::lock_guard <std::mutex> lk (mtx_) ;
+    pktype_t pktype ;
+    int n ;
+
+    if (frames_.empty ())
+	return PK_AGAIN ;
+
+    frame &f = frames_.front () ;
+    n = (int) f.data.size () ;
+    if (n > *len)
+	n = *len ;
+    std::memcpy (data, f.data.data (), n) ;
+    *len = n ;
+    *saddr = new l2addr_loop (f.saddr) ;
+    pktype = f.pktype ;
+    frames_.pop_front () ;
+
+    if (frames_.empty ())
+    {
+	std::uint64_t v ;
+
+	// the eventfd is not readable anymore
+	if (read (fd_, &v, sizeof v) == -1)
+	    perror ("eventfd") ;
+    }
+
+    return pktype ;
+}
+
+/**
+ * @brief Receive a frame, waiting for one if needed
+ *
+ * @param saddr address of the sender (allocated by this method)
+ * @param data buffer to store the frame
+ * @param len size of buffer on input, length of frame on output
+ * @return PK_ME or PK_BCAST, or PK_NONE if the network is terminated
+ */
+
+pktype_t l2net_loop::recv (l2addr **saddr, void *data, int *len)
+{
+    for (;;)
+    {
+	struct pollfd pfd ;
+	pktype_t pktype ;
+
+	pktype = try_recv (saddr, data, len) ;
+	if (pktype != PK_AGAIN)
+	    return pktype ;
+
+	pfd.fd = fd_ ;
+	pfd.events = POLLIN ;
+	if (pfd.fd == -1 || (poll (&pfd, 1, -1) == -1 && errno != EINTR))
+	{
+	    *saddr = nullptr ;
+	    return PK_NONE ;
+	}
+    }
+}
+
+l2addr *l2net_loop::bcastaddr (void)
+{
+    return &l2addr_loop_broadcast ;
+}
+
+}					// end of namespace casan
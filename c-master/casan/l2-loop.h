@@ -0,0 +1,110 @@
+/**
+ * @file l2-loop.h
+ * @brief l2addr and l2net specializations for an in-memory network
+ */
+
+#ifndef CASAN_L2LOOP_H
+#define	CASAN_L2LOOP_H
+
+#include "l2.h"
+#include <deque>
+#include <string>
+#include <mutex>
+#include <functional>
+
+// Loopback address length
+#define	LOOPADDRLEN	4
+// Loopback default MTU
+#define	LOOPMTU		1024
+// Loopback default maximum latency (ms)
+#define	LOOPMAXLATENCY	10
+
+
+namespace casan {
+
+/**
+ * @brief Specialization of the l2addr abstract class for the loopback
+ *	network
+ *
+ * Addresses are 32-bit numbers, so that many simulated nodes can be
+ * attached to the same loopback network.
+ */
+
+class l2addr_loop: public l2addr
+{
+    public:
+	l2addr_loop () ;			// default constructor
+	l2addr_loop (unsigned long int n) ;	// constructor
+	l2addr_loop (const l2addr_loop &l) ;	// copy constructor
+	l2addr_loop &operator= (const l2addr_loop &l) ;	// copy assignment constructor
+
+	bool operator== (const l2addr &) ;
+	bool operator!= (const l2addr &) ;
+	const byte *bytes (int *len) const ;
+	unsigned long int number (void) const ;
+
+    protected:
+	void print (std::ostream &os) const ;
+
+    private:
+	byte addr_ [LOOPADDRLEN] ;
+} ;
+
+extern l2addr_loop l2addr_loop_broadcast ;
+
+/**
+ * @brief Specialization of the l2net abstract class for the loopback
+ *	network
+ *
+ * This class provides an in-memory network, in order to run the
+ * CASAN engine without any network hardware (for tests and
+ * benchmarks). The network has two ends:
+ * - the CASAN engine uses the l2net methods: frames sent are given
+ *	to the output function, and frames received are the ones
+ *	provided by the input method
+ * - the other end (simulated slaves) provides the output function,
+ *	and calls the input method to send frames to the engine
+ *
+ * Frames given to the input method are queued, and the network can
+ * be polled (see l2net::pollfd) as long as the queue is not empty.
+ */
+
+class l2net_loop: public l2net
+{
+    public:
+	// frame sent by the engine: given to the other end
+	typedef std::function <void (l2addr_loop &daddr, const byte *data, int len)> output_t ;
+
+	~l2net_loop () {} ;
+	int init (const l2addr_loop &myaddr, int mtu = 0, int maxlatency = 0) ;
+	void term (void) ;
+	int send (l2addr *daddr, void *data, int len) ;
+	int bsend (void *data, int len) ;
+	pktype_t recv (l2addr **saddr, void *data, int *len) ;
+	l2addr *bcastaddr (void) ;
+	int pollfd (void)		{ return fd_ ; }
+	pktype_t try_recv (l2addr **saddr, void *data, int *len) ;
+
+	// other end of the network
+	void output (output_t f)	{ output_ = f ; }
+	void input (const l2addr_loop &saddr, const l2addr_loop &daddr,
+					const void *data, int len) ;
+	const l2addr_loop &addr (void)	{ return myaddr_ ; }
+
+    private:
+	struct frame
+	{
+	    l2addr_loop saddr ;
+	    pktype_t pktype ;
+	    std::string data ;
+	} ;
+
+	l2addr_loop myaddr_ ;
+	output_t output_ ;
+	std::deque <frame> frames_ ;	// protected by mtx_
+	std::mutex mtx_ ;
+	int fd_ = -1 ;			// eventfd, readable if frames_ != {}
+} ;
+
+}					// end of namespace casan
+#endif
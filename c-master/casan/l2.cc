@@ -7,6 +7,7 @@
 
 #include "global.h"
 #include "l2.h"
+#include "pool.h"
 
 namespace casan {
 
@@ -24,4 +25,83 @@ std::ostream& operator<< (std::ostream &os, const l2addr &a)
     return os ;
 }
 
+/**
+ * @brief Allocate L2 addresses from the memory pool
+ *
+ * Receiving a frame creates a new address (see l2net::recv), which
+ * is freed after the slave lookup: avoid a heap allocation.
+ */
+
+void *l2addr::operator new (std::size_t sz)
+{
+    return pool::alloc (sz) ;
+}
+
+void l2addr::operator delete (void *p)
+{
+    pool::release (p) ;
+}
+
+/**
+ * @brief Receive a frame without blocking
+ *
+ * This default method is used by networks which cannot be polled
+ * (see l2net::pollfd): there is never any frame ready.
+ *
+ * @param saddr set to nullptr
+ * @return PK_AGAIN
+ */
+
+pktype_t l2net::try_recv (l2addr **saddr, void *, int *)
+{
+    *saddr = nullptr ;
+    return PK_AGAIN ;
+}
+
+/**
+ * @brief Receive frames without blocking
+ *
+ * This default method calls l2net::try_recv for each frame.
+ * For each received frame, the address is created (or nullptr),
+ * and the length and the reception status are updated.
+ *
+ * @param f frames (with a buffer and its size)
+ * @param n number of frames
+ * @return number of received frames (0 if none is ready), or -1
+ */
+
+int l2net::recv_batch (l2frame *f, int n)
+{
+    int i ;
+
+    for (i = 0 ; i < n ; i++)
+    {
+	f [i].pktype = try_recv (&f [i].addr, f [i].data, &f [i].len) ;
+	if (f [i].pktype == PK_AGAIN)
+	    break ;
+    }
+    return i ;
+}
+
+/**
+ * @brief Send frames
+ *
+ * This default method calls l2net::send for each frame, and stops
+ * at the first error.
+ *
+ * @param f frames (with a destination address)
+ * @param n number of frames
+ * @return number of sent frames, or -1 if the first one failed
+ */
+
+int l2net::send_batch (l2frame *f, int n)
+{
+    int i ;
+
+    for (i = 0 ; i < n ; i++)
+	if (send (f [i].addr, f [i].data, f [i].len) == -1)
+	    break ;
+    return (i == 0 && n > 0) ? -1 : i ;
+}
+
 }					// end of namespace casan
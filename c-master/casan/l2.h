@@ -6,6 +6,8 @@
 #ifndef	CASAN_L2_H
 #define	CASAN_L2_H
 
+#include <functional>
+
 namespace casan {
 
 /**
@@ -15,9 +17,13 @@ namespace casan {
 typedef enum pktype {
     PK_ME,		///< packet addressed to me
     PK_BCAST,		///< packet broadcasted
-    PK_NONE		///< no packet (or not for me)
+    PK_NONE,		///< no packet (or not for me)
+    PK_AGAIN		///< no packet available yet (see l2net::try_recv)
 } pktype_t ;
 
+/** maximum number of frames in a batch (see l2net::recv_batch) */
+#define	L2_BATCH	64
+
 /**
  * @brief Abstracts an address of any L2 network
  *
@@ -33,6 +39,11 @@ class l2addr
 	virtual ~l2addr () {} ;
 	virtual bool operator== (const l2addr &other) = 0 ;
 	virtual bool operator!= (const l2addr &other) = 0 ;
+	virtual const byte *bytes (int *len) const = 0 ;	// raw address
+
+	// addresses are allocated for each received frame: use the pool
+	static void *operator new (std::size_t sz) ;
+	static void operator delete (void *p) ;
 
 	// ugly hack to make operator<< feel as a virtual one
 	friend std::ostream& operator<< (std::ostream &os, const l2addr &a) ;
@@ -41,6 +52,18 @@ class l2addr
 	virtual void print (std::ostream &os) const = 0 ;
 } ;
 
+/**
+ * @brief A frame in a batch (see l2net::recv_batch and l2net::send_batch)
+ */
+
+struct l2frame
+{
+    l2addr *addr ;		///< source (created by recv) or destination
+    void *data ;		///< frame payload, provided by the caller
+    int len ;			///< payload length (recv: buffer size)
+    pktype_t pktype ;		///< reception status
+} ;
+
 /**
  * @brief Abstracts access to any L2 network
  *
@@ -53,6 +76,31 @@ class l2addr
  * Each derived class provides some methods specific to the
  * L2 technology (specify Ethernet type for Ethernet, or channel
  * id for IEEE 802.15.4 for example), and a specific `init` method.
+ *
+ * Networks which can be multiplexed with other ones (with `poll`
+ * or `epoll`) provide a file descriptor which is readable when a
+ * frame may be received, and a non-blocking receive method. Other
+ * networks (with `pollfd` returning -1) need a dedicated thread
+ * blocked on the `recv` method: they must provide the `interrupt`
+ * method, which makes a blocked (or the next) `recv` return without
+ * any frame, in order to stop this thread.
+ *
+ * Frames can also be received and sent in batches, in order to save
+ * system calls when many slaves are active on a network. Default
+ * batch methods just loop on the frame methods.
+ *
+ * Networks which receive frames in a memory shared with the kernel
+ * can provide views on received frames (see l2net::recv_view), in
+ * order to decode them without copying.
+ *
+ * Networks may also filter received frames in the kernel (see
+ * l2net::filter), in order to not wake the engine up for frames
+ * from hosts which are not slaves.
+ *
+ * Networks which know that a frame has not been delivered (no
+ * acknowledgement at the link level) report it with the function
+ * registered by l2net::txfail. This function is called by the thread
+ * which receives frames from the network.
  */
 
 class l2net
@@ -66,12 +114,35 @@ class l2net
 	virtual pktype_t recv (l2addr **saddr, void *data, int *len) = 0 ;
 	virtual l2addr * bcastaddr (void) = 0 ;
 
+	// non-blocking access (returns PK_AGAIN if no frame is ready)
+	virtual int pollfd (void)		{ return -1 ; }
+	virtual pktype_t try_recv (l2addr **saddr, void *data, int *len) ;
+
+	// wake up a thread blocked in recv (networks which cannot be polled)
+	virtual void interrupt (void)		{}
+
+	// batched access (at most L2_BATCH frames)
+	virtual int recv_batch (l2frame *f, int n) ;
+	virtual int send_batch (l2frame *f, int n) ;
+
+	// zero-copy reception (recv_view returns -1 if not supported)
+	virtual int recv_view (l2frame *, int)	{ return -1 ; }
+	virtual void release_view (void)	{}
+
+	// in-kernel filtering (addresses of bound slaves, concatenated)
+	virtual int filter (const byte *, int)	{ return 0 ; }
+
+	// link-level delivery failures
+	typedef std::function <void (l2addr *daddr, const byte *data, int len)> txfail_t ;
+	void txfail (txfail_t f)		{ txfail_ = f ; }
+
 	int mtu (void) 		{ return mtu_ ; }
 	int maxlatency (void) 	{ return maxlatency_ ; }
 
     protected:
 	int mtu_ ;			// initialized in the init method
 	int maxlatency_ ;		// initialized in the init method
+	txfail_t txfail_ ;		// see txfail
 } ;
 
 }					// end of namespace casan
@@ -0,0 +1,160 @@
+/**
+ * @file loopslave.cc
+ * @brief Slave side of a loopback network, for tests
+ */
+
+#include <iostream>
+#include <list>
+#include <vector>
+#include <cstdio>
+#include <memory>
+#include <chrono>
+
+#include "global.h"
+#include "byte.h"
+
+#include "option.h"
+#include "resource.h"
+#include "slave.h"
+#include "loopslave.h"
+
+loopslave::loopslave (casan::l2net_loop *l2)
+    : l2_ (l2)
+{
+    l2_->output (
+	[this] (casan::l2addr_loop &daddr, const byte *data, int len)
+	{
+	    output (daddr, data, len) ;
+	}) ;
+    thr_ = new std::thread (&loopslave::thread, this) ;
+}
+
+/**
+ * @brief Stop the slave side
+ *
+ * Delayed frames are lost, and frames sent by the engine are now
+ * dropped.
+ */
+
+loopslave::~loopslave ()
+{
+    {
+	std::lock_guard <std::mutex> lk (mtx_) ;
+
+	stop_ = true ;
+	condvar_.notify_one () ;
+    }
+    thr_->join () ;
+    delete thr_ ;
+    l2_->output (nullptr) ;
+}
+
+/**
+ * @brief Send a frame from a slave to the engine
+ *
+ * @param saddr address of the slave
+ * @param data frame contents
+ * @param len length of data
+ * @param delay delay (ms) before the engine receives the frame
+ */
+
+void loopslave::send (const casan::l2addr_loop &saddr, const void *data, int len, int delay)
+{
+    if (delay == 0)
+	l2_->input (saddr, l2_->addr (), data, len) ;
+    else
+    {
+	std::lock_guard <std::mutex> lk (mtx_) ;
+	delayed d ;
+
+	d.saddr = saddr ;
+	d.frame.assign ((const char *) data, len) ;
+	queue_.insert (std::make_pair (DATE_TIMEOUT_MS (delay), d)) ;
+	condvar_.notify_one () ;
+    }
+}
+
+/**
+ * @brief Send a message from a slave to the engine
+ *
+ * The message is sent on the loopback network to the engine address,
+ * and looped back to the engine as if it were sent by the slave.
+ *
+ * @param saddr address of the slave
+ * @param m message (its peer is modified)
+ */
+
+void loopslave::send (const casan::l2addr_loop &saddr, casan::msg &m)
+{
+    std::lock_guard <std::mutex> lk (msgmtx_) ;
+    casan::l2addr_loop engine (l2_->addr ()) ;
+    casan::slave peer ;
+
+    msgsrc_ = saddr ;
+    peer.l2 (l2_) ;
+    peer.addr (std::shared_ptr <casan::l2addr> (&engine, [] (casan::l2addr *) {})) ;
+    m.peer (&peer) ;
+    (void) m.send () ;
+    m.peer (nullptr) ;
+}
+
+/**
+ * @brief Slave coming up: send a Discover message to the engine
+ *
+ * @param saddr address of the slave
+ * @param sid slave id
+ */
+
+void loopslave::discover (const casan::l2addr_loop &saddr, slaveid_t sid)
+{
+    casan::msg m ;
+    char buf [MAXBUF] ;
+    int len ;
+
+    m.type (casan::msg::MT_NON) ;
+    m.code (casan::msg::MC_POST) ;
+    m.add_path_ctl () ;
+    len = std::snprintf (buf, sizeof buf, "slave=%ld", sid) ;
+    casan::option o (casan::option::MO_Uri_Query, buf, len) ;
+    m.pushoption (o) ;
+    send (saddr, m) ;
+}
+
+/*
+ * Frame sent on the loopback network: messages sent by loopslave::send
+ * go back to the engine, other frames are given to the handler
+ */
+
+void loopslave::output (casan::l2addr_loop &daddr, const byte *data, int len)
+{
+    if (daddr == l2_->addr ())
+	l2_->input (msgsrc_, daddr, data, len) ;
+    else if (handler_)
+	handler_ (daddr, data, len) ;
+}
+
+/*
+ * Delivery thread: deliver delayed frames when they are due
+ */
+
+void loopslave::thread (void)
+{
+    std::unique_lock <std::mutex> lk (mtx_) ;
+
+    while (! stop_)
+    {
+	if (queue_.empty ())
+	    condvar_.wait (lk) ;
+	else if (std::chrono::system_clock::now () < queue_.begin ()->first)
+	    condvar_.wait_until (lk, queue_.begin ()->first) ;
+	else
+	{
+	    delayed d = queue_.begin ()->second ;
+
+	    queue_.erase (queue_.begin ()) ;
+	    lk.unlock () ;
+	    l2_->input (d.saddr, l2_->addr (), d.frame.data (), d.frame.size ()) ;
+	    lk.lock () ;
+	}
+    }
+}
@@ -0,0 +1,76 @@
+/**
+ * @file loopslave.h
+ * @brief Slave side of a loopback network, for tests
+ */
+
+#ifndef CASAN_LOOPSLAVE_H
+#define	CASAN_LOOPSLAVE_H
+
+#include <map>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "global.h"
+#include "l2-loop.h"
+#include "msg.h"
+
+/**
+ * @brief Slave side of a loopback network
+ *
+ * This class is the other end of a loopback network (see
+ * casan::l2net_loop), for tests and benchmarks which need a few
+ * scripted slaves instead of a fleet of simulated ones (see the
+ * slavesim class):
+ * - frames sent by the engine are given to the handler, which
+ *	plays the role of the slaves (the handler is called by engine
+ *	threads, and must be registered before the network is given
+ *	to the engine)
+ * - frames (or messages) are sent to the engine on behalf of a
+ *	slave, either immediately or after a delay. Delayed frames
+ *	are delivered by a dedicated thread.
+ */
+
+class loopslave
+{
+    public:
+	// frame sent by the engine to a slave (or broadcasted)
+	typedef casan::l2net_loop::output_t handler_t ;
+
+	loopslave (casan::l2net_loop *l2) ;
+	~loopslave () ;
+
+	void handler (handler_t h)	{ handler_ = h ; }
+
+	// send to the engine from a slave
+	void send (const casan::l2addr_loop &saddr, const void *data, int len,
+					int delay = 0) ;
+	void send (const casan::l2addr_loop &saddr, casan::msg &m) ;
+	void discover (const casan::l2addr_loop &saddr, slaveid_t sid) ;
+
+    private:
+	struct delayed
+	{
+	    casan::l2addr_loop saddr ;
+	    std::string frame ;
+	} ;
+
+	casan::l2net_loop *l2_ ;
+	handler_t handler_ ;
+
+	casan::l2addr_loop msgsrc_ ;	// source of the message being sent
+	std::mutex msgmtx_ ;		// protects msgsrc_
+
+	std::multimap <timepoint_t, delayed> queue_ ;	// protected by mtx_
+	bool stop_ = false ;		// protected by mtx_
+	std::mutex mtx_ ;
+	std::condition_variable condvar_ ;
+	std::thread *thr_ ;
+
+	void output (casan::l2addr_loop &daddr, const byte *data, int len) ;
+	void thread (void) ;
+} ;
+
+#endif
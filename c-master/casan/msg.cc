@@ -6,7 +6,9 @@
 #include <iostream>
 #include <cstring>
 #include <cstdio>
+#include <cmath>
 #include <vector>
+#include <utility>
 
 #include "global.h"
 
@@ -14,28 +16,45 @@
 #include "l2.h"
 #include "msg.h"
 #include "slave.h"
+#include "rto.h"
 #include "utils.h"
 #include "byte.h"
 
 namespace casan {
 
-int msg::global_message_id = 1 ;
+std::atomic <unsigned int> msg::global_message_id (1) ;
 
 // reset pointer and length
 #define	RESET_PL(p,l)	do {					\
 			    if (p != nullptr)			\
 			    {					\
-				delete [] p ;			\
+				pool::release (p) ;		\
 				p = nullptr ;			\
 				l = 0 ;				\
 			    }					\
 			} while (false)				// no ";"
+// copy the payload if it is a view in the encoded message
+#define	UNVIEW_PAYLOAD	do {					\
+			    if (payview_)			\
+			    {					\
+				byte *p = payload_ ;		\
+				ALLOC_COPYNUL (payload_, p, paylen_) ; \
+				payview_ = false ;		\
+			    }					\
+			} while (false)				// no ";"
 // reset encoded message
 #define	RESET_BINARY	do {					\
+			    UNVIEW_PAYLOAD ;			\
 			    RESET_PL (msg_, msglen_) ;		\
 			} while (false)				// no ";"
 // reset all pointers
 #define	RESET_POINTERS	do {					\
+			    if (payview_)			\
+			    {					\
+				payload_ = nullptr ;		\
+				paylen_ = 0 ;			\
+				payview_ = false ;		\
+			    }					\
 			    RESET_PL (msg_, msglen_) ;		\
 			    RESET_PL (payload_, paylen_) ;	\
 			    if (reqrep_ != nullptr)		\
@@ -49,6 +68,7 @@ int msg::global_message_id = 1 ;
 			    reqrep_ = nullptr ;			\
 			    msg_ = nullptr ; msglen_ = 0 ;	\
 			    payload_ = nullptr ; paylen_ = 0 ;	\
+			    payview_ = false ;			\
 			    toklen_ = 0 ; ntrans_ = 0 ;		\
 			    timeout_ = duration_t (0) ;		\
 			    next_timeout_ = std::chrono::system_clock::time_point::max () ; \
@@ -73,16 +93,21 @@ int msg::global_message_id = 1 ;
 #define	COAP_ID(b)	(((b) [2] << 8) | (b) [3])
 
 #define	ALLOC_COPY(f,m,l)	do {				\
-				    f = new byte [(l)] ;	\
+				    f = (byte *) pool::alloc (l) ;	\
 				    std::memcpy (f, (m), (l)) ;	\
 				} while (false)			// no ";"
 // add a nul byte to ease string operations
 #define	ALLOC_COPYNUL(f,m,l)	do {				\
-				    f = new byte [(l) + 1] ;	\
+				    f = (byte *) pool::alloc ((l) + 1) ; \
 				    std::memcpy (f, (m), (l)) ;	\
 				    f [(l)]=0 ;			\
 				} while (false)			// no ";"
 #define	OPTVAL(o)	((o).optval_ ? (o).optval_ : (o).staticval_)
+// 64 bit FNV-1a hash step, on variable h
+#define	FNV_BYTE(b)	do {					\
+			    h ^= (byte) (b) ;			\
+			    h *= 1099511628211ULL ;		\
+			} while (false)				// no ";"
 
 /**
  * @brief Default constructor: initialize an empty message.
@@ -105,6 +130,7 @@ msg::msg (const msg &m)
 	ALLOC_COPY (msg_, m.msg_, msglen_) ;
     if (payload_)
 	ALLOC_COPYNUL (payload_, m.payload_, paylen_) ;
+    payview_ = false ;
 }
 
 /**
@@ -122,6 +148,7 @@ msg &msg::operator= (const msg &m)
 	    ALLOC_COPY (msg_, m.msg_, msglen_) ;
 	if (payload_)
 	    ALLOC_COPYNUL (payload_, m.payload_, paylen_) ;
+	payview_ = false ;
     }
     return *this ;
 }
@@ -176,6 +203,29 @@ int msg::operator == (msg &m)
     return r ;
 }
 
+/**
+ * @brief Compute a fingerprint of a received message
+ *
+ * The fingerprint is a 64 bit FNV-1a hash of the encoded message,
+ * used to compare received messages without keeping them.
+ *
+ * @return fingerprint (0 if message is not encoded)
+ */
+
+std::uint64_t msg::fingerprint (void)
+{
+    std::uint64_t h ;
+
+    h = 0 ;
+    if (msg_ != nullptr)
+    {
+	h = 14695981039346656037ULL ;
+	for (int i = 0 ; i < msglen_ ; i++)
+	    FNV_BYTE (msg_ [i]) ;
+    }
+    return h ;
+}
+
 /******************************************************************************
  * Receive message
  */
@@ -186,31 +236,105 @@ int msg::operator == (msg &m)
  * Receive a message on a given L2 network, and decode it
  * according to CoAP specification if it is a valid incoming
  * message.
+ * In non-blocking mode, pktype () returns PK_AGAIN if no message
+ * was ready to be received.
  *
  * @param l2 L2 network access
+ * @param block wait for a message (see l2net::recv and l2net::try_recv)
  * @return receive status (see l2net class)
  */
 
-l2addr *msg::recv (l2net *l2)
+l2addr *msg::recv (l2net *l2, bool block)
 {
-    l2addr *a ;
-    int len ;
+    l2frame f ;
 
-    /*
-     * Reset message object to a known state
-     */
+    recv_buffer (l2, f) ;
+    if (block)
+	f.pktype = l2->recv (&f.addr, f.data, &f.len) ;	// create a l2addr
+    else
+	f.pktype = l2->try_recv (&f.addr, f.data, &f.len) ;
+    return recv_decode (f) ;
+}
+
+/**
+ * @brief Receive and decode a batch of messages
+ *
+ * Ready frames are received on a given L2 network (without
+ * blocking) in the given messages, which are then decoded as
+ * with msg::recv.
+ * If the network provides views on received frames (see
+ * l2net::recv_view), frames are decoded in place, and only valid
+ * messages are copied before the frames are released.
+ *
+ * @param l2 L2 network access
+ * @param m messages (existing objects)
+ * @param a source addresses of valid received messages (or nullptr),
+ *	which must be freed by caller
+ * @param n number of messages (at most L2_BATCH)
+ * @return number of received frames (0 if none was ready)
+ */
+
+int msg::recv_batch (l2net *l2, msgptr_t m [], l2addr *a [], int n)
+{
+    l2frame f [L2_BATCH] ;
+    int r ;
+
+    if (n > L2_BATCH)
+	n = L2_BATCH ;
+
+    r = l2->recv_view (f, n) ;
+    if (r >= 0)
+    {
+	for (int i = 0 ; i < r ; i++)
+	{
+	    m [i]->recv_reset () ;
+	    a [i] = m [i]->recv_decode (f [i]) ;
+	}
+	l2->release_view () ;
+	return r ;
+    }
+
+    for (int i = 0 ; i < n ; i++)
+	m [i]->recv_buffer (l2, f [i]) ;
+
+    r = l2->recv_batch (f, n) ;
+    if (r == -1)
+	r = 0 ;
+
+    for (int i = 0 ; i < r ; i++)
+	a [i] = m [i]->recv_decode (f [i]) ;
+
+    return r ;
+}
 
+// Reset message object to a known state
+void msg::recv_reset (void)
+{
     RESET_POINTERS ;
     RESET_VALUES ;
+}
 
-    /*
-     * Read message from L2 network
-     */
+// Reset message object, and provide a buffer to receive a frame
+void msg::recv_buffer (l2net *l2, l2frame &f)
+{
+    recv_reset () ;
+
+    f.addr = nullptr ;
+    f.len = l2->mtu () ;
+    f.data = msg_ = (byte *) pool::alloc (f.len + 1) ;	// + 1 for payload nul byte
+    f.pktype = PK_NONE ;
+}
+
+// Decode a received frame (in the message buffer, or a view if none)
+l2addr *msg::recv_decode (l2frame &f)
+{
+    l2addr *a = f.addr ;
+    bool view = (msg_ == nullptr) ;
 
-    len = l2->mtu () ;
-    msg_ = new byte [len] ;
-    pktype_ = l2->recv (&a, msg_, &len) ; 	// create a l2addr *a
-    msglen_ = len ;
+    pktype_ = f.pktype ;
+    msglen_ = f.len ;
+    if (view)
+	msg_ = (byte *) f.data ;
 
     if (! ((pktype_ == PK_ME || pktype_ == PK_BCAST) && coap_decode ()))
     {
@@ -222,6 +346,35 @@ l2addr *msg::recv (l2net *l2)
 	a = 0 ;
     }
 
+    /*
+     * A view will be released: valid messages are copied (with
+     * the payload view), and nothing is kept from invalid ones.
+     */
+
+    if (view)
+    {
+	byte *b = nullptr ;
+
+	if (a != nullptr)
+	{
+	    b = (byte *) pool::alloc (msglen_ + 1) ;	// + 1 for payload nul byte
+	    std::memcpy (b, msg_, msglen_) ;
+	    if (payview_)
+		payload_ = b + (payload_ - msg_) ;
+	}
+	else
+	{
+	    payload_ = nullptr ;
+	    paylen_ = 0 ;
+	    payview_ = false ;
+	    msglen_ = 0 ;
+	}
+	msg_ = b ;
+    }
+
+    if (payview_)
+	payload_ [paylen_] = 0 ;
+
 #ifdef DEBUG
     if (a)
     {
@@ -231,7 +384,8 @@ l2addr *msg::recv (l2net *l2)
 
 	D (D_MESSAGE, "VALID RECV -> " << p << ", id=" << id_ << ", len=" << msglen_) ;
     }
-    else D (D_MESSAGE, "INVALID RECV pkt=" << pktype_ << ", len=" << len) ;
+    else if (pktype_ != PK_AGAIN)
+	D (D_MESSAGE, "INVALID RECV pkt=" << pktype_ << ", len=" << f.len) ;
 #endif
 
     return a ;
@@ -338,8 +492,16 @@ bool msg::coap_decode (void)
 	    }
 	    else
 	    {
+		/*
+		 * The payload is not copied: it is a view in the
+		 * received buffer (the buffer has room for a nul
+		 * byte after the end of the message, which is
+		 * added by msg::recv_decode).
+		 */
+
 		i++ ;
-		ALLOC_COPYNUL (payload_, msg_ + i, paylen_) ;
+		payload_ = msg_ + i ;
+		payview_ = true ;
 	    }
 	}
 	else paylen_ = 0 ;			// protect further operations
@@ -375,82 +537,170 @@ bool msg::coap_decode (void)
 
 int msg::send (void)
 {
+    std::shared_ptr <l2addr> a ;	// kept until sent (see slave::addr)
+    l2net *l2 ;
     int r ;
 
     if (msg_ == nullptr)
 	coap_encode () ;
 
     D (D_MESSAGE, "TRANSMIT id=" << id_ << " ntrans_=" << ntrans_) ;
-    r = peer_->l2 ()->send (peer_->addr (), msg_, msglen_) ;
+    l2 = peer_->l2 () ;
+    a = peer_->addr () ;
+    if (l2 == nullptr || a == nullptr)	// slave has been reset
+	return -1 ;
+    r = l2->send (a.get (), msg_, msglen_) ;
     if (r == -1)
     {
 	std::cout << "ERREUR \n" ;
     }
     else
+	transmitted (l2) ;
+    return r ;
+}
+
+/**
+ * @brief Send a batch of messages on the same L2 network
+ *
+ * Messages are encoded if needed, and sent with a single call
+ * to l2net::send_batch. Timers are updated for sent messages
+ * as with msg::send. Messages whose peer has no address anymore
+ * are not sent, and are moved after the other ones (which are
+ * kept in order), such that sent messages are the first ones.
+ *
+ * @param l2 L2 network access (the network of all peers)
+ * @param m messages (reordered)
+ * @param n number of messages (at most L2_BATCH)
+ * @return number of sent messages (the first ones), or -1
+ */
+
+int msg::send_batch (l2net *l2, msgptr_t m [], int n)
+{
+    l2frame f [L2_BATCH] ;
+    std::shared_ptr <l2addr> a [L2_BATCH] ;	// kept until sent
+    int nf, r ;
+
+    if (n > L2_BATCH)
+	n = L2_BATCH ;
+
+    nf = 0 ;
+    for (int i = 0 ; i < n ; i++)
     {
-	int maxlat = peer_ ->l2 ()->maxlatency () ;
+	a [nf] = m [i]->peer_->addr () ;
+	if (a [nf] == nullptr)		// slave has been reset: skip it
+	    continue ;
+	if (i != nf)
+	    std::swap (m [i], m [nf]) ;
+	if (m [nf]->msg_ == nullptr)
+	    m [nf]->coap_encode () ;
+
+	D (D_MESSAGE, "TRANSMIT id=" << m [nf]->id_ << " ntrans_=" << m [nf]->ntrans_) ;
+	f [nf].addr = a [nf].get () ;
+	f [nf].data = m [nf]->msg_ ;
+	f [nf].len = m [nf]->msglen_ ;
+	nf++ ;
+    }
 
-	/*
-	 * Timers for reliable messages
-	 */
+    r = nf == 0 ? 0 : l2->send_batch (f, nf) ;
 
-	switch (type_)
-	{
-	    case MT_CON :
-		if (ntrans_ == 0)
+    for (int i = 0 ; i < r ; i++)
+	m [i]->transmitted (l2) ;
+
+    return r ;
+}
+
+// Update timers of a message after its transmission
+void msg::transmitted (l2net *l2)
+{
+    int maxlat = l2->maxlatency () ;
+
+    /*
+     * Timers for reliable messages
+     */
+
+    switch (type_)
+    {
+	case MT_CON :
+	    if (ntrans_ == 0)
+	    {
+		long int nmilli, t, span ;
+		int r ;
+
+		/*
+		 * initial timeout should be \in
+		 *	[ACK_TIMEOUT ... ACK_TIMEOUT * ACK_RANDOM_FACTOR] (1)
+		 *
+		 * Let's name i = initial timeout, t = ACK_TIMEOUT and
+		 * f = ACK_RANDOM_FACTOR
+		 * (1)	<==> t <= i < t*f
+		 *		<==> 1 <= i/t < f
+		 *		<==> 0 <= (i/t) - 1 < f-1
+		 *		<==> 0 <= ((i/t) - 1) * 1000 < (f-1)*1000
+		 * So, we take a pseudo-random number r between 0 and (f-1)*1000
+		 *		r = ((i/t) - 1) * 1000
+		 * and compute i = t(r/1000 + 1) = t*(r + 1000)/1000
+
+		 *
+		 * The ACK_TIMEOUT is replaced by the timeout estimated
+		 * from RTTs to the slave (see casan::window_grant and
+		 * rto::timeout), if any.
+		 */
+
+		if (rto_.count () > 0)
 		{
-		    long int nmilli ;
-		    int r ;
-
-		    /*
-		     * initial timeout should be \in
-		     *	[ACK_TIMEOUT ... ACK_TIMEOUT * ACK_RANDOM_FACTOR] (1)
-		     *
-		     * Let's name i = initial timeout, t = ACK_TIMEOUT and
-		     * f = ACK_RANDOM_FACTOR
-		     * (1)	<==> t <= i < t*f
-		     *		<==> 1 <= i/t < f
-		     *		<==> 0 <= (i/t) - 1 < f-1
-		     *		<==> 0 <= ((i/t) - 1) * 1000 < (f-1)*1000
-		     * So, we take a pseudo-random number r between 0 and (f-1)*1000
-		     *		r = ((i/t) - 1) * 1000
-		     * and compute i = t(r/1000 + 1) = t*(r + 1)/1000
-		     */
-
-		    r = random_value (int ((ACK_RANDOM_FACTOR - 1.0) * 1000)) ;
-		    nmilli = ACK_TIMEOUT * (r + 1) ;
-		    nmilli = nmilli / 1000 ;
-		    timeout_ = duration_t (nmilli) ;
-		    expire_ = DATE_TIMEOUT_MS (EXCHANGE_LIFETIME (maxlat)) ;
+		    t = rto_.count () ;
+		    backoff_ = rto::backoff (rto_) ;
 		}
 		else
 		{
-		    timeout_ *= 2 ;
+		    t = ACK_TIMEOUT ;
+		    backoff_ = 2 ;
 		}
-		next_timeout_ = std::chrono::system_clock::now () + timeout_ ;
+		r = random_value (int ((ACK_RANDOM_FACTOR - 1.0) * 1000)) ;
+		nmilli = t * (r + 1000) ;
+		nmilli = nmilli / 1000 ;
+		timeout_ = duration_t (nmilli) ;
 
-		ntrans_++ ;
-		break ;
-	    case MT_NON :
-		STOP_TRANSMIT ;
-		expire_ = DATE_TIMEOUT_MS (NON_LIFETIME (maxlat)) ;
-		break ;
-	    case MT_ACK :
-	    case MT_RST :
 		/*
-		 * Non reliable messages : arbitrary set the retransmission
-		 * counter in order to skip further retransmissions.
+		 * The exchange must last long enough for all
+		 * retransmissions, even with a large RTO
 		 */
 
-		STOP_TRANSMIT ;
-		expire_ = DATE_TIMEOUT_MS (MAX_RTT (maxlat)) ;	// arbitrary
-		break ;
-	    default :
-		std::cout << "Can't happen (msg type == " << type_ << ")\n" ;
-		break ;
-	}
+		span = 0 ;
+		for (int i = 0 ; i < MAX_RETRANSMIT ; i++)
+		    span += nmilli * std::pow (backoff_, i) ;
+		span += MAX_RTT (maxlat) ;
+		if (span < EXCHANGE_LIFETIME (maxlat))
+		    span = EXCHANGE_LIFETIME (maxlat) ;
+		sent_ = std::chrono::system_clock::now () ;
+		expire_ = sent_ + duration_t (span) ;
+	    }
+	    else
+	    {
+		timeout_ = duration_t (long (timeout_.count () * backoff_)) ;
+	    }
+	    next_timeout_ = std::chrono::system_clock::now () + timeout_ ;
+
+	    ntrans_++ ;
+	    break ;
+	case MT_NON :
+	    STOP_TRANSMIT ;
+	    expire_ = DATE_TIMEOUT_MS (NON_LIFETIME (maxlat)) ;
+	    break ;
+	case MT_ACK :
+	case MT_RST :
+	    /*
+	     * Non reliable messages : arbitrary set the retransmission
+	     * counter in order to skip further retransmissions.
+	     */
+
+	    STOP_TRANSMIT ;
+	    expire_ = DATE_TIMEOUT_MS (MAX_RTT (maxlat)) ;	// arbitrary
+	    break ;
+	default :
+	    std::cout << "Can't happen (msg type == " << type_ << ")\n" ;
+	    break ;
     }
-    return r ;
 }
 
 /**
@@ -468,8 +718,7 @@ void msg::coap_encode (void)
 
     msglen_ = 4 + toklen_ ;
 
-    optlist_.sort () ;			// sort option list
-    opt_nb = 0 ;
+    opt_nb = 0 ;			// option list is already sorted
     for (auto &o : optlist_)
     {
 	int opt_delta, opt_len ;
@@ -498,17 +747,13 @@ void msg::coap_encode (void)
      */
 
     if (id_ == 0)
-    {
-	id_ = global_message_id++ ;
-	if (global_message_id > 0xffff)
-	    global_message_id = 1 ;
-    }
+	id_ = new_id () ;
 
     /*
      * Format message, part 3 : build message
      */
 
-    msg_ = new byte [msglen_] ;
+    msg_ = (byte *) pool::alloc (msglen_) ;
 
     i = 0 ;
 
@@ -583,6 +828,26 @@ void msg::coap_encode (void)
     ntrans_ = 0 ;
 }
 
+/**
+ * @brief Allocate a new message id
+ *
+ * Message ids are allocated from a global counter, in the range
+ * [1..0xffff]. This function may be called from any thread.
+ *
+ * @return message id
+ */
+
+int msg::new_id (void)
+{
+    int id ;
+
+    do
+    {
+	id = global_message_id++ & 0xffff ;
+    } while (id == 0) ;
+    return id ;
+}
+
 /**
  * @brief Stop retransmissions for this message
  *
@@ -634,8 +899,9 @@ void msg::code (int code)
 
 void msg::payload (void *data, int len)
 {
-    if (payload_)
-	delete [] payload_ ;
+    if (payload_ && ! payview_)
+	pool::release (payload_) ;
+    payview_ = false ;
 
     ALLOC_COPYNUL (payload_, data, len) ;
     paylen_ = len ;
@@ -648,7 +914,7 @@ void msg::payload (void *data, int len)
 
 void msg::pushoption (option &o)
 {
-    optlist_.push_back (o) ;
+    optlist_.insert (o) ;
 }
 
 /**
@@ -660,6 +926,19 @@ void msg::wt (waiter *w)
     waiter_ = w ;
 }
 
+/**
+ * @brief Set the completion function for this request
+ *
+ * The function will be called once by an engine thread, with the
+ * request as argument, when an answer is received (the answer is
+ * then linked to the request) or when the request expires.
+ */
+
+void msg::completion (completion_t c)
+{
+    completion_ = c ;
+}
+
 /**
  * @brief Returns the Max-Age option (in seconds) or -1
  */
@@ -667,15 +946,11 @@ void msg::wt (waiter *w)
 long int msg::max_age (void)
 {
     long int ma = -1 ;
+    option *o ;
 
-    for (auto &o : optlist_)
-    {
-	if (o.optcode_ == option::MO_Max_Age)
-	{
-	    ma = o.optval () ;
-	    break ;
-	}
-    }
+    o = optlist_.find (option::MO_Max_Age) ;
+    if (o != nullptr)
+	ma = o->optval () ;
     return ma ;
 }
 
@@ -684,6 +959,7 @@ long int msg::max_age (void)
  *
  * This method checks if a request message matches the current message
  * for caching (see CoAP spec, 5.6):
+ * - same slave
  * - request method match
  * - all options match, except those marked NoCacheKey (5.4) or recognized by
  *	the cache
@@ -693,7 +969,7 @@ bool msg::cache_match (msgptr_t m)
 {
     bool r ;
 
-    if (type_ != m->type_)
+    if (peer_ != m->peer_ || code_ != m->code_)
 	r = false ;
     else
     {
@@ -702,14 +978,7 @@ bool msg::cache_match (msgptr_t m)
 	r = true ;
 
 	/*
-	 * Don't assume that each option list is already sorted
-	 */
-
-	optlist_.sort () ;
-	m->optlist_.sort () ;
-
-	/*
-	 * Traverse the option list
+	 * Traverse the option lists (which are always sorted)
 	 */
 
 	auto ol1 = optlist_.begin () ;
@@ -757,6 +1026,44 @@ bool msg::cache_match (msgptr_t m)
 }
 
 
+/**
+ * @brief Compute a hash of the cache key of a request
+ *
+ * The hash (64 bit FNV-1a) covers the elements checked by
+ * `cache_match`: slave, request code and options which are not
+ * marked NoCacheKey. Two requests which match have the same hash.
+ *
+ * @return hash value
+ */
+
+std::uint64_t msg::cache_hash (void)
+{
+    std::uint64_t h ;
+    std::uintptr_t p ;
+
+    h = 14695981039346656037ULL ;
+
+    p = (std::uintptr_t) peer_ ;
+    for (unsigned int i = 0 ; i < sizeof p ; i++)
+	FNV_BYTE (p >> (i * 8)) ;
+    FNV_BYTE (code_) ;
+
+    for (auto &o : optlist_)
+    {
+	byte *v ;
+
+	if (o.nocachekey ())
+	    continue ;
+	FNV_BYTE (o.optcode_) ;
+	FNV_BYTE (o.optlen_) ;
+	v = OPTVAL (o) ;
+	for (int i = 0 ; i < o.optlen_ ; i++)
+	    FNV_BYTE (v [i]) ;
+    }
+
+    return h ;
+}
+
 /**
  * @brief Mutually link a reply and a request messages
  *
@@ -771,7 +1078,7 @@ void msg::link_reqrep (msgptr_t m1, msgptr_t m2)
     {
 	// unlink peer message if it exists
 	if (m1->reqrep_ != nullptr)
-	    m2->reqrep_->reqrep_ = nullptr ;
+	    m1->reqrep_->reqrep_ = nullptr ;
 	// unlink current message
 	m1->reqrep_ = nullptr ;
     }
@@ -855,7 +1162,7 @@ option msg::popoption (void)
 {
     option o ;
 
-    o = optlist_.front () ;
+    o = std::move (optlist_.front ()) ;
     optlist_.pop_front () ;
     return o ;
 }
@@ -869,7 +1176,7 @@ option msg::popoption (void)
 
 void msg::option_reset_iterator (void)
 {
-    optiter_ = optlist_.begin () ;
+    optiter_ = 0 ;
 }
 
 /**
@@ -883,16 +1190,24 @@ option *msg::option_next (void)
 {
     option *o ;
 
-    if (optiter_ == optlist_.end ())
+    if (optiter_ >= optlist_.size ())
 	o = nullptr ;
     else
-    {
-	o = & (*optiter_) ;
-	optiter_++ ;
-    }
+	o = &optlist_ [optiter_++] ;
     return o ;
 }
 
+/**
+ * @brief Return the first option with a given code
+ *
+ * @return pointer to the option, or nullptr if not found
+ */
+
+option *msg::getoption (option::optcode_t c)
+{
+    return optlist_.find (c) ;
+}
+
 /**
  * @brief Returns the waiter for this message
  */
@@ -9,10 +9,15 @@
 #include <list>
 #include <chrono>
 #include <memory>
+#include <functional>
+#include <atomic>
+#include <cstdint>
 
 #include "coap.h"
 #include "l2.h"
 #include "option.h"
+#include "optlist.h"
+#include "pool.h"
 
 namespace casan {
 
@@ -43,8 +48,10 @@ typedef std::shared_ptr <msg> msgptr_t ;
  * However, each modification of an attribute will squeeze the
  * binary form, which will be automatically re-created if needed.
  *
- * Each request sent has a "waiter" which represents a thread to
- * awake when the answer will be received.
+ * Each request sent may have either a "waiter", which represents a
+ * thread to awake when the answer will be received, or a completion
+ * function, which is called (by an engine thread) when the answer is
+ * received or when the request expires without answer.
  *
  * @bug should wake the waiter if a request is abandonned due to a time-out
  */
@@ -54,6 +61,7 @@ class msg
     public:
 	// types
 	typedef enum msgtype { MT_CON=0, MT_NON, MT_ACK, MT_RST } msgtype_t ;
+	typedef std::function <void (msgptr_t req)> completion_t ;
 	typedef enum msgcode { MC_EMPTY=0,
 		    MC_GET=1, MC_POST, MC_PUT, MC_DELETE } msgcode_t ;
 	// CASAN_HELLO is never used
@@ -69,12 +77,17 @@ class msg
 
 	// operators
 	int operator == (msg &) ;	// only for received messages
+	std::uint64_t fingerprint (void) ;	// only for received messages
 
 	friend std::ostream& operator<< (std::ostream &os, const msg &m) ;
 
 	// basic operations
 	int send (void) ;
-	l2addr *recv (l2net *l2) ;	// returned addr must be freed by caller
+	l2addr *recv (l2net *l2, bool block = true) ; // returned addr must be freed by caller
+
+	// batched operations (at most L2_BATCH messages on the same network)
+	static int send_batch (l2net *l2, msgptr_t m [], int n) ;
+	static int recv_batch (l2net *l2, msgptr_t m [], l2addr *a [], int n) ;
 
 	// mutators (to send messages)
 	void peer (slave *s) ;
@@ -85,6 +98,7 @@ class msg
 	void payload (void *data, int len) ;
 	void pushoption (option &o) ;
 	void wt (waiter *w) ;
+	void completion (completion_t c) ;
 
 	void stop_retransmit (void) ;	// no need for more retransmits
 
@@ -104,10 +118,12 @@ class msg
 
 	void option_reset_iterator (void) ;
 	option *option_next (void) ;
+	option *getoption (option::optcode_t c) ;	// first option with code c
 
 	long int max_age (void) ;
 
 	bool cache_match (msgptr_t m) ;		// do reqs match for caching?
+	std::uint64_t cache_hash (void) ;	// hash of the cache key
 
 	static void link_reqrep (msgptr_t m1, msgptr_t m2) ;	// m2 == 0 <=> unlink
 	// control messages
@@ -123,11 +139,16 @@ class msg
 	int ntrans_ = 0 ;		// # of transmissions (CON/NON)
 	duration_t timeout_ ;		// current timeout (CON)
 	timepoint_t next_timeout_ ;	// (CON)
+	timepoint_t sent_ ;		// first transmission (CON)
+	duration_t rto_ {0} ;		// initial timeout, or 0 (CON)
+	double backoff_ = 2 ;		// timeout factor for retransmissions
+	bool inflight_ = false ;	// counted in peer window (see casan)
 
 	friend class casan ;
 
     private:
 	waiter *waiter_ = nullptr ;	// wakeup when an answer is received
+	completion_t completion_ ;	// or call this function (once)
 
 	// Formatted message, as it appears on the cable/over the air
 	byte *msg_ = nullptr ;		// NULL when reset
@@ -145,17 +166,24 @@ class msg
 	msgtype_t type_ = MT_RST ;
 	int code_ = MC_EMPTY ;
 	int id_ = 0 ;			// message id
-	std::list <option> optlist_ ;	// list of all options
-	std::list <option>::iterator optiter_ ;
+	bool payview_ = false ;		// payload_ points into msg_
+	optlist optlist_ ;		// all options, sorted by code
+	int optiter_ = 0 ;		// index in optlist_
 
 	msgptr_t reqrep_ = nullptr ;	// "request of" or "response of"
 	casantype_t casantype_ = CASAN_UNKNOWN ;
 
-	static int global_message_id ;
+	static std::atomic <unsigned int> global_message_id ;
+	static int new_id (void) ;	// thread-safe message id allocation
 
 	void coap_encode (void) ;
 	bool coap_decode (void) ;
 
+	void transmitted (l2net *l2) ;
+	void recv_reset (void) ;
+	void recv_buffer (l2net *l2, l2frame &f) ;
+	l2addr *recv_decode (l2frame &f) ;
+
 	bool is_casan_ctl_msg (void) ;
 	casantype_t casan_type (bool checkreqrep) ;
 } ;
@@ -0,0 +1,393 @@
+/**
+ * @file observe.cc
+ * @brief CASAN engine: observation of resources
+ *
+ * A resource is observed (see RFC 7641) once for all subscribers
+ * (for example, HTTP clients waiting for Server-Sent Events): the
+ * master registers itself as an observer on the slave with the first
+ * subscription, and each notification received from the slave is
+ * delivered to all subscribers.
+ *
+ * The registration is renewed if no notification is received
+ * before the Max-Age of the last one expires (the slave may have
+ * forgotten us, or may not support the Observe option at all, in
+ * which case the resource is just polled). The master deregisters
+ * when the last subscriber leaves.
+ */
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <mutex>
+
+#include "global.h"
+#include "utils.h"
+#include "byte.h"
+
+#include "l2.h"
+#include "msg.h"
+#include "option.h"
+#include "resource.h"
+#include "casan.h"
+
+namespace casan {
+
+/** delay (ms) before a new registration attempt */
+#define	OBSERVE_RETRY		5000
+/** delay (ms) after Max-Age expiration before a new registration */
+#define	OBSERVE_MARGIN		2000
+
+/**
+ * @brief An observed resource
+ */
+
+struct casan::observation
+{
+    slave *sl ;
+    resource res ;			// copy of the observed resource
+    byte token [2] ;			// token used for all registrations
+    corrkey key ;			// (slave, token)
+    std::map <int, notify_t> subscribers ;
+    msgptr_t last ;			// last notification received
+    long int serial ;			// its Observe value, or -1
+    timepoint_t date ;			// its reception date
+    timepoint_t expire ;		// end of its validity (Max-Age)
+
+    observation (slave *s, const resource &r) : sl (s), res (r) {}
+} ;
+
+/**
+ * @brief Subscribe to the notifications of a resource
+ *
+ * The notification function is called (by a worker thread or by
+ * the calling thread) with each new representation of the resource,
+ * starting with the current one if it is known and still valid.
+ * It must not block, nor call casan::observe or casan::unobserve.
+ *
+ * @param s slave
+ * @param res resource provided by the slave
+ * @param n notification function
+ * @return subscriber id, to be given to casan::unobserve
+ */
+
+int casan::observe (slave *s, resource *res, notify_t n)
+{
+    obsptr_t o ;
+    msgptr_t last ;
+    bool first ;
+    int id ;
+
+    {
+	std::unique_lock <std::mutex> lk (obsmtx_) ;
+
+	for (auto &e : obslist_)
+	{
+	    if (e.second->sl == s && *res == e.second->res.vpath ())
+	    {
+		o = e.second ;
+		break ;
+	    }
+	}
+
+	first = (o == nullptr) ;
+	if (first)
+	{
+	    unsigned int t = tokcount_++ ;
+	    msg m ;
+
+	    o = std::make_shared <observation> (s, *res) ;
+	    o->token [0] = BYTE_HIGH (t) ;
+	    o->token [1] = BYTE_LOW (t) ;
+	    o->serial = -1 ;
+
+	    m.peer (s) ;
+	    m.token (o->token, sizeof o->token) ;
+	    o->key = corrkey_token (&m) ;
+	    obslist_ [o->key] = o ;
+	}
+	else if (o->last != nullptr
+			&& std::chrono::system_clock::now () < o->expire)
+	    last = o->last ;
+
+	id = ++obsid_ ;
+	o->subscribers [id] = n ;
+	subs_ [id] = o ;
+    }
+
+    if (first)
+	observe_register (o, 0) ;
+    else if (last != nullptr)
+	n (last) ;
+
+    return id ;
+}
+
+/**
+ * @brief Cancel a subscription
+ *
+ * When the last subscriber leaves, the master deregisters from
+ * the slave.
+ *
+ * @param id subscriber id returned by casan::observe
+ */
+
+void casan::unobserve (int id)
+{
+    obsptr_t o ;
+    bool lastsub ;
+
+    {
+	std::unique_lock <std::mutex> lk (obsmtx_) ;
+
+	auto it = subs_.find (id) ;
+	if (it == subs_.end ())
+	    return ;
+	o = it->second ;
+	subs_.erase (it) ;
+
+	o->subscribers.erase (id) ;
+	lastsub = o->subscribers.empty () ;
+	if (lastsub)
+	    obslist_.erase (o->key) ;
+    }
+
+    if (lastsub)
+    {
+	{
+	    std::unique_lock <std::mutex> lk (mtx_) ;
+
+	    sched_.remove (o.get ()) ;
+	}
+	observe_register (o, 1) ;
+    }
+}
+
+/**
+ * @brief Send a registration (or a deregistration) request
+ *
+ * The request is a GET with an Observe option (0 to register, 1 to
+ * deregister) and the token of the observation. The reply to a
+ * registration is the first notification. If there is no reply,
+ * a new attempt is scheduled.
+ *
+ * @param o observation
+ * @param obsval Observe option value
+ */
+
+void casan::observe_register (obsptr_t o, int obsval)
+{
+    std::weak_ptr <observation> w (o) ;
+    msgptr_t m ;
+
+    if (o->sl->status () != slave::SL_RUNNING)
+    {
+	if (obsval == 0)
+	    schedule (o.get (), EV_OBSERVE, DATE_TIMEOUT_MS (OBSERVE_RETRY)) ;
+	return ;
+    }
+
+    D (D_MESSAGE, (obsval == 0 ? "Register" : "Deregister")
+			<< " observer for slave " << o->sl->slaveid ()) ;
+
+    m = std::make_shared <msg> () ;
+    m->peer (o->sl) ;
+    m->type (msg::MT_CON) ;
+    m->code (msg::MC_GET) ;
+    m->token (o->token, sizeof o->token) ;
+    option ob (option::MO_Observe, obsval) ;
+    m->pushoption (ob) ;
+    o->res.add_to_message (*m) ;
+
+    add_request (m,
+	[this, w, obsval] (msgptr_t req)
+	{
+	    msgptr_t r = req->reqrep () ;
+	    obsptr_t o ;
+
+	    msg::link_reqrep (req, nullptr) ;
+
+	    /*
+	     * Next notifications carry the same token: they must
+	     * not be correlated with this request (see casan::notify)
+	     */
+
+	    {
+		std::unique_lock <std::mutex> lk (reqmtx_) ;
+
+		corr_remove (req.get ()) ;
+	    }
+
+	    o = w.lock () ;
+	    if (obsval != 0 || o == nullptr)
+		return ;
+
+	    if (r != nullptr && (r->code () >> 5) == 2)
+		observe_deliver (o, r) ;
+	    else
+		schedule (o.get (), EV_OBSERVE, DATE_TIMEOUT_MS (OBSERVE_RETRY)) ;
+	}) ;
+}
+
+/**
+ * @brief Deliver a notification to all subscribers
+ *
+ * Notifications older than the last one (see RFC 7641, 3.4) are
+ * ignored. The registration is renewed if no other notification
+ * is received before the Max-Age of this one expires.
+ *
+ * @param o observation
+ * @param r received notification
+ */
+
+void casan::observe_deliver (obsptr_t o, msgptr_t r)
+{
+    std::vector <notify_t> subs ;
+    timepoint_t now ;
+    long int serial, maxage ;
+    option *ob ;
+
+    now = std::chrono::system_clock::now () ;
+    ob = r->getoption (option::MO_Observe) ;
+    serial = ob == nullptr ? -1 : (long int) ob->optval () ;
+    maxage = r->max_age () ;
+    if (maxage == -1)
+	maxage = DEFAULT_MAX_AGE ;
+
+    {
+	std::unique_lock <std::mutex> lk (obsmtx_) ;
+
+	if (o->last != nullptr && o->serial != -1 && serial != -1)
+	{
+	    long int v1 = o->serial ;
+	    long int v2 = serial ;
+
+	    if (! ((v1 < v2 && v2 - v1 < OBSERVE_SERIAL_WINDOW)
+		    || (v1 > v2 && v1 - v2 > OBSERVE_SERIAL_WINDOW)
+		    || now > o->date + duration_t (OBSERVE_FRESHNESS)))
+	    {
+		D (D_MESSAGE, "Ignoring old notification " << serial) ;
+		return ;
+	    }
+	}
+
+	o->last = r ;
+	o->serial = serial ;
+	o->date = now ;
+	o->expire = now + duration_t (maxage * 1000) ;
+
+	for (auto &s : o->subscribers)
+	    subs.push_back (s.second) ;
+    }
+
+    for (auto &n : subs)
+	n (r) ;
+
+    schedule (o.get (), EV_OBSERVE, o->expire + duration_t (OBSERVE_MARGIN)) ;
+}
+
+/**
+ * @brief Renew a registration (called by the sender thread)
+ *
+ * The observation may have been removed since the event was
+ * scheduled: the key is only used if it is still registered.
+ *
+ * @param key observation (key in the scheduler)
+ */
+
+void casan::observe_refresh (void *key)
+{
+    obsptr_t o ;
+
+    {
+	std::unique_lock <std::mutex> lk (obsmtx_) ;
+
+	for (auto &e : obslist_)
+	{
+	    if (e.second.get () == key)
+	    {
+		o = e.second ;
+		break ;
+	    }
+	}
+    }
+
+    if (o != nullptr)
+	observe_register (o, 0) ;
+}
+
+/**
+ * @brief Handle a notification received from a slave
+ *
+ * Notifications carry the token of the registration request. They
+ * are handled here when they are not a reply to a pending request
+ * (i.e. except the first one). A CON notification is acknowledged
+ * if the observation is known, else it is rejected with a RST
+ * (see RFC 7641, 3.5 and 3.6).
+ *
+ * @param m received message
+ * @return true if the message is a notification
+ */
+
+bool casan::notify (msgptr_t m)
+{
+    obsptr_t o ;
+
+    if (m->toklen_ == 0 || (m->code () >> 5) == 0
+			|| m->getoption (option::MO_Observe) == nullptr)
+	return false ;
+
+    {
+	std::unique_lock <std::mutex> lk (obsmtx_) ;
+
+	auto it = obslist_.find (corrkey_token (m.get ())) ;
+	if (it != obslist_.end ())
+	    o = it->second ;
+    }
+
+    if (m->type () == msg::MT_CON || (o == nullptr && m->type () == msg::MT_NON))
+    {
+	msg ack ;
+
+	ack.peer (m->peer ()) ;
+	ack.type (o != nullptr ? msg::MT_ACK : msg::MT_RST) ;
+	ack.id (m->id ()) ;
+	(void) ack.send () ;
+    }
+
+    if (o != nullptr)
+	observe_deliver (o, m) ;
+    else
+	D (D_MESSAGE, "Notification for an unknown observation") ;
+
+    return true ;
+}
+
+/**
+ * @brief Dumps observed resources
+ *
+ * @return string containing the output
+ */
+
+std::string casan::html_observe (void)
+{
+    std::ostringstream oss ;
+
+    std::unique_lock <std::mutex> lk (obsmtx_) ;
+
+    for (auto &e : obslist_)
+    {
+	observation &o = *e.second ;
+
+	oss << "Slave " << o.sl->slaveid () << " " << o.res
+	    << "\tsubscribers=" << o.subscribers.size ()
+	    << ", serial=" << o.serial
+	    << ", last=" << (o.last == nullptr ? "none" : "received")
+	    << "\n" ;
+    }
+
+    return oss.str () ;
+}
+
+}					// end of namespace casan
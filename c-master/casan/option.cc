@@ -11,6 +11,7 @@
 
 #include "casan.h"
 #include "option.h"
+#include "pool.h"
 #include "utils.h"
 
 #define	MAXOPT	256
@@ -31,14 +32,14 @@ struct option::optdesc * option::optdesc_ = 0 ;
 #define	DELETE_VAL(p)	do {					\
 			    if (p)				\
 			    {					\
-				delete [] p ;			\
+				pool::release (p) ;		\
 				p = 0 ;				\
 			    }					\
 			} while (false)				// no ";"
 #define	COPY_VAL(p)	do {					\
 			    byte *b ;				\
 			    if (optlen_ + 1 > (int) sizeof staticval_) \
-				b = optval_ = new byte [optlen_+ 1] ; \
+				b = optval_ = (byte *) pool::alloc (optlen_ + 1) ; \
 			    else				\
 			    {					\
 				optval_ = 0 ;			\
@@ -202,6 +203,39 @@ option &option::operator= (const option &o)
     return *this ;
 }
 
+/**
+ * Move constructor
+ *
+ * This constructor takes the value of an existing option, without
+ * copying it.
+ */
+
+option::option (option &&o)
+{
+    std::memcpy (this, &o, sizeof o) ;
+    o.optval_ = 0 ;
+    o.optlen_ = 0 ;
+}
+
+/**
+ * Move assignment
+ *
+ * This operator takes the value of an existing option, without
+ * copying it.
+ */
+
+option &option::operator= (option &&o)
+{
+    if (this != &o)
+    {
+	DELETE_VAL (optval_) ;
+	std::memcpy (this, &o, sizeof o) ;
+	o.optval_ = 0 ;
+	o.optlen_ = 0 ;
+    }
+    return *this ;
+}
+
 /**
  * Default destructor
  */
@@ -239,6 +273,10 @@ void option::static_init (void)
     optdesc_ [MO_Max_Age].minlen = 0 ;
     optdesc_ [MO_Max_Age].maxlen = 4 ;
 
+    optdesc_ [MO_Observe].format = OF_UINT ;
+    optdesc_ [MO_Observe].minlen = 0 ;
+    optdesc_ [MO_Observe].maxlen = 3 ;
+
     optdesc_ [MO_Proxy_Uri].format = OF_STRING ;
     optdesc_ [MO_Proxy_Uri].minlen = 1 ;
     optdesc_ [MO_Proxy_Uri].maxlen = 1034 ;
@@ -289,7 +327,7 @@ std::ostream& operator<< (std::ostream &os, const option &o)
     return os ;
 }
 
-/** @brief Operator used for list sorting (cf msg.cc)
+/** @brief Operator used to order options by code (cf optlist.cc)
  */
 
 bool option::operator< (const option &o) const
@@ -54,6 +54,7 @@ class option
 			MO_Location_Path	= 8,
 			MO_Location_Query	= 20,
 			MO_Max_Age		= 14,
+			MO_Observe		= 6,
 			MO_Proxy_Uri		= 35,
 			MO_Proxy_Scheme		= 39,
 			MO_Uri_Host		= 3,
@@ -73,11 +74,13 @@ class option
 	option (optcode_t c, uint v) ;		// constructor
 	option (const option &o) ;		// copy constructor
 	option &operator= (const option &o) ;	// copy assignment constructor
+	option (option &&o) ;			// move constructor
+	option &operator= (option &&o) ;	// move assignment
 	~option () ;				// destructor
 
 	friend std::ostream& operator<< (std::ostream &os, const option &o) ;
 
-	bool operator< (const option &o) const ; // for list sorting in msg.cc
+	bool operator< (const option &o) const ; // order by option code
 
 	bool operator== (const option &o) ;
 	bool operator!= (const option &o) ;
@@ -106,6 +109,7 @@ class option
 	byte staticval_ [8 + 1] ;	// keep a \0 after, just in case
 
 	friend class msg ;
+	friend class optlist ;
 
     private:
 	typedef enum optfmt { OF_NONE = 0, OF_OPAQUE, OF_STRING,
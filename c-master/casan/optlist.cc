@@ -0,0 +1,194 @@
+/**
+ * @file optlist.cc
+ * @brief optlist class implementation
+ */
+
+#include <iostream>
+#include <utility>
+#include <new>
+
+#include "global.h"
+
+#include "optlist.h"
+#include "pool.h"
+
+namespace casan {
+
+#define	BITMAP_MAX	64		// codes above are not in the bitmap
+
+/******************************************************************************
+ * Constructors and destructors
+ */
+
+optlist::optlist ()
+{
+    opt_ = (option *) inline_ ;
+}
+
+optlist::optlist (const optlist &l)
+{
+    opt_ = (option *) inline_ ;
+    *this = l ;
+}
+
+optlist &optlist::operator= (const optlist &l)
+{
+    if (this != &l)
+    {
+	clear () ;
+	while (cap_ < l.size_)
+	    grow () ;
+	for (int i = 0 ; i < l.size_ ; i++)
+	    new (opt_ + i) option (l.opt_ [i]) ;
+	size_ = l.size_ ;
+	bitmap_ = l.bitmap_ ;
+    }
+    return *this ;
+}
+
+optlist::~optlist ()
+{
+    clear () ;
+    if (opt_ != (option *) inline_)
+	pool::release (opt_) ;
+}
+
+/******************************************************************************
+ * Utilities
+ */
+
+std::uint64_t optlist::bit (option::optcode_t c)
+{
+    return (int) c < BITMAP_MAX ? ((std::uint64_t) 1) << (int) c : 0 ;
+}
+
+/*
+ * Double the capacity: options are moved into a new pool array
+ */
+
+void optlist::grow (void)
+{
+    option *n ;
+
+    n = (option *) pool::alloc (2 * cap_ * sizeof (option)) ;
+    for (int i = 0 ; i < size_ ; i++)
+    {
+	new (n + i) option (std::move (opt_ [i])) ;
+	opt_ [i].~option () ;
+    }
+    if (opt_ != (option *) inline_)
+	pool::release (opt_) ;
+    opt_ = n ;
+    cap_ *= 2 ;
+}
+
+/******************************************************************************
+ * Mutators
+ */
+
+/**
+ * @brief Insert a copy of an option, after all options with a lower
+ *	or equal code.
+ *
+ * Options are usually inserted in ascending order (when a message
+ * is decoded), so the search starts from the end.
+ */
+
+void optlist::insert (const option &o)
+{
+    int i ;
+
+    if (size_ == cap_)
+	grow () ;
+
+    i = size_ ;
+    if (i == 0 || opt_ [i - 1].optcode_ <= o.optcode_)
+	new (opt_ + i) option (o) ;
+    else
+    {
+	new (opt_ + i) option (std::move (opt_ [i - 1])) ;
+	for (i-- ; i > 0 && opt_ [i - 1].optcode_ > o.optcode_ ; i--)
+	    opt_ [i] = std::move (opt_ [i - 1]) ;
+	opt_ [i] = o ;
+    }
+    size_++ ;
+    bitmap_ |= bit (o.optcode_) ;
+}
+
+/**
+ * @brief Remove the first option
+ */
+
+void optlist::pop_front (void)
+{
+    option::optcode_t c ;
+
+    if (size_ == 0)
+	return ;
+
+    c = opt_ [0].optcode_ ;
+    for (int i = 1 ; i < size_ ; i++)
+	opt_ [i - 1] = std::move (opt_ [i]) ;
+    size_-- ;
+    opt_ [size_].~option () ;
+
+    if (size_ == 0 || opt_ [0].optcode_ != c)
+	bitmap_ &= ~bit (c) ;
+}
+
+/**
+ * @brief Remove all options (but keep the allocated array, if any)
+ */
+
+void optlist::clear (void)
+{
+    for (int i = 0 ; i < size_ ; i++)
+	opt_ [i].~option () ;
+    size_ = 0 ;
+    bitmap_ = 0 ;
+}
+
+/******************************************************************************
+ * Accessors
+ */
+
+/**
+ * @brief Check if an option with the given code is present
+ */
+
+bool optlist::present (option::optcode_t c)
+{
+    bool r ;
+
+    if ((int) c < BITMAP_MAX)
+	r = (bitmap_ & bit (c)) != 0 ;
+    else
+	r = find (c) != nullptr ;
+    return r ;
+}
+
+/**
+ * @brief Find the first option with the given code
+ *
+ * @return pointer to the option, or nullptr if not found
+ */
+
+option *optlist::find (option::optcode_t c)
+{
+    option *r = nullptr ;
+
+    if ((int) c >= BITMAP_MAX || (bitmap_ & bit (c)))
+    {
+	for (int i = 0 ; i < size_ && opt_ [i].optcode_ <= c ; i++)
+	{
+	    if (opt_ [i].optcode_ == c)
+	    {
+		r = &opt_ [i] ;
+		break ;
+	    }
+	}
+    }
+    return r ;
+}
+
+}					// end of namespace casan
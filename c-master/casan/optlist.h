@@ -0,0 +1,69 @@
+/**
+ * @file optlist.h
+ * @brief optlist class interface
+ */
+
+#ifndef CASAN_OPTLIST_H
+#define CASAN_OPTLIST_H
+
+#include <cstdint>
+
+#include "option.h"
+
+namespace casan {
+
+/**
+ * @brief Sorted list of options of a message
+ *
+ * This class stores the options of a message in a contiguous
+ * array, kept sorted by option code: an option is inserted after
+ * all options with a lower or equal code, such that repeated
+ * options (Uri-Path for example) keep their relative order.
+ * Thus, options can be encoded or compared without sorting.
+ *
+ * The first `INLINE` options are stored inside the object itself,
+ * which is enough for most messages. Beyond that, options are moved
+ * into a larger array taken from the memory pool.
+ *
+ * A bitmap records which option codes (below 64) are present, in order
+ * to quickly answer that an option is absent.
+ */
+
+class optlist
+{
+    public:
+	static const int INLINE = 8 ;	// options stored in the object
+
+	optlist () ;				// constructor
+	optlist (const optlist &l) ;		// copy constructor
+	optlist &operator= (const optlist &l) ;	// copy assignment
+	~optlist () ;				// destructor
+
+	void insert (const option &o) ;		// insert at the right place
+	void pop_front (void) ;
+	void clear (void) ;
+
+	option &front (void)	{ return opt_ [0] ; }
+	option *begin (void)	{ return opt_ ; }
+	option *end (void)	{ return opt_ + size_ ; }
+	option &operator[] (int i) { return opt_ [i] ; }
+	int size (void)		{ return size_ ; }
+	bool empty (void)	{ return size_ == 0 ; }
+
+	bool present (option::optcode_t c) ;
+	option *find (option::optcode_t c) ;	// first option with code c
+
+    private:
+	option *opt_ ;			// inline_ or pool array
+	int size_ = 0 ;
+	int cap_ = INLINE ;
+	std::uint64_t bitmap_ = 0 ;	// bit i: option code i is present
+
+	alignas (option) unsigned char inline_ [INLINE * sizeof (option)] ;
+
+	static std::uint64_t bit (option::optcode_t c) ;
+	void grow (void) ;
+} ;
+
+}					// end of namespace casan
+#endif
@@ -0,0 +1,152 @@
+/**
+ * @file pool.cc
+ * @brief Memory pool implementation
+ */
+
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <new>
+
+#include "global.h"
+
+#include "pool.h"
+
+namespace casan {
+
+/*
+ * Each block is preceded by a header which gives its size class
+ * (-1 for large blocks). The header is padded in order to keep
+ * the block correctly aligned.
+ */
+
+union hdr
+{
+    int cls ;
+    std::max_align_t align ;
+} ;
+
+struct freeblock
+{
+    freeblock *next ;
+} ;
+
+/*
+ * Free lists: std::mutex has a constexpr constructor, thus these
+ * lists are initialized before any dynamic initialization.
+ */
+
+static struct freelist
+{
+    std::mutex mtx ;
+    freeblock *head ;
+} freelists [pool::NCLASSES] ;
+
+std::atomic <long int> pool::heap_allocs_ (0) ;
+
+#define	CLASSIZE(c)	(MINSIZE << (c))
+#define	BLOCKSIZE(c)	(sizeof (hdr) + CLASSIZE (c))
+
+/**
+ * @brief Returns the smallest size class for a given length, or -1
+ */
+
+int pool::sizeclass (std::size_t len)
+{
+    for (int c = 0 ; c < NCLASSES ; c++)
+	if (len <= CLASSIZE (c))
+	    return c ;
+    return -1 ;
+}
+
+/**
+ * @brief Add a new chunk of blocks to a free list
+ *
+ * The free list must be locked.
+ */
+
+void pool::refill (int cls)
+{
+    freelist &fl = freelists [cls] ;
+    std::size_t bsize = BLOCKSIZE (cls) ;
+    std::size_t n = CHUNKSIZE / bsize ;
+    char *chunk ;
+
+    if (n == 0)
+	n = 1 ;
+    chunk = static_cast <char *> (::operator new (n * bsize)) ;
+    heap_allocs_++ ;
+
+    for (std::size_t i = 0 ; i < n ; i++)
+    {
+	hdr *h = (hdr *) (chunk + i * bsize) ;
+	freeblock *b = (freeblock *) (h + 1) ;
+
+	h->cls = cls ;
+	b->next = fl.head ;
+	fl.head = b ;
+    }
+}
+
+/**
+ * @brief Allocate a block
+ *
+ * @param len requested size
+ * @return pointer to a block of at least len bytes
+ */
+
+void *pool::alloc (std::size_t len)
+{
+    int cls ;
+    hdr *h ;
+
+    cls = sizeclass (len) ;
+    if (cls == -1)
+    {
+	h = static_cast <hdr *> (::operator new (sizeof (hdr) + len)) ;
+	heap_allocs_++ ;
+	h->cls = -1 ;
+	return h + 1 ;
+    }
+    else
+    {
+	freelist &fl = freelists [cls] ;
+	std::lock_guard <std::mutex> lk (fl.mtx) ;
+	freeblock *b ;
+
+	if (fl.head == nullptr)
+	    refill (cls) ;
+	b = fl.head ;
+	fl.head = b->next ;
+	return b ;
+    }
+}
+
+/**
+ * @brief Release a block allocated with pool::alloc
+ *
+ * @param p pointer to the block (may be null)
+ */
+
+void pool::release (void *p)
+{
+    hdr *h ;
+
+    if (p == nullptr)
+	return ;
+
+    h = static_cast <hdr *> (p) - 1 ;
+    if (h->cls == -1)
+	::operator delete (h) ;
+    else
+    {
+	freelist &fl = freelists [h->cls] ;
+	std::lock_guard <std::mutex> lk (fl.mtx) ;
+	freeblock *b = static_cast <freeblock *> (p) ;
+
+	b->next = fl.head ;
+	fl.head = b ;
+    }
+}
+
+}					// end of namespace casan
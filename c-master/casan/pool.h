@@ -0,0 +1,89 @@
+/**
+ * @file pool.h
+ * @brief Memory pool interface
+ */
+
+#ifndef CASAN_POOL_H
+#define	CASAN_POOL_H
+
+#include <cstddef>
+#include <atomic>
+
+namespace casan {
+
+/**
+ * @brief Memory pool for message buffers and small objects
+ *
+ * This class is a slab allocator with a few size classes (powers
+ * of 2, up to a L2 MTU). Blocks are carved out of large chunks,
+ * and freed blocks are kept on a per-class free list. Chunks are
+ * never returned to the system: once the pool has reached its
+ * high-water mark, allocating and releasing blocks do not make any
+ * heap allocation.
+ *
+ * Requests larger than the largest size class are forwarded
+ * to the global operator new.
+ *
+ * All methods are static and thread-safe.
+ */
+
+class pool
+{
+    public:
+	static void *alloc (std::size_t len) ;
+	static void release (void *p) ;
+
+	// number of chunks or large blocks allocated from the heap
+	static long int heap_allocs (void)	{ return heap_allocs_ ; }
+
+	static const int NCLASSES = 7 ;		// 32 .. 2048 bytes
+	static const std::size_t MINSIZE = 32 ;
+	static const std::size_t CHUNKSIZE = 32 * 1024 ;
+
+    private:
+	static std::atomic <long int> heap_allocs_ ;
+
+	static int sizeclass (std::size_t len) ;
+	static void refill (int cls) ;
+} ;
+
+/**
+ * @brief Standard allocator using the memory pool
+ *
+ * This allocator can be used for standard containers and with
+ * std::allocate_shared.
+ */
+
+template <class T>
+class pool_allocator
+{
+    public:
+	typedef T value_type ;
+
+	pool_allocator () {}
+	template <class U> pool_allocator (const pool_allocator <U> &) {}
+
+	T *allocate (std::size_t n)
+	{
+	    return static_cast <T *> (pool::alloc (n * sizeof (T))) ;
+	}
+	void deallocate (T *p, std::size_t)
+	{
+	    pool::release (p) ;
+	}
+} ;
+
+template <class T, class U>
+bool operator== (const pool_allocator <T> &, const pool_allocator <U> &)
+{
+    return true ;
+}
+
+template <class T, class U>
+bool operator!= (const pool_allocator <T> &, const pool_allocator <U> &)
+{
+    return false ;
+}
+
+}					// end of namespace casan
+#endif
@@ -0,0 +1,190 @@
+/**
+ * @file registry.cc
+ * @brief Slave registry implementation
+ */
+
+#include <list>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <functional>
+#include <unordered_map>
+
+#include "global.h"
+
+#include "l2.h"
+#include "msg.h"
+#include "resource.h"
+#include "slave.h"
+#include "registry.h"
+
+namespace casan {
+
+std::size_t registry::addrhash::operator() (const addrkey &k) const
+{
+    return std::hash <void *> () (k.l2) ^ std::hash <std::string> () (k.addr) ;
+}
+
+/**
+ * @brief Build the address index key for a network and an address
+ */
+
+registry::addrkey registry::mkkey (l2net *l2, l2addr *a)
+{
+    addrkey k ;
+    const byte *b ;
+    int len ;
+
+    b = a->bytes (&len) ;
+    k.l2 = l2 ;
+    k.addr.assign ((const char *) b, len) ;
+    return k ;
+}
+
+/**
+ * @brief Add a new slave
+ *
+ * The slave is copied in the registry. If a slave with the same
+ * slave id is already registered, the new slave is not added.
+ *
+ * @param s slave to add
+ * @return pointer to the registered slave
+ */
+
+slave *registry::add (slave &s)
+{
+    std::unique_lock <rwlock> lk (rw_) ;
+    slave *r ;
+
+    auto it = byid_.find (s.slaveid ()) ;
+    if (it != byid_.end ())
+	r = it->second ;
+    else
+    {
+	slist_.push_front (s) ;
+	r = &slist_.front () ;
+	byid_ [r->slaveid ()] = r ;
+	if (r->l2 () != nullptr && r->addr () != nullptr)
+	    byaddr_ [mkkey (r->l2 (), r->addr ().get ())] = r ;
+    }
+    return r ;
+}
+
+/**
+ * @brief Locate a slave by its slave id
+ *
+ * @param sid slave id
+ * @return pointer to the found slave, or NULL if not found
+ */
+
+slave *registry::find (slaveid_t sid)
+{
+    shared_lock lk (rw_) ;
+
+    auto it = byid_.find (sid) ;
+    return it == byid_.end () ? nullptr : it->second ;
+}
+
+/**
+ * @brief Locate a slave by its current network and address
+ *
+ * @param l2 network
+ * @param a slave address on this network
+ * @return pointer to the found slave, or NULL if not found
+ */
+
+slave *registry::find (l2net *l2, l2addr *a)
+{
+    addrkey k = mkkey (l2, a) ;
+    shared_lock lk (rw_) ;
+
+    auto it = byaddr_.find (k) ;
+    return it == byaddr_.end () ? nullptr : it->second ;
+}
+
+/**
+ * @brief Set the network and address of a registered slave
+ *
+ * The previous address (if any) is removed from the index, and
+ * freed when no other thread uses it (see slave::addr). The slave
+ * takes ownership of the new address.
+ *
+ * @param s registered slave
+ * @param l2 network
+ * @param a slave address on this network
+ */
+
+void registry::bind (slave *s, l2net *l2, l2addr *a)
+{
+    std::unique_lock <rwlock> lk (rw_) ;
+
+    unbind (s) ;
+    s->l2 (l2) ;
+    s->addr (a) ;
+    byaddr_ [mkkey (l2, a)] = s ;
+}
+
+/**
+ * @brief Reset a registered slave
+ *
+ * The address of the slave is removed from the index before
+ * the slave is reset (see slave::reset).
+ *
+ * @param s registered slave
+ */
+
+void registry::reset (slave *s)
+{
+    std::unique_lock <rwlock> lk (rw_) ;
+
+    unbind (s) ;
+    s->reset () ;
+}
+
+/**
+ * @brief Remove all slaves
+ */
+
+void registry::clear (void)
+{
+    std::unique_lock <rwlock> lk (rw_) ;
+
+    byaddr_.clear () ;
+    byid_.clear () ;
+    slist_.clear () ;
+}
+
+/**
+ * @brief Apply a function to each registered slave
+ *
+ * The function is called with the registry locked in shared mode:
+ * it must not call a registry method which modifies the registry.
+ *
+ * @param f function to apply
+ */
+
+void registry::foreach (std::function <void (slave &)> f)
+{
+    shared_lock lk (rw_) ;
+
+    for (auto &s : slist_)
+	f (s) ;
+}
+
+/**
+ * @brief Remove the current address of a slave from the index
+ *
+ * The registry must be locked in exclusive mode.
+ */
+
+void registry::unbind (slave *s)
+{
+    if (s->l2 () != nullptr && s->addr () != nullptr)
+    {
+	auto it = byaddr_.find (mkkey (s->l2 (), s->addr ().get ())) ;
+	if (it != byaddr_.end () && it->second == s)
+	    byaddr_.erase (it) ;
+    }
+}
+
+}					// end of namespace casan
@@ -0,0 +1,78 @@
+/**
+ * @file registry.h
+ * @brief Slave registry interface
+ */
+
+#ifndef CASAN_REGISTRY_H
+#define	CASAN_REGISTRY_H
+
+#include <list>
+#include <string>
+#include <functional>
+#include <unordered_map>
+
+#include "slave.h"
+#include "rwlock.h"
+
+namespace casan {
+
+class l2net ;
+class l2addr ;
+
+/**
+ * @brief Slave registry
+ *
+ * This class holds all slaves known by the CASAN engine. Slaves
+ * are never removed, thus pointers to slaves stay valid during the
+ * lifetime of the registry.
+ *
+ * Slaves are indexed by their slave id (for HTTP requests) and by
+ * their current network and address (for received messages). The
+ * address index must be kept up-to-date: the network and address
+ * of a registered slave must be changed through the bind and
+ * reset methods of this class.
+ *
+ * Lookups may be performed concurrently by several threads (HTTP
+ * threads and receiver threads). Modifications get an exclusive
+ * access.
+ */
+
+class registry
+{
+    public:
+	slave *add (slave &s) ;
+	slave *find (slaveid_t sid) ;
+	slave *find (l2net *l2, l2addr *a) ;
+	void bind (slave *s, l2net *l2, l2addr *a) ;
+	void reset (slave *s) ;
+	void clear (void) ;
+
+	// apply a function to each slave (under shared lock)
+	void foreach (std::function <void (slave &)> f) ;
+
+    private:
+	struct addrkey
+	{
+	    l2net *l2 ;
+	    std::string addr ;		// raw address bytes
+	    bool operator== (const addrkey &k) const
+	    {
+		return l2 == k.l2 && addr == k.addr ;
+	    }
+	} ;
+	struct addrhash
+	{
+	    std::size_t operator() (const addrkey &k) const ;
+	} ;
+
+	std::list <slave> slist_ ;	// registered slaves
+	std::unordered_map <slaveid_t, slave *> byid_ ;
+	std::unordered_map <addrkey, slave *, addrhash> byaddr_ ;
+	rwlock rw_ ;
+
+	static addrkey mkkey (l2net *l2, l2addr *a) ;
+	void unbind (slave *s) ;
+} ;
+
+}					// end of namespace casan
+#endif
@@ -40,6 +40,7 @@ class resource
 	void add_to_message (msg &m) ;
 
 	// Accessors
+	const std::vector <std::string> &vpath (void) { return vpath_ ; }
 	// return attribute values (or NULL if not found) for an attribute name
 	std::list <std::string> *attribute (const std::string name) ;
 
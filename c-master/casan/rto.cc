@@ -0,0 +1,170 @@
+/**
+ * @file rto.cc
+ * @brief Adaptive retransmission timeout estimator implementation
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+
+#include "global.h"
+
+#include "coap.h"
+#include "rto.h"
+
+namespace casan {
+
+/**
+ * @brief Reset the estimators
+ *
+ * Without any measurement, the RTO is the maximum round-trip time
+ * of the network (see MAX_RTT).
+ *
+ * @param maxlat maximum latency of the network of the slave (ms)
+ */
+
+void rto::init (int maxlat)
+{
+    strong_ = estimator () ;
+    weak_ = estimator () ;
+    min_rto_ = 2 * maxlat ;
+    rto_ = MAX_RTT (maxlat) ;
+    updated_ = std::chrono::system_clock::now () ;
+    nstrong_ = nweak_ = 0 ;
+    min_ = max_ = 0 ;
+}
+
+/**
+ * @brief Update an estimator with a new sample (RFC 6298)
+ *
+ * @param rtt measured round-trip time (ms)
+ * @param k weight of the variance
+ * @return new RTO estimated by this estimator (ms)
+ */
+
+double rto::estimator::update (double rtt, int k)
+{
+    if (! valid)
+    {
+	srtt = rtt ;
+	rttvar = rtt / 2 ;
+	valid = true ;
+    }
+    else
+    {
+	rttvar = 0.75 * rttvar + 0.25 * std::fabs (srtt - rtt) ;
+	srtt = 0.875 * srtt + 0.125 * rtt ;
+    }
+    return srtt + k * rttvar ;
+}
+
+/**
+ * @brief Add a RTT measurement
+ *
+ * The RTT is measured from the first transmission of a CON message
+ * to the reception of its acknowledgement. Replies to the first
+ * transmission update the strong estimator, replies received after
+ * one or two retransmissions update the weak estimator, and later
+ * replies are ignored since they cannot be matched to a transmission.
+ *
+ * @param rtt measured round-trip time
+ * @param ntrans number of transmissions of the message
+ */
+
+void rto::sample (std::chrono::microseconds rtt, int ntrans)
+{
+    double r = rtt.count () / 1000.0 ;
+
+    if (ntrans < 1 || ntrans > RTO_MAX_NTRANS)
+	return ;
+
+    if (ntrans == 1)
+    {
+	rto_ = 0.5 * strong_.update (r, 4) + 0.5 * rto_ ;
+	nstrong_++ ;
+    }
+    else
+    {
+	rto_ = 0.25 * weak_.update (r, 1) + 0.75 * rto_ ;
+	nweak_++ ;
+    }
+    bound () ;
+    updated_ = std::chrono::system_clock::now () ;
+
+    if (nsamples () == 1 || r < min_)
+	min_ = r ;
+    if (r > max_)
+	max_ = r ;
+}
+
+/**
+ * @brief Get the initial timeout for the next CON message
+ *
+ * The RTO ages if it has not been updated for some time.
+ *
+ * @param now current date
+ * @return initial timeout (before the random factor)
+ */
+
+duration_t rto::timeout (timepoint_t now)
+{
+    double idle = std::chrono::duration <double, std::milli> (now - updated_).count () ;
+
+    if (rto_ < 1000 && idle > 16 * rto_)
+    {
+	rto_ *= 2 ;
+	bound () ;
+	updated_ = now ;
+    }
+    else if (rto_ > 3000 && idle > 4 * rto_)
+    {
+	rto_ = 1000 + 0.5 * rto_ ;
+	updated_ = now ;
+    }
+    return duration_t (long (std::ceil (rto_))) ;
+}
+
+/**
+ * @brief Variable backoff factor for retransmissions
+ *
+ * A small initial timeout is quickly increased, and a large one
+ * is increased slowly.
+ *
+ * @param initial initial timeout of the message
+ * @return factor to apply to the timeout for each retransmission
+ */
+
+double rto::backoff (duration_t initial)
+{
+    if (initial.count () < 1000)
+	return 3 ;
+    else if (initial.count () > 3000)
+	return 1.5 ;
+    return 2 ;
+}
+
+// Keep the RTO in its bounds
+void rto::bound (void)
+{
+    if (rto_ < min_rto_)
+	rto_ = min_rto_ ;
+    if (rto_ > RTO_MAX)
+	rto_ = RTO_MAX ;
+}
+
+/**
+ * @brief Dump RTT statistics
+ */
+
+std::ostream& operator<< (std::ostream &os, const rto &r)
+{
+    os << "rto=" << long (r.current ())
+	<< "ms samples=" << r.nsamples () ;
+    if (r.nsamples () > 0)
+	os << " srtt=" << r.srtt ()
+	    << "ms min=" << r.minrtt ()
+	    << "ms max=" << r.maxrtt () << "ms" ;
+    return os ;
+}
+
+}					// end of namespace casan
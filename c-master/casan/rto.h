@@ -0,0 +1,95 @@
+/**
+ * @file rto.h
+ * @brief Adaptive retransmission timeout estimator interface
+ */
+
+#ifndef CASAN_RTO_H
+#define	CASAN_RTO_H
+
+#include <iostream>
+#include <chrono>
+
+#include "global.h"
+
+namespace casan {
+
+/** upper bound of the RTO (ms) */
+#define	RTO_MAX		60000
+/** RTTs are not measured after this number of transmissions */
+#define	RTO_MAX_NTRANS	3
+
+/**
+ * @brief Retransmission timeout (RTO) estimator for a slave
+ *
+ * This class implements the CoCoA estimator (CoAP Simple Congestion
+ * Control/Advanced): round-trip times measured on exchanges with
+ * a slave give the initial timeout of the next CON messages sent
+ * to this slave, instead of the fixed ACK_TIMEOUT.
+ *
+ * Two RFC 6298 estimators are kept:
+ * - the strong one uses RTTs of replies to a first transmission
+ *	(RTO = SRTT + 4 RTTVAR), and contributes for 1/2 to the RTO
+ * - the weak one uses RTTs (measured from the first transmission)
+ *	of replies received after one or two retransmissions
+ *	(RTO = SRTT + RTTVAR), and contributes for 1/4 to the RTO
+ *
+ * Without any measurement, the RTO is derived from the maximum
+ * latency of the network (see MAX_RTT). The RTO is bounded by
+ * twice the maximum latency of the network and by RTO_MAX.
+ *
+ * The RTO ages when it is not updated: a small RTO (< 1 s) is
+ * doubled after 16 RTOs, and a large one (> 3 s) moves towards
+ * 1 s after 4 RTOs. Retransmissions use a variable backoff factor
+ * (see rto::backoff): 3 for a small initial timeout, 1.5 for a
+ * large one, 2 otherwise.
+ *
+ * Statistics (number of samples, smoothed, minimum and maximum RTT)
+ * are kept for the debug page.
+ *
+ * This class is not thread-safe: estimators are protected by the
+ * lock of the outstanding request table of the engine.
+ */
+
+class rto
+{
+    public:
+	void init (int maxlat) ;	// reset estimators
+
+	void sample (std::chrono::microseconds rtt, int ntrans) ;
+	duration_t timeout (timepoint_t now) ;
+	static double backoff (duration_t initial) ;
+
+	// statistics (ms)
+	long int nsamples (void) const	{ return nstrong_ + nweak_ ; }
+	double srtt (void) const	{ return strong_.valid ? strong_.srtt : weak_.srtt ; }
+	double minrtt (void) const	{ return min_ ; }
+	double maxrtt (void) const	{ return max_ ; }
+	double current (void) const	{ return rto_ ; }
+
+	friend std::ostream& operator<< (std::ostream &os, const rto &r) ;
+
+    private:
+	struct estimator
+	{
+	    double srtt = 0 ;		// ms
+	    double rttvar = 0 ;		// ms
+	    bool valid = false ;	// at least one sample
+
+	    double update (double rtt, int k) ;
+	} ;
+
+	estimator strong_ ;		// RTT of first transmissions
+	estimator weak_ ;		// RTT after retransmissions
+	double rto_ = 0 ;		// current RTO (ms)
+	double min_rto_ = 0 ;		// lower bound of the RTO (ms)
+	timepoint_t updated_ ;		// date of the last RTO update
+	long int nstrong_ = 0 ;		// statistics
+	long int nweak_ = 0 ;
+	double min_ = 0 ;
+	double max_ = 0 ;
+
+	void bound (void) ;
+} ;
+
+}					// end of namespace casan
+#endif
@@ -0,0 +1,56 @@
+/**
+ * @file rwlock.h
+ * @brief Reader/writer lock
+ */
+
+#ifndef CASAN_RWLOCK_H
+#define	CASAN_RWLOCK_H
+
+#include <pthread.h>
+
+namespace casan {
+
+/**
+ * @brief Reader/writer lock
+ *
+ * C++11 does not provide a shared mutex: this class is a thin
+ * wrapper around POSIX rwlocks. The lock/unlock methods (exclusive
+ * access) allow the use of std::unique_lock, and the shared_lock
+ * class provides the same RAII style for shared access.
+ */
+
+class rwlock
+{
+    public:
+	rwlock ()		{ pthread_rwlock_init (&rw_, NULL) ; }
+	~rwlock ()		{ pthread_rwlock_destroy (&rw_) ; }
+	rwlock (const rwlock &) = delete ;
+	rwlock &operator= (const rwlock &) = delete ;
+
+	void lock (void)		{ pthread_rwlock_wrlock (&rw_) ; }
+	void unlock (void)		{ pthread_rwlock_unlock (&rw_) ; }
+	void lock_shared (void)		{ pthread_rwlock_rdlock (&rw_) ; }
+	void unlock_shared (void)	{ pthread_rwlock_unlock (&rw_) ; }
+
+    private:
+	pthread_rwlock_t rw_ ;
+} ;
+
+/**
+ * @brief Shared (reader) access to a rwlock for the current scope
+ */
+
+class shared_lock
+{
+    public:
+	shared_lock (rwlock &rw) : rw_ (rw)	{ rw_.lock_shared () ; }
+	~shared_lock ()				{ rw_.unlock_shared () ; }
+	shared_lock (const shared_lock &) = delete ;
+	shared_lock &operator= (const shared_lock &) = delete ;
+
+    private:
+	rwlock &rw_ ;
+} ;
+
+}					// end of namespace casan
+#endif
@@ -0,0 +1,175 @@
+/**
+ * @file scheduler.cc
+ * @brief Deadline scheduler implementation
+ */
+
+#include <vector>
+#include <unordered_map>
+
+#include "global.h"
+
+#include "scheduler.h"
+
+namespace casan {
+
+#define	PARENT(i)	(((i) - 1) / 2)
+#define	LEFT(i)		(2 * (i) + 1)
+#define	RIGHT(i)	(2 * (i) + 2)
+
+/**
+ * @brief Add a new entry, or reschedule an existing one
+ *
+ * If the key is already present in the scheduler, the entry is moved
+ * to its new date (earlier or later) and its type is updated.
+ *
+ * @param key opaque key identifying the entry
+ * @param type user defined type of event
+ * @param date deadline
+ */
+
+void scheduler::add (void *key, int type, timepoint_t date)
+{
+    auto it = index_.find (key) ;
+
+    if (it == index_.end ())
+    {
+	entry e ;
+
+	e.date = date ;
+	e.type = type ;
+	e.key = key ;
+	heap_.push_back (e) ;
+	index_ [key] = heap_.size () - 1 ;
+	up (heap_.size () - 1) ;
+    }
+    else
+    {
+	std::size_t i = it->second ;
+	timepoint_t old = heap_ [i].date ;
+
+	heap_ [i].date = date ;
+	heap_ [i].type = type ;
+	if (date < old)
+	    up (i) ;
+	else
+	    down (i) ;
+    }
+}
+
+/**
+ * @brief Remove an entry, if present
+ *
+ * @param key opaque key identifying the entry
+ */
+
+void scheduler::remove (void *key)
+{
+    auto it = index_.find (key) ;
+
+    if (it != index_.end ())
+	erase (it->second) ;
+}
+
+/**
+ * @brief Extract the first due entry
+ *
+ * If the first entry (i.e. with the smallest date) is due at the
+ * given date, it is removed from the scheduler and returned.
+ * The caller must use `add` to reschedule it if needed.
+ *
+ * @param now current date
+ * @param key address of a pointer which will contain the key
+ * @param type address of an integer which will contain the type
+ * @return true if an entry has been found and removed
+ */
+
+bool scheduler::pop (timepoint_t now, void **key, int *type)
+{
+    bool r = false ;
+
+    if (! heap_.empty () && heap_ [0].date <= now)
+    {
+	*key = heap_ [0].key ;
+	*type = heap_ [0].type ;
+	erase (0) ;
+	r = true ;
+    }
+    return r ;
+}
+
+/**
+ * @brief Date of the next deadline
+ *
+ * @return date of the first entry, or `time_point::max ()` if
+ *	the scheduler is empty
+ */
+
+timepoint_t scheduler::next (void)
+{
+    if (heap_.empty ())
+	return std::chrono::system_clock::time_point::max () ;
+    return heap_ [0].date ;
+}
+
+/******************************************************************************
+ * Heap maintenance
+ */
+
+void scheduler::exchange (std::size_t i, std::size_t j)
+{
+    entry tmp ;
+
+    tmp = heap_ [i] ;
+    heap_ [i] = heap_ [j] ;
+    heap_ [j] = tmp ;
+    index_ [heap_ [i].key] = i ;
+    index_ [heap_ [j].key] = j ;
+}
+
+void scheduler::up (std::size_t i)
+{
+    while (i > 0 && heap_ [i].date < heap_ [PARENT (i)].date)
+    {
+	exchange (i, PARENT (i)) ;
+	i = PARENT (i) ;
+    }
+}
+
+void scheduler::down (std::size_t i)
+{
+    std::size_t n = heap_.size () ;
+
+    for (;;)
+    {
+	std::size_t min = i ;
+
+	if (LEFT (i) < n && heap_ [LEFT (i)].date < heap_ [min].date)
+	    min = LEFT (i) ;
+	if (RIGHT (i) < n && heap_ [RIGHT (i)].date < heap_ [min].date)
+	    min = RIGHT (i) ;
+	if (min == i)
+	    break ;
+	exchange (i, min) ;
+	i = min ;
+    }
+}
+
+void scheduler::erase (std::size_t i)
+{
+    std::size_t last = heap_.size () - 1 ;
+
+    index_.erase (heap_ [i].key) ;
+    if (i != last)
+    {
+	heap_ [i] = heap_ [last] ;
+	index_ [heap_ [i].key] = i ;
+	heap_.pop_back () ;
+	if (i > 0 && heap_ [i].date < heap_ [PARENT (i)].date)
+	    up (i) ;
+	else
+	    down (i) ;
+    }
+    else heap_.pop_back () ;
+}
+
+}					// end of namespace casan
@@ -0,0 +1,63 @@
+/**
+ * @file scheduler.h
+ * @brief Deadline scheduler interface
+ */
+
+#ifndef CASAN_SCHEDULER_H
+#define	CASAN_SCHEDULER_H
+
+#include <vector>
+#include <unordered_map>
+
+namespace casan {
+
+/**
+ * @brief Deadline scheduler
+ *
+ * This class is an indexed binary min-heap of deadlines. Each entry
+ * is identified by an opaque key (in practice, the address of a
+ * receiver, of a slave or of a message) and carries an integer type
+ * chosen by the user of this class, which tells what to do when the
+ * deadline is reached.
+ *
+ * Unlike a plain priority queue, the heap keeps track of the position
+ * of each key. An entry can thus be rescheduled or removed in
+ * O(log n), and a thread processing deadlines only touches entries
+ * which are actually due.
+ *
+ * There is at most one entry for a given key: adding an already
+ * present key only changes its date and type.
+ *
+ * This class is not thread-safe: the caller must provide its own
+ * locking.
+ */
+
+class scheduler
+{
+    public:
+	void add (void *key, int type, timepoint_t date) ;
+	void remove (void *key) ;
+	bool pop (timepoint_t now, void **key, int *type) ;
+	timepoint_t next (void) ;		// date of first entry or max ()
+
+	std::size_t size (void)		{ return heap_.size () ; }
+	bool empty (void)		{ return heap_.empty () ; }
+
+    private:
+	struct entry
+	{
+	    timepoint_t date ;
+	    int type ;
+	    void *key ;
+	} ;
+	std::vector <entry> heap_ ;
+	std::unordered_map <void *, std::size_t> index_ ;	// key -> heap pos
+
+	void up (std::size_t i) ;
+	void down (std::size_t i) ;
+	void exchange (std::size_t i, std::size_t j) ;
+	void erase (std::size_t i) ;
+} ;
+
+}					// end of namespace casan
+#endif
@@ -0,0 +1,235 @@
+/**
+ * @file shards.cc
+ * @brief Sharded CASAN engine implementation
+ */
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <mutex>
+
+#include "global.h"
+
+#include "l2.h"
+#include "msg.h"
+#include "slave.h"
+#include "casan.h"
+#include "shards.h"
+
+namespace casan {
+
+/**
+ * @brief Constructor, with only one shard
+ */
+
+shards::shards ()
+{
+    count (1) ;
+}
+
+/**
+ * @brief Destructor: stops and removes all shards
+ */
+
+shards::~shards ()
+{
+    stop () ;
+    for (auto e : shards_)
+	delete e ;
+}
+
+/**
+ * @brief Set the number of shards
+ *
+ * This method must be called before the shards are configured
+ * and started.
+ *
+ * @param n number of shards (at least 1)
+ */
+
+void shards::count (int n)
+{
+    if (n < 1)
+	n = 1 ;
+    for (auto e : shards_)
+	delete e ;
+    shards_.clear () ;
+    for (int i = 0 ; i < n ; i++)
+	shards_.push_back (new casan) ;
+    nnets_.assign (n, 0) ;
+}
+
+/**
+ * @brief Start all shards (see casan::init)
+ */
+
+void shards::init (void)
+{
+    for (auto e : shards_)
+	e->init () ;
+}
+
+/**
+ * @brief Stop all shards (see casan::stop)
+ */
+
+void shards::stop (void)
+{
+    for (auto e : shards_)
+	e->stop () ;
+
+    std::lock_guard <std::mutex> lk (mtx_) ;
+    nets_.clear () ;
+    nnets_.assign (shards_.size (), 0) ;
+}
+
+/**
+ * @brief Add an L2 network to the shard with the fewest networks
+ *
+ * @param l2 pointer to an existing l2net object
+ */
+
+void shards::start_net (l2net *l2)
+{
+    int best = 0 ;
+
+    {
+	std::lock_guard <std::mutex> lk (mtx_) ;
+
+	for (int i = 1 ; i < (int) nnets_.size () ; i++)
+	    if (nnets_ [i] < nnets_ [best])
+		best = i ;
+	nnets_ [best]++ ;
+	nets_ [l2] = best ;
+    }
+
+    D (D_CONF, "Network started by shard " << best) ;
+    shards_ [best]->start_net (l2) ;
+}
+
+/**
+ * @brief Remove an L2 network (see casan::stop_net)
+ *
+ * @param l2 pointer to an l2net object given to shards::start_net
+ */
+
+void shards::stop_net (l2net *l2)
+{
+    int i ;
+
+    {
+	std::lock_guard <std::mutex> lk (mtx_) ;
+
+	auto it = nets_.find (l2) ;
+	if (it == nets_.end ())
+	    return ;
+	i = it->second ;
+	nets_.erase (it) ;
+	nnets_ [i]-- ;
+    }
+
+    shards_ [i]->stop_net (l2) ;
+}
+
+/**
+ * @brief Find the shard owning a network
+ *
+ * @param l2 pointer to an l2net object given to shards::start_net
+ * @return shard, or NULL if the network is not found
+ */
+
+casan *shards::engine (l2net *l2)
+{
+    std::lock_guard <std::mutex> lk (mtx_) ;
+
+    auto it = nets_.find (l2) ;
+    return it == nets_.end () ? NULL : shards_ [it->second] ;
+}
+
+/**
+ * @brief Add a known slave to all shards
+ *
+ * The slave may be associated through any network, thus each
+ * shard gets its own copy of the slave.
+ *
+ * @param s slave to add
+ */
+
+void shards::add_slave (slave *s)
+{
+    for (auto e : shards_)
+	e->add_slave (s) ;
+}
+
+/**
+ * @brief Find the shard owning a slave
+ *
+ * The owner is the shard where the slave is associated. If the
+ * slave has moved to a network owned by another shard, it may be
+ * associated in both shards until the first association expires:
+ * the most recent association (i.e. the latest expiration date)
+ * is used.
+ * If the slave is not associated, the first shard is returned, in
+ * order to get a non-running slave (as casan::find_slave does).
+ *
+ * @param sid slave id
+ * @param s slave (copy in the owning shard) or NULL if not found
+ * @return owning shard
+ */
+
+casan *shards::owner (slaveid_t sid, slave **s)
+{
+    casan *e = shards_ [0] ;
+
+    *s = e->find_slave (sid) ;
+    for (auto x : shards_)
+    {
+	slave *y = x->find_slave (sid) ;
+
+	if (y != nullptr && y->status () == slave::SL_RUNNING
+		&& (*s == nullptr
+		    || (*s)->status () != slave::SL_RUNNING
+		    || y->next_timeout_ > (*s)->next_timeout_))
+	{
+	    e = x ;
+	    *s = y ;
+	}
+    }
+    return e ;
+}
+
+/**
+ * @brief Dumps all shards (see casan::html_debug)
+ *
+ * @return string containing the output
+ */
+
+std::string shards::html_debug (void)
+{
+    std::ostringstream oss ;
+
+    if (shards_.size () == 1)
+	return shards_ [0]->html_debug () ;
+
+    for (std::size_t i = 0 ; i < shards_.size () ; i++)
+	oss << "Shard " << i << ":\n" << shards_ [i]->html_debug () << "\n" ;
+    return oss.str () ;
+}
+
+/**
+ * @brief Aggregated list of resources (see casan::resource_list)
+ *
+ * @return string containing the resources of all running slaves
+ */
+
+std::string shards::resource_list (void)
+{
+    std::string str = "" ;
+
+    for (auto e : shards_)
+	str += e->resource_list () ;
+    return str ;
+}
+
+}					// end of namespace casan
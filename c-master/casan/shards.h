@@ -0,0 +1,73 @@
+/**
+ * @file shards.h
+ * @brief Sharded CASAN engine interface
+ */
+
+#ifndef CASAN_SHARDS_H
+#define	CASAN_SHARDS_H
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <unordered_map>
+
+#include "casan.h"
+
+namespace casan {
+
+/**
+ * @brief Set of CASAN engines sharing the work of a master
+ *
+ * A single CASAN engine has only one sender thread, which handles
+ * retransmissions, hello messages and timers for all networks and
+ * all slaves. With many networks, this class spreads the work over
+ * many engines (shards), each one with its own threads, scheduler,
+ * outstanding request table and deduplication sets:
+ * - each network is owned by one shard (the one with the fewest
+ *	networks when the network is started)
+ * - slaves are registered in all shards, and a slave is owned by
+ *	the shard of the network it is associated through
+ * - requests for a slave must be sent through the shard owning
+ *	the slave (see shards::owner)
+ *
+ * Shards must be configured (see shards::shard) between the
+ * calls to shards::count and shards::init.
+ */
+
+class shards
+{
+    public:
+	shards () ;
+	~shards () ;
+
+	// number of shards (before init)
+	void count (int n) ;
+	int count (void)			{ return shards_.size () ; }
+	casan &shard (int i)			{ return *shards_ [i] ; }
+
+	// start and stop all shards
+	void init (void) ;
+	void stop (void) ;
+
+	// networks are spread over shards
+	void start_net (l2net *l2) ;
+	void stop_net (l2net *l2) ;
+	casan *engine (l2net *l2) ;
+
+	// slaves are known by all shards
+	void add_slave (slave *s) ;
+	casan *owner (slaveid_t sid, slave **s) ;
+
+	// dump data structures
+	std::string html_debug (void) ;
+	std::string resource_list (void) ;
+
+    private:
+	std::vector <casan *> shards_ ;
+	std::vector <int> nnets_ ;	// number of networks by shard
+	std::unordered_map <l2net *, int> nets_ ; // network -> shard
+	std::mutex mtx_ ;		// protects nnets_ and nets_
+} ;
+
+}					// end of namespace casan
+#endif
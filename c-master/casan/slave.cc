@@ -28,10 +28,8 @@ namespace casan {
 
 void slave::reset (void)
 {
-    if (addr_)
-	delete addr_ ;			// XXX should be lock-protected
     l2_ = 0 ;
-    addr_ = 0 ;
+    addr (std::shared_ptr <l2addr> ()) ; // freed by the last user
     reslist_.clear () ;
     curmtu_ = 0 ;
     status_ = SL_INACTIVE ;
@@ -45,7 +43,7 @@ void slave::reset (void)
 
 std::ostream& operator<< (std::ostream &os, const slave &s)
 {
-    l2addr *a ;
+    std::shared_ptr <l2addr> a ;
     std::time_t nt ;
     char buf [MAXBUF] ;
 
@@ -64,7 +62,7 @@ std::ostream& operator<< (std::ostream &os, const slave &s)
 	    os << "(unknown state)" ;
 	    break ;
     }
-    a = ((slave *) (&s))->addr () ;	// why "a = s.addr ()" doesn't work?
+    a = s.addr () ;
     if (a)
 	os << " mac=" << *a ;
     os << "\n" ;
@@ -119,7 +117,7 @@ const std::vector <resource> &slave::resource_list (void)
 /**
  * @brief CASAN protocol handling
  *
- * This method is called by a receiver thread when the received
+ * This method is called by a worker thread when the received
  * message is a control message originated from this slave.
  * The method implements the CASAN control protocol for this
  * slave, and maintains the state associated to this slave.
@@ -6,7 +6,11 @@
 #ifndef CASAN_SLAVE_H
 #define	CASAN_SLAVE_H
 
+#include <deque>
+#include <memory>
+
 #include "msg.h"
+#include "rto.h"
 
 namespace casan {
 
@@ -20,6 +24,11 @@ class resource ;
  * @brief CASAN slave class
  *
  * This class describes a slave in the CASAN system.
+ *
+ * The address of a slave may be changed (see registry::bind) or
+ * removed (see registry::reset) while a thread sends a message to
+ * this slave: it is shared, and a thread must keep the reference
+ * returned by slave::addr as long as it uses the address.
  */
 
 class slave
@@ -36,7 +45,8 @@ class slave
 
 	// Mutators
 	void l2 (l2net *l2) 		{ l2_ = l2 ; }
-	void addr (l2addr *a) 		{ addr_ = a ; }
+	void addr (l2addr *a) 		{ addr (std::shared_ptr <l2addr> (a)) ; }
+	void addr (std::shared_ptr <l2addr> a) { std::atomic_store (&addr_, a) ; }
 	void slaveid (slaveid_t sid)	{ slaveid_ = sid ; }
 	void defmtu (int m)		{ defmtu_ = m ; }
 	void curmtu (int m)		{ curmtu_ = m ; }
@@ -46,7 +56,7 @@ class slave
 
 	// Accessors
 	l2net *l2 (void) 		{ return l2_ ; }
-	l2addr *addr (void) 		{ return addr_ ; }
+	std::shared_ptr <l2addr> addr (void) const { return std::atomic_load (&addr_) ; }
 	slaveid_t slaveid (void) 	{ return slaveid_ ; }
 	int defmtu (void) 		{ return defmtu_ ; }
 	int curmtu (void) 		{ return curmtu_ ; }
@@ -65,16 +75,23 @@ class slave
 	reply_handler_t handler_ ;	// handler to process answers
 
 	friend class casan ;
+	friend class shards ;
 
 	// needed for operator<<
 	timepoint_t next_timeout_ ;	// remaining ttl
 
+	// congestion control (protected by the engine reqmtx_)
+	rto rto_ ;			// RTO estimator and RTT statistics
+	l2net *rtonet_ = nullptr ;	// network of the estimator
+	int outstanding_ = 0 ;		// CON messages in flight
+	std::deque <msgptr_t> pending_ ;	// CON messages waiting
+
     private:
 	slaveid_t slaveid_ = 0 ;	// slave id
 	int defmtu_ = 0 ;		// default (configured) slave MTU
 	int curmtu_ = 0 ;		// current slave MTU
 	l2net *l2_ = nullptr ;		// l2 network this slave is on
-	l2addr *addr_ = nullptr ;	// slave address
+	std::shared_ptr <l2addr> addr_ ; // slave address (see slave::addr)
 	int init_ttl_ = 0 ;		// initial ttl (in sec)
 	enum status_code status_ = SL_INACTIVE;	// current status of slave
 	std::vector <resource> reslist_ ;	// resource list
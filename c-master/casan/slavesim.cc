@@ -0,0 +1,465 @@
+/**
+ * @file slavesim.cc
+ * @brief Simulated slaves on a loopback network
+ */
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+
+#include "global.h"
+#include "byte.h"
+
+#include "coap.h"
+#include "msg.h"
+#include "option.h"
+#include "slavesim.h"
+
+#define	CTL_PATH1	".well-known"
+#define	CTL_PATH2	"casan"
+#define	RESOURCES	"</temp>;rt=\"temp\""
+#define	REPLY_HDRLEN	(4 + COAP_MAX_TOKLEN + 1)
+
+/*
+ * Decoded CoAP message (only what simulated slaves need)
+ */
+
+struct coapmsg
+{
+    int type ;
+    int code ;
+    std::vector <std::string> path ;
+    std::vector <std::string> query ;
+} ;
+
+// decode a CoAP message, return false if it is not valid
+static bool decode (const byte *b, int len, coapmsg &m)
+{
+    int tkl, i, opt ;
+
+    if (len < 4 || (b [0] >> 6) != CASAN_VERSION)
+	return false ;
+    m.type = (b [0] >> 4) & 0x3 ;
+    m.code = b [1] ;
+    tkl = b [0] & 0xf ;
+    if (tkl > COAP_MAX_TOKLEN || 4 + tkl > len)
+	return false ;
+
+    opt = 0 ;
+    for (i = 4 + tkl ; i < len && b [i] != 0xff ; )
+    {
+	int delta = b [i] >> 4 ;
+	int olen = b [i] & 0xf ;
+
+	i++ ;
+	for (int *v : { &delta, &olen })
+	{
+	    if (*v == 13 && i < len)
+		*v = 13 + b [i++] ;
+	    else if (*v == 14 && i + 1 < len)
+	    {
+		*v = 269 + INT16 (b [i], b [i + 1]) ;
+		i += 2 ;
+	    }
+	    else if (*v >= 13)
+		return false ;
+	}
+	if (i + olen > len)
+	    return false ;
+
+	opt += delta ;
+	if (opt == casan::option::MO_Uri_Path)
+	    m.path.push_back (std::string ((const char *) b + i, olen)) ;
+	else if (opt == casan::option::MO_Uri_Query)
+	    m.query.push_back (std::string ((const char *) b + i, olen)) ;
+	i += olen ;
+    }
+    return true ;
+}
+
+// encode an option (options must be encoded in increasing order)
+static int encode_option (byte *b, int &last, int code, const std::string &val)
+{
+    int delta = code - last ;
+    int olen = val.size () ;
+    int i = 1 ;
+
+    b [0] = 0 ;
+    for (int sh : { 4, 0 })
+    {
+	int v = sh == 4 ? delta : olen ;
+
+	if (v < 13)
+	    b [0] |= v << sh ;
+	else if (v < 269)
+	{
+	    b [0] |= 13 << sh ;
+	    b [i++] = v - 13 ;
+	}
+	else
+	{
+	    b [0] |= 14 << sh ;
+	    b [i++] = BYTE_HIGH (v - 269) ;
+	    b [i++] = BYTE_LOW (v - 269) ;
+	}
+    }
+    std::memcpy (b + i, val.data (), olen) ;
+    last = code ;
+    return i + olen ;
+}
+
+static bool is_ctl (const coapmsg &m)
+{
+    return m.path.size () == 2 && m.path [0] == CTL_PATH1
+				&& m.path [1] == CTL_PATH2 ;
+}
+
+static bool has_query (const coapmsg &m, const char *prefix)
+{
+    for (auto &q : m.query)
+	if (q.compare (0, std::strlen (prefix), prefix) == 0)
+	    return true ;
+    return false ;
+}
+
+/******************************************************************************
+ * slavesim methods
+ */
+
+/**
+ * @brief Constructor
+ *
+ * The output function of the loopback network is registered, but
+ * no frame is sent to the engine before slavesim::start.
+ *
+ * @param l2 loopback network (already initialized)
+ * @param first slave id of the first slave
+ * @param n number of slaves
+ * @param p simulation parameters
+ */
+
+slavesim::slavesim (casan::l2net_loop *l2, slaveid_t first, int n, const params &p)
+    : l2_ (l2), first_ (first), params_ (p), nodes_ (n)
+{
+    int paylen = p.paylen ;
+
+    if (paylen > l2->mtu () - REPLY_HDRLEN)
+	paylen = l2->mtu () - REPLY_HDRLEN ;
+    value_.assign (paylen, '0') ;
+
+    l2_->output (
+	[this] (casan::l2addr_loop &daddr, const byte *data, int len)
+	{
+	    output (daddr, data, len) ;
+	}) ;
+}
+
+slavesim::~slavesim ()
+{
+    stop () ;
+    l2_->output (nullptr) ;
+}
+
+/**
+ * @brief Start the simulation
+ *
+ * Each slave sends a first Discover message, and the thread used
+ * to deliver delayed frames and periodic Discover messages is
+ * started.
+ */
+
+void slavesim::start (void)
+{
+    std::vector <delayed> out ;
+
+    {
+	std::lock_guard <std::mutex> lk (mtx_) ;
+
+	for (int i = 0 ; i < (int) nodes_.size () ; i++)
+	    discover (i, out) ;
+	stop_ = false ;
+    }
+    inject (out) ;
+    thr_ = new std::thread (&slavesim::thread, this) ;
+}
+
+/**
+ * @brief Stop the simulation
+ *
+ * Delayed frames are lost, and frames sent by the engine are now
+ * ignored.
+ */
+
+void slavesim::stop (void)
+{
+    if (thr_ != nullptr)
+    {
+	{
+	    std::lock_guard <std::mutex> lk (mtx_) ;
+
+	    stop_ = true ;
+	    condvar_.notify_one () ;
+	}
+	thr_->join () ;
+	delete thr_ ;
+	thr_ = nullptr ;
+    }
+}
+
+/**
+ * @brief Number of associated slaves
+ *
+ * A slave is associated as soon as it has answered an Associate
+ * request, even if the answer is later lost.
+ */
+
+int slavesim::nassoc (void)
+{
+    std::lock_guard <std::mutex> lk (mtx_) ;
+    int n = 0 ;
+
+    for (auto &s : nodes_)
+	if (s.assoc)
+	    n++ ;
+    return n ;
+}
+
+/*
+ * Frame sent by the engine (called by an engine thread)
+ */
+
+void slavesim::output (casan::l2addr_loop &daddr, const byte *data, int len)
+{
+    std::vector <delayed> out ;
+    long int a = daddr.number () ;
+    int n = nodes_.size () ;
+
+    {
+	std::lock_guard <std::mutex> lk (mtx_) ;
+
+	if (stop_)
+	    return ;
+	if (daddr == casan::l2addr_loop_broadcast)
+	{
+	    for (int i = 0 ; i < n ; i++)
+		process (i, data, len, out) ;
+	}
+	else if (a >= SLAVESIM_ADDR0 && a < SLAVESIM_ADDR0 + n)
+	    process (a - SLAVESIM_ADDR0, data, len, out) ;
+    }
+    inject (out) ;
+}
+
+/*
+ * Process a frame received by a slave (mtx_ is locked), and queue
+ * frames to send in out
+ */
+
+void slavesim::process (int i, const byte *data, int len, std::vector <delayed> &out)
+{
+    coapmsg m ;
+
+    nrecv_++ ;
+    if (lost ())
+	return ;
+    if (! decode (data, len, m))
+	return ;
+
+    if (m.type == casan::msg::MT_NON)
+    {
+	// Hello: not yet associated slaves send a Discover
+	if (m.code == casan::msg::MC_POST && is_ctl (m) && has_query (m, "hello=")
+			&& ! nodes_ [i].assoc)
+	    discover (i, out) ;
+    }
+    else if (m.type == casan::msg::MT_CON)
+    {
+	if (m.code == casan::msg::MC_POST && is_ctl (m) && has_query (m, "ttl="))
+	{
+	    nodes_ [i].assoc = true ;
+	    reply (i, COAP_MKCODE (2, 5), data, RESOURCES, out) ;
+	}
+	else if (m.code == casan::msg::MC_GET && m.path.size () == 1
+			&& m.path [0] == "temp")
+	    reply (i, COAP_MKCODE (2, 5), data, value_, out) ;
+	else
+	    reply (i, COAP_MKCODE (4, 4), data, "", out) ;
+    }
+}
+
+/*
+ * Build a Discover message (NON POST /.well-known/casan?slave=id&mtu=m)
+ */
+
+void slavesim::discover (int i, std::vector <delayed> &out)
+{
+    byte b [MAXBUF] ;
+    int len, last, id ;
+    char q [MAXBUF] ;
+
+    id = ++nodes_ [i].id & 0xffff ;
+    len = 0 ;
+    b [len++] = (CASAN_VERSION << 6) | (casan::msg::MT_NON << 4) ;
+    b [len++] = casan::msg::MC_POST ;
+    b [len++] = BYTE_HIGH (id) ;
+    b [len++] = BYTE_LOW (id) ;
+
+    last = 0 ;
+    len += encode_option (b + len, last, casan::option::MO_Uri_Path, CTL_PATH1) ;
+    len += encode_option (b + len, last, casan::option::MO_Uri_Path, CTL_PATH2) ;
+    std::snprintf (q, sizeof q, "slave=%ld", first_ + i) ;
+    len += encode_option (b + len, last, casan::option::MO_Uri_Query, q) ;
+    std::snprintf (q, sizeof q, "mtu=%d", l2_->mtu ()) ;
+    len += encode_option (b + len, last, casan::option::MO_Uri_Query, q) ;
+
+    push (i, true, b, len, out) ;
+}
+
+/*
+ * Build a piggy-backed reply to a confirmable request
+ */
+
+void slavesim::reply (int i, int code, const byte *req, const std::string &pl,
+					std::vector <delayed> &out)
+{
+    byte b [MAXBUF] ;
+    int tkl = req [0] & 0xf ;
+    int len ;
+
+    len = 0 ;
+    b [len++] = (CASAN_VERSION << 6) | (casan::msg::MT_ACK << 4) | tkl ;
+    b [len++] = code ;
+    b [len++] = req [2] ;		// same id
+    b [len++] = req [3] ;
+    std::memcpy (b + len, req + 4, tkl) ;	// same token
+    len += tkl ;
+    if (! pl.empty ())
+    {
+	b [len++] = 0xff ;
+	std::memcpy (b + len, pl.data (), pl.size ()) ;
+	len += pl.size () ;
+    }
+
+    push (i, false, b, len, out) ;
+}
+
+/*
+ * Queue a frame sent by a slave, with its delivery date, unless it
+ * is lost
+ */
+
+void slavesim::push (int i, bool bcast, const byte *b, int len,
+				std::vector <delayed> &out)
+{
+    delayed d ;
+    int ms ;
+
+    if (lost ())
+	return ;
+
+    ms = params_.latency ;
+    if (params_.jitter > 0)
+	ms += std::uniform_int_distribution <int> (0, params_.jitter) (rng_) ;
+    d.date = std::chrono::system_clock::now () + duration_t (ms) ;
+    d.slave = i ;
+    d.bcast = bcast ;
+    d.frame.assign ((const char *) b, len) ;
+    out.push_back (std::move (d)) ;
+}
+
+// random frame loss (mtx_ is locked)
+bool slavesim::lost (void)
+{
+    if (params_.loss > 0
+	    && std::uniform_real_distribution <double> (0, 1) (rng_) < params_.loss)
+    {
+	nlost_++ ;
+	return true ;
+    }
+    return false ;
+}
+
+/*
+ * Send frames to the engine: immediately if there is no latency,
+ * else through the delivery thread (mtx_ is not locked)
+ */
+
+void slavesim::inject (std::vector <delayed> &out)
+{
+    if (out.empty ())
+	return ;
+
+    if (params_.latency == 0 && params_.jitter == 0)
+    {
+	for (auto &d : out)
+	    deliver (d) ;
+    }
+    else
+    {
+	std::lock_guard <std::mutex> lk (mtx_) ;
+
+	for (auto &d : out)
+	    queue_.push (std::move (d)) ;
+	condvar_.notify_one () ;
+    }
+    out.clear () ;
+}
+
+void slavesim::deliver (const delayed &d)
+{
+    casan::l2addr_loop src (SLAVESIM_ADDR0 + d.slave) ;
+    casan::l2addr_loop dst (SLAVESIM_MASTER) ;
+
+    nsent_++ ;
+    l2_->input (src, d.bcast ? casan::l2addr_loop_broadcast : dst,
+				d.frame.data (), d.frame.size ()) ;
+}
+
+/*
+ * Delivery thread: deliver delayed frames when they are due, and
+ * send a Discover from slaves which are not yet associated at each
+ * Discover period
+ */
+
+void slavesim::thread (void)
+{
+    timepoint_t next = std::chrono::system_clock::now ()
+				+ duration_t (params_.discover) ;
+
+    for (;;)
+    {
+	std::vector <delayed> due, out ;
+	timepoint_t now ;
+
+	{
+	    std::unique_lock <std::mutex> lk (mtx_) ;
+	    timepoint_t wake = next ;
+
+	    if (! queue_.empty () && queue_.top ().date < wake)
+		wake = queue_.top ().date ;
+	    if (! stop_)
+		condvar_.wait_until (lk, wake) ;
+	    if (stop_)
+		break ;
+
+	    now = std::chrono::system_clock::now () ;
+	    while (! queue_.empty () && queue_.top ().date <= now)
+	    {
+		due.push_back (queue_.top ()) ;
+		queue_.pop () ;
+	    }
+	    if (now >= next)
+	    {
+		for (int i = 0 ; i < (int) nodes_.size () ; i++)
+		    if (! nodes_ [i].assoc)
+			discover (i, out) ;
+		next = now + duration_t (params_.discover) ;
+	    }
+	}
+
+	for (auto &d : due)
+	    deliver (d) ;
+	inject (out) ;
+    }
+}
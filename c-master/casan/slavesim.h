@@ -0,0 +1,117 @@
+/**
+ * @file slavesim.h
+ * @brief Simulated slaves on a loopback network
+ */
+
+#ifndef CASAN_SLAVESIM_H
+#define	CASAN_SLAVESIM_H
+
+#include <vector>
+#include <queue>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <random>
+#include <atomic>
+
+#include "global.h"
+#include "l2-loop.h"
+
+/**
+ * @brief A fleet of simulated slaves
+ *
+ * This class simulates many slaves, attached to the engine through
+ * a loopback network (see casan::l2net_loop), in order to load test
+ * the CASAN engine without any hardware. Each slave behaves as the
+ * Arduino implementation:
+ * - until it is associated, it sends a Discover message (broadcast)
+ *	periodically, and when it receives a Hello message
+ * - it answers the Associate request with the list of its resources
+ *	(a single `/temp` resource)
+ * - it answers confirmable GET requests for `/temp` with a
+ *	piggy-backed 2.05 reply, and other confirmable requests with
+ *	a 4.04 reply
+ *
+ * Slave `i` (from 0) has the slave id `first + i` and the loopback
+ * address `SLAVESIM_ADDR0 + i`. The engine must use the address
+ * SLAVESIM_MASTER on the loopback network.
+ *
+ * Frames in both directions may be lost, and replies may be delayed
+ * (by a fixed latency plus a random jitter). Delayed frames are
+ * delivered to the engine by a dedicated thread.
+ *
+ * The output function registered on the loopback network is called
+ * by engine threads: slaves are protected by a single mutex.
+ */
+
+#define	SLAVESIM_MASTER		1	///< address of the engine
+#define	SLAVESIM_ADDR0		2	///< address of the first slave
+
+class slavesim
+{
+    public:
+	/// simulation parameters
+	struct params
+	{
+	    int latency = 0 ;		///< reply latency (ms)
+	    int jitter = 0 ;		///< random additional latency (ms)
+	    double loss = 0 ;		///< frame loss probability (0..1)
+	    int paylen = 4 ;		///< length of `/temp` replies
+	    int discover = 1000 ;	///< Discover period (ms)
+	} ;
+
+	slavesim (casan::l2net_loop *l2, slaveid_t first, int n, const params &p) ;
+	~slavesim () ;
+
+	void start (void) ;		// first Discover, start the thread
+	void stop (void) ;
+
+	int nassoc (void) ;		// # of associated slaves
+	std::atomic <long int> nrecv_ {0} ;	// frames received from the engine
+	std::atomic <long int> nsent_ {0} ;	// frames sent to the engine
+	std::atomic <long int> nlost_ {0} ;	// frames lost (both directions)
+
+    private:
+	struct node
+	{
+	    bool assoc = false ;	// Associate request answered
+	    int id = 0 ;		// last message id
+	} ;
+
+	struct delayed
+	{
+	    timepoint_t date ;
+	    int slave ;
+	    bool bcast ;		// Discover
+	    std::string frame ;
+	    bool operator< (const delayed &d) const { return date > d.date ; }
+	} ;
+
+	casan::l2net_loop *l2_ ;
+	slaveid_t first_ ;
+	params params_ ;
+	std::string value_ ;		// `/temp` value
+
+	std::vector <node> nodes_ ;	// protected by mtx_
+	std::priority_queue <delayed> queue_ ;	// protected by mtx_
+	std::mt19937 rng_ ;		// protected by mtx_
+	bool stop_ = false ;		// protected by mtx_
+	std::mutex mtx_ ;
+	std::condition_variable condvar_ ;
+	std::thread *thr_ = nullptr ;
+
+	void output (casan::l2addr_loop &daddr, const byte *data, int len) ;
+	void process (int i, const byte *data, int len, std::vector <delayed> &out) ;
+	void discover (int i, std::vector <delayed> &out) ;
+	void reply (int i, int code, const byte *req, const std::string &pl,
+					std::vector <delayed> &out) ;
+	void push (int i, bool bcast, const byte *b, int len,
+					std::vector <delayed> &out) ;
+	bool lost (void) ;
+	void inject (std::vector <delayed> &out) ;
+	void deliver (const delayed &d) ;
+	void thread (void) ;
+} ;
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * @file spsc.h
+ * @brief Bounded single-producer single-consumer ring
+ */
+
+#ifndef CASAN_SPSC_H
+#define	CASAN_SPSC_H
+
+#include <vector>
+#include <atomic>
+#include <utility>
+#include <cstddef>
+
+namespace casan {
+
+/**
+ * @brief Bounded lock-free ring between two threads
+ *
+ * One thread (the producer) pushes objects, and another one (the
+ * consumer) pops them, without any lock: each index is only
+ * modified by one thread, and is published to the other one with
+ * release/acquire ordering. Slots are allocated once (see
+ * spsc::capacity): pushing and popping do not make any heap
+ * allocation.
+ *
+ * When the ring is full, the object is not pushed and the overflow
+ * counter is incremented. The highest depth reached is recorded,
+ * in order to help sizing the ring.
+ *
+ * This class does not provide any way to wait for objects: the
+ * consumer must be woken up by other means.
+ */
+
+template <class T>
+class spsc
+{
+    public:
+	static const std::size_t DEFAULT_CAPACITY = 1024 ;
+
+	spsc ()					{ capacity (DEFAULT_CAPACITY) ; }
+	spsc (const spsc &) = delete ;
+	spsc &operator= (const spsc &) = delete ;
+
+	/**
+	 * @brief Set the number of slots (must be called before use)
+	 *
+	 * @param n minimum number of slots (rounded up to a power of 2)
+	 */
+
+	void capacity (std::size_t n)
+	{
+	    std::size_t c = 1 ;
+
+	    while (c < n)
+		c <<= 1 ;
+	    ring_.clear () ;
+	    ring_.resize (c) ;
+	    mask_ = c - 1 ;
+	    head_ = tail_ = peak_ = overflow_ = 0 ;
+	}
+	std::size_t capacity (void) const	{ return mask_ + 1 ; }
+
+	/**
+	 * @brief Push an object (producer only)
+	 *
+	 * @param v object, moved into the ring (unchanged if full)
+	 * @return false if the ring is full
+	 */
+
+	bool push (T &v)
+	{
+	    std::size_t t = tail_.load (std::memory_order_relaxed) ;
+	    std::size_t h = head_.load (std::memory_order_acquire) ;
+
+	    if (t - h > mask_)
+	    {
+		overflow_.fetch_add (1, std::memory_order_relaxed) ;
+		return false ;
+	    }
+	    ring_ [t & mask_] = std::move (v) ;
+	    tail_.store (t + 1, std::memory_order_release) ;
+
+	    if (t + 1 - h > peak_.load (std::memory_order_relaxed))
+		peak_.store (t + 1 - h, std::memory_order_relaxed) ;
+	    return true ;
+	}
+
+	/**
+	 * @brief Pop an object (consumer only)
+	 *
+	 * @param v object moved out of the ring
+	 * @return false if the ring is empty
+	 */
+
+	bool pop (T &v)
+	{
+	    std::size_t h = head_.load (std::memory_order_relaxed) ;
+
+	    if (h == tail_.load (std::memory_order_acquire))
+		return false ;
+	    v = std::move (ring_ [h & mask_]) ;
+	    ring_ [h & mask_] = T () ;		// release resources now
+	    head_.store (h + 1, std::memory_order_release) ;
+	    return true ;
+	}
+
+	// statistics, which may be read by any thread
+	bool empty (void) const			{ return depth () == 0 ; }
+	std::size_t depth (void) const
+	{
+	    std::size_t h = head_.load (std::memory_order_acquire) ;
+
+	    return tail_.load (std::memory_order_acquire) - h ;
+	}
+	std::size_t peak (void) const		{ return peak_ ; }
+	unsigned long int overflow (void) const	{ return overflow_ ; }
+
+    private:
+	static const std::size_t CACHELINE = 64 ;
+
+	std::vector <T> ring_ ;
+	std::size_t mask_ ;
+
+	// indexes are in separate cache lines, written by only one thread
+	char pad0_ [CACHELINE] ;
+	std::atomic <std::size_t> head_ ;	// next slot to pop
+	char pad1_ [CACHELINE] ;
+	std::atomic <std::size_t> tail_ ;	// next slot to push
+	char pad2_ [CACHELINE] ;
+	std::atomic <std::size_t> peak_ ;	// written by the producer
+	std::atomic <unsigned long int> overflow_ ;
+} ;
+
+template <class T>
+const std::size_t spsc <T>::DEFAULT_CAPACITY ;
+
+}					// end of namespace casan
+#endif
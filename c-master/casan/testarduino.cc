@@ -28,7 +28,7 @@ void connexion(void)
 {
 	casan::l2net *l ;
 	casan::l2net_eth *le ;
-	casan::l2addr_eth *sa ;		// slave address
+	casan::l2addr_eth *sa ;		// slave address, freed by the slave
 	casan::slave s ;		// slave
 	casan::slave sb ;		// pseudo-slave for broadcast
 	casan::msg m1, m2, m3 ;
@@ -50,7 +50,7 @@ void connexion(void)
 	s.l2 (l) ;
 
 	// pseudo-slave for broadcast address
-	sb.addr (&casan::l2addr_eth_broadcast) ;
+	sb.addr (std::shared_ptr <casan::l2addr> (&casan::l2addr_eth_broadcast, [] (casan::l2addr *) {})) ;
 	sb.l2 (l) ;
 
 	std::cout << IFACE << " initialized for " << ADDR << "\n" ;
@@ -99,7 +99,6 @@ void connexion(void)
 	m3.pushoption(opt_ask_resources);
 	m3.send () ;
 
-	delete sa ;
 	delete l ;
 }
 
@@ -107,7 +106,7 @@ void request_hello(char *val)
 {
 	casan::l2net *l ;
 	casan::l2net_eth *le ;
-	casan::l2addr_eth *sa ;		// slave address
+	casan::l2addr_eth *sa ;		// slave address, freed by the slave
 	casan::slave s ;		// slave
 	casan::slave sb ;		// pseudo-slave for broadcast
 	casan::msg m1;
@@ -129,7 +128,7 @@ void request_hello(char *val)
 	s.l2 (l) ;
 
 	// pseudo-slave for broadcast address
-	sb.addr (&casan::l2addr_eth_broadcast) ;
+	sb.addr (std::shared_ptr <casan::l2addr> (&casan::l2addr_eth_broadcast, [] (casan::l2addr *) {})) ;
 	sb.l2 (l) ;
 
 	std::cout << IFACE << " initialized for " << ADDR << "\n" ;
@@ -158,7 +157,6 @@ void request_hello(char *val)
 	m1.pushoption (opt_hello) ;
 	m1.send () ;
 
-	delete sa ;
 	delete l ;
 }
 
@@ -166,7 +164,7 @@ void request_assoc(char *val)
 {
 	casan::l2net *l ;
 	casan::l2net_eth *le ;
-	casan::l2addr_eth *sa ;		// slave address
+	casan::l2addr_eth *sa ;		// slave address, freed by the slave
 	casan::slave s ;		// slave
 	casan::slave sb ;		// pseudo-slave for broadcast
 	casan::msg m1;
@@ -212,7 +210,6 @@ void request_assoc(char *val)
 	m1.pushoption(opt_assoc);
 	m1.send() ;
 
-	delete sa ;
 	delete l ;
 }
 
@@ -220,7 +217,7 @@ void requete_ressources(char * resource, char * val)
 {
 	casan::l2net *l ;
 	casan::l2net_eth *le ;
-	casan::l2addr_eth *sa ;		// slave address
+	casan::l2addr_eth *sa ;		// slave address, freed by the slave
 	casan::slave s ;		// slave
 	casan::slave sb ;		// pseudo-slave for broadcast
 	casan::msg m ;
@@ -242,7 +239,7 @@ void requete_ressources(char * resource, char * val)
 	s.l2 (l) ;
 
 	// pseudo-slave for broadcast address
-	sb.addr (&casan::l2addr_eth_broadcast) ;
+	sb.addr (std::shared_ptr <casan::l2addr> (&casan::l2addr_eth_broadcast, [] (casan::l2addr *) {})) ;
 	sb.l2 (l) ;
 
 	std::cout << IFACE << " initialized for " << ADDR << "\n" ;
@@ -269,7 +266,6 @@ void requete_ressources(char * resource, char * val)
 
 	m.send () ;
 
-	delete sa ;
 	delete l ;
 }
 
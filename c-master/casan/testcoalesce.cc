@@ -0,0 +1,215 @@
+/**
+ * @file testcoalesce.cc
+ * @brief Test of request coalescing in the cache
+ *
+ * This program sends NREQ identical GET requests in parallel, as
+ * master::http_casan does on a cache miss (see cache::coalesce),
+ * to one simulated slave on a loopback network (see loopslave).
+ * The slave answers after a delay, such that all requests are issued
+ * while the first one is in progress. Exactly one frame must be sent to the slave,
+ * and all requests must get the reply.
+ *
+ * Usage: testcoalesce
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "global.h"
+#include "byte.h"
+
+#include "l2.h"
+#include "l2-loop.h"
+#include "msg.h"
+#include "resource.h"
+#include "casan.h"
+#include "cache.h"
+#include "loopslave.h"
+
+#define	NREQ		100		// parallel requests
+#define	SID		169		// slave id
+#define	DELAY		200		// slave answer delay (ms)
+#define	PAYLOAD		"21.5"
+#define	MASTER		1		// engine address on the network
+
+int debug_levels = 0 ;
+
+const char *debug_title (int)
+{
+    return "" ;
+}
+
+/*
+ * Simulated slave: confirmable messages are answered after DELAY ms
+ * with a cacheable piggy-backed reply. GET requests are counted.
+ */
+
+casan::l2addr_loop slave_addr (SID) ;
+std::atomic <int> nsent (0) ;		// GET frames sent to the slave
+
+void slave (loopslave *ls, casan::l2addr_loop &daddr, const byte *b, int len)
+{
+    byte ack [4 + COAP_MAX_TOKLEN + 3 + 1 + sizeof PAYLOAD] ;
+    int tkl, i ;
+
+    if (daddr != slave_addr || len < 4
+			|| ((b [0] >> 4) & 0x3) != casan::msg::MT_CON)
+	return ;
+
+    if (b [1] == casan::msg::MC_GET)
+	nsent++ ;
+
+    tkl = b [0] & 0xf ;
+    i = 0 ;
+    ack [i++] = (CASAN_VERSION << 6) | (casan::msg::MT_ACK << 4) | tkl ;
+    ack [i++] = COAP_MKCODE (2, 5) ;
+    ack [i++] = b [2] ;
+    ack [i++] = b [3] ;
+    std::memcpy (ack + i, b + 4, tkl) ;
+    i += tkl ;
+    ack [i++] = 0xd1 ;			// Max-Age (delta 13+1), length 1
+    ack [i++] = casan::option::MO_Max_Age - 13 ;
+    ack [i++] = 60 ;
+    ack [i++] = 0xff ;
+    std::memcpy (ack + i, PAYLOAD, sizeof PAYLOAD - 1) ;
+    i += sizeof PAYLOAD - 1 ;
+    ls->send (slave_addr, ack, i, DELAY) ;
+}
+
+/*
+ * HTTP thread: send a GET request as master::http_casan does, and
+ * wait for the completion
+ */
+
+std::mutex startmtx ;
+std::condition_variable startcv ;
+bool started = false ;
+std::atomic <int> nreplies (0) ;
+
+void http_thread (casan::casan *e, casan::cache *c, casan::slave *s)
+{
+    const char path [] = "temp" ;
+    casan::msgptr_t m (new casan::msg) ;
+    casan::msgptr_t r ;
+
+    m->peer (s) ;
+    m->type (casan::msg::MT_CON) ;
+    m->code (casan::msg::MC_GET) ;
+    casan::option o (casan::option::MO_Uri_Path, path, sizeof path - 1) ;
+    m->pushoption (o) ;
+
+    {
+	std::unique_lock <std::mutex> lk (startmtx) ;
+	while (! started)
+	    startcv.wait (lk) ;
+    }
+
+    r = c->get (m) ;
+    if (r == nullptr)
+    {
+	std::promise <casan::msgptr_t> p ;
+	std::future <casan::msgptr_t> f = p.get_future () ;
+
+	c->coalesce (m,
+		[e, m] (casan::cache::done_t done)
+		{
+		    e->add_request (m,
+			[done] (casan::msgptr_t req)
+			{
+			    done (req->reqrep ()) ;
+			    casan::msg::link_reqrep (req, nullptr) ;
+			}) ;
+		},
+		[&p] (casan::msgptr_t rep)
+		{
+		    p.set_value (rep) ;
+		}) ;
+
+	if (f.wait_for (std::chrono::seconds (5)) == std::future_status::ready)
+	    r = f.get () ;
+    }
+
+    if (r != nullptr)
+    {
+	int len ;
+	char *p = (char *) r->payload (&len) ;
+
+	if (len == sizeof PAYLOAD - 1 && std::memcmp (p, PAYLOAD, len) == 0)
+	    nreplies++ ;
+    }
+}
+
+int main (int argc, char *argv [])
+{
+    casan::casan e ;
+    casan::cache c ;
+    casan::slave s ;
+    casan::slave *sp ;
+    casan::l2net_loop *l2 ;
+    loopslave *ls ;
+    std::vector <std::thread *> thr ;
+    bool ok ;
+
+    (void) argc ; (void) argv ;
+
+    e.timer_first_hello (1) ;
+    e.timer_interval_hello (10) ;
+    e.timer_slave_ttl (3600) ;
+    e.init () ;
+
+    s.slaveid (SID) ;
+    s.init_ttl (3600) ;
+    e.add_slave (&s) ;
+
+    l2 = new casan::l2net_loop ;
+    if (l2->init (casan::l2addr_loop (MASTER)) == -1)
+    {
+	perror ("loopback") ;
+	std::exit (1) ;
+    }
+    ls = new loopslave (l2) ;
+    ls->handler (
+	[ls] (casan::l2addr_loop &daddr, const byte *data, int len)
+	{
+	    slave (ls, daddr, data, len) ;
+	}) ;
+    e.start_net (l2) ;
+
+    sp = e.find_slave (SID) ;
+    ls->discover (slave_addr, SID) ;
+    while (sp->addr () == nullptr)
+	std::this_thread::sleep_for (std::chrono::milliseconds (1)) ;
+
+    for (int i = 0 ; i < NREQ ; i++)
+	thr.push_back (new std::thread (http_thread, &e, &c, sp)) ;
+
+    {
+	std::unique_lock <std::mutex> lk (startmtx) ;
+	started = true ;
+	startcv.notify_all () ;
+    }
+    for (auto t : thr)
+	t->join () ;
+
+    ok = (nsent == 1 && nreplies == NREQ) ;
+    std::cout << NREQ << " requests, " << nsent << " frame(s) sent, "
+		<< nreplies << " replies: " << (ok ? "OK" : "FAILED") << "\n" ;
+    std::cout << c.html_debug () ;
+
+    e.stop () ;
+    delete ls ;
+    l2->term () ;
+    delete l2 ;
+    return ok ? 0 : 1 ;
+}
@@ -0,0 +1,281 @@
+/**
+ * @file testobserve.cc
+ * @brief Test of resource observation
+ *
+ * This program subscribes NSUB times to the same resource of one
+ * simulated slave on a loopback network (as NSUB HTTP clients of
+ * an event stream would do, see master::http_observe). The slave
+ * (see loopslave) behaves as the Arduino implementation: it registers
+ * the master on a GET with Observe=0 and deregisters it on Observe=1.
+ * The test checks that:
+ * - only one registration is sent to the slave
+ * - each notification (ACK, CON or NON) is delivered once to
+ *	each subscriber, and old notifications are ignored
+ * - CON notifications are acknowledged
+ * - the master deregisters when the last subscriber leaves, and
+ *	rejects notifications with a RST after that
+ *
+ * Usage: testobserve
+ */
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "global.h"
+#include "byte.h"
+
+#include "l2.h"
+#include "l2-loop.h"
+#include "msg.h"
+#include "option.h"
+#include "resource.h"
+#include "casan.h"
+#include "loopslave.h"
+
+#define	NSUB		10		// subscribers
+#define	SID		169		// slave id
+#define	WAIT		300		// delay (ms) to process frames
+#define	MASTER		1		// engine address on the network
+
+int debug_levels = 0 ;
+
+const char *debug_title (int)
+{
+    return "" ;
+}
+
+/*
+ * Simulated slave: confirmable requests are answered with a
+ * piggy-backed reply, with an Observe option if the master registers
+ * itself. Registrations, deregistrations and ACK/RST sent to the
+ * slave are recorded.
+ */
+
+casan::l2addr_loop slave_addr (SID) ;
+std::atomic <int> nreg (0) ;		// GET with Observe=0
+std::atomic <int> ndereg (0) ;		// GET with Observe=1
+std::atomic <int> nack (0) ;		// empty ACK received
+std::atomic <int> nrst (0) ;		// RST received
+byte token [COAP_MAX_TOKLEN] ;		// token of the registration
+int toklen = 0 ;
+
+/*
+ * Build a 2.05 reply with the registration token, an Observe option
+ * (if serial >= 0), a Max-Age and a payload (if val is not null)
+ */
+
+int mkreply (byte *b, casan::msg::msgtype t, int id, int serial, const char *val)
+{
+    int i, delta ;
+
+    i = 0 ;
+    b [i++] = (CASAN_VERSION << 6) | (t << 4) | toklen ;
+    b [i++] = COAP_MKCODE (2, 5) ;
+    b [i++] = BYTE_HIGH (id) ;
+    b [i++] = BYTE_LOW (id) ;
+    std::memcpy (b + i, token, toklen) ;
+    i += toklen ;
+    delta = casan::option::MO_Max_Age ;
+    if (serial >= 0)
+    {
+	b [i++] = (casan::option::MO_Observe << 4) | 2 ;
+	b [i++] = BYTE_HIGH (serial) ;
+	b [i++] = BYTE_LOW (serial) ;
+	delta -= casan::option::MO_Observe ;
+    }
+    b [i++] = (delta << 4) | 1 ;
+    b [i++] = 60 ;
+    if (val != nullptr)
+    {
+	b [i++] = 0xff ;
+	std::memcpy (b + i, val, std::strlen (val)) ;
+	i += std::strlen (val) ;
+    }
+    return i ;
+}
+
+// send a notification from the slave
+void notify (loopslave *ls, casan::msg::msgtype t, int id, int serial, const char *val)
+{
+    byte b [MAXBUF] ;
+
+    ls->send (slave_addr, b, mkreply (b, t, id, serial, val)) ;
+}
+
+void slave (loopslave *ls, casan::l2addr_loop &daddr, const byte *b, int len)
+{
+    int type, tkl, id ;
+
+    if (daddr != slave_addr || len < 4)
+	return ;
+
+    type = (b [0] >> 4) & 0x3 ;
+    tkl = b [0] & 0xf ;
+    id = (b [2] << 8) | b [3] ;
+
+    if (type == casan::msg::MT_ACK && b [1] == casan::msg::MC_EMPTY)
+	nack++ ;
+    else if (type == casan::msg::MT_RST)
+	nrst++ ;
+    else if (type == casan::msg::MT_CON)
+    {
+	byte rep [MAXBUF] ;
+	int serial = -1 ;
+
+	/*
+	 * Observe is the first option of the request (before Uri-Path)
+	 */
+
+	if (b [1] == casan::msg::MC_GET && len > 4 + tkl
+			&& (b [4 + tkl] >> 4) == casan::option::MO_Observe)
+	{
+	    int olen = b [4 + tkl] & 0xf ;
+	    int obs = olen == 0 ? 0 : b [5 + tkl] ;
+
+	    std::memcpy (token, b + 4, tkl) ;
+	    toklen = tkl ;
+	    if (obs == 0)
+	    {
+		nreg++ ;
+		serial = 1 ;
+	    }
+	    else
+		ndereg++ ;
+	}
+	ls->send (slave_addr, rep, mkreply (rep, casan::msg::MT_ACK, id, serial,
+				serial == 1 ? "v1" : nullptr)) ;
+    }
+}
+
+/*
+ * Values received by each subscriber
+ */
+
+std::mutex submtx ;
+std::vector <std::string> received [NSUB] ;
+
+void wait (void)
+{
+    std::this_thread::sleep_for (std::chrono::milliseconds (WAIT)) ;
+}
+
+bool check (const char *name, bool ok)
+{
+    std::cout << name << ": " << (ok ? "OK" : "FAILED") << "\n" ;
+    return ok ;
+}
+
+int main (int argc, char *argv [])
+{
+    casan::casan e ;
+    casan::slave s ;
+    casan::slave *sp ;
+    casan::resource res ("/temp") ;
+    casan::l2net_loop *l2 ;
+    loopslave *ls ;
+    int subid [NSUB] ;
+    bool ok, same ;
+
+    (void) argc ; (void) argv ;
+
+    e.timer_first_hello (1) ;
+    e.timer_interval_hello (10) ;
+    e.timer_slave_ttl (3600) ;
+    e.init () ;
+
+    s.slaveid (SID) ;
+    s.init_ttl (3600) ;
+    e.add_slave (&s) ;
+
+    l2 = new casan::l2net_loop ;
+    if (l2->init (casan::l2addr_loop (MASTER)) == -1)
+    {
+	perror ("loopback") ;
+	std::exit (1) ;
+    }
+    ls = new loopslave (l2) ;
+    ls->handler (
+	[ls] (casan::l2addr_loop &daddr, const byte *data, int len)
+	{
+	    slave (ls, daddr, data, len) ;
+	}) ;
+    e.start_net (l2) ;
+
+    sp = e.find_slave (SID) ;
+    ls->discover (slave_addr, SID) ;
+    while (sp->status () != casan::slave::SL_RUNNING)
+	std::this_thread::sleep_for (std::chrono::milliseconds (1)) ;
+
+    /*
+     * Subscribe: the first value is the reply to the registration
+     */
+
+    for (int i = 0 ; i < NSUB ; i++)
+    {
+	subid [i] = e.observe (sp, &res,
+		[i] (casan::msgptr_t r)
+		{
+		    std::unique_lock <std::mutex> lk (submtx) ;
+		    int len ;
+		    char *p = (char *) r->payload (&len) ;
+
+		    received [i].push_back (std::string (p, len)) ;
+		}) ;
+    }
+    wait () ;
+
+    /*
+     * Notifications: as sent by the Arduino implementation (ACK
+     * with a new message id), CON, NON, and an old one
+     */
+
+    notify (ls, casan::msg::MT_ACK, 1001, 2, "v2") ;
+    notify (ls, casan::msg::MT_CON, 1002, 3, "v3") ;
+    notify (ls, casan::msg::MT_NON, 1003, 2, "old") ;
+    notify (ls, casan::msg::MT_NON, 1004, 4, "v4") ;
+    wait () ;
+
+    /*
+     * Unsubscribe, then a notification must be rejected
+     */
+
+    for (int i = 0 ; i < NSUB ; i++)
+	e.unobserve (subid [i]) ;
+    wait () ;
+    notify (ls, casan::msg::MT_CON, 1005, 5, "v5") ;
+    wait () ;
+
+    same = true ;
+    {
+	std::unique_lock <std::mutex> lk (submtx) ;
+	std::vector <std::string> expected = { "v1", "v2", "v3", "v4" } ;
+
+	for (int i = 0 ; i < NSUB ; i++)
+	    if (received [i] != expected)
+		same = false ;
+    }
+
+    ok = true ;
+    ok &= check ("one registration", nreg == 1) ;
+    ok &= check ("notifications delivered", same) ;
+    ok &= check ("CON notification acknowledged", nack == 1) ;
+    ok &= check ("one deregistration", ndereg == 1) ;
+    ok &= check ("late notification rejected", nrst == 1) ;
+    std::cout << e.html_debug () ;
+
+    e.stop () ;
+    delete ls ;
+    l2->term () ;
+    delete l2 ;
+    return ok ? 0 : 1 ;
+}
@@ -28,7 +28,7 @@ int main (int argc, char *argv [])
 {
     casan::l2net *l ;
     casan::l2net_eth *le ;
-    casan::l2addr_eth *sa ;		// slave address
+    casan::l2addr_eth *sa ;		// slave address, freed by the slave
     casan::slave s ;			// slave
     casan::slave sb ;			// pseudo-slave for broadcast
     casan::msg m1, m2 ;
@@ -51,7 +51,7 @@ int main (int argc, char *argv [])
     s.l2 (l) ;
 
     // pseudo-slave for broadcast address
-    sb.addr (&casan::l2addr_eth_broadcast) ;
+    sb.addr (std::shared_ptr <casan::l2addr> (&casan::l2addr_eth_broadcast, [] (casan::l2addr *) {})) ;
     sb.l2 (l) ;
 
     std::cout << IFACE << " initialized for " << ADDR << "\n" ;
@@ -89,6 +89,5 @@ int main (int argc, char *argv [])
     m2.pushoption (ocf) ;
     m2.send () ;
 
-    delete sa ;
     delete l ;
 }
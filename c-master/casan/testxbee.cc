@@ -1,102 +1,168 @@
+/**
+ * @file testxbee.cc
+ * @brief Test of the XBee driver
+ *
+ * This program initializes an XBee and sends frames to two slaves,
+ * without waiting between frames. It should be run with the XBee
+ * emulator (see xbeesim.cc), which echoes frames delivered to the
+ * first slave, and does not deliver frames to the second one:
+ *	./xbeesim -e -d 56:78 /tmp/xbee &
+ *	./testxbee /tmp/xbee
+ * The test checks that:
+ * - the XBee is configured (at the requested speed)
+ * - all frames sent to the first slave are received back
+ * - the frame sent to the second slave is reported as not
+ *	delivered (see l2net::txfail), with its contents
+ *
+ * Usage: testxbee <device> [<baud>]
+ */
+
 #include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
 #include <cstring>
-#include <vector>
 
 #include <stdio.h>
-#include <unistd.h>
-#include <stdlib.h>
+#include <poll.h>
 
 #include "global.h"
+#include "byte.h"
 
 #include "l2.h"
 #include "l2-154.h"
-#include "msg.h"
-#include "resource.h"
-#include "casan.h"
-
-#define IFACE		"ttyUSB0"
-// #define ADDR		"90:a2:da:80:0a:d4"		// arduino
-#define SADDR		"ca:fe"
-#define	PANID		"56:78"
-#define DADDR		"12:34"
+
+#define	MYADDR		"ca:fe"
+#define	PANID		"12:34"
 #define	CHANNEL		25
+#define	ALIVE		"00:42"		// echoed by the emulator
+#define	DEAD		"56:78"		// not delivered by the emulator
+#define	NFRAMES		100
+#define	DEFAULT_BAUD	115200
+#define	WAIT		1000		// ms to wait for frames
 
-#define	PATH_1		".well-known"
-#define	PATH_2		"casan"
+int debug_levels = 0 ;
 
-#define	SLAVE169	"slave=169"
-#define	MTU		"mtu=100"
+const char *debug_title (int)
+{
+    return "" ;
+}
+
+bool check (const char *name, bool ok)
+{
+    std::cout << name << ": " << (ok ? "OK" : "FAILED") << "\n" ;
+    return ok ;
+}
+
+/*
+ * Receive frames (waiting at most ms for each one), and return
+ * the number of frames received from the given source
+ */
+
+int receive (casan::l2net &l2, casan::l2addr &src, int ms)
+{
+    int n = 0 ;
+
+    for (;;)
+    {
+	casan::l2addr *a ;
+	char buf [MAXBUF] ;
+	int len = sizeof buf ;
+	casan::pktype_t t ;
+
+	t = l2.try_recv (&a, buf, &len) ;
+	if (t == casan::PK_AGAIN)
+	{
+	    struct pollfd pfd ;
+
+	    pfd.fd = l2.pollfd () ;
+	    pfd.events = POLLIN ;
+	    if (ms == 0 || poll (&pfd, 1, ms) <= 0)
+		break ;
+	    continue ;
+	}
+	if (a != nullptr)
+	{
+	    if (t == casan::PK_ME && *a == src)
+		n++ ;
+	    delete a ;
+	}
+    }
+
+    return n ;
+}
 
 int main (int argc, char *argv [])
 {
-    casan::l2net *l ;
-    casan::l2net_154 *le ;
-    casan::l2addr_154 *sa ;		// slave address
-    casan::slave s ;			// slave
-    casan::slave sb ;			// pseudo-slave for broadcast
-    casan::msg m1, m2 ;
-    char buf [512] = "" ;
-    std::string iface = "ttyUSB0" ;
-    std::string myaddr = SADDR ;
-    std::string panid = PANID ;
-
-    // start new interface
-    le = new casan::l2net_154 ;
-    if (le->init (iface, "xbee", myaddr, panid, CHANNEL) == -1)
+    casan::l2net_154 l2 ;
+    casan::l2addr_154 alive (ALIVE), dead (DEAD) ;
+    int baud = DEFAULT_BAUD ;
+    int nrecv, nfail ;
+    bool samefail ;
+    char buf [MAXBUF] ;
+    bool ok ;
+
+    if (argc < 2 || argc > 3)
+    {
+	std::cerr << "usage: " << argv [0] << " <device> [<baud>]\n" ;
+	std::exit (1) ;
+    }
+    if (argc == 3)
+	baud = std::atoi (argv [2]) ;
+
+    auto t0 = std::chrono::steady_clock::now () ;
+    ok = check ("init", l2.init (argv [1], "xbee", 0, MYADDR, PANID, CHANNEL, baud) == 0) ;
+    if (! ok)
+    {
+	perror (argv [1]) ;
+	std::exit (1) ;
+    }
+    auto t1 = std::chrono::steady_clock::now () ;
+    std::cout << "initialized in "
+		<< std::chrono::duration_cast <std::chrono::milliseconds> (t1 - t0).count ()
+		<< " ms\n" ;
+
+    nfail = 0 ;
+    samefail = false ;
+    l2.txfail (
+	[&nfail, &samefail, &dead]
+	(casan::l2addr *a, const byte *data, int len)
+	{
+	    nfail++ ;
+	    samefail = *a == dead && len == 4 && std::memcmp (data, "dead", 4) == 0 ;
+	}) ;
+
+    /*
+     * Send all frames without waiting for their status. If the
+     * serial line is busy, or if too many frames are outstanding,
+     * receive in the mean time.
+     */
+
+    nrecv = 0 ;
+    for (int i = 0 ; i <= NFRAMES ; i++)
     {
-	perror ("init") ;
-	exit (1) ;
+	casan::l2addr *d = i < NFRAMES ? &alive : &dead ;
+	int len ;
+
+	if (i < NFRAMES)
+	    len = std::snprintf (buf, sizeof buf, "frame %d", i) ;
+	else
+	    len = std::snprintf (buf, sizeof buf, "dead") ;
+
+	while (l2.send (d, buf, len) == -1)
+	    nrecv += receive (l2, alive, 0) ;
     }
 
-    std::cout << IFACE << " initialized for " << myaddr << "/" << PANID
-			<< " on channel " << CHANNEL << "\n" ;
-    // from now on, use only generic l2net interface
-    l = le ;
-
-    // register new slave
-    sa = new casan::l2addr_154 (DADDR) ;
-    s.addr (sa) ;
-    s.l2 (l) ;
-
-    // pseudo-slave for broadcast address
-    sb.addr (&casan::l2addr_154_broadcast) ;
-    sb.l2 (l) ;
-
-    // sleep (1) ;
-
-    casan::option uri_path1 (casan::option::MO_Uri_Path, (void *) PATH_1, sizeof PATH_1 - 1) ;
-    // casan::option uri_path2 (casan::option::MO_Uri_Path, (void *) PATH_2, sizeof PATH_2 - 1) ;
-    casan::option uri_path2 ;
-
-    uri_path2 = uri_path1 ;
-    uri_path2.optval ((void *) PATH_2, sizeof PATH_2 - 1) ;
-
-    // DISCOVER message
-    m1.type (casan::msg::MT_NON) ;
-    m1.code (casan::msg::MC_POST) ;
-    m1.peer (&sb) ;
-    m1.id (10) ;
-    m1.pushoption (uri_path1) ;
-    m1.pushoption (uri_path2) ;
-    casan::option os (casan::option::MO_Uri_Query, (void *) SLAVE169, sizeof SLAVE169 - 1) ;
-    m1.pushoption (os) ;
-    casan::option os2 (casan::option::MO_Uri_Query, (void *) MTU, sizeof MTU - 1) ;
-    m1.pushoption (os2) ;
-    m1.send () ;
-
-    sleep (2) ;
-
-    // ASSOCIATE answer message
-    std::strcpy (buf, "</test>;title=\"My test\";ct=0,</foo>;if=\"clock\";rt=\"Ticks;title=\"My clock\";ct=0;obs") ;
-    m2.type (casan::msg::MT_ACK) ;		// will not be retransmitted
-    m2.code (COAP_MKCODE (2, 5)) ;
-    m2.peer (&s) ;
-    m2.payload (buf, strlen (buf)) ;
-    m2.id (2) ;
-    casan::option ocf (casan::option::MO_Content_Format, (void *) "abc", sizeof "abc" - 1) ;
-    m2.pushoption (ocf) ;
-    m2.send () ;
-
-    delete sa ;
-    delete l ;
+    /*
+     * Receive remaining echoed frames, and TX_STATUS frames
+     */
+
+    nrecv += receive (l2, alive, WAIT) ;
+
+    ok &= check ("frames echoed", nrecv == NFRAMES) ;
+    ok &= check ("one delivery failure", nfail == 1) ;
+    ok &= check ("failed frame reported", samefail) ;
+
+    l2.term () ;
+    std::exit (ok ? 0 : 1) ;
 }
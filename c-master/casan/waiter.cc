@@ -63,6 +63,13 @@ void waiter::do_and_wait (action_t a, timepoint_t max)
 
 void waiter::wakeup (void)
 {
+    /*
+     * Take the lock, in order to not wake the thread up before it
+     * waits (i.e. while it is performing its action).
+     */
+
+    std::unique_lock <std::mutex> lk (mtx_) ;
+
     condvar_.notify_all () ;
 }
 
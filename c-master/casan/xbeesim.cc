@@ -0,0 +1,276 @@
+/**
+ * @file xbeesim.cc
+ * @brief XBee emulator on a pseudo-terminal
+ *
+ * This program emulates an XBee USB stick (802.15.4 firmware), in
+ * order to test the l2net_154 driver (and the CASAN master) without
+ * hardware. It creates a pseudo-terminal and a symbolic link to it,
+ * which can be used as the device of an 802.15.4 network.
+ *
+ * The emulator understands:
+ * - "+++" to enter AT command mode, after the guard time (option -g)
+ * - AT commands (each one is answered by OK), ATCN to leave the
+ *	command mode: API mode is used if ATAP1 has been received
+ * - in API mode, TX requests with 16-bit addresses: a TX_STATUS
+ *	frame is returned for each request with a frame id.
+ *	Delivery fails (status 1, no ACK) for destinations given
+ *	with option -d.
+ *	With option -e, each frame delivered to a unicast destination
+ *	is echoed back, as if it was sent by the destination.
+ *
+ * Addresses are written as in the CASAN configuration file (ab:cd).
+ *
+ * Usage: xbeesim [-e] [-g <guard time in ms>] [-d <addr>]... <link>
+ */
+
+#include <iostream>
+#include <string>
+#include <set>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "global.h"
+#include "byte.h"
+
+#define	XBEE_START	0x7e
+#define	XBEE_TX_SHORT	0x01
+#define	XBEE_RX_SHORT	0x81
+#define	XBEE_TX_STATUS	0x89
+#define	STATUS_OK	0
+#define	STATUS_NOACK	1
+#define	BCAST		0xffff
+#define	RSSI		0x28
+
+enum mode { TRANSPARENT, COMMAND, API } ;
+
+int fd ;				// master side of the pseudo-terminal
+bool echo = false ;			// echo delivered frames
+int guard = 0 ;				// guard time (ms)
+std::set <int> dead ;			// unreachable destinations
+
+mode curmode = TRANSPARENT ;
+bool apimode = false ;			// ATAP1 received
+std::string line ;			// current AT command
+byte frame [MAXBUF] ;			// current API frame
+int framelen = 0 ;
+int nplus = 0 ;				// consecutive '+'
+
+void usage (const char *prog)
+{
+    std::cerr << "usage: " << prog
+		<< " [-e] [-g <guard time in ms>] [-d <addr>]... <link>\n" ;
+    std::exit (1) ;
+}
+
+// address as in the configuration file, in the order of API frames
+int parse_addr (const char *s)
+{
+    unsigned int hi, lo ;
+
+    if (std::sscanf (s, "%x:%x", &hi, &lo) != 2)
+	return -1 ;
+    return (lo << 8) | hi ;
+}
+
+void output (const void *data, int len)
+{
+    const byte *b = (const byte *) data ;
+
+    while (len > 0)
+    {
+	int r = write (fd, b, len) ;
+
+	if (r > 0)
+	{
+	    b += r ;
+	    len -= r ;
+	}
+	else
+	{
+	    struct pollfd pfd ;
+
+	    pfd.fd = fd ;
+	    pfd.events = POLLOUT ;
+	    (void) poll (&pfd, 1, 100) ;
+	}
+    }
+}
+
+void send_frame (const byte *data, int len)
+{
+    byte buf [MAXBUF] ;
+    int c = 0 ;
+
+    buf [0] = XBEE_START ;
+    buf [1] = BYTE_HIGH (len) ;
+    buf [2] = BYTE_LOW (len) ;
+    std::memcpy (buf + 3, data, len) ;
+    for (int i = 0 ; i < len ; i++)
+	c = (c + data [i]) & 0xff ;
+    buf [3 + len] = 0xff - c ;
+    output (buf, len + 4) ;
+}
+
+// TX request: return status, and echo the frame if requested
+void tx_request (const byte *d, int len)
+{
+    int id = d [1] ;
+    int dst = INT16 (d [2], d [3]) ;
+    int status = dead.count (dst) ? STATUS_NOACK : STATUS_OK ;
+    byte buf [MAXBUF] ;
+
+    if (status == STATUS_OK && echo && dst != BCAST)
+    {
+	buf [0] = XBEE_RX_SHORT ;
+	buf [1] = d [2] ;		// source = destination
+	buf [2] = d [3] ;
+	buf [3] = RSSI ;
+	buf [4] = 0 ;			// options: not a broadcast
+	std::memcpy (buf + 5, d + 5, len - 5) ;
+	send_frame (buf, len) ;
+    }
+
+    if (id != 0)
+    {
+	buf [0] = XBEE_TX_STATUS ;
+	buf [1] = id ;
+	buf [2] = status ;
+	send_frame (buf, 3) ;
+    }
+}
+
+void at_command (void)
+{
+    std::cout << line << "\n" ;
+    if (line == "ATAP1")
+	apimode = true ;
+    output ("OK\r", 3) ;
+    if (line == "ATCN")
+	curmode = apimode ? API : TRANSPARENT ;
+    line.clear () ;
+}
+
+// receive a byte from the driver
+void input (byte c)
+{
+    switch (curmode)
+    {
+	case COMMAND :
+	    if (c == '\r')
+		at_command () ;
+	    else
+		line += (char) c ;
+	    return ;
+
+	case API :
+	    if (framelen > 0 || c == XBEE_START)
+	    {
+		frame [framelen++] = c ;
+		if (framelen >= 3 && framelen == INT16 (frame [1], frame [2]) + 4)
+		{
+		    if (frame [3] == XBEE_TX_SHORT && framelen >= 9)
+			tx_request (frame + 3, framelen - 4) ;
+		    framelen = 0 ;
+		}
+		else if (framelen == MAXBUF)
+		    framelen = 0 ;
+		return ;
+	    }
+	    break ;
+
+	case TRANSPARENT :
+	    break ;
+    }
+
+    // "+++" outside of frames: enter command mode
+    nplus = c == '+' ? nplus + 1 : 0 ;
+    if (nplus == 3)
+    {
+	std::this_thread::sleep_for (std::chrono::milliseconds (guard)) ;
+	output ("OK\r", 3) ;
+	curmode = COMMAND ;
+	nplus = 0 ;
+    }
+}
+
+int main (int argc, char *argv [])
+{
+    const char *link ;
+    struct termios tm ;
+    int opt, sfd ;
+
+    while ((opt = getopt (argc, argv, "eg:d:")) != -1)
+    {
+	switch (opt)
+	{
+	    case 'e' :
+		echo = true ;
+		break ;
+	    case 'g' :
+		guard = std::atoi (optarg) ;
+		break ;
+	    case 'd' :
+		if (parse_addr (optarg) == -1)
+		    usage (argv [0]) ;
+		dead.insert (parse_addr (optarg)) ;
+		break ;
+	    default :
+		usage (argv [0]) ;
+	}
+    }
+    if (optind != argc - 1)
+	usage (argv [0]) ;
+    link = argv [optind] ;
+
+    fd = posix_openpt (O_RDWR | O_NOCTTY) ;
+    if (fd == -1 || grantpt (fd) == -1 || unlockpt (fd) == -1)
+    {
+	perror ("posix_openpt") ;
+	std::exit (1) ;
+    }
+
+    // keep the slave side open: the driver may close and reopen it
+    sfd = open (ptsname (fd), O_RDWR | O_NOCTTY) ;
+    if (sfd == -1 || tcgetattr (sfd, &tm) == -1)
+    {
+	perror (ptsname (fd)) ;
+	std::exit (1) ;
+    }
+    cfmakeraw (&tm) ;
+    (void) tcsetattr (sfd, TCSANOW, &tm) ;
+
+    (void) unlink (link) ;
+    if (symlink (ptsname (fd), link) == -1)
+    {
+	perror (link) ;
+	std::exit (1) ;
+    }
+    std::cout << "XBee emulated on " << link << "\n" << std::flush ;
+
+    for (;;)
+    {
+	byte buf [MAXBUF] ;
+	int n ;
+
+	n = read (fd, buf, sizeof buf) ;
+	if (n == -1)
+	{
+	    perror ("read") ;
+	    break ;
+	}
+	for (int i = 0 ; i < n ; i++)
+	    input (buf [i]) ;
+	std::cout << std::flush ;
+    }
+
+    (void) unlink (link) ;
+    std::exit (1) ;
+}
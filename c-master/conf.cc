@@ -89,6 +89,28 @@ std::ostream& operator<< (std::ostream &os, const conf &cf)
 	    }
 	    os << "timer " << p << " " << cf.timers [i] << "\n" ;
 	}
+	for (int i = 0 ; i < NTAB (cf.limits) ; i++)
+	{
+	    const char *p ;
+	    switch (i)
+	    {
+		case conf::I_LIMIT_DEDUP :
+		    p = "dedup" ;
+		    break ;
+		case conf::I_LIMIT_CACHE :
+		    p = "cache" ;
+		    break ;
+		case conf::I_LIMIT_RING :
+		    p = "ring" ;
+		    break ;
+		case conf::I_LIMIT_NSTART :
+		    p = "nstart" ;
+		    break ;
+	    }
+	    os << "limit " << p << " " << cf.limits [i] << "\n" ;
+	}
+	os << "engine " << (cf.evloop ? "eventloop" : "threads") << "\n" ;
+	os << "engine shards " << cf.shards << "\n" ;
 	for (auto &n : cf.netlist_)
 	{
 	    os << "network " ;
@@ -98,14 +120,18 @@ std::ostream& operator<< (std::ostream &os, const conf &cf)
 		    os << "ethernet " << n.net_eth.iface
 			<< " ethertype 0x"
 				<< std::hex << n.net_eth.ethertype << std::dec ;
+		    if (n.net_eth.ring != 0)
+			os << " ring " << n.net_eth.ring ;
 		    break ;
 		case conf::NET_154 :
-		    os << "802.15.4" << n.net_eth.iface
+		    os << "802.15.4 " << n.net_154.iface
 			<< " type " << (n.net_154.type == conf::NET_154_XBEE ? "xbee" : "(none)")
 			<< " addr " << n.net_154.addr
 			<< " panid " << n.net_154.panid
 			<< " channel " << n.net_154.channel
 			;
+		    if (n.net_154.baud != 0)
+			os << " baud " << n.net_154.baud ;
 		    break ;
 		default :
 		    os << "(unrecognized network)\n" ;
@@ -148,21 +174,25 @@ std::string conf::html_debug (void)
 #define	HELP_TIMER	3
 #define	HELP_NETWORK	4
 #define	HELP_SLAVE	5
-#define	HELP_NETETH	(HELP_SLAVE+1)
+#define	HELP_LIMIT	6
+#define	HELP_ENGINE	7
+#define	HELP_NETETH	(HELP_ENGINE+1)
 #define	HELP_NET154	(HELP_NETETH+1)
 
 static const char *syntax_help [] =
 {
-    "http-server, namespace, timer, network, or slave",
+    "http-server, namespace, timer, network, slave, limit, or engine",
 
     "http-server [listen <addr>] [port <num>] [threads <num>]",
     "namespace <admin|casan|well-known> <path>",
     "timer <firsthello|hello|slavettl|http> <value in s>",
     "network <ethernet|802.15.4> ...",
     "slave id <id> [ttl <timeout in s>] [mtu <bytes>]",
+    "limit <dedup|cache|ring|nstart> <value>",
+    "engine <threads|eventloop|shards <num>>",
 
-    "network ethernet <iface> [mtu <bytes>] [ethertype [0x]<val>]",
-    "network 802.15.4 <iface> type <xbee> addr <addr> panid <id> [channel <chan>] [mtu <bytes>]",
+    "network ethernet <iface> [mtu <bytes>] [ethertype [0x]<val>] [ring <blocks>]",
+    "network 802.15.4 <iface> type <xbee> addr <addr> panid <id> [channel <chan>] [mtu <bytes>] [baud <bps>]",
 } ;
 
 bool conf::parse_file (void)
@@ -363,6 +393,77 @@ bool conf::parse_line (std::string &line)
 		}
 	    }
 	}
+	else if (tokens [i] == "limit")
+	{
+	    i++ ;
+
+	    if (i + 2 != asize)
+	    {
+		parse_error_num_token (asize, HELP_LIMIT) ;
+		r = false ;
+	    }
+	    else
+	    {
+		int idx ;
+
+		if (tokens [i] == "dedup")
+		    idx = I_LIMIT_DEDUP ;
+		else if (tokens [i] == "cache")
+		    idx = I_LIMIT_CACHE ;
+		else if (tokens [i] == "ring")
+		    idx = I_LIMIT_RING ;
+		else if (tokens [i] == "nstart")
+		    idx = I_LIMIT_NSTART ;
+		else
+		    idx = -1 ;
+
+		if (idx == -1)
+		{
+		    parse_error_unk_token (tokens [i], HELP_LIMIT) ;
+		    r = false ;
+		}
+		else if (! limit_set_ [idx])	// defaults are set on each line
+		{
+		    i++ ;
+		    limits [idx] = std::stol (tokens [i]) ;
+		    limit_set_ [idx] = true ;
+		}
+		else
+		{
+		    parse_error_dup_token (tokens [i], HELP_LIMIT) ;
+		    r = false ;
+		}
+	    }
+	}
+	else if (tokens [i] == "engine")
+	{
+	    i++ ;
+
+	    if (i + 2 == asize && tokens [i] == "shards")
+	    {
+		i++ ;
+		shards = std::stoi (tokens [i]) ;
+		if (shards < 1)
+		{
+		    parse_error_unk_token (tokens [i], HELP_ENGINE) ;
+		    r = false ;
+		}
+	    }
+	    else if (i + 1 != asize)
+	    {
+		parse_error_num_token (asize, HELP_ENGINE) ;
+		r = false ;
+	    }
+	    else if (tokens [i] == "threads")
+		evloop = false ;
+	    else if (tokens [i] == "eventloop")
+		evloop = true ;
+	    else
+	    {
+		parse_error_unk_token (tokens [i], HELP_ENGINE) ;
+		r = false ;
+	    }
+	}
 	else if (tokens [i] == "network")
 	{
 	    cf_network c ;
@@ -414,6 +515,16 @@ bool conf::parse_line (std::string &line)
 					is >> c.net_eth.ethertype ;
 				}
 			    }
+			    else if (tokens [i] == "ring")
+			    {
+				if (c.net_eth.ring != 0)
+				{
+				    parse_error_dup_token (tokens [i], HELP_NETETH) ;
+				    r = false ;
+				    break ;
+				}
+				else c.net_eth.ring = std::stoi (tokens [i+1]) ;
+			    }
 			    else
 			    {
 				parse_error_unk_token (tokens [i], HELP_NETETH) ;
@@ -447,6 +558,7 @@ bool conf::parse_line (std::string &line)
 		    c.net_154.addr = "" ;
 		    c.net_154.panid = "" ;
 		    c.net_154.channel = 0 ;
+		    c.net_154.baud = 0 ;
 		    i++ ;
 
 		    if (i < asize)
@@ -516,6 +628,16 @@ bool conf::parse_line (std::string &line)
 				}
 				else c.net_154.channel = std::stoi (tokens [i+1]) ;
 			    }
+			    else if (tokens [i] == "baud")
+			    {
+				if (c.net_154.baud != 0)
+				{
+				    parse_error_dup_token (tokens [i], HELP_NET154) ;
+				    r = false ;
+				    break ;
+				}
+				else c.net_154.baud = std::stoi (tokens [i+1]) ;
+			    }
 			    else
 			    {
 				parse_error_unk_token (tokens [i], HELP_NET154) ;
@@ -636,6 +758,15 @@ bool conf::parse_line (std::string &line)
     if (timers [I_SLAVE_TTL] == 0)
 	timers [I_SLAVE_TTL] = DEFAULT_SLAVE_TTL ;
 
+    if (limits [I_LIMIT_DEDUP] == 0)
+	limits [I_LIMIT_DEDUP] = DEFAULT_LIMIT_DEDUP ;
+    if (limits [I_LIMIT_CACHE] == 0)
+	limits [I_LIMIT_CACHE] = DEFAULT_LIMIT_CACHE ;
+    if (limits [I_LIMIT_RING] == 0)
+	limits [I_LIMIT_RING] = DEFAULT_LIMIT_RING ;
+    if (limits [I_LIMIT_NSTART] == 0)
+	limits [I_LIMIT_NSTART] = DEFAULT_LIMIT_NSTART ;
+
     for (auto &s : slavelist_)
 	if (s.ttl == 0)
 	    s.ttl = timers [I_SLAVE_TTL] ;
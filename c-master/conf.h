@@ -46,6 +46,20 @@ class conf
 	} ;
 	casantimer_t timers [I_LAST] ;
 
+	/// size limits
+	enum cf_limit_index {
+	    I_LIMIT_DEDUP = 0,		///< max # of msg in dedup set per network
+	    I_LIMIT_CACHE = 1,		///< max size of the cache (bytes)
+	    I_LIMIT_RING = 2,		///< receive ring size per network
+	    I_LIMIT_NSTART = 3,		///< outstanding CON msg per slave
+	    I_LIMIT_LAST = 4		///< last value
+	} ;
+	long int limits [I_LIMIT_LAST] = { 0 } ;
+
+	/// engine mode
+	bool evloop = false ;		///< event loop (else threads)
+	int shards = 1 ;		///< number of engines (see casan::shards)
+
 	/// HTTP server configuration
 	struct cf_http
 	{
@@ -70,6 +84,7 @@ class conf
 	{
 	    std::string iface ;		///< interface name (see `netstat -i`)
 	    int ethertype = 0 ;		///< frame type
+	    int ring = 0 ;		///< blocks in the receive ring (0: none)
 	} ;
 	/// IEEE 802.15.4 type (i.e. type of interface)
 	enum net_154_type { NET_154_NONE, NET_154_XBEE } ;
@@ -81,6 +96,7 @@ class conf
 	    std::string addr ;		///< short or long addr: ab:cd[:ef:ab:cd:ef:ab:cd]
 	    std::string panid ;		///< in hex [ab:cd]
 	    int channel ;
+	    int baud ;			///< serial line speed (0: default)
 	} ;
 	/// network configuration
 	struct cf_network
@@ -105,6 +121,7 @@ class conf
     private:
 	std::string file_ ;		// parsed file
 	int lineno_ = 0 ;		// parsed line
+	bool limit_set_ [I_LIMIT_LAST] = { false } ; // limit statement seen
 
 	bool parse_file (void) ;
 	bool parse_line (std::string &line) ;
@@ -118,6 +135,11 @@ class conf
 	const casantimer_t DEFAULT_INTERVAL_HELLO = 10 ;	// 10 s
 	const casantimer_t DEFAULT_SLAVE_TTL	= 3600 ;	// 1 h
 
+	const long int DEFAULT_LIMIT_DEDUP	= 10000 ;	// messages
+	const long int DEFAULT_LIMIT_CACHE	= 4194304 ;	// 4 MB
+	const long int DEFAULT_LIMIT_RING	= 8192 ;	// messages
+	const long int DEFAULT_LIMIT_NSTART	= 4 ;		// messages
+
 	const char *DEFAULT_HTTP_PORT		= "http" ;
 	const char *DEFAULT_HTTP_LISTEN		= "*" ;
 	const int DEFAULT_HTTP_THREADS		= 5 ;
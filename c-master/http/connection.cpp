@@ -10,17 +10,35 @@
 
 #include "connection.hpp"
 #include <vector>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
 #include <boost/bind.hpp>
 #include "request_handler.hpp"
 
 namespace http {
 namespace server2 {
 
+const int connection::idle_timeout;
+const std::size_t connection::max_chunks;
+
 connection::connection(asio::io_service& io_service,
     request_handler& handler)
-  : socket_(io_service),
-    request_handler_(handler)
+  : io_service_(io_service),
+    socket_(io_service),
+    request_handler_(handler),
+    timer_(io_service),
+    begin_(0),
+    end_(0),
+    keep_alive_(false),
+    streaming_(false),
+    chunked_(false)
+{
+}
+
+connection::~connection()
 {
+  stop_stream();
 }
 
 asio::ip::tcp::socket& connection::socket()
@@ -30,7 +48,38 @@ asio::ip::tcp::socket& connection::socket()
 
 void connection::start()
 {
-  socket_.async_read_some(asio::buffer(buffer_),
+  // Replies to pipelined requests are sent back to back: do not let
+  // Nagle's algorithm delay them until the previous one is acked.
+  asio::error_code ignored_ec;
+  socket_.set_option(asio::ip::tcp::no_delay(true), ignored_ec);
+  read_more();
+}
+
+void connection::read_more()
+{
+  // Keep unparsed data (the beginning of a request) at the beginning of
+  // the buffer, since the parser refers to it, and read after it.
+  if (begin_ > 0)
+  {
+    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  if (end_ == buffer_.size())
+  {
+    // Request line and headers do not fit in the buffer.
+    reply_ = reply::stock_reply(reply::bad_request);
+    keep_alive_ = false;
+    write_reply();
+    return;
+  }
+
+  timer_.expires_from_now(std::chrono::seconds(idle_timeout));
+  timer_.async_wait(boost::bind(&connection::handle_timeout,
+        shared_from_this(), asio::placeholders::error));
+
+  socket_.async_read_some(
+      asio::buffer(buffer_.data() + end_, buffer_.size() - end_),
       boost::bind(&connection::handle_read, shared_from_this(),
         asio::placeholders::error,
         asio::placeholders::bytes_transferred));
@@ -41,31 +90,9 @@ void connection::handle_read(const asio::error_code& e,
 {
   if (!e)
   {
-    boost::tribool result;
-    boost::tie(result, boost::tuples::ignore) = request_parser_.parse(
-        request_, buffer_.data(), buffer_.data() + bytes_transferred);
-
-    if (result)
-    {
-      request_handler_.handle_request(request_, reply_);
-      asio::async_write(socket_, reply_.to_buffers(),
-          boost::bind(&connection::handle_write, shared_from_this(),
-            asio::placeholders::error));
-    }
-    else if (!result)
-    {
-      reply_ = reply::stock_reply(reply::bad_request);
-      asio::async_write(socket_, reply_.to_buffers(),
-          boost::bind(&connection::handle_write, shared_from_this(),
-            asio::placeholders::error));
-    }
-    else
-    {
-      socket_.async_read_some(asio::buffer(buffer_),
-          boost::bind(&connection::handle_read, shared_from_this(),
-            asio::placeholders::error,
-            asio::placeholders::bytes_transferred));
-    }
+    timer_.cancel();
+    end_ += bytes_transferred;
+    process();
   }
 
   // If an error occurs then no new asynchronous operations are started. This
@@ -74,10 +101,136 @@ void connection::handle_read(const asio::error_code& e,
   // handler returns. The connection class's destructor closes the socket.
 }
 
+void connection::process()
+{
+  boost::tribool result;
+  char* next;
+  boost::tie(result, next) = request_parser_.parse(
+      request_, buffer_.data() + begin_, buffer_.data() + end_);
+  begin_ = next - buffer_.data();
+
+  if (result)
+  {
+    keep_alive_ = wants_keep_alive(request_);
+    request_handler_.handle_request(request_, reply_,
+        boost::bind(&connection::complete, shared_from_this(), _1));
+  }
+  else if (!result)
+  {
+    reply_ = reply::stock_reply(reply::bad_request);
+    keep_alive_ = false;
+    write_reply();
+  }
+  else
+  {
+    read_more();
+  }
+}
+
+void connection::handle_timeout(const asio::error_code& e)
+{
+  // The timer may have been restarted after it expired: only close
+  // the connection if the deadline is really over.
+  if (e != asio::error::operation_aborted
+      && timer_.expires_at() <= asio::steady_timer::clock_type::now())
+  {
+    asio::error_code ignored_ec;
+    socket_.close(ignored_ec);
+  }
+}
+
+bool connection::wants_keep_alive(const request& req)
+{
+  // HTTP/1.1 connections persist by default, HTTP/1.0 ones only
+  // if explicitly requested.
+  bool keep = req.http_version_major > 1
+    || (req.http_version_major == 1 && req.http_version_minor >= 1);
+  for (std::size_t i = 0; i < req.headers.size(); ++i)
+  {
+    const request_header& h = req.headers[i];
+    if (request_parser::iequals(h.name, "Connection"))
+    {
+      if (request_parser::iequals(h.value, "close"))
+        keep = false;
+      else if (request_parser::iequals(h.value, "keep-alive"))
+        keep = true;
+    }
+  }
+  return keep;
+}
+
+void connection::complete(std::function<void ()> finish)
+{
+  // The reply may be completed by another thread: go back to our
+  // io_service before touching the reply and the socket.
+  io_service_.post(boost::bind(&connection::handle_complete,
+        shared_from_this(), finish));
+}
+
+void connection::handle_complete(std::function<void ()> finish)
+{
+  if (finish)
+    finish();
+  write_reply();
+}
+
+void connection::write_reply()
+{
+  // A reply to HEAD has the headers of a reply to GET, without content.
+  bool head = request_.method == boost::string_ref("HEAD");
+  header h;
+  if (reply_.stream && head)
+  {
+    // The stream is not started: the end of the (empty) content is
+    // the connection closure.
+    reply_.stream.reset();
+    keep_alive_ = false;
+  }
+  else if (reply_.stream)
+  {
+    // The stream only ends when the connection is closed.
+    keep_alive_ = false;
+    chunked_ = request_.http_version_major > 1
+      || (request_.http_version_major == 1 && request_.http_version_minor >= 1);
+    if (chunked_)
+    {
+      h.name = "Transfer-Encoding";
+      h.value = "chunked";
+      reply_.headers.push_back(h);
+    }
+  }
+  h.name = "Connection";
+  h.value = keep_alive_ ? "keep-alive" : "close";
+  reply_.headers.push_back(h);
+  asio::async_write(socket_, reply_.to_buffers(!head),
+      boost::bind(&connection::handle_write, shared_from_this(),
+        asio::placeholders::error));
+}
+
 void connection::handle_write(const asio::error_code& e)
 {
   if (!e)
   {
+    if (reply_.stream)
+    {
+      start_stream();
+      return;
+    }
+
+    if (keep_alive_)
+    {
+      // Get ready for the next request, which may already be in
+      // the buffer if the client pipelines its requests.
+      request_ = request();
+      reply_ = reply();
+      request_parser_.reset();
+      if (begin_ < end_)
+        process();
+      else
+        read_more();
+      return;
+    }
+
     // Initiate graceful connection closure.
     asio::error_code ignored_ec;
     socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ignored_ec);
@@ -89,5 +242,95 @@ void connection::handle_write(const asio::error_code& e)
   // destructor closes the socket.
 }
 
+void connection::start_stream()
+{
+  // Nothing is expected from the client, but reading tells us when it
+  // closes the connection. The idle timer is not used.
+  streaming_ = true;
+  socket_.async_read_some(asio::buffer(buffer_),
+      boost::bind(&connection::handle_stream_read, shared_from_this(),
+        asio::placeholders::error));
+
+  // The writer must not keep the connection alive.
+  boost::weak_ptr<connection> weak(shared_from_this());
+  reply_.stream->start(boost::bind(&connection::stream_write, weak, _1));
+}
+
+void connection::stream_write(boost::weak_ptr<connection> weak,
+    const std::string& data)
+{
+  // An empty chunk would end the chunked content.
+  connection_ptr c = weak.lock();
+  if (c && !data.empty())
+    c->io_service_.post(boost::bind(&connection::handle_stream_write,
+          c, data));
+}
+
+void connection::handle_stream_write(const std::string& data)
+{
+  if (!streaming_)
+    return;
+
+  if (chunks_.size() >= max_chunks)
+  {
+    // The client does not read fast enough: give up.
+    stop_stream();
+    return;
+  }
+
+  if (chunked_)
+  {
+    char len[20];
+    std::snprintf(len, sizeof len, "%lx\r\n",
+        static_cast<unsigned long>(data.size()));
+    chunks_.push_back(len + data + "\r\n");
+  }
+  else
+    chunks_.push_back(data);
+
+  if (chunks_.size() == 1)
+    write_chunk();
+}
+
+void connection::write_chunk()
+{
+  asio::async_write(socket_, asio::buffer(chunks_.front()),
+      boost::bind(&connection::handle_chunk_write, shared_from_this(),
+        asio::placeholders::error));
+}
+
+void connection::handle_chunk_write(const asio::error_code& e)
+{
+  if (e)
+  {
+    stop_stream();
+    return;
+  }
+  chunks_.pop_front();
+  if (!chunks_.empty())
+    write_chunk();
+}
+
+void connection::handle_stream_read(const asio::error_code& e)
+{
+  if (!e)
+    socket_.async_read_some(asio::buffer(buffer_),
+        boost::bind(&connection::handle_stream_read, shared_from_this(),
+          asio::placeholders::error));
+  else
+    stop_stream();
+}
+
+void connection::stop_stream()
+{
+  if (streaming_)
+  {
+    streaming_ = false;
+    reply_.stream->stop();
+    asio::error_code ignored_ec;
+    socket_.close(ignored_ec);
+  }
+}
+
 } // namespace server2
 } // namespace http
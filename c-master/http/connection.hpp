@@ -12,9 +12,12 @@
 #define HTTP_SERVER2_CONNECTION_HPP
 
 #include <asio.hpp>
+#include <functional>
+#include <deque>
 #include <boost/array.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include "reply.hpp"
 #include "request.hpp"
@@ -34,29 +37,93 @@ public:
   explicit connection(asio::io_service& io_service,
       request_handler& handler);
 
+  /// Stop the stream of the reply, if any.
+  ~connection();
+
   /// Get the socket associated with the connection.
   asio::ip::tcp::socket& socket();
 
   /// Start the first asynchronous operation for the connection.
   void start();
 
+  /// Seconds to wait for the next request on a persistent connection.
+  static const int idle_timeout = 15;
+
+  /// Maximum number of stream chunks waiting to be sent to a slow client.
+  static const std::size_t max_chunks = 64;
+
 private:
+  /// Wait for more data from the client.
+  void read_more();
+
   /// Handle completion of a read operation.
   void handle_read(const asio::error_code& e,
       std::size_t bytes_transferred);
 
+  /// Parse buffered data and handle the request, if complete.
+  void process();
+
+  /// Close the connection if it has been idle for too long.
+  void handle_timeout(const asio::error_code& e);
+
+  /// Check if the client wants the connection to persist.
+  static bool wants_keep_alive(const request& req);
+
+  /// Send the reply.
+  void write_reply();
+
+  /// Handle completion of a request (from any thread).
+  void complete(std::function<void ()> finish);
+
+  /// Finish the reply and send it.
+  void handle_complete(std::function<void ()> finish);
+
   /// Handle completion of a write operation.
   void handle_write(const asio::error_code& e);
 
+  /// Start the stream of the reply, once the headers have been sent.
+  void start_stream();
+
+  /// Send a piece of stream content (from any thread).
+  static void stream_write(boost::weak_ptr<connection> weak,
+      const std::string& data);
+
+  /// Queue a piece of stream content.
+  void handle_stream_write(const std::string& data);
+
+  /// Send the first queued piece of stream content.
+  void write_chunk();
+
+  /// Handle completion of a stream write operation.
+  void handle_chunk_write(const asio::error_code& e);
+
+  /// Handle data received while streaming (ignored) or connection closure.
+  void handle_stream_read(const asio::error_code& e);
+
+  /// Stop the stream and close the connection.
+  void stop_stream();
+
+  /// The io_service used to finish replies.
+  asio::io_service& io_service_;
+
   /// Socket for the connection.
   asio::ip::tcp::socket socket_;
 
   /// The handler used to process the incoming request.
   request_handler& request_handler_;
 
+  /// Timer to close idle persistent connections.
+  asio::steady_timer timer_;
+
   /// Buffer for incoming data.
   boost::array<char, 8192> buffer_;
 
+  /// Unparsed data in the buffer (pipelined requests).
+  std::size_t begin_, end_;
+
+  /// True if the connection persists after the current reply.
+  bool keep_alive_;
+
   /// The incoming request.
   request request_;
 
@@ -65,6 +132,15 @@ private:
 
   /// The reply to be sent back to the client.
   reply reply_;
+
+  /// True while the stream of the reply is running.
+  bool streaming_;
+
+  /// True if stream content is sent with the chunked transfer encoding.
+  bool chunked_;
+
+  /// Stream content waiting to be sent (the first one is being sent).
+  std::deque<std::string> chunks_;
 };
 
 typedef boost::shared_ptr<connection> connection_ptr;
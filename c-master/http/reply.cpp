@@ -10,6 +10,7 @@
 
 #include "reply.hpp"
 #include <string>
+#include <cstring>
 #include <boost/lexical_cast.hpp>
 
 namespace http {
@@ -18,37 +19,37 @@ namespace server2 {
 namespace status_strings {
 
 const std::string ok =
-  "HTTP/1.0 200 OK\r\n";
+  "HTTP/1.1 200 OK\r\n";
 const std::string created =
-  "HTTP/1.0 201 Created\r\n";
+  "HTTP/1.1 201 Created\r\n";
 const std::string accepted =
-  "HTTP/1.0 202 Accepted\r\n";
+  "HTTP/1.1 202 Accepted\r\n";
 const std::string no_content =
-  "HTTP/1.0 204 No Content\r\n";
+  "HTTP/1.1 204 No Content\r\n";
 const std::string multiple_choices =
-  "HTTP/1.0 300 Multiple Choices\r\n";
+  "HTTP/1.1 300 Multiple Choices\r\n";
 const std::string moved_permanently =
-  "HTTP/1.0 301 Moved Permanently\r\n";
+  "HTTP/1.1 301 Moved Permanently\r\n";
 const std::string moved_temporarily =
-  "HTTP/1.0 302 Moved Temporarily\r\n";
+  "HTTP/1.1 302 Moved Temporarily\r\n";
 const std::string not_modified =
-  "HTTP/1.0 304 Not Modified\r\n";
+  "HTTP/1.1 304 Not Modified\r\n";
 const std::string bad_request =
-  "HTTP/1.0 400 Bad Request\r\n";
+  "HTTP/1.1 400 Bad Request\r\n";
 const std::string unauthorized =
-  "HTTP/1.0 401 Unauthorized\r\n";
+  "HTTP/1.1 401 Unauthorized\r\n";
 const std::string forbidden =
-  "HTTP/1.0 403 Forbidden\r\n";
+  "HTTP/1.1 403 Forbidden\r\n";
 const std::string not_found =
-  "HTTP/1.0 404 Not Found\r\n";
+  "HTTP/1.1 404 Not Found\r\n";
 const std::string internal_server_error =
-  "HTTP/1.0 500 Internal Server Error\r\n";
+  "HTTP/1.1 500 Internal Server Error\r\n";
 const std::string not_implemented =
-  "HTTP/1.0 501 Not Implemented\r\n";
+  "HTTP/1.1 501 Not Implemented\r\n";
 const std::string bad_gateway =
-  "HTTP/1.0 502 Bad Gateway\r\n";
+  "HTTP/1.1 502 Bad Gateway\r\n";
 const std::string service_unavailable =
-  "HTTP/1.0 503 Service Unavailable\r\n";
+  "HTTP/1.1 503 Service Unavailable\r\n";
 
 asio::const_buffer to_buffer(reply::status_type status)
 {
@@ -100,10 +101,65 @@ const char crlf[] = { '\r', '\n' };
 
 } // namespace misc_strings
 
-std::vector<asio::const_buffer> reply::to_buffers()
+void reply::set_content(std::shared_ptr<const void> owner,
+    const void* data, std::size_t size)
+{
+  content_owner_ = owner;
+  content_ref_ = asio::buffer(data, size);
+  content.clear();
+
+  // Format "Content-Length: <size>\r\n" without any allocation.
+  char digits[20];
+  int n = 0;
+  do
+  {
+    digits[n++] = '0' + size % 10;
+    size /= 10;
+  } while (size != 0);
+  const char name[] = "Content-Length: ";
+  std::memcpy(content_length_, name, sizeof name - 1);
+  char* p = content_length_ + sizeof name - 1;
+  while (n > 0)
+    *p++ = digits[--n];
+  *p++ = '\r';
+  *p++ = '\n';
+  *p = '\0';
+}
+
+void reply::set_rendered(std::shared_ptr<const std::string> rendered)
+{
+  rendered_ = rendered;
+  rendered_head_ = rendered->find("\r\n\r\n") + 2;
+}
+
+std::shared_ptr<const std::string> reply::render()
+{
+  std::vector<asio::const_buffer> buffers = to_buffers();
+  std::shared_ptr<std::string> r = std::make_shared<std::string>();
+  r->reserve(asio::buffer_size(buffers));
+  for (std::size_t i = 0; i < buffers.size(); ++i)
+    r->append(asio::buffer_cast<const char*>(buffers[i]),
+        asio::buffer_size(buffers[i]));
+  return r;
+}
+
+std::vector<asio::const_buffer> reply::to_buffers(bool with_content)
 {
   std::vector<asio::const_buffer> buffers;
-  buffers.push_back(status_strings::to_buffer(status));
+  buffers.reserve(5 + 4 * headers.size());
+  if (rendered_)
+  {
+    buffers.push_back(asio::buffer(rendered_->data(), rendered_head_));
+  }
+  else
+  {
+    buffers.push_back(status_strings::to_buffer(status));
+    if (asio::buffer_size(header_block) > 0)
+      buffers.push_back(header_block);
+    if (content_owner_)
+      buffers.push_back(asio::buffer(content_length_,
+            std::strlen(content_length_)));
+  }
   for (std::size_t i = 0; i < headers.size(); ++i)
   {
     header& h = headers[i];
@@ -112,8 +168,22 @@ std::vector<asio::const_buffer> reply::to_buffers()
     buffers.push_back(asio::buffer(h.value));
     buffers.push_back(asio::buffer(misc_strings::crlf));
   }
-  buffers.push_back(asio::buffer(misc_strings::crlf));
-  buffers.push_back(asio::buffer(content));
+  if (rendered_)
+  {
+    // Empty line and content
+    std::size_t size = rendered_->size() - rendered_head_;
+    if (!with_content)
+      size = sizeof misc_strings::crlf;
+    buffers.push_back(asio::buffer(rendered_->data() + rendered_head_, size));
+  }
+  else
+  {
+    buffers.push_back(asio::buffer(misc_strings::crlf));
+    if (with_content && content_owner_)
+      buffers.push_back(content_ref_);
+    else if (with_content)
+      buffers.push_back(asio::buffer(content));
+  }
   return buffers;
 }
 
@@ -13,12 +13,32 @@
 
 #include <string>
 #include <vector>
+#include <memory>
+#include <functional>
 #include <asio.hpp>
 #include "header.hpp"
 
 namespace http {
 namespace server2 {
 
+/// Content of a reply produced over time, such as a stream of events.
+class reply_stream
+{
+public:
+  /// Send a piece of content to the client. The function may be called
+  /// from any thread, and does nothing once the connection is closed.
+  typedef std::function<void (const std::string&)> writer_t;
+
+  virtual ~reply_stream() {}
+
+  /// Called once the status line and headers have been sent.
+  virtual void start(writer_t write) = 0;
+
+  /// Called once the connection is closed. The stream must not use
+  /// the writer any longer.
+  virtual void stop() = 0;
+};
+
 /// A reply to be sent to a client.
 struct reply
 {
@@ -49,13 +69,49 @@ struct reply
   /// The content to be sent in the reply.
   std::string content;
 
+  /// Content sent after the headers, until the client closes the connection
+  /// (chunked transfer encoding is used for HTTP/1.1 clients). The content
+  /// member is not used.
+  std::shared_ptr<reply_stream> stream;
+
+  /// Preformatted header lines (each one terminated by CRLF), sent before
+  /// the other headers. The memory block is not owned by the reply.
+  asio::const_buffer header_block;
+
+  /// Use a memory block owned by another object as content, instead of
+  /// copying it into content. A Content-Length header is added.
+  void set_content(std::shared_ptr<const void> owner,
+      const void* data, std::size_t size);
+
+  /// Use a serialized reply (see render), shared with other replies, instead
+  /// of status, header_block and content. Headers set in this reply (if any)
+  /// are sent after the serialized ones.
+  void set_rendered(std::shared_ptr<const std::string> rendered);
+
+  /// Serialize the reply (status line, headers and content).
+  std::shared_ptr<const std::string> render();
+
   /// Convert the reply into a vector of buffers. The buffers do not own the
   /// underlying memory blocks, therefore the reply object must remain valid and
-  /// not be changed until the write operation has completed.
-  std::vector<asio::const_buffer> to_buffers();
+  /// not be changed until the write operation has completed. The content is
+  /// left out (but not its Content-Length header) for a reply to HEAD.
+  std::vector<asio::const_buffer> to_buffers(bool with_content = true);
 
   /// Get a stock reply.
   static reply stock_reply(status_type status);
+
+private:
+  /// Content set by set_content, and the object owning it.
+  asio::const_buffer content_ref_;
+  std::shared_ptr<const void> content_owner_;
+
+  /// Content-Length header line for content_ref_.
+  char content_length_[40] = {};
+
+  /// Serialized reply set by set_rendered, and size of its status line
+  /// and headers (before the empty line).
+  std::shared_ptr<const std::string> rendered_;
+  std::size_t rendered_head_ = 0;
 };
 
 } // namespace server2
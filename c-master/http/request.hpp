@@ -13,6 +13,7 @@
 
 #include <string>
 #include <vector>
+#include <boost/utility/string_ref.hpp>
 #include "header.hpp"
 
 namespace http {
@@ -24,14 +25,25 @@ struct post_arg
     std::string value ;
 } ;
 
-/// A request received from a client.
+/// A header of a received request.
+struct request_header
+{
+  boost::string_ref name;
+  boost::string_ref value;
+};
+
+/// A request received from a client. Method, URI and headers are views
+/// into the connection buffer, valid until the reply has been sent. If
+/// the body is received after them, they are views into head instead,
+/// since the connection buffer is then reused for the body.
 struct request
 {
-  std::string method;
-  std::string uri;
+  boost::string_ref method;
+  boost::string_ref uri;
   int http_version_major;
   int http_version_minor;
-  std::vector<header> headers;
+  std::vector<request_header> headers;
+  std::string head;				// request line and headers
   std::string rawargs;				// raw encoded POST query
   std::vector <post_arg> postargs;		// decoded POST query
 };
@@ -9,329 +9,303 @@
 //
 
 #include "request_parser.hpp"
+#include <algorithm>
+#include <limits>
+#include <cstring>
 #include "request.hpp"
 
 namespace http {
 namespace server2 {
 
+namespace {
+
+/// Character classes, indexed by byte value.
+struct char_tables
+{
+  char_tables()
+  {
+    const char tspecials[] = "()<>@,;:\\\"/[]?={} \t";
+    for (int c = 0; c < 256; ++c)
+    {
+      hex[c] = -1;
+      lower[c] = c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c;
+      token[c] = c > 31 && c < 127 && std::strchr(tspecials, c) == 0;
+    }
+    for (int c = '0'; c <= '9'; ++c)
+      hex[c] = c - '0';
+    for (int c = 'a'; c <= 'f'; ++c)
+      hex[c] = c - 'a' + 10;
+    for (int c = 'A'; c <= 'F'; ++c)
+      hex[c] = c - 'A' + 10;
+  }
+
+  signed char hex[256];
+  bool token[256];
+  unsigned char lower[256];
+};
+
+const char_tables tables;
+
+/// Make a view into the bytes at from refer to the same bytes copied at to.
+boost::string_ref rebase(boost::string_ref s, const char* from, const char* to)
+{
+  return boost::string_ref(to + (s.data() - from), s.size());
+}
+
+} // namespace
+
 request_parser::request_parser()
-  : state_(method_start)
+  : state_(expecting_head), scanned_(0), body_remaining_(0)
 {
 }
 
 void request_parser::reset()
 {
-  state_ = method_start;
+  state_ = expecting_head;
+  scanned_ = 0;
+  body_remaining_ = 0;
 }
 
-boost::tribool request_parser::consume(request& req, char input, int remaining)
+boost::tuple<boost::tribool, char*> request_parser::parse(request& req,
+    char* begin, char* end)
 {
-  switch (state_)
+  boost::tribool result = boost::indeterminate;
+
+  if (state_ == expecting_head)
   {
-  case method_start:
-    if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return false;
-    }
-    else
-    {
-      state_ = method;
-      req.method.push_back(input);
-      return boost::indeterminate;
-    }
-  case method:
-    if (input == ' ')
-    {
-      state_ = uri;
-      return boost::indeterminate;
-    }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return false;
-    }
-    else
-    {
-      req.method.push_back(input);
-      return boost::indeterminate;
-    }
-  case uri_start:
-    if (is_ctl(input))
-    {
-      return false;
-    }
-    else
-    {
-      state_ = uri;
-      req.uri.push_back(input);
-      return boost::indeterminate;
-    }
-  case uri:
-    if (input == ' ')
-    {
-      state_ = http_version_h;
-      return boost::indeterminate;
-    }
-    else if (is_ctl(input))
-    {
-      return false;
-    }
-    else
-    {
-      req.uri.push_back(input);
-      return boost::indeterminate;
-    }
-  case http_version_h:
-    if (input == 'H')
-    {
-      state_ = http_version_t_1;
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case http_version_t_1:
-    if (input == 'T')
-    {
-      state_ = http_version_t_2;
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case http_version_t_2:
-    if (input == 'T')
-    {
-      state_ = http_version_p;
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case http_version_p:
-    if (input == 'P')
-    {
-      state_ = http_version_slash;
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case http_version_slash:
-    if (input == '/')
-    {
-      req.http_version_major = 0;
-      req.http_version_minor = 0;
-      state_ = http_version_major_start;
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case http_version_major_start:
-    if (is_digit(input))
-    {
-      req.http_version_major = req.http_version_major * 10 + input - '0';
-      state_ = http_version_major;
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case http_version_major:
-    if (input == '.')
-    {
-      state_ = http_version_minor_start;
-      return boost::indeterminate;
-    }
-    else if (is_digit(input))
-    {
-      req.http_version_major = req.http_version_major * 10 + input - '0';
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case http_version_minor_start:
-    if (is_digit(input))
-    {
-      req.http_version_minor = req.http_version_minor * 10 + input - '0';
-      state_ = http_version_minor;
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case http_version_minor:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_1;
-      return boost::indeterminate;
-    }
-    else if (is_digit(input))
-    {
-      req.http_version_minor = req.http_version_minor * 10 + input - '0';
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case expecting_newline_1:
-    if (input == '\n')
-    {
-      state_ = header_line_start;
-      return boost::indeterminate;
-    }
-    else
-    {
-      return false;
-    }
-  case header_line_start:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_3;
-      return boost::indeterminate;
-    }
-    else if (!req.headers.empty() && (input == ' ' || input == '\t'))
-    {
-      state_ = header_lws;
-      return boost::indeterminate;
-    }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return false;
-    }
-    else
-    {
-      req.headers.push_back(header());
-      req.headers.back().name.push_back(input);
-      state_ = header_name;
-      return boost::indeterminate;
-    }
-  case header_lws:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_2;
-      return boost::indeterminate;
-    }
-    else if (input == ' ' || input == '\t')
-    {
-      return boost::indeterminate;
-    }
-    else if (is_ctl(input))
-    {
-      return false;
-    }
-    else
-    {
-      state_ = header_value;
-      req.headers.back().value.push_back(input);
-      return boost::indeterminate;
-    }
-  case header_name:
-    if (input == ':')
-    {
-      state_ = space_before_header_value;
-      return boost::indeterminate;
-    }
-    else if (!is_char(input) || is_ctl(input) || is_tspecial(input))
-    {
-      return false;
-    }
-    else
-    {
-      req.headers.back().name.push_back(input);
-      return boost::indeterminate;
-    }
-  case space_before_header_value:
-    if (input == ' ')
+    // Ignore empty lines before the request line (such as a CRLF
+    // sent after a body).
+    if (scanned_ == 0)
+      while (begin != end && (*begin == '\r' || *begin == '\n'))
+        ++begin;
+
+    // Look for the empty line ending the head, starting after the
+    // lines scanned during the previous calls.
+    char* line = begin + scanned_;
+    char* eol;
+    while ((eol = static_cast<char*>(
+            std::memchr(line, '\n', end - line))) != 0)
     {
-      state_ = header_value;
-      return boost::indeterminate;
+      if (eol == line || (eol == line + 1 && *line == '\r'))
+        break;
+      line = eol + 1;
     }
-    else
+    if (eol == 0)
     {
-      return false;
+      scanned_ = line - begin;
+      return boost::make_tuple(result, begin);
     }
-  case header_value:
-    if (input == '\r')
-    {
-      state_ = expecting_newline_2;
-      return boost::indeterminate;
+
+    char* head = begin;
+    result = parse_head(req, begin, line);
+    begin = eol + 1;
+    if (!result)
+      return boost::make_tuple(result, begin);
+
+    // The body (if any) is delimited by Content-Length, such
+    // that a following (pipelined) request is not consumed.
+    if (!content_length(req, body_remaining_))
+      return boost::make_tuple(boost::tribool(false), begin);
+    if (body_remaining_ > 0)
+    {
+      state_ = expecting_post_args;
+      result = boost::indeterminate;
+
+      // The rest of the body will be read over the head: keep it.
+      if (body_remaining_ > static_cast<std::size_t>(end - begin))
+        keep_head(req, head, line);
     }
-    else if (is_ctl(input))
+  }
+
+  if (state_ == expecting_post_args)
+  {
+    std::size_t n = std::min<std::size_t>(end - begin, body_remaining_);
+    req.rawargs.append(begin, n);
+    begin += n;
+    body_remaining_ -= n;
+    if (body_remaining_ == 0)
+      result = true;
+  }
+
+  if (result)
+    result = query_decode (req) ;
+  return boost::make_tuple(result, begin);
+}
+
+boost::tribool request_parser::parse_head(request& req,
+    char* begin, char* end)
+{
+  bool first = true;
+
+  // Usual requests have less than 16 headers: allocate only once.
+  req.headers.reserve(16);
+  while (begin != end)
+  {
+    char* eol = static_cast<char*>(std::memchr(begin, '\n', end - begin));
+    char* next = eol + 1;
+    if (eol != begin && eol[-1] == '\r')
+      --eol;
+
+    if (first)
+    {
+      if (!parse_request_line(req, begin, eol))
+        return false;
+      first = false;
+    }
+    else if (*begin == ' ' || *begin == '\t')
+    {
+      // Obsolete line folding: replace the line terminator by spaces
+      // and extend the previous header value.
+      if (req.headers.empty())
+        return false;
+      request_header& h = req.headers.back();
+      char* v = const_cast<char*>(h.value.data());
+      std::fill(v + h.value.size(), begin, ' ');
+      for (char* p = begin; p != eol; ++p)
+        if (is_ctl(*p) && *p != '\t')
+          return false;
+      if (h.value.empty())
+        for (v = begin; v != eol && (*v == ' ' || *v == '\t'); ++v)
+          ;
+      while (eol != v && (eol[-1] == ' ' || eol[-1] == '\t'))
+        --eol;
+      h.value = boost::string_ref(v, eol - v);
+    }
+    else if (!parse_header_line(req, begin, eol))
     {
       return false;
     }
-    else
-    {
-      req.headers.back().value.push_back(input);
-      return boost::indeterminate;
-    }
-  case expecting_newline_2:
-    if (input == '\n')
-    {
-      state_ = header_line_start;
-      return boost::indeterminate;
-    }
-    else
-    {
+
+    begin = next;
+  }
+  return true;
+}
+
+bool request_parser::parse_request_line(request& req, char* begin, char* end)
+{
+  char* p = begin;
+
+  // Method
+  while (p != end && is_token(*p))
+    ++p;
+  if (p == begin || p == end || *p != ' ')
+    return false;
+  req.method = boost::string_ref(begin, p - begin);
+
+  // URI
+  char* uri = ++p;
+  p = static_cast<char*>(std::memchr(uri, ' ', end - uri));
+  if (p == 0 || p == uri)
+    return false;
+  for (char* q = uri; q != p; ++q)
+    if (is_ctl(*q))
       return false;
-    }
-  case expecting_newline_3:
-    if (input == '\n')
-    {
-	if (remaining > 0)
-	{
-	    state_ = expecting_post_args;
-	    return boost::indeterminate;
-	}
-	return true ;
-    }
-    else return false ;
-  case expecting_post_args:
-    req.rawargs += input;
-    if (remaining > 0)
-	return boost::indeterminate;
-    else
-	return true ;
-  default:
+  req.uri = boost::string_ref(uri, p - uri);
+
+  // HTTP version
+  ++p;
+  if (end - p < 8 || std::memcmp(p, "HTTP/", 5) != 0)
     return false;
-  }
+  p += 5;
+  if (!is_digit(*p))
+    return false;
+  req.http_version_major = 0;
+  while (p != end && is_digit(*p))
+    req.http_version_major = req.http_version_major * 10 + *p++ - '0';
+  if (p == end || *p++ != '.' || p == end || !is_digit(*p))
+    return false;
+  req.http_version_minor = 0;
+  while (p != end && is_digit(*p))
+    req.http_version_minor = req.http_version_minor * 10 + *p++ - '0';
+  return p == end;
 }
 
-bool request_parser::is_char(int c)
+bool request_parser::parse_header_line(request& req, char* begin, char* end)
 {
-  return c >= 0 && c <= 127;
+  char* p = begin;
+
+  while (p != end && is_token(*p))
+    ++p;
+  if (p == begin || p == end || *p != ':')
+    return false;
+
+  request_header h;
+  h.name = boost::string_ref(begin, p - begin);
+
+  ++p;
+  while (p != end && (*p == ' ' || *p == '\t'))
+    ++p;
+  for (char* q = p; q != end; ++q)
+    if (is_ctl(*q) && *q != '\t')
+      return false;
+  while (end != p && (end[-1] == ' ' || end[-1] == '\t'))
+    --end;
+  h.value = boost::string_ref(p, end - p);
+
+  req.headers.push_back(h);
+  return true;
 }
 
-bool request_parser::is_ctl(int c)
+bool request_parser::content_length(const request& req, std::size_t& len)
 {
-  return (c >= 0 && c <= 31) || (c == 127);
+  len = 0;
+  for (std::size_t i = 0; i < req.headers.size(); ++i)
+  {
+    const request_header& h = req.headers[i];
+    if (iequals(h.name, "Content-Length"))
+    {
+      if (h.value.empty())
+        return false;
+      for (std::size_t j = 0; j < h.value.size(); ++j)
+      {
+        if (!is_digit(h.value[j]))
+          return false;
+        std::size_t d = h.value[j] - '0';
+        if (len > (std::numeric_limits<std::size_t>::max() - d) / 10)
+          return false;
+        len = len * 10 + d;
+      }
+      break;
+    }
+  }
+  return true;
 }
 
-bool request_parser::is_tspecial(int c)
+void request_parser::keep_head(request& req, const char* begin,
+    const char* end)
 {
-  switch (c)
+  req.head.assign(begin, end);
+  const char* to = req.head.data();
+  req.method = rebase(req.method, begin, to);
+  req.uri = rebase(req.uri, begin, to);
+  for (std::size_t i = 0; i < req.headers.size(); ++i)
   {
-  case '(': case ')': case '<': case '>': case '@':
-  case ',': case ';': case ':': case '\\': case '"':
-  case '/': case '[': case ']': case '?': case '=':
-  case '{': case '}': case ' ': case '\t':
-    return true;
-  default:
-    return false;
+    req.headers[i].name = rebase(req.headers[i].name, begin, to);
+    req.headers[i].value = rebase(req.headers[i].value, begin, to);
   }
 }
 
+bool request_parser::iequals(boost::string_ref a, boost::string_ref b)
+{
+  if (a.size() != b.size())
+    return false;
+  for (std::size_t i = 0; i < a.size(); ++i)
+    if (tables.lower[static_cast<unsigned char>(a[i])]
+        != tables.lower[static_cast<unsigned char>(b[i])])
+      return false;
+  return true;
+}
+
+bool request_parser::is_token(int c)
+{
+  return tables.token[static_cast<unsigned char>(c)];
+}
+
+bool request_parser::is_ctl(int c)
+{
+  return (c >= 0 && c <= 31) || (c == 127);
+}
+
 bool request_parser::is_digit(int c)
 {
   return c >= '0' && c <= '9';
@@ -339,14 +313,38 @@ bool request_parser::is_digit(int c)
 
 int request_parser::hex_value (int c)
 {
-    int r = -1 ;
-    if (c >= '0' && c <= '9')
-	r = c - '0' ;
-    if (c >= 'a' && c <= 'f')
-	r = c - 'a' + 10 ;
-    if (c >= 'A' && c <= 'F')
-	r = c - 'A' + 10 ;
-    return r ;
+    return tables.hex [static_cast <unsigned char> (c)] ;
+}
+
+bool request_parser::percent_decode (const char *begin, const char *end, std::string &out)
+{
+    out.reserve (out.size () + (end - begin)) ;
+    while (begin != end)
+    {
+	const char *pc ;
+	std::size_t start ;
+	int hi, lo ;
+
+	// copy characters up to the next escape
+	pc = static_cast <const char *> (std::memchr (begin, '%', end - begin)) ;
+	if (pc == 0)
+	    pc = end ;
+	start = out.size () ;
+	out.append (begin, pc) ;
+	std::replace (out.begin () + start, out.end (), '+', ' ') ;
+	if (pc == end)
+	    break ;
+
+	if (end - pc < 3)
+	    return false ;
+	hi = hex_value (pc [1]) ;
+	lo = hex_value (pc [2]) ;
+	if (hi == -1 || lo == -1)
+	    return false ;
+	out += static_cast <char> (hi * 16 + lo) ;
+	begin = pc + 3 ;
+    }
+    return true ;
 }
 
 bool request_parser::query_decode (request &req)
@@ -357,7 +355,7 @@ bool request_parser::query_decode (request &req)
     // Look for Content-Type header
     for (auto &h : req.headers)
     {
-	if (h.name == "Content-Type")
+	if (iequals (h.name, "Content-Type"))
 	{
 	    if (h.value == "application/x-www-form-urlencoded")
 	    {
@@ -369,136 +367,32 @@ bool request_parser::query_decode (request &req)
 
     if (encoding == www_form_urlencoded)
     {
-	enum { name_start,
-		name,
-		name_pcent1,
-		name_pcent2,
-		value,
-		value_pcent1,
-		value_pcent2,
-		error,
-	    } state = name_start ;
-	unsigned char pcentchar ;
-
-	for (auto c : req.rawargs)
+	const char *p = req.rawargs.data () ;
+	const char *end = p + req.rawargs.size () ;
+	bool last = false ;
+
+	// each "name=value" pair ends with '&' or with the query
+	while (r && ! last)
 	{
-	    int x ;			// current hex value
+	    const char *amp, *eq ;
 
-	    switch (state)
+	    amp = static_cast <const char *> (std::memchr (p, '&', end - p)) ;
+	    if (amp == 0)
+	    {
+		amp = end ;
+		last = true ;
+	    }
+	    eq = static_cast <const char *> (std::memchr (p, '=', amp - p)) ;
+	    if (eq == 0 || eq == p)
+		r = false ;
+	    else
 	    {
-		case name_start:
-		    req.postargs.push_back (post_arg ()) ;
-		    if (c == '%')
-		    {
-			state = name_pcent1 ;
-			pcentchar = 0 ;
-		    }
-		    else if (c == '=')
-		    {
-			state = error ;
-		    }
-		    else if (c == '&')
-		    {
-			state = error ;
-		    }
-		    else
-		    {
-			if (c == '+')
-			    c = ' ' ;
-			state = name ;
-			req.postargs.back ().name.push_back (c) ;
-		    }
-		    break ;
-		case name:
-		    if (c == '%')
-		    {
-			state = name_pcent1 ;
-			pcentchar = 0 ;
-		    }
-		    else if (c == '=')
-		    {
-			state = value ;
-		    }
-		    else if (c == '&')
-		    {
-			state = error ;
-		    }
-		    else
-		    {
-			if (c == '+')
-			    c = ' ' ;
-			req.postargs.back ().name.push_back (c) ;
-		    }
-		    break ;
-		case name_pcent1:
-		    x = hex_value (c) ;
-		    if (x == -1)
-			state = error ;
-		    else
-		    {
-			pcentchar = pcentchar * 16 + x ;
-			state = name_pcent2 ;
-		    }
-		    break ;
-		case name_pcent2:
-		    x = hex_value (c) ;
-		    if (x == -1)
-			state = error ;
-		    else
-		    {
-			pcentchar = pcentchar * 16 + x ;
-			req.postargs.back ().name.push_back (pcentchar) ;
-			state = name ;
-		    }
-		    break ;
-		case value:
-		    if (c == '%')
-		    {
-			state = value_pcent1 ;
-			pcentchar = 0 ;
-		    }
-		    else if (c == '&')
-		    {
-			state = name_start ;
-		    }
-		    else
-		    {
-			if (c == '+')
-			    c = ' ' ;
-			req.postargs.back ().value.push_back (c) ;
-		    }
-		    break ;
-		case value_pcent1:
-		    x = hex_value (c) ;
-		    if (x == -1)
-			state = error ;
-		    else
-		    {
-			pcentchar = pcentchar * 16 + x ;
-			state = value_pcent2 ;
-		    }
-		    break ;
-		case value_pcent2:
-		    x = hex_value (c) ;
-		    if (x == -1)
-			state = error ;
-		    else
-		    {
-			pcentchar = pcentchar * 16 + x ;
-			req.postargs.back ().value.push_back (pcentchar) ;
-			state = value ;
-		    }
-		    break ;
-		case error:
-		    // silently skip remaining characters
-		    break ;
-		default:
-		    state = error ;
-		    break ;
+		req.postargs.push_back (post_arg ()) ;
+		r = percent_decode (p, eq, req.postargs.back ().name)
+		    && percent_decode (eq + 1, amp, req.postargs.back ().value) ;
 	    }
+	    p = amp + (last ? 0 : 1) ;
 	}
-	if (state != value)
-	    r = false ;
     }
 
     return r ;
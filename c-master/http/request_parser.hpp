@@ -11,6 +11,9 @@
 #ifndef HTTP_SERVER2_REQUEST_PARSER_HPP
 #define HTTP_SERVER2_REQUEST_PARSER_HPP
 
+#include <cstddef>
+#include <string>
+#include <boost/utility/string_ref.hpp>
 #include <boost/logic/tribool.hpp>
 #include <boost/tuple/tuple.hpp>
 
@@ -31,73 +34,69 @@ public:
 
   /// Parse some data. The tribool return value is true when a complete request
   /// has been parsed, false if the data is invalid, indeterminate when more
-  /// data is required. The InputIterator return value indicates how much of the
-  /// input has been consumed.
-  template <typename InputIterator>
-  boost::tuple<boost::tribool, InputIterator> parse(request& req,
-      InputIterator begin, InputIterator end)
-  {
-    while (begin != end)
-    {
-      boost::tribool result = consume(req, *begin, end-begin-1);
-      begin++;
-      if (result)
-	result = query_decode (req) ;
-      if (result || !result)
-        return boost::make_tuple(result, begin);
-    }
-    boost::tribool result = boost::indeterminate;
-    return boost::make_tuple(result, begin);
-  }
+  /// data is required. The returned pointer indicates how much of the input
+  /// has been consumed.
+  ///
+  /// The request line and headers are only consumed once they have all been
+  /// received: until then, the caller must keep them at the beginning of the
+  /// next input and append new data after them. Method, URI and headers of
+  /// the request are views into the input, or into the request itself if
+  /// the body is not complete (the input may then be reused).
+  boost::tuple<boost::tribool, char*> parse(request& req,
+      char* begin, char* end);
+
+  /// Case-insensitive comparison of ASCII strings (such as header names).
+  static bool iequals(boost::string_ref a, boost::string_ref b);
+
+  /// Hex digit value or -1.
+  static int hex_value(int c);
+
+  /// Append the decoding of "%hh" escapes and '+' in [begin, end) to out.
+  /// Returns false if the encoding was invalid.
+  static bool percent_decode(const char* begin, const char* end,
+      std::string& out);
 
 private:
-  /// Handle the next character of input.
-  boost::tribool consume(request& req, char input, int remaining);
+  /// Parse the request line and headers, ending just before the empty line.
+  boost::tribool parse_head(request& req, char* begin, char* end);
+
+  /// Parse the request line (without the line terminator).
+  static bool parse_request_line(request& req, char* begin, char* end);
+
+  /// Parse a header line (without the line terminator).
+  static bool parse_header_line(request& req, char* begin, char* end);
+
+  /// Get the value of the Content-Length header (0 if none).
+  static bool content_length(const request& req, std::size_t& len);
+
+  /// Copy the request line and headers into the request, and make
+  /// method, URI and headers refer to this copy.
+  static void keep_head(request& req, const char* begin, const char* end);
 
-  /// Check if a byte is an HTTP character.
-  static bool is_char(int c);
+  /// Check if a byte is an HTTP token character.
+  static bool is_token(int c);
 
   /// Check if a byte is an HTTP control character.
   static bool is_ctl(int c);
 
-  /// Check if a byte is defined as an HTTP tspecial character.
-  static bool is_tspecial(int c);
-
   /// Check if a byte is a digit.
   static bool is_digit(int c);
 
-  /// hex digit value or -1
-  static int hex_value (int c) ;
-
   /// Decode Query string
   static bool query_decode (request &req) ;
 
   /// The current state of the parser.
   enum state
   {
-    method_start,
-    method,
-    uri_start,
-    uri,
-    http_version_h,
-    http_version_t_1,
-    http_version_t_2,
-    http_version_p,
-    http_version_slash,
-    http_version_major_start,
-    http_version_major,
-    http_version_minor_start,
-    http_version_minor,
-    expecting_newline_1,
-    header_line_start,
-    header_lws,
-    header_name,
-    space_before_header_value,
-    header_value,
-    expecting_newline_2,
-    expecting_newline_3,
+    expecting_head,
     expecting_post_args,
   } state_;
+
+  /// Bytes of the head already scanned for the empty line.
+  std::size_t scanned_;
+
+  /// Remaining bytes of the request body.
+  std::size_t body_remaining_;
 };
 
 } // namespace server2
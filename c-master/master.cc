@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <string>
+#include <cstring>
 #include <list>
 #include <vector>
 #include <asio.hpp>
@@ -60,9 +61,20 @@ bool master::start (conf &cf)
     if (cf.done_)
     {
 	// Start CASAN engine machinery
-	engine_.timer_first_hello (cf.timers [conf::I_FIRST_HELLO]) ;
-	engine_.timer_interval_hello (cf.timers [conf::I_INTERVAL_HELLO]) ;
-	engine_.timer_slave_ttl (cf.timers [conf::I_SLAVE_TTL]) ;
+	engine_.count (cf.shards) ;
+	for (int i = 0 ; i < engine_.count () ; i++)
+	{
+	    casan::casan &e = engine_.shard (i) ;
+
+	    e.timer_first_hello (cf.timers [conf::I_FIRST_HELLO]) ;
+	    e.timer_interval_hello (cf.timers [conf::I_INTERVAL_HELLO]) ;
+	    e.timer_slave_ttl (cf.timers [conf::I_SLAVE_TTL]) ;
+	    e.limit_dedup (cf.limits [conf::I_LIMIT_DEDUP]) ;
+	    e.limit_ring (cf.limits [conf::I_LIMIT_RING]) ;
+	    e.limit_nstart (cf.limits [conf::I_LIMIT_NSTART]) ;
+	    e.event_loop (cf.evloop) ;
+	}
+	cache_.maxsize (cf.limits [conf::I_LIMIT_CACHE]) ;
 	engine_.init () ;
 
 	conf_ = &cf ;
@@ -79,7 +91,7 @@ bool master::start (conf &cf)
 #if defined (USE_PF_PACKET) || defined (USE_PCAP)
 			casan::l2net_eth *le ;
 			le = new casan::l2net_eth ;
-			if (le->init (n.net_eth.iface.c_str (), n.mtu, n.net_eth.ethertype) == -1)
+			if (le->init (n.net_eth.iface.c_str (), n.mtu, n.net_eth.ethertype, n.net_eth.ring) == -1)
 			{
 			    perror ("init") ;
 			    delete le ;
@@ -108,7 +120,7 @@ bool master::start (conf &cf)
 				break ;
 			}
 
-			if (l8->init (n.net_154.iface, t, n.mtu, n.net_154.addr, n.net_154.panid, n.net_154.channel) == -1)
+			if (l8->init (n.net_154.iface, t, n.mtu, n.net_154.addr, n.net_154.panid, n.net_154.channel, n.net_154.baud) == -1)
 			{
 			    perror ("init") ;
 			    delete l8 ;
@@ -134,7 +146,7 @@ bool master::start (conf &cf)
 	    v = new casan::slave ;
 	    v->slaveid (s.id) ;
 	    if (s.ttl == 0)
-		ttl = engine_.timer_slave_ttl () ;
+		ttl = cf.timers [conf::I_SLAVE_TTL] ;
 	    else
 		ttl = s.ttl ;
 	    v->defmtu (s.mtu) ;		// default mtu (not related to L2 spec)
@@ -179,7 +191,7 @@ bool master::stop (void)
     for (auto &h : httplist_)
 	h.threads_->join () ;
 
-    // engine_.stop () ;
+    engine_.stop () ;
 
     return r ;
 }
@@ -259,7 +271,7 @@ bool master::parse_path (const std::string path, master::parse_result &res)
 			}
 			i++ ;
 
-			res.slave_ = engine_.find_slave (sid) ;
+			res.engine_ = engine_.owner (sid, &res.slave_) ;
 			if (res.slave_ == nullptr ||
 				res.slave_->status () != casan::slave::SL_RUNNING)
 			    throw int (42) ;
@@ -317,18 +329,24 @@ bool master::parse_path (const std::string path, master::parse_result &res)
  * which may be forwarded to the CASAN side or answered directly if it
  * is a control request.
  *
+ * Requests forwarded to the CASAN side are answered asynchronously:
+ * the HTTP server thread does not wait for the CASAN answer. In all
+ * cases, the `complete` function is called when the reply is ready.
+ *
  * @param request_path requested URL
  * @param req the request HTTP message
  * @param rep our reply
+ * @param complete function to call when the reply is ready
  */
 
-void master::handle_http (const std::string request_path, const http::server2::request & req, http::server2::reply & rep)
+void master::handle_http (const std::string request_path, const http::server2::request & req, http::server2::reply & rep, completion_t complete)
 {
     parse_result res ;
 
     if (! parse_path (request_path, res))
     {
 	rep = http::server2::reply::stock_reply (http::server2::reply::not_found) ;
+	complete (nullptr) ;
 	return ;
     }
 
@@ -336,16 +354,19 @@ void master::handle_http (const std::string request_path, const http::server2::r
     {
 	case conf::NS_ADMIN :
 	    http_admin (res, req, rep) ;
+	    complete (nullptr) ;
 	    break ;
 	case conf::NS_CASAN :
-	    http_casan (res, req, rep) ;
+	    http_casan (res, req, rep, complete) ;
 	    break ;
 	case conf::NS_WELL_KNOWN :
 	    http_well_known (res, req, rep) ;
+	    complete (nullptr) ;
 	    break ;
 	case conf::NS_NONE :
 	default :
 	    rep = http::server2::reply::stock_reply (http::server2::reply::not_found) ;
+	    complete (nullptr) ;
 	    break ;
     }
 }
@@ -363,6 +384,7 @@ void master::http_admin (const parse_result & res, const http::server2::request
 	    "<li><a href=\"" + res.base_ + "/conf\">configuration</a>"
 	    "<li><a href=\"" + res.base_ + "/run\">running status</a>"
 	    "<li><a href=\"" + res.base_ + "/slave\">slave status</a>"
+	    "<li><a href=\"" + res.base_ + "/cache\">cache status</a>"
 	    "</ul></body></html>" ;
 
 	rep.headers.resize (2) ;
@@ -396,6 +418,18 @@ void master::http_admin (const parse_result & res, const http::server2::request
 	rep.headers[1].name = "Content-Type" ;
 	rep.headers[1].value = "text/html" ;
     }
+    else if (res.str_ == "/cache")
+    {
+	rep.status = http::server2::reply::ok ;
+	rep.content = "<html><body><pre>"
+	    + cache_.html_debug () + "</pre></body></html>" ;
+
+	rep.headers.resize (2) ;
+	rep.headers[0].name = "Content-Length" ;
+	rep.headers[0].value = boost::lexical_cast < std::string > (rep.content.size ()) ;
+	rep.headers[1].name = "Content-Type" ;
+	rep.headers[1].value = "text/html" ;
+    }
     else if (res.str_ == "/slave")
     {
 	// check which slave is concerned
@@ -515,21 +549,37 @@ static struct
     { "DELETE", casan::msg::MC_DELETE },
 } ;
 
-void master::http_casan (const parse_result &res, const http::server2::request & req, http::server2::reply & rep)
+void master::http_casan (const parse_result &res, const http::server2::request & req, http::server2::reply & rep, completion_t complete)
 {
     std::shared_ptr <casan::msg> m (new casan::msg) ;
-    std::shared_ptr <casan::msg> mc ;	// message found in cache,if any
-    std::shared_ptr <casan::msg> r ;	// reply (received or cached)
+    casan::cache::rendered_t rendered ;	// reply found in cache, if any
+    casan::casan *e = res.engine_ ;	// shard owning the slave
     casan::msg::msgcode_t code ;
-    casan::waiter w ;
-    timepoint_t timeout ;
-    casantimer_t max ;
 
     code = casan::msg::MC_GET ;
     for (int i = 0 ; i < NTAB (tabmethod); i++)
 	if (tabmethod[i].text == req.method)
 	    code = tabmethod[i].code ;
 
+    /*
+     * An event stream (such as a browser EventSource) observes the
+     * resource instead of getting its current representation.
+     */
+
+    if (code == casan::msg::MC_GET)
+    {
+	for (auto &h : req.headers)
+	{
+	    if (http::server2::request_parser::iequals (h.name, "Accept")
+		    && h.value.find ("text/event-stream") != boost::string_ref::npos)
+	    {
+		http_observe (res, rep) ;
+		complete (nullptr) ;
+		return ;
+	    }
+	}
+    }
+
     m->peer (res.slave_) ;
     m->type (casan::msg::MT_CON) ;
     m->code (code) ;
@@ -539,6 +589,7 @@ void master::http_casan (const parse_result &res, const http::server2::request &
     //TODO: find request length!
     if (m->paylen () > res.slave_->curmtu ()) {
 	rep = http::server2::reply::stock_reply (http::server2::reply::bad_request) ;
+	complete (nullptr) ;
 	return ;
     }
 
@@ -546,37 +597,98 @@ void master::http_casan (const parse_result &res, const http::server2::request &
      * Is the request already present in cache?
      */
 
-    mc = cache_.get (m) ;
-    if (mc != nullptr)
+    rendered = cache_.get_rendered (m,
+	[this, &res] (casan::msgptr_t r)
+	{
+	    http::server2::reply tmp ;
+
+	    http_reply (res, r, tmp) ;
+	    return tmp.render () ;
+	}) ;
+    if (rendered != nullptr)
     {
 	/*
-	 * Request is found in cache. Don't forward it again.
+	 * Request is found in cache. Don't forward it again: the
+	 * HTTP response, built on the first hit, is sent as is.
 	 */
 
-	m = mc ;
 	D (D_CACHE, "Found request " << *m << " in cache") ;
-	D (D_CACHE, "reply = " << *(m->reqrep ())) ;
+	rep.set_rendered (rendered) ;
+	complete (nullptr) ;
+	return ;
     }
-    else
-    {
-	/*
-	 * Request not found in cache. We must send it
-	 * and wait for a reply
-	 */
 
-	m->wt (&w) ;
+    /*
+     * Request not found in cache. We must send it (unless another
+     * HTTP request is sending the same request). The reply will be
+     * built, in the HTTP server thread, when the CASAN answer is
+     * received or when the request expires.
+     */
 
-	max = EXCHANGE_LIFETIME (res.slave_->l2 ()->maxlatency()) ;
-	timeout = DATE_TIMEOUT_MS (max) ;
-	D (D_HTTP, "HTTP request, timeout = " << max << " ms") ;
+    D (D_HTTP, "HTTP request, timeout = "
+		<< EXCHANGE_LIFETIME (res.slave_->l2 ()->maxlatency()) << " ms") ;
 
-	auto a = std::bind (&casan::casan::add_request, &this->engine_, m) ;
-	w.do_and_wait (a, timeout) ;
+    cache_.coalesce (m,
+	[e, m] (casan::cache::done_t done)
+	{
+	    e->add_request (m,
+		[done] (casan::msgptr_t req)
+		{
+		    done (req->reqrep ()) ;
+
+		    /*
+		     * Break the request/reply reference cycle: the
+		     * cache (if the reply is cacheable) keeps its own
+		     * references.
+		     */
+
+		    casan::msg::link_reqrep (req, nullptr) ;
+		}) ;
+	},
+	[this, res, &rep, complete] (casan::msgptr_t r)
+	{
+	    complete ([this, res, &rep, r] () { http_reply (res, r, rep) ; }) ;
+	}) ;
+}
 
-	m->wt (nullptr) ;
-    }
+/*
+ * Preformatted Content-Type header lines for CoAP content formats
+ * See RFC 7252:  "12.3. Content-Format Registry"
+ */
 
-    r = m->reqrep () ;
+static struct
+{
+    int format ;
+    const char *block ;
+} tabformat [] = {
+    {  0, "Content-Type: text/plain; charset=utf-8\r\n" },
+    { 40, "Content-Type: application/link-format\r\n" },
+    { 41, "Content-Type: application/xml\r\n" },
+    { 42, "Content-Type: application/octet-stream\r\n" },
+    { 47, "Content-Type: application/exi\r\n" },
+    { 50, "Content-Type: application/json\r\n" },
+} ;
+
+static asio::const_buffer content_type_block (int contentformat)
+{
+    const char *b = "Content-Type: application/octet-stream\r\n" ;
+
+    for (int i = 0 ; i < NTAB (tabformat) ; i++)
+	if (tabformat [i].format == contentformat)
+	    b = tabformat [i].block ;
+    return asio::buffer (b, std::strlen (b)) ;
+}
+
+/**
+ * @brief Build the HTTP reply from the CASAN reply
+ *
+ * @param res parsed path of the HTTP request
+ * @param r CASAN reply, or nullptr if no reply has been received
+ * @param rep HTTP reply
+ */
+
+void master::http_reply (const parse_result &res, casan::msgptr_t r, http::server2::reply & rep)
+{
     if (r == nullptr)
     {
 	/*
@@ -593,59 +705,113 @@ void master::http_casan (const parse_result &res, const http::server2::request &
 	char *payld ;
 	payld = (char *) r->payload (&paylen) ;
 
-	// add the request (and reply) in the cache
-	if (mc == nullptr)		// request was not already in cache
-	    cache_.add (m) ;
-
 	// get content format
-	r->option_reset_iterator () ;
-	while ((o = r->option_next ()) != nullptr)
-	{
-	    if (o->optcode () == casan::option::MO_Content_Format)
-	    {
-		contentformat = o->optval () ;
-		break ;
-	    }
-	}
+	o = r->getoption (casan::option::MO_Content_Format) ;
+	if (o != nullptr)
+	    contentformat = o->optval () ;
 
 	// get announced mtu
-	r->option_reset_iterator () ;
-	while ((o = r->option_next ()) != nullptr)
-	{
-	    if (o->optcode () == casan::option::MO_Size1)
-	    {
-		res.slave_->curmtu (o->optval ()) ;
-		break ;
-	    }
-	}
+	o = r->getoption (casan::option::MO_Size1) ;
+	if (o != nullptr)
+	    res.slave_->curmtu (o->optval ()) ;
 
 	rep.status = http::server2::reply::ok ;
 
-	rep.headers.resize (2) ;
-	rep.headers[0].name = "Content-Length" ;
-	rep.headers[1].name = "Content-Type" ;
+	/*
+	 * The payload is sent from the CASAN reply itself (which may
+	 * be in the cache), without copy. The reply keeps a reference
+	 * to the message until the HTTP reply has been sent.
+	 */
+
+	rep.header_block = content_type_block (contentformat) ;
+	rep.set_content (r, payld, paylen) ;
+    }
+}
+
+/******************************************************************************
+ * Server-Sent Events for observed resources
+ */
 
-	// See draft-ietf-core-coap-16.txt:  "12.3. Content-Format Registry"
-	switch (contentformat)
+/*
+ * Format a notification as an event: each payload line is sent
+ * in a "data:" field (see the W3C Server-Sent Events specification)
+ */
+
+static std::string sse_event (casan::msgptr_t r)
+{
+    std::string ev ;
+    const char *p, *end ;
+    int paylen ;
+
+    p = (const char *) r->payload (&paylen) ;
+    end = p + paylen ;
+    for (;;)
+    {
+	const char *eol = (const char *) std::memchr (p, '\n', end - p) ;
+	const char *e = eol == nullptr ? end : eol ;
+
+	if (e > p && e [-1] == '\r')
+	    e-- ;
+	ev += "data: " ;
+	ev.append (p, e - p) ;
+	ev += "\n" ;
+	if (eol == nullptr)
+	    break ;
+	p = eol + 1 ;
+    }
+    ev += "\n" ;
+    return ev ;
+}
+
+/*
+ * Stream of events for an HTTP client: the resource is observed
+ * (by the CASAN engine, once for all clients) until the client
+ * closes the connection.
+ */
+
+class sse_stream : public http::server2::reply_stream
+{
+    public:
+	sse_stream (casan::casan &engine, casan::slave *s, const casan::resource &r)
+	    : engine_ (engine), slave_ (s), res_ (r)
 	{
-	    case 0 :			// text/plain charset=utf-8
-		// rep.content = "<html><body><pre>" ;
-		for (int i = 0 ; i < paylen ; i++)
-		    rep.content.push_back (payld [i]) ;
-		// rep.content += "</pre></body></html>" ;
-		rep.headers[1].value = "text/plain" ;
-		break ;
-
-	    case 50 :			// application/json
-		// rep.content = "<html><body><pre>" ;
-		for (int i = 0 ; i < paylen ; i++)
-		    rep.content.push_back (payld [i]) ;
-		// rep.content += "</pre></body></html>" ;
-		rep.headers[1].value = "application/json" ;
-		break ;
 	}
 
-	rep.headers[0].value =
-	    boost::lexical_cast < std::string > (rep.content.size ()) ;
-    }
+	void start (writer_t write)
+	{
+	    id_ = engine_.observe (slave_, &res_,
+		[write] (casan::msgptr_t r)
+		{
+		    write (sse_event (r)) ;
+		}) ;
+	}
+
+	void stop (void)
+	{
+	    engine_.unobserve (id_) ;
+	}
+
+    private:
+	casan::casan &engine_ ;
+	casan::slave *slave_ ;
+	casan::resource res_ ;
+	int id_ = -1 ;
+} ;
+
+/**
+ * @brief Reply with a stream of events for an observed resource
+ *
+ * @param res parsed path of the HTTP request
+ * @param rep HTTP reply
+ */
+
+void master::http_observe (const parse_result &res, http::server2::reply & rep)
+{
+    rep.status = http::server2::reply::ok ;
+    rep.headers.resize (2) ;
+    rep.headers[0].name = "Content-Type" ;
+    rep.headers[0].value = "text/event-stream" ;
+    rep.headers[1].name = "Cache-Control" ;
+    rep.headers[1].value = "no-cache" ;
+    rep.stream = std::make_shared <sse_stream> (*res.engine_, res.slave_, *res.res_) ;
 }
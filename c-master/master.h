@@ -6,9 +6,12 @@
 #ifndef	MASTER_H
 #define	MASTER_H
 
+#include <functional>
+
 #include "conf.h"
 #include "cache.h"
 #include "casan.h"
+#include "shards.h"
 
 namespace http {
 namespace server2 {
@@ -35,10 +38,13 @@ class master
 	bool start (conf &cf) ;
 	bool stop (void) ;
 
-	void handle_http (const std::string request_path, const http::server2::request& req, http::server2::reply& rep);
+	// see request_handler::completion_t
+	typedef std::function <void (std::function <void (void)>)> completion_t ;
+
+	void handle_http (const std::string request_path, const http::server2::request& req, http::server2::reply& rep, completion_t complete) ;
 
     private:
-	casan::casan engine_ ;
+	casan::shards engine_ ;
 	conf *conf_ ;
 	casan::cache cache_ ;
 
@@ -53,13 +59,16 @@ class master
 	{
 	    conf::cf_ns_type type_ ;
 	    std::string base_ ;		// first part of path
+	    casan::casan *engine_ ;	// for NS_CASAN: shard of the slave
 	    casan::slave *slave_ ;	// for NS_CASAN
 	    casan::resource *res_ ;	// for NS_CASAN
 	    std::string str_ ;		// for NS_ADMIN
 	} ;
 
 	void http_admin (const parse_result &res, const http::server2::request& req, http::server2::reply& rep) ;
-	void http_casan (const parse_result &res, const http::server2::request& req, http::server2::reply& rep) ;
+	void http_casan (const parse_result &res, const http::server2::request& req, http::server2::reply& rep, completion_t complete) ;
+	void http_reply (const parse_result &res, casan::msgptr_t r, http::server2::reply& rep) ;
+	void http_observe (const parse_result &res, http::server2::reply& rep) ;
 	void http_well_known (const parse_result &res, const http::server2::request& req, http::server2::reply& rep) ;
 	bool parse_path (const std::string path, parse_result &res) ;
 
@@ -26,6 +26,7 @@
 #include "http/mime_types.hpp"
 #include "http/reply.hpp"
 #include "http/request.hpp"
+#include "http/request_parser.hpp"
 #include "http/server.hpp"
 
 #include "conf.h"
@@ -56,12 +57,15 @@ request_handler::request_handler(const std::string& doc_root)
  *
  * This method directly handles badly formatted requests, and if
  * not, gives control to the master::handle_http method.
+ * In all cases, the `complete` function is called when the reply
+ * is ready to be sent.
  *
  * @param req the request HTTP message
  * @param rep our reply
+ * @param complete function to call when the reply is ready
  */
 
-void request_handler::handle_request(const http::server2::request& req, http::server2::reply& rep)
+void request_handler::handle_request(const http::server2::request& req, http::server2::reply& rep, completion_t complete)
 {
   std::string request_path;
 
@@ -69,6 +73,7 @@ void request_handler::handle_request(const http::server2::request& req, http::se
   if (!url_decode(req.uri, request_path))
   {
     rep = http::server2::reply::stock_reply(http::server2::reply::bad_request);
+    complete(nullptr);
     return;
   }
 
@@ -94,6 +99,7 @@ void request_handler::handle_request(const http::server2::request& req, http::se
       || request_path.find("..") != std::string::npos)
   {
     rep = http::server2::reply::stock_reply(http::server2::reply::bad_request);
+    complete(nullptr);
     return;
   }
 
@@ -101,47 +107,16 @@ void request_handler::handle_request(const http::server2::request& req, http::se
   if (request_path[request_path.size() - 1] == '/')
   {
     rep = http::server2::reply::stock_reply(http::server2::reply::bad_request);
+    complete(nullptr);
     return;
   }
 
-  master.handle_http (request_path, req, rep) ;
+  master.handle_http (request_path, req, rep, complete) ;
 }
 
-bool request_handler::url_decode(const std::string& in, std::string& out)
+bool request_handler::url_decode(boost::string_ref in, std::string& out)
 {
   out.clear();
-  out.reserve(in.size());
-  for (std::size_t i = 0; i < in.size(); ++i)
-  {
-    if (in[i] == '%')
-    {
-      if (i + 3 <= in.size())
-      {
-        int value;
-        std::istringstream is(in.substr(i + 1, 2));
-        if (is >> std::hex >> value)
-        {
-          out += static_cast<char>(value);
-          i += 2;
-        }
-        else
-        {
-          return false;
-        }
-      }
-      else
-      {
-        return false;
-      }
-    }
-    else if (in[i] == '+')
-    {
-      out += ' ';
-    }
-    else
-    {
-      out += in[i];
-    }
-  }
-  return true;
+  return http::server2::request_parser::percent_decode(in.begin(), in.end(),
+      out);
 }
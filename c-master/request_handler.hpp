@@ -21,7 +21,9 @@
 #define REQUEST_HANDLER_HPP
 
 #include <string>
+#include <functional>
 #include <boost/noncopyable.hpp>
+#include <boost/utility/string_ref.hpp>
 
 namespace http {
 namespace server2 {
@@ -38,8 +40,14 @@ public:
   /// Construct with a directory containing files to be served.
   explicit request_handler(const std::string& doc_root);
 
-  /// Handle a request and produce a reply.
-  void handle_request(const http::server2::request& req, http::server2::reply& rep);
+  /// Function called (from any thread) when the reply is ready. Its
+  /// argument (if not null) is first called by the connection
+  /// io_service, in order to finish the reply before sending it.
+  typedef std::function<void (std::function<void ()>)> completion_t;
+
+  /// Handle a request and produce a reply, possibly asynchronously.
+  void handle_request(const http::server2::request& req,
+      http::server2::reply& rep, completion_t complete);
 
 private:
   /// The directory containing the files to be served.
@@ -47,7 +55,7 @@ private:
 
   /// Perform URL-decoding on a string. Returns false if the encoding was
   /// invalid.
-  static bool url_decode(const std::string& in, std::string& out);
+  static bool url_decode(boost::string_ref in, std::string& out);
 };
 
 #endif // REQUEST_HANDLER_HPP